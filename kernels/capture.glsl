@@ -0,0 +1,22 @@
+// Converts the canvas to 8 bits per channel for frame capture, see Frame_capture in main.cpp. One uint per pixel
+//  (RGBA, red in the lowest byte), with the rows top-down as image files and video encoders expect them
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+layout(rgba32f, binding = 0) uniform image2D img_output;
+
+layout(std430, binding = 31) buffer layout_capture_pixels
+{
+    uint capture_pixels[];
+};
+
+void main()
+{
+    ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 image_size = imageSize(img_output);
+
+    if (texel_coord.x >= image_size.x || texel_coord.y >= image_size.y) {
+        return;
+    }
+
+    vec4 color = vec4(imageLoad(img_output, texel_coord).rgb, 1.0f);
+    capture_pixels[texel_coord.x + (image_size.y - 1 - texel_coord.y) * image_size.x] = packUnorm4x8(color);
+}
@@ -1,202 +1,313 @@
-#define PI 3.1415926535897932384626433832795f
+// Trail deposits are accumulated as fixed point, since there are no float atomics in core GLSL
+#define TRAIL_FIXED_POINT_SCALE 65536.0f
+// Tiles this close to a particle are kept resident. Covers the sensors and the movement in one step
+#define MOLD_TILE_MARGIN 20
+// Resident tiles without particles nearby are released after this many steps, when their trails have mostly faded
+#define MOLD_TILE_RELEASE_STEPS 64u
 
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
 layout(rgba32f, binding = 0) uniform image2D img_output;
-layout(location = 0) uniform int image_width;
-layout(location = 1) uniform int image_height;
+// Optional copy of the trail map with four types per layer, used for filtered sensing. See publish_trail_texture()
+layout(rgba16f, binding = 1) uniform writeonly image2DArray trail_image;
+layout(binding = 3) uniform sampler2DArray trail_map;
+layout(location = 0) uniform int world_width;
+layout(location = 1) uniform int world_height;
 layout(location = 2) uniform int action_id;
-layout(location = 3) uniform float pseudo_random_float;
+layout(location = 3) uniform uint step_idx;      // Number of steps since the particles were created
 layout(location = 4) uniform float t_step_ms;   // Pre-defined step length
 layout(location = 5) uniform int num_types;
+layout(location = 11) uniform int num_layers;   // (num_types + 3) / 4
 layout(location = 6) uniform float speed_factor;
+layout(location = 7) uniform uint seed;
+layout(location = 8) uniform float steer_randomness;   // Max random turn per step, in radians. 0 disables it
+layout(location = 9) uniform bool accumulate_trails;   // Overlapping trails add up instead of overwriting each other
+layout(location = 10) uniform bool use_trail_texture;  // Sense from trail_map instead of reading every pixel in mold_intensity
+layout(location = 12) uniform int num_tiles_x;
+layout(location = 13) uniform int num_tiles_y;
 
 layout(std430, binding = 7) buffer layout_mold_particles
 {
     Mold_particle mold_particles[];
 };
 
+// Must be kept in sync with Mold_counters in main.cpp. The particle actions are dispatched indirectly from num_groups
+layout(std430, binding = 19) buffer layout_mold_counters
+{
+    uvec3 num_groups;
+    uint num_alive;
+};
+
+// Slots of the live particles in mold_particles. See mold_lifecycle.glsl
+layout(std430, binding = 21) buffer layout_mold_alive
+{
+    uint mold_alive[];
+};
+
+// Slot of the particle for this invocation, or -1 past the end of the alive list
+int get_particle_index() {
+    int idx_alive = mold_linear_index();
+    return idx_alive < int(num_alive) ? int(mold_alive[idx_alive]) : -1;
+}
+
+// Resident pages back to back, see mold_trail_index(). num_layers vec4 per pixel, type t in component t % 4
+//  of layer t / 4. Unused components stay 0
 layout(std430, binding = 8) buffer layout_mold_intensity
 {
-    float mold_intensity[];
+    vec4 mold_intensity[];
+};
+
+// The same buffer as uint bits, for atomicMax(). Non-negative floats order the same as their bits
+layout(std430, binding = 8) buffer layout_mold_intensity_bits
+{
+    uint mold_intensity_bits[];
+};
+
+// One float per type, same order as mold_intensity. Only used with accumulate_trails
+layout(std430, binding = 13) buffer layout_mold_deposits
+{
+    uint mold_deposits[];
+};
+
+// Row t holds how strongly type t is drawn to the trail of each type. Positive attracts, negative repels
+layout(std430, binding = 15) buffer layout_mold_interactions
+{
+    vec4 mold_interactions[MAX_TYPES * MAX_LAYERS];
 };
 
-void extract_mold(ivec2 texel_coord) {
-    int idx_particle = texel_coord.x + texel_coord.y * image_width;
+// Stack of free pages in the pool
+layout(std430, binding = 17) buffer layout_mold_page_pool
+{
+    int num_free_pages;
+    int free_pages[];
+};
 
-    if (idx_particle >= mold_particles.length()) {
+void mold_step_deposit(int run, ivec2 pos, int mold_type, float weight) {
+    if (weight <= 0.0f || pos.x < 0 || pos.y < 0 || pos.x >= world_width || pos.y >= world_height) {
         return;
     }
 
-    int num_line_steps = 10;
-    vec2 pos_last = mold_particles[idx_particle].pos;
-    vec2 pos_cur = mold_particles[idx_particle].pos_last;
+    int idx_first = mold_trail_index(pos, num_tiles_x, num_layers);
+
+    // The pool ran out of pages when this tile was needed
+    if (idx_first < 0) {
+        return;
+    }
 
-    // TODO: This is a primitive line drawing algorithm. Use a better one, with anti-aliasing and no upper limit
-    //  to the number of steps required
-    for (int idx_step = 0; idx_step < num_line_steps; idx_step++) {
-        vec2 pos_write = pos_cur + idx_step * (pos_last - pos_cur) / float(num_line_steps - 1);
-        ivec2 pos = ivec2(pos_write);
+    int idx_intensity = idx_first + mold_type / 4;
 
-        int idx_intensity = num_types * (pos.x + image_width * pos.y) + mold_particles[idx_particle].type;
-        mold_intensity[idx_intensity] = 1.0;
+    if (accumulate_trails) {
+        atomicAdd(mold_deposits[4 * idx_intensity + mold_type % 4], uint(weight * TRAIL_FIXED_POINT_SCALE + 0.5f));
+    }
+    else {
+        // Atomic, so particles crossing the same pixel give the same result in any order
+        atomicMax(mold_intensity_bits[4 * idx_intensity + mold_type % 4], floatBitsToUint(weight));
     }
 }
 
-void darken(ivec2 texel_coord) {
-    if (texel_coord.x >= image_width || texel_coord.y >= image_height) {
+void extract_mold() {
+    int idx_particle = get_particle_index();
+
+    if (idx_particle < 0) {
         return;
     }
 
-    float reduce_factor = speed_factor * t_step_ms / 1000.0f;
+    mold_extract(0, mold_particles[idx_particle]);
+}
+
+// Moves the accumulated deposits into the trail map and clears them for the next step. Runs over the page pool
+void resolve_deposits() {
+    int page = int(gl_WorkGroupID.y);
 
-    for (int c = 0; c < num_types; c++) {
-        int idx = num_types * (texel_coord.x + image_width * texel_coord.y) + c;
-        mold_intensity[idx] = max(0, mold_intensity[idx] - reduce_factor);
+    if (mold_page_tiles[page] < 0) {
+        return;
     }
-}
 
-float get_area_value(ivec2 pos_center, int r, int mold_type) {
-    float ret = 0;
-    int num_pixels = 0;
-
-    int x_start = max(0, pos_center.x - r);
-    int x_end_exclusive = min(image_width - 1, pos_center.x + r);
-    int y_start = max(0, pos_center.y - r);
-    int y_end_exclusive = min(image_height - 1, pos_center.y + r);
-
-    for (int x = x_start; x < x_end_exclusive; x++) {
-        for (int y = y_start; y < y_end_exclusive; y++) {
-            for (int c = 0; c < num_types; c++) {
-                int idx = num_types * (x + y * image_width) + c;
-                if(c == mold_type){
-                    ret += mold_intensity[idx];
-                }
-                else {
-                    ret -= mold_intensity[idx];
-                }
-            }
-            num_pixels++;
+    ivec2 texel_page = mold_page_texel();
+    int idx_first = num_layers * (page * MOLD_TILE_SIZE * MOLD_TILE_SIZE + texel_page.x + texel_page.y * MOLD_TILE_SIZE);
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        int idx = idx_first + layer;
+        uvec4 deposit = uvec4(mold_deposits[4 * idx], mold_deposits[4 * idx + 1], mold_deposits[4 * idx + 2], mold_deposits[4 * idx + 3]);
+        if (any(greaterThan(deposit, uvec4(0u)))) {
+            mold_intensity[idx] = min(vec4(1.0f), mold_intensity[idx] + vec4(deposit) / TRAIL_FIXED_POINT_SCALE);
+            mold_deposits[4 * idx] = 0u;
+            mold_deposits[4 * idx + 1] = 0u;
+            mold_deposits[4 * idx + 2] = 0u;
+            mold_deposits[4 * idx + 3] = 0u;
         }
     }
+}
 
-    ret /= float(num_pixels);
+// Copies the trail map into trail_image, four types per layer. The host generates the mipmaps afterwards.
+//  The texture covers the whole world, so this is only used when the world is the size of the window
+void publish_trail_texture(ivec2 texel_coord) {
+    if (texel_coord.x >= world_width || texel_coord.y >= world_height) {
+        return;
+    }
 
-    return ret;
+    int idx_first = mold_trail_index(texel_coord, num_tiles_x, num_layers);
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        imageStore(trail_image, ivec3(texel_coord, layer), idx_first < 0 ? vec4(0) : mold_intensity[idx_first + layer]);
+    }
 }
 
-void move(ivec2 texel_coord) {
-    int idx = texel_coord.x + texel_coord.y * image_width;
+// Flags the tiles a particle can sense or leave trails in during this step
+void mark_tiles() {
+    int idx = get_particle_index();
 
-    if (idx >= mold_particles.length()) {
+    if (idx < 0) {
         return;
     }
 
-    float factor_distance_px = 10.0f;
-    int search_radius_px = 5;
+    vec2 pos = mold_particles[idx].pos;
+    ivec2 tile_min = max(ivec2(0), ivec2(pos - float(MOLD_TILE_MARGIN)) / MOLD_TILE_SIZE);
+    ivec2 tile_max = min(ivec2(num_tiles_x, num_tiles_y) - 1, ivec2(pos + float(MOLD_TILE_MARGIN)) / MOLD_TILE_SIZE);
 
-    int pos_x_left = int(mold_particles[idx].pos.x + factor_distance_px * cos(mold_particles[idx].angle + PI / 4.0f));
-    int pos_y_left = int(mold_particles[idx].pos.y + factor_distance_px * sin(mold_particles[idx].angle + PI / 4.0f));
-    int pos_x_fwd = int(mold_particles[idx].pos.x + factor_distance_px * cos(mold_particles[idx].angle));
-    int pos_y_fwd = int(mold_particles[idx].pos.y + factor_distance_px * sin(mold_particles[idx].angle));
-    int pos_x_right = int(mold_particles[idx].pos.x + factor_distance_px * cos(mold_particles[idx].angle - PI / 4.0f));
-    int pos_y_right = int(mold_particles[idx].pos.y + factor_distance_px * sin(mold_particles[idx].angle - PI / 4.0f));
+    for (int y = tile_min.y; y <= tile_max.y; y++) {
+        for (int x = tile_min.x; x <= tile_max.x; x++) {
+            int idx_tile = x + y * num_tiles_x;
+            // Most particles share their tiles with many others, so only write if needed
+            if (mold_tiles[idx_tile].step_last_used != step_idx + 1u) {
+                mold_tiles[idx_tile].step_last_used = step_idx + 1u;
+            }
+        }
+    }
+}
 
-    float val_left = get_area_value(ivec2(pos_x_left, pos_y_left), search_radius_px, mold_particles[idx].type);
-    float val_fwd = get_area_value(ivec2(pos_x_fwd, pos_y_fwd), search_radius_px, mold_particles[idx].type);
-    float val_right = get_area_value(ivec2(pos_x_right, pos_y_right), search_radius_px, mold_particles[idx].type);
-    
-    float abs_left = abs(val_left);
-    float abs_right = abs(val_right);
-    float abs_fwd = abs(val_fwd);
+// Returns the pages of tiles that have not been used for a while to the pool
+void release_tiles() {
+    int idx_tile = mold_linear_index();
 
-    bool is_largest_left = abs_left > abs_right && abs_left > abs_fwd;
-    bool is_largest_right = abs_right > abs_left && abs_right > abs_fwd;
-    bool is_largest_fwd = abs_fwd > abs_left && abs_fwd > abs_right;
-    float factor_rotate = speed_factor * 2 * PI * 0.015f;
+    if (idx_tile >= num_tiles_x * num_tiles_y) {
+        return;
+    }
 
-    bool rotate_left = false;
-    bool rotate_right = false;
+    int page = mold_tiles[idx_tile].page;
 
-    if (is_largest_left) {
-        if (val_left > 0) {
-            rotate_left = true;
-        }
-        else {
-            rotate_right = true;
-        }
+    if (page == MOLD_NO_PAGE || step_idx + 1u - mold_tiles[idx_tile].step_last_used <= MOLD_TILE_RELEASE_STEPS) {
+        return;
     }
 
-    if (is_largest_right) {
-        if (val_right > 0) {
-            rotate_right = true;
-        }
-        else {
-            rotate_left = true;
-        }
-    }
+    free_pages[atomicAdd(num_free_pages, 1)] = page;
+    mold_page_tiles[page] = MOLD_PAGE_RELEASED;
+    mold_tiles[idx_tile].page = MOLD_NO_PAGE;
+}
 
-    if (is_largest_fwd) {
-        if (val_fwd < 0) {
-            // Other mold types ahead!
-            if (val_left > val_right) {
-                rotate_left = true;
-            }
-            else {
-                rotate_right = true;
-            }
-        }
+// Clears the trails of the pages release_tiles() just returned to the pool, one work group per page
+void clear_released_pages() {
+    int page = int(gl_WorkGroupID.y);
+    // Read by all invocations before the first one resets it below
+    bool is_released = mold_page_tiles[page] == MOLD_PAGE_RELEASED;
+    barrier();
+
+    if (!is_released) {
+        return;
     }
 
-    if (rotate_left) {
-        mold_particles[idx].angle += factor_rotate * t_step_ms;
+    int idx_first = num_layers * page * MOLD_TILE_SIZE * MOLD_TILE_SIZE;
+    int group_size = int(gl_WorkGroupSize.x * gl_WorkGroupSize.y);
+
+    for (int idx = int(gl_LocalInvocationIndex); idx < num_layers * MOLD_TILE_SIZE * MOLD_TILE_SIZE; idx += group_size) {
+        mold_intensity[idx_first + idx] = vec4(0);
     }
 
-    if (rotate_right) {
-        mold_particles[idx].angle -= factor_rotate * t_step_ms;
+    if (gl_LocalInvocationIndex == 0u) {
+        mold_page_tiles[page] = -1;
     }
+}
 
-    float factor_move = speed_factor * 0.1f;
-    float new_x = mold_particles[idx].pos.x + factor_move * t_step_ms * cos(mold_particles[idx].angle);
-    float new_y = mold_particles[idx].pos.y + factor_move * t_step_ms * sin(mold_particles[idx].angle);
+// Gives the tiles marked in this step a free page, which clear_released_pages() has cleared. Runs after
+//  release_tiles(), never in the same pass, since the free page stack only supports either pushing or popping at a time
+void allocate_tiles() {
+    int idx_tile = mold_linear_index();
 
-    bool update_angle = false;
-    bool do_move = true;
-    bool is_out_of_bounds = false;
+    if (idx_tile >= num_tiles_x * num_tiles_y) {
+        return;
+    }
 
-    if (new_x < 0 || new_x >= image_width) {
-        is_out_of_bounds = true;
+    if (mold_tiles[idx_tile].page != MOLD_NO_PAGE || mold_tiles[idx_tile].step_last_used != step_idx + 1u) {
+        return;
     }
 
-    if (new_y < 0 || new_y >= image_height) {
-        is_out_of_bounds = true;
+    int idx_free = atomicAdd(num_free_pages, -1) - 1;
+
+    if (idx_free < 0) {
+        // The pool is exhausted. The tile stays without trails until a page is released
+        atomicAdd(num_free_pages, 1);
+        return;
     }
 
-    if (is_out_of_bounds) {
-        new_x = clamp(new_x, 0, image_width - 1);
-        new_y = clamp(new_y, 0, image_height - 1);
-        update_angle = true;
-        do_move = false;
+    int page = free_pages[idx_free];
+    mold_page_tiles[page] = idx_tile;
+    mold_tiles[idx_tile].page = page;
+}
+
+// Same as mold_area_value(), but the average over the 2r x 2r area comes from a single trilinear
+//  sample per layer at the mip level where one texel covers about the whole area
+float get_area_value_filtered(ivec2 pos_center, int r, int mold_type) {
+    // At the center of the pixel, texture coordinates of whole numbers are the corners between pixels
+    vec2 uv = (vec2(pos_center) + 0.5f) / vec2(world_width, world_height);
+    float lod = log2(2.0f * r);
+    float ret = 0;
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        ret += dot(textureLod(trail_map, vec3(uv, layer), lod), mold_interactions[mold_type * MAX_LAYERS + layer]);
     }
 
-    if (update_angle) {
-        // A way to generate a "random" behavior
-        float new_angle = PI * (1.0f + sin(pseudo_random_float * float(idx)));
-        mold_particles[idx].angle = new_angle;
+    return ret;
+}
+
+int mold_step_trail_index(int run, ivec2 pos) {
+    return mold_trail_index(pos, num_tiles_x, num_layers);
+}
+
+vec4 mold_step_trail(int idx) {
+    return mold_intensity[idx];
+}
+
+vec4 mold_step_interaction(int run, int mold_type, int layer) {
+    return mold_interactions[mold_type * MAX_LAYERS + layer];
+}
+
+float mold_step_sense(int run, ivec2 pos_center, int r, int mold_type) {
+    if (use_trail_texture) {
+        return get_area_value_filtered(pos_center, r, mold_type);
     }
 
-    if (do_move) {
-        mold_particles[idx].pos_last = mold_particles[idx].pos;
-        mold_particles[idx].pos = vec2(new_x, new_y);
+    return mold_area_value(run, pos_center, r, mold_type, ivec2(world_width, world_height), num_layers);
+}
+
+void move() {
+    int idx = get_particle_index();
+
+    if (idx < 0) {
+        return;
     }
+
+    float sensor_distance = 10.0f;
+    // Each particle has its own random numbers for every step, so neighbouring particles are uncorrelated
+    //  and a run can be repeated exactly with the same seed
+    vec4 r = random_uniform4(seed, RANDOM_STREAM_MOLD_MOVE, uint(idx), step_idx);
+
+    mold_particles[idx] = mold_move(mold_particles[idx], 0, ivec2(world_width, world_height), sensor_distance, speed_factor,
+        t_step_ms, steer_randomness, r);
 }
 
 void main()
 {
     ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
 
+    // Actions 0, 1 and 4 run over the alive list, 5 and 6 over the tiles, 2 and 7 over the page pool and 3 over the world
     switch (action_id) {
-    case 0: move(texel_coord); break;
-    case 1: darken(texel_coord); break;
-    case 2: extract_mold(texel_coord); break;
+    // Diffusion and decay of the trails are done by mold_diffuse between move and extract_mold
+    case 0: move(); break;
+    case 1: extract_mold(); break;
+    case 2: resolve_deposits(); break;
+    case 3: publish_trail_texture(texel_coord); break;
+    case 4: mark_tiles(); break;
+    case 5: release_tiles(); break;
+    case 6: allocate_tiles(); break;
+    case 7: clear_released_pages(); break;
     }
 }
\ No newline at end of file
@@ -0,0 +1,125 @@
+// Must be kept in sync with max_num_mold_types in main.cpp
+#define MAX_TYPES 16
+#define MAX_LAYERS (MAX_TYPES / 4)
+#define MAX_DIFFUSE_RADIUS 4
+#define TILE_SIZE 16
+#define TILE_STRIDE (TILE_SIZE + 2 * MAX_DIFFUSE_RADIUS)
+
+// Blurs and fades the trail map in one pass, from mold_intensity into mold_intensity_next.
+//  Each work group loads its tile plus a halo into shared memory once per type and does a separable
+//  Gaussian from there, instead of every invocation reading all its neighbours from the SSBO.
+//  Four types are blurred at once, since the trail map stores them together in a vec4.
+//  Runs over the page pool: y is the page, x the work group within the tile. Free pages are skipped.
+layout(local_size_x = TILE_SIZE, local_size_y = TILE_SIZE, local_size_z = 1) in;
+layout(location = 0) uniform int world_width;
+layout(location = 1) uniform int world_height;
+layout(location = 2) uniform int num_layers;            // (num_types + 3) / 4
+layout(location = 3) uniform int diffuse_radius;        // 0 - MAX_DIFFUSE_RADIUS
+layout(location = 4) uniform float decay_amount;        // Reduction per step for a decay rate of 1
+layout(location = 5) uniform bool use_shared_memory;    // false: Naive version, reading every tap from the SSBO. Used for benchmarking
+layout(location = 6) uniform float kernel_weights[MAX_DIFFUSE_RADIUS + 1];  // Normalized 1D weights, center first
+layout(location = 11) uniform float diffusion_rates[MAX_TYPES];     // 0: No blur, 1: Replace with the blurred value
+layout(location = 27) uniform float decay_rates[MAX_TYPES];
+layout(location = 43) uniform int num_tiles_x;
+
+// Same layout as in mold_compute: resident pages back to back, num_layers vec4 per pixel
+layout(std430, binding = 8) buffer layout_mold_intensity
+{
+    vec4 mold_intensity[];
+};
+
+layout(std430, binding = 14) buffer layout_mold_intensity_next
+{
+    vec4 mold_intensity_next[];
+};
+
+shared vec4 tile[TILE_STRIDE * TILE_STRIDE];
+shared vec4 tile_horizontal[TILE_STRIDE * TILE_SIZE];
+
+// Clamps to the edge, so the border of the world does not fade faster than the rest. Tiles that are not
+//  resident have no trails
+vec4 read_intensity(ivec2 pos, int layer) {
+    pos = clamp(pos, ivec2(0, 0), ivec2(world_width - 1, world_height - 1));
+    int idx_first = mold_trail_index(pos, num_tiles_x, num_layers);
+    return idx_first < 0 ? vec4(0.0f) : mold_intensity[idx_first + layer];
+}
+
+vec4 diffuse_naive(ivec2 texel_coord, int layer) {
+    vec4 ret = vec4(0.0f);
+
+    for (int dy = -diffuse_radius; dy <= diffuse_radius; dy++) {
+        for (int dx = -diffuse_radius; dx <= diffuse_radius; dx++) {
+            ret += kernel_weights[abs(dx)] * kernel_weights[abs(dy)] * read_intensity(texel_coord + ivec2(dx, dy), layer);
+        }
+    }
+
+    return ret;
+}
+
+// Must be called from all invocations in the work group, since it uses barriers
+vec4 diffuse_tiled(ivec2 tile_origin, ivec2 local_coord, int layer) {
+    int tile_width = TILE_SIZE + 2 * diffuse_radius;
+    int idx_local = local_coord.x + local_coord.y * TILE_SIZE;
+
+    // The previous layer might still be reading from the shared arrays
+    barrier();
+
+    for (int i = idx_local; i < tile_width * tile_width; i += TILE_SIZE * TILE_SIZE) {
+        ivec2 pos_tile = ivec2(i % tile_width, i / tile_width);
+        tile[pos_tile.x + pos_tile.y * TILE_STRIDE] = read_intensity(tile_origin - diffuse_radius + pos_tile, layer);
+    }
+
+    barrier();
+
+    // Horizontal pass over all rows, including the halo rows needed by the vertical pass
+    for (int i = idx_local; i < tile_width * TILE_SIZE; i += TILE_SIZE * TILE_SIZE) {
+        int col = i % TILE_SIZE;
+        int row = i / TILE_SIZE;
+        vec4 sum = vec4(0.0f);
+        for (int k = -diffuse_radius; k <= diffuse_radius; k++) {
+            sum += kernel_weights[abs(k)] * tile[col + diffuse_radius + k + row * TILE_STRIDE];
+        }
+        tile_horizontal[col + row * TILE_SIZE] = sum;
+    }
+
+    barrier();
+
+    vec4 ret = vec4(0.0f);
+
+    for (int k = -diffuse_radius; k <= diffuse_radius; k++) {
+        ret += kernel_weights[abs(k)] * tile_horizontal[local_coord.x + (local_coord.y + diffuse_radius + k) * TILE_SIZE];
+    }
+
+    return ret;
+}
+
+void main()
+{
+    int page = int(gl_WorkGroupID.y);
+    int idx_mold_tile = mold_page_tiles[page];
+
+    // The whole work group returns, so this does not skip any barriers
+    if (idx_mold_tile < 0) {
+        return;
+    }
+
+    ivec2 texel_page = mold_page_texel();
+    ivec2 texel_coord = ivec2(idx_mold_tile % num_tiles_x, idx_mold_tile / num_tiles_x) * MOLD_TILE_SIZE + texel_page;
+    ivec2 local_coord = ivec2(gl_LocalInvocationID.xy);
+    ivec2 tile_origin = texel_coord - local_coord;
+    // No early return, all invocations have to reach the barriers. Tiles at the border can be partly outside the world
+    bool is_inside = texel_coord.x < world_width && texel_coord.y < world_height;
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        vec4 blurred = use_shared_memory ? diffuse_tiled(tile_origin, local_coord, layer) : diffuse_naive(texel_coord, layer);
+
+        if (is_inside) {
+            int idx = num_layers * (page * MOLD_TILE_SIZE * MOLD_TILE_SIZE + texel_page.x + texel_page.y * MOLD_TILE_SIZE) + layer;
+            int c = 4 * layer;
+            vec4 diffusion_rate = vec4(diffusion_rates[c], diffusion_rates[c + 1], diffusion_rates[c + 2], diffusion_rates[c + 3]);
+            vec4 decay_rate = vec4(decay_rates[c], decay_rates[c + 1], decay_rates[c + 2], decay_rates[c + 3]);
+            vec4 value = mix(mold_intensity[idx], blurred, diffusion_rate);
+            mold_intensity_next[idx] = max(vec4(0.0f), value - decay_rate * decay_amount);
+        }
+    }
+}
\ No newline at end of file
@@ -0,0 +1,85 @@
+#define PI 3.1415926535897932384626433832795f
+
+// Must be kept in sync with Mold_init_mode in main.cpp
+#define MOLD_INIT_RANDOM 0
+#define MOLD_INIT_ELLIPSE 1
+#define MOLD_INIT_CIRCLE 2
+#define MOLD_INIT_SEED_MAP 3
+
+// One invocation per particle. Must give the same particles as mold_init_particle() in main.cpp
+layout(local_size_x = 256, local_size_y = 1, local_size_z = 1) in;
+layout(binding = 2) uniform sampler2D seed_map;
+// The particles are spread over a spawn area of this size, placed at spawn_origin in the world
+layout(location = 0) uniform int image_width;
+layout(location = 1) uniform int image_height;
+layout(location = 2) uniform int init_mode;
+layout(location = 3) uniform uint seed;
+layout(location = 4) uniform int num_types;
+layout(location = 5) uniform vec2 spawn_origin;
+layout(location = 6) uniform uint num_mold_particles;   // The rest of the pool starts out free
+layout(location = 7) uniform uint max_age;              // Particles die after this many steps. 0: Never
+
+layout(std430, binding = 7) buffer layout_mold_particles
+{
+    Mold_particle mold_particles[];
+};
+
+void main()
+{
+    uint idx_mold = gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * gl_WorkGroupSize.x;
+
+    if (idx_mold >= num_mold_particles) {
+        return;
+    }
+
+    // Precise keeps the compiler from fusing the multiplies and adds, which would round differently than the CPU
+    precise float pos_x = image_width / 2.0f;
+    precise float pos_y = image_height / 2.0f;
+    precise float angle = 0.0f;
+    float id_normalized = float(idx_mold) / (float(num_mold_particles) - 1.0f);
+
+    if (init_mode == MOLD_INIT_RANDOM) {
+        vec4 r = random_uniform4(seed, RANDOM_STREAM_MOLD_INIT, idx_mold, 0u);
+        pos_x = image_width * r.x;
+        pos_y = image_height * r.y;
+        angle = 2.0f * PI * r.z;
+    }
+
+    if (init_mode == MOLD_INIT_ELLIPSE) {
+        pos_x = image_width / 2.0f + image_width / 4.0f * cos(2.0f * PI * id_normalized);
+        pos_y = image_height / 2.0f + image_height / 4.0f * sin(2.0f * PI * id_normalized);
+        angle = 2.0f * PI * id_normalized;
+    }
+
+    if (init_mode == MOLD_INIT_CIRCLE) {
+        pos_x = image_width / 2.0f + image_width / 4.0f * cos(2.0f * PI * id_normalized);
+        pos_y = image_height / 2.0f + image_width / 4.0f * sin(2.0f * PI * id_normalized);
+        angle = 2.0f * PI * id_normalized;
+    }
+
+    if (init_mode == MOLD_INIT_SEED_MAP) {
+        // Pick random pixels until we find a bright enough one
+        ivec2 seed_map_size = textureSize(seed_map, 0);
+        int max_attempts = 100;
+        for (int idx_attempt = 0; idx_attempt < max_attempts; idx_attempt++) {
+            vec4 r = random_uniform4(seed, RANDOM_STREAM_MOLD_INIT, idx_mold, uint(idx_attempt));
+            int seed_x = min(int(r.x * seed_map_size.x), seed_map_size.x - 1);
+            int seed_y = min(int(r.y * seed_map_size.y), seed_map_size.y - 1);
+            pos_x = image_width * (seed_x + 0.5f) / seed_map_size.x;
+            pos_y = image_height * (seed_y + 0.5f) / seed_map_size.y;
+            angle = 2.0f * PI * r.z;
+            vec3 seed_color = texelFetch(seed_map, ivec2(seed_x, seed_y), 0).rgb;
+            if ((seed_color.r + seed_color.g + seed_color.b) / 3.0f > 0.5f) {
+                break;
+            }
+        }
+    }
+
+    mold_particles[idx_mold].pos = spawn_origin + vec2(pos_x, pos_y);
+    // No trail until the particle has moved
+    mold_particles[idx_mold].pos_last = spawn_origin + vec2(pos_x, pos_y);
+    mold_particles[idx_mold].angle = angle;
+    mold_particles[idx_mold].type = int((idx_mold + 1) % uint(num_types));
+    // Staggered, so the initial particles do not all die in the same step
+    mold_particles[idx_mold].age = max_age > 0u ? idx_mold % max_age : 0u;
+}
\ No newline at end of file
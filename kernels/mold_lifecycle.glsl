@@ -0,0 +1,189 @@
+#define PI 3.1415926535897932384626433832795f
+
+// Removes dead mold particles from the alive list and spawns new ones, without the host knowing any counts.
+//  The particle slots form a pool: mold_alive lists the live ones, mold_free_slots is a stack of the rest.
+//  Every step runs the actions in order:
+//   0: Scan the survive flags within each work group (over the current alive list)
+//   1: Scan the group sums, one work group
+//   2: Write the survivors to mold_alive_next and push the dead slots to the free stack
+//   3: Let survivors on dense trails spawn a particle into a free slot
+//   4: Update the counts and the indirect dispatch arguments, one invocation
+//  Afterwards, the host swaps mold_alive and mold_alive_next.
+layout(local_size_x = SCAN_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(location = 0) uniform int action_id;
+layout(location = 1) uniform uint max_age;              // Particles die after this many steps. 0: Never
+layout(location = 2) uniform float spawn_probability;   // Per step, for particles on a dense enough trail
+layout(location = 3) uniform float spawn_threshold;     // Trail intensity of the own type needed to spawn
+layout(location = 4) uniform uint seed;
+layout(location = 5) uniform uint step_idx;
+layout(location = 6) uniform int num_tiles_x;
+layout(location = 7) uniform int num_layers;
+layout(location = 8) uniform int world_width;
+layout(location = 9) uniform int world_height;
+
+// Must be kept in sync with Mold_counters in main.cpp. Also bound as the indirect dispatch buffer
+layout(std430, binding = 19) buffer layout_mold_counters
+{
+    uvec3 num_groups;       // Indirect dispatch over the alive list, SCAN_GROUP_SIZE invocations per group
+    uint num_alive;
+    uint num_alive_next;    // Survivors of this step, before spawning
+    uint num_spawned;
+    int num_free_slots;
+};
+
+layout(std430, binding = 7) buffer layout_mold_particles
+{
+    Mold_particle mold_particles[];
+};
+
+layout(std430, binding = 8) buffer layout_mold_intensity
+{
+    vec4 mold_intensity[];
+};
+
+layout(std430, binding = 20) buffer layout_mold_free_slots
+{
+    uint mold_free_slots[];
+};
+
+layout(std430, binding = 21) buffer layout_mold_alive
+{
+    uint mold_alive[];
+};
+
+layout(std430, binding = 22) buffer layout_mold_alive_next
+{
+    uint mold_alive_next[];
+};
+
+// Exclusive prefix of the survive flags within the work group, per alive list entry
+layout(std430, binding = 23) buffer layout_mold_scan_offsets
+{
+    uint mold_scan_offsets[];
+};
+
+// Number of survivors per work group, turned into the start of each group in mold_alive_next by action 1
+layout(std430, binding = 24) buffer layout_mold_group_sums
+{
+    uint mold_group_sums[];
+};
+
+bool survives(uint slot) {
+    return max_age == 0u || mold_particles[slot].age < max_age;
+}
+
+void scan_groups() {
+    int idx_alive = mold_linear_index();
+    uint idx_group = linear_group_index();
+    // No early return, all invocations have to reach the barriers
+    bool is_survivor = idx_alive < int(num_alive) && survives(mold_alive[idx_alive]);
+    uint offset = group_exclusive_scan(is_survivor ? 1u : 0u);
+
+    if (idx_alive < int(num_alive)) {
+        mold_scan_offsets[idx_alive] = offset;
+    }
+
+    if (gl_LocalInvocationIndex == SCAN_GROUP_SIZE - 1) {
+        mold_group_sums[idx_group] = group_scan_total();
+    }
+}
+
+// There are at most a few thousand groups, so a single work group goes through them in chunks
+void scan_group_sums() {
+    uint num_scan_groups = (num_alive + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE;
+    uint carry = 0u;
+
+    for (uint base = 0u; base < num_scan_groups; base += SCAN_GROUP_SIZE) {
+        uint idx = base + gl_LocalInvocationIndex;
+        uint value = idx < num_scan_groups ? mold_group_sums[idx] : 0u;
+        uint offset = group_exclusive_scan(value);
+        if (idx < num_scan_groups) {
+            mold_group_sums[idx] = carry + offset;
+        }
+        carry += group_scan_total();
+    }
+
+    if (gl_LocalInvocationIndex == 0) {
+        num_alive_next = carry;
+    }
+}
+
+void scatter() {
+    int idx_alive = mold_linear_index();
+
+    if (idx_alive >= int(num_alive)) {
+        return;
+    }
+
+    uint idx_group = uint(idx_alive) / SCAN_GROUP_SIZE;
+    uint slot = mold_alive[idx_alive];
+
+    if (survives(slot)) {
+        mold_alive_next[mold_group_sums[idx_group] + mold_scan_offsets[idx_alive]] = slot;
+    }
+    else {
+        mold_free_slots[atomicAdd(num_free_slots, 1)] = slot;
+    }
+}
+
+void spawn() {
+    int idx_alive = mold_linear_index();
+
+    if (idx_alive >= int(num_alive_next) || spawn_probability <= 0.0f) {
+        return;
+    }
+
+    Mold_particle parent = mold_particles[mold_alive_next[idx_alive]];
+    ivec2 pos = clamp(ivec2(parent.pos), ivec2(0), ivec2(world_width - 1, world_height - 1));
+    int idx_first = mold_trail_index(pos, num_tiles_x, num_layers);
+
+    if (idx_first < 0 || mold_intensity[idx_first + parent.type / 4][parent.type % 4] < spawn_threshold) {
+        return;
+    }
+
+    vec4 r = random_uniform4(seed, RANDOM_STREAM_MOLD_SPAWN, mold_alive_next[idx_alive], step_idx);
+
+    if (r.x >= spawn_probability) {
+        return;
+    }
+
+    int idx_free = atomicAdd(num_free_slots, -1) - 1;
+
+    if (idx_free < 0) {
+        // The pool is full
+        atomicAdd(num_free_slots, 1);
+        return;
+    }
+
+    uint slot = mold_free_slots[idx_free];
+    mold_particles[slot].pos = parent.pos;
+    mold_particles[slot].pos_last = parent.pos;
+    mold_particles[slot].angle = 2.0f * PI * r.y;
+    mold_particles[slot].type = parent.type;
+    mold_particles[slot].age = 0u;
+    mold_alive_next[num_alive_next + atomicAdd(num_spawned, 1u)] = slot;
+}
+
+void finalize() {
+    if (gl_GlobalInvocationID.x > 0) {
+        return;
+    }
+
+    num_alive = num_alive_next + num_spawned;
+    num_spawned = 0u;
+    uint num_dispatch_groups = max(1u, (num_alive + SCAN_GROUP_SIZE - 1) / SCAN_GROUP_SIZE);
+    num_groups.x = min(num_dispatch_groups, 65535u);
+    num_groups.y = (num_dispatch_groups + num_groups.x - 1u) / num_groups.x;
+    num_groups.z = 1u;
+}
+
+void main()
+{
+    switch (action_id) {
+    case 0: scan_groups(); break;
+    case 1: scan_group_sums(); break;
+    case 2: scatter(); break;
+    case 3: spawn(); break;
+    case 4: finalize(); break;
+    }
+}
@@ -1,28 +1,53 @@
-#define PI 3.1415926535897932384626433832795f
-
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
 layout(rgba32f, binding = 0) uniform image2D img_output;
 layout(location = 0) uniform int image_width;
 layout(location = 1) uniform int image_height;
+layout(location = 2) uniform bool use_trail_texture;
 layout(location = 5) uniform int num_types;
+layout(location = 6) uniform int num_layers;
+layout(location = 7) uniform int world_width;
+layout(location = 8) uniform int world_height;
+layout(location = 9) uniform int num_tiles_x;
+layout(location = 10) uniform vec2 camera_origin;   // World position shown at texel (0, 0), the bottom left pixel
+layout(location = 11) uniform float camera_zoom;    // Pixels per world unit
+
+layout(binding = 3) uniform sampler2DArray trail_map;
 
 layout(std430, binding = 8) buffer layout_mold_intensity
 {
-	float mold_intensity[];
+	vec4 mold_intensity[];
 };
 
+// idx_first is the index of the first vec4 of the pixel, from mold_trail_index()
+float get_intensity(ivec2 world_coord, int idx_first, int idx_type) {
+	if (use_trail_texture) {
+		return texelFetch(trail_map, ivec3(world_coord, idx_type / 4), 0)[idx_type % 4];
+	}
+
+	return mold_intensity[idx_first + idx_type / 4][idx_type % 4];
+}
+
+// One invocation per pixel on screen, so only the tiles in view are read
 void render(ivec2 texel_coord) {
 	if (texel_coord.x >= image_width || texel_coord.y >= image_height) {
 		return;
 	}
 
 	vec4 pixel_color = vec4(0, 0, 0, 1);
+	ivec2 world_coord = ivec2(floor(camera_origin + vec2(texel_coord) / camera_zoom));
 
-	vec4 colors[3] = vec4[3](
-		vec4(0.0, 0.2, 0.3, 1.0),
-		vec4(0.3, 0.7, 0.0, 1.0),
-		vec4(0.7, 0.3, 0.0, 1.0)
-		);
+	if (world_coord.x < 0 || world_coord.y < 0 || world_coord.x >= world_width || world_coord.y >= world_height) {
+		imageStore(img_output, texel_coord, vec4(0.05, 0.05, 0.05, 1));
+		return;
+	}
+
+	int idx_first = mold_trail_index(world_coord, num_tiles_x, num_layers);
+
+	// No particles have been close to this tile for a while
+	if (idx_first < 0) {
+		imageStore(img_output, texel_coord, pixel_color);
+		return;
+	}
 
 	int idx_type_to_use = -1;
 	float cur_intensity = -1.0;
@@ -31,24 +56,24 @@ void render(ivec2 texel_coord) {
 	bool do_blend = false;
 
 	for (int idx_type = 0; idx_type < num_types; idx_type++) {
-		int idx_pixel = num_types * (texel_coord.x + image_width * texel_coord.y) + idx_type;
+		float intensity = get_intensity(world_coord, idx_first, idx_type);
 
-		if (!do_blend && mold_intensity[idx_pixel] > cur_intensity) {
+		if (!do_blend && intensity > cur_intensity) {
 			idx_type_to_use = idx_type;
-			cur_intensity = mold_intensity[idx_pixel];
+			cur_intensity = intensity;
 		}
 
 		if (do_blend) {
 			vec4 cur_color = vec4(1, 1, 1, 1);
-			if (colors.length() > idx_type) {
-				cur_color = colors[idx_type];
+			if (MOLD_TYPE_COLORS.length() > idx_type) {
+				cur_color = MOLD_TYPE_COLORS[idx_type];
 			}
-			pixel_color += mold_intensity[idx_pixel] * cur_color;
+			pixel_color += intensity * cur_color;
 		}
 	}
 
 	if (!do_blend && (idx_type_to_use > -1)) {
-		pixel_color = cur_intensity * colors[idx_type_to_use];
+		pixel_color = cur_intensity * MOLD_TYPE_COLORS[idx_type_to_use];
 	}
 
 	pixel_color.r = min(pixel_color.r, 1);
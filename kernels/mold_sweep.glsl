@@ -0,0 +1,199 @@
+// Many small mold simulations at once, for parameter sweeps (--sweep in main.cpp). Every run has the same
+//  number of particles, back to back in mold_sweep_particles, and its own dense trail map, so a single dispatch
+//  advances all of them. The passes over pixels use z for the run. Simpler than the mold scene: no tiles,
+//  lifecycle or trail texture, and each type follows its own trail and avoids all others (the default interactions)
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+layout(location = 0) uniform int action_id;
+layout(location = 1) uniform int world_width;
+layout(location = 2) uniform int world_height;
+layout(location = 3) uniform int num_layers;        // (num_types + 3) / 4 for the run with the most types
+layout(location = 4) uniform int num_runs;
+layout(location = 5) uniform uint num_particles_per_run;
+layout(location = 6) uniform uint step_idx;
+layout(location = 7) uniform float kernel_weights[2];   // Normalized 1D Gaussian weights of radius 1, center first
+
+// Must be kept in sync with Mold_sweep_run in main.cpp
+struct Mold_sweep_run {
+    float speed_factor;
+    float t_step_ms;
+    float sensor_distance;  // From the particle to its sensors, in pixels
+    int num_types;
+    uint seed;
+};
+
+layout(std430, binding = 32) buffer layout_mold_sweep_runs
+{
+    Mold_sweep_run mold_sweep_runs[];
+};
+
+layout(std430, binding = 33) buffer layout_mold_sweep_particles
+{
+    Mold_particle mold_sweep_particles[];
+};
+
+// The trail maps of all runs back to back, num_layers vec4 per pixel as in the mold scene
+layout(std430, binding = 34) buffer layout_mold_sweep_trails
+{
+    vec4 mold_sweep_trails[];
+};
+
+// The same buffer as uint bits, for atomicMax(). Non-negative floats order the same as their bits
+layout(std430, binding = 34) buffer layout_mold_sweep_trails_bits
+{
+    uint mold_sweep_trails_bits[];
+};
+
+layout(std430, binding = 35) buffer layout_mold_sweep_trails_next
+{
+    vec4 mold_sweep_trails_next[];
+};
+
+// One uint per pixel (RGBA, red in the lowest byte) and the rows top-down, one image per run. See capture.glsl
+layout(std430, binding = 36) buffer layout_mold_sweep_pixels
+{
+    uint mold_sweep_pixels[];
+};
+
+// Index of the first vec4 of the pixel in the trail map of the run. pos must be inside the world
+int trail_index(int run, ivec2 pos) {
+    return num_layers * ((run * world_height + pos.y) * world_width + pos.x);
+}
+
+// Particle for this invocation, or -1 past the end of the last run. 1D work groups spread over x and y
+int get_particle_index() {
+    uint idx_group = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+    uint idx = idx_group * gl_WorkGroupSize.x * gl_WorkGroupSize.y + gl_LocalInvocationIndex;
+    return idx < uint(num_runs) * num_particles_per_run ? int(idx) : -1;
+}
+
+// Same particles as the random mode of mold_init for the seed of the run
+void init() {
+    int idx = get_particle_index();
+
+    if (idx < 0) {
+        return;
+    }
+
+    Mold_sweep_run run = mold_sweep_runs[uint(idx) / num_particles_per_run];
+    uint idx_in_run = uint(idx) % num_particles_per_run;
+    vec4 r = random_uniform4(run.seed, RANDOM_STREAM_MOLD_INIT, idx_in_run, 0u);
+    vec2 pos = vec2(world_width * r.x, world_height * r.y);
+
+    mold_sweep_particles[idx].pos = pos;
+    mold_sweep_particles[idx].pos_last = pos;
+    mold_sweep_particles[idx].angle = 2.0f * PI * r.z;
+    mold_sweep_particles[idx].type = int((idx_in_run + 1u) % uint(run.num_types));
+    mold_sweep_particles[idx].age = 0u;
+}
+
+int mold_step_trail_index(int run, ivec2 pos) {
+    return trail_index(run, pos);
+}
+
+vec4 mold_step_trail(int idx) {
+    return mold_sweep_trails[idx];
+}
+
+// Each type follows its own trail and avoids the trails of all other types of the run
+vec4 mold_step_interaction(int run, int mold_type, int layer) {
+    ivec4 types = 4 * layer + ivec4(0, 1, 2, 3);
+    vec4 weights = vec4(equal(types, ivec4(mold_type))) * 2.0f - 1.0f;
+    return weights * vec4(lessThan(types, ivec4(mold_sweep_runs[run].num_types)));
+}
+
+float mold_step_sense(int run, ivec2 pos_center, int r, int mold_type) {
+    return mold_area_value(run, pos_center, r, mold_type, ivec2(world_width, world_height), num_layers);
+}
+
+void mold_step_deposit(int run, ivec2 pos, int mold_type, float weight) {
+    if (weight <= 0.0f || pos.x < 0 || pos.y < 0 || pos.x >= world_width || pos.y >= world_height) {
+        return;
+    }
+
+    int idx_intensity = trail_index(run, pos) + mold_type / 4;
+    // Atomic, so particles crossing the same pixel give the same result in any order
+    atomicMax(mold_sweep_trails_bits[4 * idx_intensity + mold_type % 4], floatBitsToUint(weight));
+}
+
+// Same step as move() in mold_compute, with the parameters of the run
+void move() {
+    int idx = get_particle_index();
+
+    if (idx < 0) {
+        return;
+    }
+
+    int idx_run = idx / int(num_particles_per_run);
+    Mold_sweep_run run = mold_sweep_runs[idx_run];
+    vec4 r = random_uniform4(run.seed, RANDOM_STREAM_MOLD_MOVE, uint(idx) % num_particles_per_run, step_idx);
+
+    mold_sweep_particles[idx] = mold_move(mold_sweep_particles[idx], idx_run, ivec2(world_width, world_height), run.sensor_distance,
+        run.speed_factor, run.t_step_ms, 0.0f, r);
+}
+
+void extract_mold() {
+    int idx = get_particle_index();
+
+    if (idx < 0) {
+        return;
+    }
+
+    mold_extract(idx / int(num_particles_per_run), mold_sweep_particles[idx]);
+}
+
+// Blur of radius 1 and decay, from mold_sweep_trails into mold_sweep_trails_next. Like the naive version of
+//  mold_diffuse, with its default diffusion rate of 0.5 and decay rate of 1 for all types
+void diffuse(int run, ivec2 texel_coord) {
+    float decay_amount = mold_sweep_runs[run].speed_factor * mold_sweep_runs[run].t_step_ms / 1000.0f;
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        vec4 blurred = vec4(0.0f);
+
+        for (int dy = -1; dy <= 1; dy++) {
+            for (int dx = -1; dx <= 1; dx++) {
+                // Clamps to the edge, so the border of the world does not fade faster than the rest
+                ivec2 pos = clamp(texel_coord + ivec2(dx, dy), ivec2(0), ivec2(world_width - 1, world_height - 1));
+                blurred += kernel_weights[abs(dx)] * kernel_weights[abs(dy)] * mold_sweep_trails[trail_index(run, pos) + layer];
+            }
+        }
+
+        int idx = trail_index(run, texel_coord) + layer;
+        vec4 value = mix(mold_sweep_trails[idx], blurred, 0.5f);
+        mold_sweep_trails_next[idx] = max(vec4(0.0f), value - decay_amount);
+    }
+}
+
+// Colors the brightest type of each pixel, as mold_render does by default
+void thumbnail(int run, ivec2 texel_coord) {
+    int idx_first = trail_index(run, texel_coord);
+    int idx_type_to_use = -1;
+    float cur_intensity = -1.0;
+
+    for (int idx_type = 0; idx_type < mold_sweep_runs[run].num_types; idx_type++) {
+        float intensity = mold_sweep_trails[idx_first + idx_type / 4][idx_type % 4];
+        if (intensity > cur_intensity) {
+            idx_type_to_use = idx_type;
+            cur_intensity = intensity;
+        }
+    }
+
+    vec4 color = vec4((cur_intensity * MOLD_TYPE_COLORS[idx_type_to_use]).rgb, 1.0f);
+    int idx_pixel = (run * world_height + world_height - 1 - texel_coord.y) * world_width + texel_coord.x;
+    mold_sweep_pixels[idx_pixel] = packUnorm4x8(min(color, vec4(1.0f)));
+}
+
+void main()
+{
+    ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
+    int run = int(gl_GlobalInvocationID.z);
+    bool is_pixel = texel_coord.x < world_width && texel_coord.y < world_height && run < num_runs;
+
+    // Actions 0 - 2 run over the particles of all runs, 3 and 4 over the pixels of all runs
+    switch (action_id) {
+    case 0: init(); break;
+    case 1: move(); break;
+    case 2: extract_mold(); break;
+    case 3: if (is_pixel) diffuse(run, texel_coord); break;
+    case 4: if (is_pixel) thumbnail(run, texel_coord); break;
+    }
+}
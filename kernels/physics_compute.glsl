@@ -1,121 +1,284 @@
+// Circle physics of the physics scene, in world units and seconds. A fixed step is three dispatches over the
+//  bodies: move them and reflect them off the walls, work out the elastic response of all touching pairs that move
+//  towards each other from the velocities before the step, then apply the new velocities. The same model as
+//  physics_cpu_step() in main.cpp, which the physics benchmark compares it with
+//
+// ACTION_EVENTS is the event-driven step of physics_cpu_advance() instead, in a single work group: every round
+//  each body finds its earliest wall hit or collision, the group finds the earliest of all, and only the events at
+//  that time are handled. Collisions happen at the time of contact, so the step can be a whole frame. This is what
+//  the physics scene runs; the physics_ccd benchmark compares it with the fixed steps at equal error
+#define ACTION_MOVE 0
+#define ACTION_COLLIDE 1
+#define ACTION_APPLY 2
+#define ACTION_EVENTS 3
+
+#define T_NEVER 3.0e38f
+#define WALL_X 1u
+#define WALL_Y 2u
+
 layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
-layout(rgba32f, binding = 0) uniform image2D img_output;
 layout(location = 0) uniform float world_min_x;
 layout(location = 1) uniform float world_max_x;
 layout(location = 2) uniform float world_min_y;
 layout(location = 3) uniform float world_max_y;
-layout(location = 4) uniform float step_ms;
+layout(location = 4) uniform float dt;          // Step length in seconds
+layout(location = 5) uniform int action_id;
+layout(location = 6) uniform int max_event_rounds;  // ACTION_EVENTS: the rest of the step is moved without events after this many
 
 layout(std430, binding = 9) buffer layout_circles
 {
     Circle circles[];
 };
 
-layout(std430, binding = 11) buffer layout_physics
+// Coherent, since ACTION_EVENTS reads what other invocations of the group wrote in the same dispatch
+layout(std430, binding = 11) coherent buffer layout_physics
 {
     Physics physics[];
 };
 
-void main()
+// Must be kept in sync with Physics_scratch in main.cpp
+struct Physics_scratch {
+    vec2 vel;       // ACTION_COLLIDE: after the collisions of the step. ACTION_EVENTS: the velocity while handling the events
+    float t_body;   // ACTION_EVENTS: time of the position in physics[], from the start of the step
+    float t_event;  // ACTION_EVENTS: time of the earliest event of the body
+    int partner;    // ACTION_EVENTS: other body of a collision at t_event, or -1
+    uint walls;     // ACTION_EVENTS: WALL_X and WALL_Y for the walls hit at t_event
+};
+
+layout(std430, binding = 49) coherent buffer layout_physics_scratch
 {
-    uint workgroup_size_x = gl_WorkGroupSize.x;
-    uint workgroup_size_y = gl_WorkGroupSize.y;
-    uint workgroup_size_z = gl_WorkGroupSize.z;
-    uint cur_group_x = gl_GlobalInvocationID.x;
-    uint cur_group_y = gl_GlobalInvocationID.y;
-    uint cur_group_z = gl_GlobalInvocationID.z;
+    Physics_scratch scratch[];
+};
 
-    uint idx_circle = cur_group_x +
-        cur_group_y * workgroup_size_x +
-        cur_group_z * workgroup_size_x * workgroup_size_y;
+shared float shared_t_min[gl_WorkGroupSize.x * gl_WorkGroupSize.y];
 
-    uint num_circles = circles.length();
+vec2 get_velocity(uint idx) {
+    float dir_length = length(physics[idx].dir);
+    return dir_length > 0.0f ? physics[idx].speed * physics[idx].dir / dir_length : vec2(0);
+}
 
-    if (idx_circle >= num_circles) {
-        return;
-    }
+// Same as physics_cpu_read() in main.cpp
+void set_velocity(uint idx, vec2 velocity) {
+    float speed = length(velocity);
+    physics[idx].dir = speed > 0.0f ? velocity / speed : vec2(1, 0);
+    physics[idx].speed = speed;
+}
 
+// Same as physics_cpu_integrate() in main.cpp: a body that would end up past a wall is mirrored back in
+void move(uint idx) {
+    vec2 velocity = get_velocity(idx);
+    vec2 pos_next = physics[idx].pos + dt * velocity;
+    float r = circles[idx].r;
+    vec2 lo = vec2(world_min_x, world_min_y) + r;
+    vec2 hi = vec2(world_max_x, world_max_y) - r;
+    vec2 past_lo = max(vec2(0), lo - pos_next);
+    vec2 past_hi = max(vec2(0), pos_next - hi);
 
-    // TODO: Add a pass first where we see what happens first - collision with any of the objects or the walls?
-    //  If another object, which one?
+    physics[idx].pos = min(hi, max(lo, pos_next + 2.0f * (past_lo - past_hi)));
+    set_velocity(idx, mix(velocity, -velocity, greaterThan(past_lo + past_hi, vec2(0))));
+}
 
+// Same as physics_cpu_collide() in main.cpp, but against all other bodies instead of the ones in the cells around
+void collide(uint idx) {
+    uint num_bodies = uint(physics.length());
+    vec2 x1 = physics[idx].pos;
+    vec2 v1 = get_velocity(idx);
+    float r1 = circles[idx].r;
+    float m1 = physics[idx].mass;
+    vec2 dv = vec2(0);
 
+    for (uint idx_other = 0u; idx_other < num_bodies; idx_other++) {
+        vec2 d = x1 - physics[idx_other].pos;
+        float d_square = dot(d, d);
+        float r_sum = r1 + circles[idx_other].r;
+        if (idx_other == idx || d_square >= r_sum * r_sum || d_square == 0.0f) {
+            continue;
+        }
+        float approach = dot(v1 - get_velocity(idx_other), d);
+        if (approach >= 0.0f) {
+            continue;
+        }
+        float m2 = physics[idx_other].mass;
+        dv -= (2.0f * m2 / (m1 + m2)) * (approach / d_square) * d;
+    }
 
+    scratch[idx].vel = v1 + dv;
+}
 
+vec2 position_at(uint idx, float t) {
+    return physics[idx].pos + (t - scratch[idx].t_body) * scratch[idx].vel;
+}
 
-    float r = circles[idx_circle].r;
-    vec2 pos_initial = physics[idx_circle].pos;
-    vec2 dir_initial = normalize(physics[idx_circle].dir);
-    float speed = physics[idx_circle].speed;
-    vec2 move = step_ms * speed * dir_initial;
-    vec2 pos_next = pos_initial + move;
+void sync(uint idx, float t) {
+    physics[idx].pos = position_at(idx, t);
+    scratch[idx].t_body = t;
+}
 
-    if ((pos_next.x > world_max_x) || abs(pos_next.x - world_max_x) < r) {
-        float t_collision = (world_max_x - pos_initial.x - r) / move.x;
-        physics[idx_circle].pos.x = world_max_x - r - (1 - t_collision) * dir_initial.x;
-        physics[idx_circle].dir.x = -physics[idx_circle].dir.x;
-    }
-    else if ((pos_next.x < world_min_x) || abs(pos_next.x - world_min_x) < r) {
-        float t_collision = (pos_initial.x - r - world_min_x) / move.x;
-        physics[idx_circle].pos.x = world_min_x + r - (1 - t_collision) * dir_initial.x;
-        physics[idx_circle].dir.x = -physics[idx_circle].dir.x;
+float time_to_wall(float pos, float vel, float lo, float hi) {
+    return vel == 0.0f ? T_NEVER : max(0.0f, ((vel > 0.0f ? hi : lo) - pos) / vel);
+}
+
+// Same as physics_events_time_of_impact() in main.cpp. The same for (a, b) and (b, a), so both bodies of a pair
+//  find the same time
+float time_of_impact(uint idx_a, uint idx_b, float t_now) {
+    vec2 d = position_at(idx_a, t_now) - position_at(idx_b, t_now);
+    vec2 dv = scratch[idx_a].vel - scratch[idx_b].vel;
+    float approach = dot(d, dv);
+    if (approach >= 0.0f) {
+        return T_NEVER;
     }
-    else {
-        physics[idx_circle].pos.x = pos_next.x;
+
+    float r_sum = circles[idx_a].r + circles[idx_b].r;
+    float d_square = dot(d, d);
+    if (d_square <= r_sum * r_sum) {
+        return 0.0f;
     }
 
-    if ((pos_next.y > world_max_y) || abs(pos_next.y - world_max_y) < r) {
-        float t_collision = (world_max_y - pos_initial.y - r) / move.y;
-        physics[idx_circle].pos.y = world_max_y - r - (1 - t_collision) * dir_initial.y;
-        physics[idx_circle].dir.y = -physics[idx_circle].dir.y;
+    float v_square = dot(dv, dv);
+    float discriminant = approach * approach - v_square * (d_square - r_sum * r_sum);
+    if (discriminant < 0.0f) {
+        return T_NEVER;
     }
-    else if ((pos_next.y < world_min_y) || abs(pos_next.y - world_min_y) < r) {
-        float t_collision = (pos_initial.y - r - world_min_y) / move.y;
-        physics[idx_circle].pos.y = world_min_y + r - (1 - t_collision) * dir_initial.y;
-        physics[idx_circle].dir.y = -physics[idx_circle].dir.y;
+
+    return (-approach - sqrt(discriminant)) / v_square;
+}
+
+// The earliest event of the body from t_now on. Of several collisions at the same time, the one with the lowest
+//  index is kept. So the body with the lowest index of all that collide at the earliest time, and its partner,
+//  always pick each other, and every round handles at least one collision or wall hit
+void predict(uint idx, float t_now) {
+    uint num_bodies = uint(physics.length());
+    float t_pair = T_NEVER;
+    int partner = -1;
+    for (uint idx_other = 0u; idx_other < num_bodies; idx_other++) {
+        if (idx_other == idx) {
+            continue;
+        }
+        float t = time_of_impact(idx, idx_other, t_now);
+        if (t < t_pair) {
+            t_pair = t;
+            partner = int(idx_other);
+        }
     }
-    else {
-        physics[idx_circle].pos.y = pos_next.y;
+
+    vec2 pos = position_at(idx, t_now);
+    vec2 vel = scratch[idx].vel;
+    float r = circles[idx].r;
+    float t_wall_x = time_to_wall(pos.x, vel.x, world_min_x + r, world_max_x - r);
+    float t_wall_y = time_to_wall(pos.y, vel.y, world_min_y + r, world_max_y - r);
+    float t_event = min(t_pair, min(t_wall_x, t_wall_y));
+
+    scratch[idx].t_event = t_event < T_NEVER ? t_now + t_event : T_NEVER;
+    scratch[idx].partner = t_event < T_NEVER && t_pair == t_event ? partner : -1;
+    scratch[idx].walls = t_event < T_NEVER ? (t_wall_x == t_event ? WALL_X : 0u) | (t_wall_y == t_event ? WALL_Y : 0u) : 0u;
+}
+
+// Same response as physics_cpu_collide(), for both bodies
+void collide_pair(uint idx_a, uint idx_b) {
+    vec2 d = physics[idx_a].pos - physics[idx_b].pos;
+    float d_square = max(dot(d, d), 1.0e-12f);
+    float m_a = physics[idx_a].mass;
+    float m_b = physics[idx_b].mass;
+    float approach = dot(scratch[idx_a].vel - scratch[idx_b].vel, d);
+    scratch[idx_a].vel -= (2.0f * m_b / (m_a + m_b)) * (approach / d_square) * d;
+    scratch[idx_b].vel += (2.0f * m_a / (m_a + m_b)) * (approach / d_square) * d;
+}
+
+// Needs a dispatch of one work group. Each invocation looks after every num_invocations-th body
+void step_events() {
+    uint idx_local = gl_LocalInvocationIndex;
+    uint num_invocations = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    uint num_bodies = uint(physics.length());
+
+    for (uint idx = idx_local; idx < num_bodies; idx += num_invocations) {
+        scratch[idx].vel = get_velocity(idx);
+        scratch[idx].t_body = 0.0f;
     }
+    memoryBarrierBuffer();
+    barrier();
 
-    // Only comparing to circles with higher indices is a way to avoid
-    //  doing collision detection both ways (circle A --> circle B and circle B --> circle A)
-    for (uint idx_other = idx_circle + 1; idx_other < num_circles; idx_other++) {
-        vec2 pos_me = physics[idx_circle].pos;
-        vec2 pos_other = physics[idx_other].pos;
-        float r_me = circles[idx_circle].r;
-        float r_other = circles[idx_other].r;
-        float d = distance(pos_me, pos_other);
-
-        bool does_collide = d < r_me + r_other;
-
-        if (does_collide) {
-            float t_collision = ((r_me + r_other) - d) / distance(pos_initial, pos_me);
-            float t_after_collision = 1 - t_collision;
-            float s1 = physics[idx_circle].speed;
-            float m1 = physics[idx_circle].mass;
-            vec2 v1 = s1 * physics[idx_circle].dir;
-            vec2 x1 = physics[idx_circle].pos;
-            float s2 = physics[idx_other].speed;
-            float m2 = physics[idx_other].mass;
-            vec2 v2 = s2 * physics[idx_other].dir;
-            vec2 x2 = physics[idx_other].pos;
-
-            float d = length(x1 - x2);
-            float d_square = d * d;
-
-            vec2 v1_new = v1 - (2 * m2 / (m1 + m2)) * (dot(v1 - v2, x1 - x2) / d_square) * (x1 - x2);
-            vec2 v2_new = v2 - (2 * m1 / (m1 + m2)) * (dot(v2 - v1, x2 - x1) / d_square) * (x2 - x1);
-
-            if (m1 * length(v1_new) + m2 * length(v2_new) > 1.2 * (m1 * length(v1) + m2 * length(v2))) {
-                circles[idx_circle].color[0] = 0;
+    float t_now = 0.0f;
+    for (int idx_round = 0; idx_round < max_event_rounds && t_now < dt; idx_round++) {
+        float t_min = dt;
+        for (uint idx = idx_local; idx < num_bodies; idx += num_invocations) {
+            predict(idx, t_now);
+            t_min = min(t_min, scratch[idx].t_event);
+        }
+        shared_t_min[idx_local] = t_min;
+        memoryBarrierBuffer();
+        barrier();
+
+        for (uint stride = num_invocations / 2u; stride > 0u; stride /= 2u) {
+            if (idx_local < stride) {
+                shared_t_min[idx_local] = min(shared_t_min[idx_local], shared_t_min[idx_local + stride]);
             }
+            barrier();
+        }
+        t_min = shared_t_min[0];
+        barrier();
 
-            physics[idx_circle].dir = normalize(v1_new);
-            physics[idx_circle].speed = length(v1_new);
-            physics[idx_other].dir = normalize(v2_new);
-            physics[idx_circle].speed = length(v2_new);
+        if (t_min >= dt) {
+            break;
+        }
 
+        // Walls first, each invocation only changes its own bodies
+        for (uint idx = idx_local; idx < num_bodies; idx += num_invocations) {
+            uint walls = scratch[idx].walls;
+            if (scratch[idx].t_event == t_min && walls != 0u) {
+                sync(idx, t_min);
+                scratch[idx].vel *= vec2((walls & WALL_X) != 0u ? -1.0f : 1.0f, (walls & WALL_Y) != 0u ? -1.0f : 1.0f);
+            }
         }
+        memoryBarrierBuffer();
+        barrier();
+
+        // A body is in at most one pair that picked each other, which the body with the lower index handles
+        for (uint idx = idx_local; idx < num_bodies; idx += num_invocations) {
+            int partner = scratch[idx].partner;
+            if (scratch[idx].t_event == t_min && partner > int(idx) &&
+                scratch[partner].partner == int(idx) && scratch[partner].t_event == t_min) {
+                sync(idx, t_min);
+                sync(uint(partner), t_min);
+                collide_pair(idx, uint(partner));
+            }
+        }
+        memoryBarrierBuffer();
+        barrier();
+
+        t_now = t_min;
+    }
+
+    for (uint idx = idx_local; idx < num_bodies; idx += num_invocations) {
+        sync(idx, dt);
+        float r = circles[idx].r;
+        physics[idx].pos = clamp(physics[idx].pos, vec2(world_min_x, world_min_y) + r, vec2(world_max_x, world_max_y) - r);
+        set_velocity(idx, scratch[idx].vel);
+    }
+}
+
+void main()
+{
+    if (action_id == ACTION_EVENTS) {
+        step_events();
+        return;
+    }
+
+    uint idx_group = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+    uint idx = idx_group * gl_WorkGroupSize.x * gl_WorkGroupSize.y + gl_LocalInvocationIndex;
+
+    if (idx >= uint(physics.length())) {
+        return;
+    }
+
+    switch (action_id) {
+    case ACTION_MOVE:
+        move(idx);
+        break;
+    case ACTION_COLLIDE:
+        collide(idx);
+        break;
+    case ACTION_APPLY:
+        set_velocity(idx, scratch[idx].vel);
+        break;
     }
-}
\ No newline at end of file
+}
@@ -25,8 +25,7 @@ void main()
 {
     ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
 
-    // TODO: This compute shader should do some physics simulation, with a good main loop.
-    //  Idea: maybe have two separate shaders, one for physics calculations and one for rendering?
+    // Only draws the bodies, physics_compute.glsl moves them
 
     vec4 pixel_color = vec4(0, 0, 0, 1);
 
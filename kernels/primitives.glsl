@@ -0,0 +1,227 @@
+// Data-parallel building blocks on 32-bit unsigned values. The host functions in main.cpp (gpu_exclusive_scan(),
+//  gpu_segmented_reduce(), gpu_histogram(), gpu_radix_sort()) bind the buffers and run the actions in order.
+//  cpu_*() in main.cpp give the same results and are used to validate them.
+#define RADIX_BITS 8
+#define RADIX_NUM_DIGITS (1 << RADIX_BITS)
+#define MAX_HISTOGRAM_BINS 1024
+
+#define ACTION_SCAN_BLOCKS 0
+#define ACTION_SCAN_ADD_OFFSETS 1
+#define ACTION_SEGMENTED_REDUCE 2
+#define ACTION_HISTOGRAM 3
+#define ACTION_RADIX_COUNT 4
+#define ACTION_RADIX_SCATTER 5
+
+layout(local_size_x = SCAN_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(location = 0) uniform int action_id;
+layout(location = 1) uniform uint num_items;
+layout(location = 2) uniform uint num_segments;
+layout(location = 3) uniform uint num_bins;     // Power of two, up to MAX_HISTOGRAM_BINS
+layout(location = 4) uniform uint bit_shift;    // Bins and radix digits are (value >> bit_shift) & (num_bins - 1)
+
+// What the buffers hold depends on the action:
+//  scan:              data (in place), block_sums
+//  segmented reduce:  data (values), aux (num_segments + 1 segment starts), out (sums)
+//  histogram:         data (values), out (bins, accumulated)
+//  radix count:       data (keys), counts
+//  radix scatter:     data (keys), aux (payload), out (keys), out_aux (payload), counts (scanned)
+layout(std430, binding = 25) buffer layout_primitives_data
+{
+    uint data[];
+};
+
+layout(std430, binding = 26) buffer layout_primitives_aux
+{
+    uint aux[];
+};
+
+layout(std430, binding = 27) buffer layout_primitives_out
+{
+    uint out_data[];
+};
+
+layout(std430, binding = 28) buffer layout_primitives_out_aux
+{
+    uint out_aux[];
+};
+
+// Per digit and block, digit major, so an exclusive scan over it gives where each block writes each digit
+layout(std430, binding = 29) buffer layout_primitives_counts
+{
+    uint counts[];
+};
+
+layout(std430, binding = 30) buffer layout_primitives_block_sums
+{
+    uint block_sums[];
+};
+
+shared uint local_bins[MAX_HISTOGRAM_BINS];
+shared uint local_keys[SCAN_GROUP_SIZE];
+shared uint local_payload[SCAN_GROUP_SIZE];
+shared uint local_digits[SCAN_GROUP_SIZE];  // Digit << 1 | is_valid
+shared uint digit_starts[RADIX_NUM_DIGITS];
+
+// Exclusive scan of each block of SCAN_GROUP_SIZE values. The block totals go to block_sums, which the
+//  host scans the same way and adds back with ACTION_SCAN_ADD_OFFSETS
+void scan_blocks() {
+    // The dispatch can have a few groups past the end, see dispatch_compute_linear()
+    if (linear_group_index() * SCAN_GROUP_SIZE >= num_items) {
+        return;
+    }
+
+    uint idx = linear_group_index() * SCAN_GROUP_SIZE + gl_LocalInvocationIndex;
+    uint value = idx < num_items ? data[idx] : 0u;
+    uint prefix = group_exclusive_scan(value);
+
+    if (idx < num_items) {
+        data[idx] = prefix;
+    }
+
+    if (gl_LocalInvocationIndex == 0u) {
+        block_sums[linear_group_index()] = group_scan_total();
+    }
+}
+
+void scan_add_offsets() {
+    uint idx = linear_group_index() * SCAN_GROUP_SIZE + gl_LocalInvocationIndex;
+
+    if (idx < num_items) {
+        data[idx] += block_sums[linear_group_index()];
+    }
+}
+
+// One work group per segment, each invocation sums a strided part of it first
+void segmented_reduce() {
+    uint idx_segment = linear_group_index();
+
+    if (idx_segment >= num_segments) {
+        return;
+    }
+
+    uint sum = 0u;
+
+    for (uint idx = aux[idx_segment] + gl_LocalInvocationIndex; idx < aux[idx_segment + 1u]; idx += SCAN_GROUP_SIZE) {
+        sum += data[idx];
+    }
+
+    group_exclusive_scan(sum);
+
+    if (gl_LocalInvocationIndex == 0u) {
+        out_data[idx_segment] = group_scan_total();
+    }
+}
+
+// Counts in shared memory first, so the global atomics are one per bin and work group instead of one per value
+void histogram() {
+    for (uint bin = gl_LocalInvocationIndex; bin < num_bins; bin += SCAN_GROUP_SIZE) {
+        local_bins[bin] = 0u;
+    }
+
+    barrier();
+
+    uint idx = linear_group_index() * SCAN_GROUP_SIZE + gl_LocalInvocationIndex;
+
+    if (idx < num_items) {
+        atomicAdd(local_bins[(data[idx] >> bit_shift) & (num_bins - 1u)], 1u);
+    }
+
+    barrier();
+
+    for (uint bin = gl_LocalInvocationIndex; bin < num_bins; bin += SCAN_GROUP_SIZE) {
+        if (local_bins[bin] > 0u) {
+            atomicAdd(out_data[bin], local_bins[bin]);
+        }
+    }
+}
+
+void radix_count() {
+    uint idx_block = linear_group_index();
+    uint num_blocks = (num_items + SCAN_GROUP_SIZE - 1u) / SCAN_GROUP_SIZE;
+
+    if (idx_block >= num_blocks) {
+        return;
+    }
+
+    if (gl_LocalInvocationIndex < RADIX_NUM_DIGITS) {
+        local_bins[gl_LocalInvocationIndex] = 0u;
+    }
+
+    barrier();
+
+    uint idx = idx_block * SCAN_GROUP_SIZE + gl_LocalInvocationIndex;
+
+    if (idx < num_items) {
+        atomicAdd(local_bins[(data[idx] >> bit_shift) & (RADIX_NUM_DIGITS - 1u)], 1u);
+    }
+
+    barrier();
+
+    if (gl_LocalInvocationIndex < RADIX_NUM_DIGITS) {
+        counts[gl_LocalInvocationIndex * num_blocks + idx_block] = local_bins[gl_LocalInvocationIndex];
+    }
+}
+
+// Sorts the block by digit in shared memory with one stable split per bit, then writes each value to the start
+//  of its digit for this block (from the scanned counts) plus its rank within the digit. Stable, as LSD needs
+void radix_scatter() {
+    uint idx_block = linear_group_index();
+    uint num_blocks = (num_items + SCAN_GROUP_SIZE - 1u) / SCAN_GROUP_SIZE;
+    uint idx_local = gl_LocalInvocationIndex;
+    uint idx = idx_block * SCAN_GROUP_SIZE + idx_local;
+    bool is_valid = idx < num_items;
+
+    // Values past the end get the largest digit, and stay behind the real ones since the splits are stable
+    uint key = is_valid ? data[idx] : 0xFFFFFFFFu;
+    uint payload = is_valid ? aux[idx] : 0u;
+    uint digit = is_valid ? (key >> bit_shift) & (RADIX_NUM_DIGITS - 1u) : RADIX_NUM_DIGITS - 1u;
+    uint flags = is_valid ? 1u : 0u;
+
+    for (uint bit = 0u; bit < RADIX_BITS; bit++) {
+        bool is_zero = ((digit >> bit) & 1u) == 0u;
+        uint prefix_zeros = group_exclusive_scan(is_zero ? 1u : 0u);
+        uint num_zeros = group_scan_total();
+        uint pos = is_zero ? prefix_zeros : num_zeros + idx_local - prefix_zeros;
+
+        // The reads of the previous bit are all done, since the scan has barriers
+        local_keys[pos] = key;
+        local_payload[pos] = payload;
+        local_digits[pos] = (digit << 1) | flags;
+        barrier();
+        key = local_keys[idx_local];
+        payload = local_payload[idx_local];
+        digit = local_digits[idx_local] >> 1;
+        flags = local_digits[idx_local] & 1u;
+    }
+
+    // The block is sorted by digit now, so the first position of each digit is where it differs from the previous
+    if (idx_local < RADIX_NUM_DIGITS) {
+        digit_starts[idx_local] = SCAN_GROUP_SIZE;
+    }
+
+    barrier();
+
+    if (idx_local == 0u || (local_digits[idx_local - 1u] >> 1) != digit) {
+        digit_starts[digit] = idx_local;
+    }
+
+    barrier();
+
+    if (flags == 1u) {
+        uint pos = counts[digit * num_blocks + idx_block] + idx_local - digit_starts[digit];
+        out_data[pos] = key;
+        out_aux[pos] = payload;
+    }
+}
+
+void main()
+{
+    switch (action_id) {
+    case ACTION_SCAN_BLOCKS: scan_blocks(); break;
+    case ACTION_SCAN_ADD_OFFSETS: scan_add_offsets(); break;
+    case ACTION_SEGMENTED_REDUCE: segmented_reduce(); break;
+    case ACTION_HISTOGRAM: histogram(); break;
+    case ACTION_RADIX_COUNT: radix_count(); break;
+    case ACTION_RADIX_SCATTER: radix_scatter(); break;
+    }
+}
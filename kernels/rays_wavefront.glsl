@@ -0,0 +1,328 @@
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Renders the same image as rays.glsl, but as a wavefront: instead of one invocation following the ray of its
+//  pixel through all bounces, each stage is a pass over a queue of rays, so the invocations of a work group
+//  run the same code and rays that are done free their lanes for the next bounce. Every frame runs the actions
+//  in order, see rays_wavefront_render() in main.cpp:
+//   0: Generate a camera ray per pixel into the queue, and clear the image
+//   Per bounce:
+//   1: Intersect the queued rays with the scene, and count them per sort key and the hits for the statistics
+//   2: Turn the counts into where each key starts in the sorted queue, one invocation
+//   3: Copy the rays to the sorted queue, grouped by what they hit and their direction
+//   4: Shade: add the color of the hit (or the background) to the pixel, and queue the reflected ray
+//   5: With shadows, trace rays from the hits to the light and add the light that reaches them
+//   6: Make the reflected rays the next queue and size its indirect dispatch, one invocation
+//   7: Draw the crosshair
+//  A pixel has at most one ray in a queue, so the passes add to its color without atomics
+#define RAYS_GROUP_SIZE 256
+// Must be kept in sync with rays_num_sort_keys in main.cpp. 8 kinds of objects times 8 direction octants
+#define RAYS_NUM_SORT_KEYS 64
+
+layout(local_size_x = RAYS_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(rgba32f, binding = 0) uniform image2D imgOutput;
+layout(location = 0) uniform float t;
+layout(location = 1) uniform vec2 mouse_pos;
+layout(location = 2) uniform vec3 the_camera;
+layout(location = 3) uniform vec3 the_focus;
+layout(location = 4) uniform int w;
+layout(location = 5) uniform int h;
+layout(location = 6) uniform int num_bounces;			// 1 - RAYS_MAX_BOUNCES
+layout(location = 7) uniform int action_id;
+layout(location = 8) uniform int num_shadow_samples;	// Per hit. 0: No shadows
+layout(location = 9) uniform bool sort_rays;
+layout(location = 10) uniform uint seed;
+layout(location = 11) uniform uint frame_idx;
+
+// Must be kept in sync with rays_ray_size in main.cpp. Floats instead of vec3 so there is no padding.
+//  After the intersect pass, origin is the hit. After the shade pass, throughput is the light the hit adds to
+//  the pixel if nothing blocks the light
+struct Ray {
+	float origin[3];
+	uint pixel;				// x + y * w
+	float direction[3];
+	int object;				// What the ray hit: RAYS_MISS, RAYS_FLOOR or the index of a sphere
+	float throughput[3];	// How much of the color seen along the ray reaches the pixel
+	uint bounce;
+};
+
+// Must be kept in sync with Ray_counters in main.cpp. Also bound as the indirect dispatch buffer
+layout(std430, binding = 39) buffer layout_ray_counters
+{
+	uvec3 num_groups;		// Indirect dispatch over the queue, RAYS_GROUP_SIZE invocations per group
+	uint num_rays;
+	uint num_rays_next;		// Reflected rays queued by the shade pass
+	uint key_counts[RAYS_NUM_SORT_KEYS];
+	uint key_offsets[RAYS_NUM_SORT_KEYS];
+	// For the statistics, see Gpu_statistics in main.cpp. All rays in the queue are at the same bounce
+	uint bounce;
+	uint num_rays_per_bounce[RAYS_MAX_BOUNCES];
+	uint num_hits_per_bounce[RAYS_MAX_BOUNCES];
+};
+
+layout(std430, binding = 37) buffer layout_ray_queue
+{
+	Ray ray_queue[];
+};
+
+layout(std430, binding = 38) buffer layout_ray_queue_sorted
+{
+	Ray ray_queue_sorted[];
+};
+
+vec3 to_vec3(float v[3]) {
+	return vec3(v[0], v[1], v[2]);
+}
+
+float[3] from_vec3(vec3 v) {
+	return float[3](v.x, v.y, v.z);
+}
+
+// For 1D dispatches spread over x and y, see dispatch_compute_linear() in main.cpp
+uint rays_linear_index() {
+	return gl_GlobalInvocationID.x + gl_GlobalInvocationID.y * gl_NumWorkGroups.x * RAYS_GROUP_SIZE;
+}
+
+// Same split as dispatch_compute_linear()
+void set_num_groups(uint num_items) {
+	uint num_groups_total = max(1u, (num_items + RAYS_GROUP_SIZE - 1u) / RAYS_GROUP_SIZE);
+	num_groups.x = min(num_groups_total, 65535u);
+	num_groups.y = (num_groups_total + num_groups.x - 1u) / num_groups.x;
+	num_groups.z = 1u;
+}
+
+// Rays that hit the same kind of object in about the same direction run the same shading code and reflect
+//	into the same part of the scene, so neighbouring lanes stay in step
+uint sort_key(Ray ray) {
+	uint object_kind = ray.object < 0 ? uint(ray.object - RAYS_MISS) : 2u + uint(min(ray.object, 5));
+	uint octant = (ray.direction[0] < 0.0f ? 1u : 0u) | (ray.direction[1] < 0.0f ? 2u : 0u) | (ray.direction[2] < 0.0f ? 4u : 0u);
+
+	return object_kind * 8u + octant;
+}
+
+ivec2 pixel_coord(uint pixel) {
+	return ivec2(pixel % uint(w), pixel / uint(w));
+}
+
+void generate() {
+	uint idx = rays_linear_index();
+	uint num_pixels = uint(w * h);
+
+	if (idx == 0u) {
+		num_rays = num_pixels;
+		num_rays_next = 0u;
+		set_num_groups(num_pixels);
+		for (int idx_key = 0; idx_key < RAYS_NUM_SORT_KEYS; idx_key++) {
+			key_counts[idx_key] = 0u;
+		}
+		bounce = 0u;
+		for (int idx_bounce = 0; idx_bounce < RAYS_MAX_BOUNCES; idx_bounce++) {
+			num_rays_per_bounce[idx_bounce] = idx_bounce == 0 ? num_pixels : 0u;
+			num_hits_per_bounce[idx_bounce] = 0u;
+		}
+	}
+
+	if (idx >= num_pixels) {
+		return;
+	}
+
+	ivec2 texel_coord = pixel_coord(idx);
+	vec3 ray = rays_camera_ray(texel_coord, w, h, the_camera, the_focus);
+	ray_queue[idx] = Ray(from_vec3(the_camera), idx, from_vec3(ray), RAYS_MISS, float[3](1.0f, 1.0f, 1.0f), 0u);
+	imageStore(imgOutput, texel_coord, vec4(0, 0, 0, 1));
+}
+
+void intersect() {
+	uint idx = rays_linear_index();
+
+	if (idx >= num_rays) {
+		return;
+	}
+
+	Ray ray = ray_queue[idx];
+	Hit hit = rays_closest_hit(to_vec3(ray.origin), to_vec3(ray.direction));
+	ray.object = hit.object;
+	if (hit.object != RAYS_MISS) {
+		ray.origin = from_vec3(hit.point);
+	}
+	ray_queue[idx] = ray;
+
+	ivec2 texel_coord = pixel_coord(ray.pixel);
+	if (ray.bounce == 0u && hit.object >= 0 && texel_coord.y == (h - mouse_pos.y) && texel_coord.x == mouse_pos.x) {
+		shared_data.device_idx_selected_sphere = hit.object;
+	}
+
+	if (sort_rays) {
+		atomicAdd(key_counts[sort_key(ray)], 1u);
+	}
+
+	// One atomic per subgroup instead of one per hit
+	uint is_hit = hit.object != RAYS_MISS ? 1u : 0u;
+#ifdef GL_KHR_shader_subgroup_arithmetic
+	uint num_hits_subgroup = subgroupAdd(is_hit);
+	if (subgroupElect() && num_hits_subgroup > 0u) {
+		atomicAdd(num_hits_per_bounce[bounce], num_hits_subgroup);
+	}
+#else
+	if (is_hit != 0u) {
+		atomicAdd(num_hits_per_bounce[bounce], 1u);
+	}
+#endif
+}
+
+// There are only RAYS_NUM_SORT_KEYS counts, so one invocation is enough
+void sort_offsets() {
+	if (gl_LocalInvocationIndex != 0u) {
+		return;
+	}
+
+	uint offset = 0u;
+	for (int idx_key = 0; idx_key < RAYS_NUM_SORT_KEYS; idx_key++) {
+		key_offsets[idx_key] = offset;
+		offset += key_counts[idx_key];
+		key_counts[idx_key] = 0u;
+	}
+}
+
+// Counting sort. The order within a key depends on the timing, but does not change the image
+void scatter() {
+	uint idx = rays_linear_index();
+
+	if (idx >= num_rays) {
+		return;
+	}
+
+	Ray ray = ray_queue[idx];
+	uint idx_sorted = sort_rays ? atomicAdd(key_offsets[sort_key(ray)], 1u) : idx;
+	ray_queue_sorted[idx_sorted] = ray;
+}
+
+// The unsorted queue has been copied to the sorted one, so the reflected rays are queued in its place
+void shade() {
+	uint idx = rays_linear_index();
+
+	if (idx >= num_rays) {
+		return;
+	}
+
+	Ray ray = ray_queue_sorted[idx];
+	ivec2 texel_coord = pixel_coord(ray.pixel);
+	vec3 throughput = to_vec3(ray.throughput);
+	vec3 pixel_color = imageLoad(imgOutput, texel_coord).rgb;
+
+	if (ray.object == RAYS_MISS) {
+		imageStore(imgOutput, texel_coord, vec4(pixel_color + throughput * rays_background.rgb, 1));
+		return;
+	}
+
+	vec3 point = to_vec3(ray.origin);
+	vec3 direction = to_vec3(ray.direction);
+	// The last bounce is not reflected any further
+	bool is_last = int(ray.bounce) + 1 >= num_bounces;
+	float reflectivity = is_last ? 0.0f : rays_reflectivity;
+	vec3 color = throughput * (1.0f - reflectivity) * rays_hit_color(ray.object, point, direction, t).rgb;
+
+	if (num_shadow_samples > 0) {
+		ray_queue_sorted[idx].throughput = from_vec3(color);
+	}
+	else {
+		imageStore(imgOutput, texel_coord, vec4(pixel_color + color, 1));
+	}
+
+	if (!is_last) {
+		vec3 reflected = rays_reflect(ray.object, point, direction);
+		ray_queue[atomicAdd(num_rays_next, 1u)] = Ray(from_vec3(point + RAYS_EPSILON * reflected), ray.pixel, from_vec3(reflected),
+			RAYS_MISS, from_vec3(throughput * reflectivity), ray.bounce + 1u);
+	}
+}
+
+// Soft shadows: the share of the light that is visible from the hit, from random points on the light
+void shadow() {
+	uint idx = rays_linear_index();
+
+	if (idx >= num_rays) {
+		return;
+	}
+
+	Ray ray = ray_queue_sorted[idx];
+
+	if (ray.object == RAYS_MISS) {
+		return;
+	}
+
+	vec3 point = to_vec3(ray.origin);
+	vec3 normal = rays_normal(ray.object, point);
+	int num_visible = 0;
+
+	for (int idx_sample = 0; idx_sample < num_shadow_samples; idx_sample++) {
+		uvec4 counter = uvec4(ray.pixel, frame_idx, RANDOM_STREAM_RAYS_SHADOW, ray.bounce * uint(num_shadow_samples) + uint(idx_sample));
+		uvec4 r = philox4x32(counter, uvec2(seed, 0u));
+		vec3 target = rays_light_sample(vec4(random_to_float(r.x), random_to_float(r.y), random_to_float(r.z), random_to_float(r.w)));
+		// The light is behind the surface
+		if (dot(target - point, normal) <= 0.0f) {
+			continue;
+		}
+		if (!rays_is_occluded(point + RAYS_EPSILON * normal, target)) {
+			num_visible++;
+		}
+	}
+
+	float visibility = float(num_visible) / float(num_shadow_samples);
+	ivec2 texel_coord = pixel_coord(ray.pixel);
+	vec3 pixel_color = imageLoad(imgOutput, texel_coord).rgb + to_vec3(ray.throughput) * (rays_ambient + (1.0f - rays_ambient) * visibility);
+	imageStore(imgOutput, texel_coord, vec4(pixel_color, 1));
+}
+
+void next_bounce() {
+	if (gl_LocalInvocationIndex != 0u) {
+		return;
+	}
+
+	num_rays = num_rays_next;
+	num_rays_next = 0u;
+	set_num_groups(num_rays);
+	bounce++;
+	if (bounce < RAYS_MAX_BOUNCES) {
+		num_rays_per_bounce[bounce] = num_rays;
+	}
+}
+
+void draw_crosshair() {
+	uint idx = rays_linear_index();
+
+	if (idx >= uint(w * h)) {
+		return;
+	}
+
+	ivec2 texel_coord = pixel_coord(idx);
+	imageStore(imgOutput, texel_coord, rays_draw_crosshair(texel_coord, imageLoad(imgOutput, texel_coord), mouse_pos, h));
+}
+
+void main()
+{
+	switch (action_id) {
+	case 0:
+		generate();
+		break;
+	case 1:
+		intersect();
+		break;
+	case 2:
+		sort_offsets();
+		break;
+	case 3:
+		scatter();
+		break;
+	case 4:
+		shade();
+		break;
+	case 5:
+		shadow();
+		break;
+	case 6:
+		next_bounce();
+		break;
+	case 7:
+		draw_crosshair();
+		break;
+	}
+}
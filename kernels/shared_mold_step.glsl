@@ -0,0 +1,163 @@
+// The particle step of the mold scene (mold_compute.glsl), shared with the parameter sweeps (mold_sweep.glsl). Needs
+//  shared_mold_types.glsl before it. run is the simulation the particle belongs to, always 0 in the mold scene. The
+//  trail map is read and written through the functions declared below, which both kernels define for their own
+//  buffers
+#define PI 3.1415926535897932384626433832795f
+// Upper limit for the number of pixels along a trail segment, in case a particle jumps far
+#define MAX_LINE_STEPS 1024
+
+// Index of the first vec4 of the pixel in the trail map, or -1 if it has no trails. pos must be inside the world
+int mold_step_trail_index(int run, ivec2 pos);
+vec4 mold_step_trail(int idx);
+// How strongly mold_type is drawn to the trails of the four types in the layer. Positive attracts, negative repels
+vec4 mold_step_interaction(int run, int mold_type, int layer);
+// Weighted trail intensity around pos_center, usually mold_area_value()
+float mold_step_sense(int run, ivec2 pos_center, int r, int mold_type);
+// Leaves a trail of the given weight at pos, which can be outside the world
+void mold_step_deposit(int run, ivec2 pos, int mold_type, float weight);
+
+// Average trail intensity over the 2r x 2r area around pos_center, each type weighted by how mold_type reacts to it.
+//  The weighting is linear, so the area is summed per layer first and weighted once at the end
+float mold_area_value(int run, ivec2 pos_center, int r, int mold_type, ivec2 world_size, int num_layers) {
+    vec4 sums[MAX_LAYERS] = vec4[MAX_LAYERS](vec4(0), vec4(0), vec4(0), vec4(0));
+
+    int x_start = max(0, pos_center.x - r);
+    int x_end_exclusive = min(world_size.x - 1, pos_center.x + r);
+    int y_start = max(0, pos_center.y - r);
+    int y_end_exclusive = min(world_size.y - 1, pos_center.y + r);
+    int num_pixels = max(0, x_end_exclusive - x_start) * max(0, y_end_exclusive - y_start);
+
+    for (int y = y_start; y < y_end_exclusive; y++) {
+        for (int x = x_start; x < x_end_exclusive; x++) {
+            int idx_first = mold_step_trail_index(run, ivec2(x, y));
+            if (idx_first < 0) {
+                continue;
+            }
+            for (int layer = 0; layer < num_layers; layer++) {
+                sums[layer] += mold_step_trail(idx_first + layer);
+            }
+        }
+    }
+
+    float ret = 0;
+
+    for (int layer = 0; layer < num_layers; layer++) {
+        ret += dot(sums[layer], mold_step_interaction(run, mold_type, layer));
+    }
+
+    return ret / float(max(1, num_pixels));
+}
+
+// Senses the trails at three sensors ahead, turns towards the strongest attraction or away from the strongest
+//  repulsion, and moves forward. A particle that would leave the world stays where it is and takes a random
+//  angle instead. r are the random numbers of the particle for this step
+Mold_particle mold_move(Mold_particle particle, int run, ivec2 world_size, float sensor_distance, float speed_factor,
+    float t_step_ms, float steer_randomness, vec4 r) {
+    int search_radius_px = 5;
+
+    vec2 sensor_left = particle.pos + sensor_distance * vec2(cos(particle.angle + PI / 4.0f), sin(particle.angle + PI / 4.0f));
+    vec2 sensor_fwd = particle.pos + sensor_distance * vec2(cos(particle.angle), sin(particle.angle));
+    vec2 sensor_right = particle.pos + sensor_distance * vec2(cos(particle.angle - PI / 4.0f), sin(particle.angle - PI / 4.0f));
+
+    float val_left = mold_step_sense(run, ivec2(sensor_left), search_radius_px, particle.type);
+    float val_fwd = mold_step_sense(run, ivec2(sensor_fwd), search_radius_px, particle.type);
+    float val_right = mold_step_sense(run, ivec2(sensor_right), search_radius_px, particle.type);
+
+    float abs_left = abs(val_left);
+    float abs_right = abs(val_right);
+    float abs_fwd = abs(val_fwd);
+
+    bool rotate_left = false;
+    bool rotate_right = false;
+
+    if (abs_left > abs_right && abs_left > abs_fwd) {
+        rotate_left = val_left > 0;
+        rotate_right = !rotate_left;
+    }
+
+    if (abs_right > abs_left && abs_right > abs_fwd) {
+        rotate_right = val_right > 0;
+        rotate_left = !rotate_right;
+    }
+
+    // Repelling mold types ahead!
+    if (abs_fwd > abs_left && abs_fwd > abs_right && val_fwd < 0) {
+        rotate_left = val_left > val_right;
+        rotate_right = !rotate_left;
+    }
+
+    float factor_rotate = speed_factor * 2 * PI * 0.015f;
+
+    if (rotate_left) {
+        particle.angle += factor_rotate * t_step_ms;
+    }
+
+    if (rotate_right) {
+        particle.angle -= factor_rotate * t_step_ms;
+    }
+
+    if (steer_randomness > 0.0f) {
+        particle.angle += steer_randomness * (2.0f * r.y - 1.0f);
+    }
+
+    float factor_move = speed_factor * 0.1f;
+    vec2 pos_new = particle.pos + factor_move * t_step_ms * vec2(cos(particle.angle), sin(particle.angle));
+
+    // Either way the segment of the last step is done, so mold_extract() does not deposit it twice
+    particle.pos_last = particle.pos;
+    if (pos_new.x < 0 || pos_new.x >= world_size.x || pos_new.y < 0 || pos_new.y >= world_size.y) {
+        particle.angle = 2.0f * PI * r.x;
+    }
+    else {
+        particle.pos = pos_new;
+    }
+
+    particle.age++;
+    return particle;
+}
+
+// Draws the segment the particle moved during the last step, Xiaolin Wu style: one step per pixel along
+//  the major axis, with the coverage split between the two closest pixels across it. Nothing for a particle that
+//  did not move, eg. a new one or one that turned at a wall
+void mold_extract(int run, Mold_particle particle) {
+    if (particle.pos_last == particle.pos) {
+        return;
+    }
+
+    // Pixel centers are at .5
+    vec2 pos_start = particle.pos_last - 0.5f;
+    vec2 pos_end = particle.pos - 0.5f;
+    bool is_steep = abs(pos_end.y - pos_start.y) > abs(pos_end.x - pos_start.x);
+
+    if (is_steep) {
+        pos_start = pos_start.yx;
+        pos_end = pos_end.yx;
+    }
+
+    if (pos_start.x > pos_end.x) {
+        vec2 tmp = pos_start;
+        pos_start = pos_end;
+        pos_end = tmp;
+    }
+
+    vec2 d = pos_end - pos_start;
+    float gradient = d.x > 0.0f ? d.y / d.x : 0.0f;
+    int x_start = int(round(pos_start.x));
+    int x_end = min(int(round(pos_end.x)), x_start + MAX_LINE_STEPS);
+
+    for (int x = x_start; x <= x_end; x++) {
+        float y = pos_start.y + gradient * (float(x) - pos_start.x);
+        float y_floor = floor(y);
+        float coverage_upper = y - y_floor;
+        ivec2 pos_lower = ivec2(x, int(y_floor));
+        ivec2 pos_upper = ivec2(x, int(y_floor) + 1);
+
+        if (is_steep) {
+            pos_lower = pos_lower.yx;
+            pos_upper = pos_upper.yx;
+        }
+
+        mold_step_deposit(run, pos_lower, particle.type, 1.0f - coverage_upper);
+        mold_step_deposit(run, pos_upper, particle.type, coverage_upper);
+    }
+}
@@ -0,0 +1,24 @@
+// The number of mold types and their colors, for the kernels that step or draw the mold. MAX_TYPES must be kept in
+//  sync with max_num_mold_types in main.cpp
+#define MAX_TYPES 16
+// The trail map stores four types per vec4, so sensing all types at a pixel is num_layers vector loads
+#define MAX_LAYERS (MAX_TYPES / 4)
+
+const vec4 MOLD_TYPE_COLORS[MAX_TYPES] = vec4[MAX_TYPES](
+    vec4(0.0, 0.2, 0.3, 1.0),
+    vec4(0.3, 0.7, 0.0, 1.0),
+    vec4(0.7, 0.3, 0.0, 1.0),
+    vec4(0.6, 0.1, 0.6, 1.0),
+    vec4(0.1, 0.5, 0.7, 1.0),
+    vec4(0.7, 0.7, 0.1, 1.0),
+    vec4(0.7, 0.1, 0.2, 1.0),
+    vec4(0.1, 0.6, 0.4, 1.0),
+    vec4(0.4, 0.3, 0.7, 1.0),
+    vec4(0.7, 0.5, 0.4, 1.0),
+    vec4(0.2, 0.2, 0.7, 1.0),
+    vec4(0.5, 0.7, 0.5, 1.0),
+    vec4(0.7, 0.4, 0.0, 1.0),
+    vec4(0.3, 0.5, 0.2, 1.0),
+    vec4(0.6, 0.6, 0.6, 1.0),
+    vec4(0.7, 0.2, 0.5, 1.0)
+    );
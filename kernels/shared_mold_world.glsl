@@ -0,0 +1,52 @@
+// The mold world is split into MOLD_TILE_SIZE x MOLD_TILE_SIZE tiles, and only tiles close to particles have
+//  trail storage: a page from a fixed pool, found through mold_tiles. The trail map holds the pages back to back,
+//  so memory depends on the pool size and not on the size of the world. Must be kept in sync with main.cpp
+#define MOLD_TILE_SIZE 64
+#define MOLD_NO_PAGE -1
+// In mold_page_tiles, for pages released in this step that still have to be cleared
+#define MOLD_PAGE_RELEASED -2
+
+struct Mold_tile {
+    int page;               // MOLD_NO_PAGE if the tile is not resident
+    uint step_last_used;    // 1 + the last step a particle was close enough to sense or leave trails here. 0: Never
+};
+
+layout(std430, binding = 16) buffer layout_mold_tiles
+{
+    Mold_tile mold_tiles[];
+};
+
+// The tile each page belongs to, or a negative value for free pages
+layout(std430, binding = 18) buffer layout_mold_page_tiles
+{
+    int mold_page_tiles[];
+};
+
+// Index of the first vec4 of the pixel in the trail map, or -1 if its tile is not resident. pos must be inside the world
+int mold_trail_index(ivec2 pos, int num_tiles_x, int num_layers) {
+    ivec2 tile_coord = pos / MOLD_TILE_SIZE;
+    int page = mold_tiles[tile_coord.x + tile_coord.y * num_tiles_x].page;
+
+    if (page == MOLD_NO_PAGE) {
+        return -1;
+    }
+
+    ivec2 pos_page = pos - tile_coord * MOLD_TILE_SIZE;
+    return num_layers * (page * MOLD_TILE_SIZE * MOLD_TILE_SIZE + pos_page.x + pos_page.y * MOLD_TILE_SIZE);
+}
+
+// Linear index of the invocation, for dispatches over particles or tiles: 1D work groups spread over x and y,
+//  since there can be more than 65535 of them
+int mold_linear_index() {
+    uint idx_group = gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+    uint group_size = gl_WorkGroupSize.x * gl_WorkGroupSize.y;
+    return int(idx_group * group_size + gl_LocalInvocationIndex);
+}
+
+// For dispatches over the page pool: y is the page, x the work group within the page.
+//  Returns the pixel within the page
+ivec2 mold_page_texel() {
+    int groups_per_row = MOLD_TILE_SIZE / int(gl_WorkGroupSize.x);
+    ivec2 group_coord = ivec2(int(gl_WorkGroupID.x) % groups_per_row, int(gl_WorkGroupID.x) / groups_per_row);
+    return group_coord * ivec2(gl_WorkGroupSize.xy) + ivec2(gl_LocalInvocationID.xy);
+}
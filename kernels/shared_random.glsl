@@ -0,0 +1,37 @@
+// Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+//  There is no state: the same counter and key always give the same four numbers, so every invocation
+//  can draw its own numbers in any order. Must be kept in sync with philox4x32() in main.cpp.
+
+// The third counter word selects what the numbers are used for, so different uses never overlap
+#define RANDOM_STREAM_MOLD_INIT 0u
+#define RANDOM_STREAM_VORONOI_INIT 1u
+#define RANDOM_STREAM_MOLD_MOVE 2u
+#define RANDOM_STREAM_MOLD_SPAWN 3u
+#define RANDOM_STREAM_RAYS_SHADOW 6u
+
+uvec4 philox4x32(uvec4 counter, uvec2 key)
+{
+    for (int idx_round = 0; idx_round < 10; idx_round++) {
+        if (idx_round > 0) {
+            key += uvec2(0x9E3779B9u, 0xBB67AE85u);
+        }
+        uint hi0, lo0, hi1, lo1;
+        umulExtended(0xD2511F53u, counter.x, hi0, lo0);
+        umulExtended(0xCD9E8D57u, counter.z, hi1, lo1);
+        counter = uvec4(hi1 ^ counter.y ^ key.x, lo1, hi0 ^ counter.w ^ key.y, lo0);
+    }
+
+    return counter;
+}
+
+// [0, 1) from the upper 24 bits, which a float holds exactly. This gives the same result on the CPU
+float random_to_float(uint x)
+{
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+vec4 random_uniform4(uint seed, uint stream, uint idx, uint sub_idx)
+{
+    uvec4 r = philox4x32(uvec4(idx, sub_idx, stream, 0u), uvec2(seed, 0u));
+    return vec4(random_to_float(r.x), random_to_float(r.y), random_to_float(r.z), random_to_float(r.w));
+}
\ No newline at end of file
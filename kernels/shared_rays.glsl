@@ -0,0 +1,224 @@
+// The scene of rays.glsl and rays_wavefront.glsl: the spheres from the host over a floor of two triangles, lit by
+//  a round light. Both kernels use the same intersections and colors, so they render the same image
+#define PI 3.1415926538
+// Must be kept in sync with rays_max_bounces in main.cpp
+#define RAYS_MAX_BOUNCES 8
+#define RAYS_MAX_DISTANCE 10000.0f
+// Rays leaving a surface start this far from it, so they do not hit it again
+#define RAYS_EPSILON 0.001f
+// What a ray hit, or the index of a sphere
+#define RAYS_MISS -2
+#define RAYS_FLOOR -1
+
+struct Sphere {
+	float position[3];
+	float r;
+	float color[3];
+};
+
+struct Shared_data {
+	int host_idx_selected_sphere;
+	int device_idx_selected_sphere;
+};
+
+layout(std430, binding = 1) buffer layout_spheres
+{
+	Sphere spheres[];
+};
+layout(std430, binding = 2) buffer layout_shared_data
+{
+	Shared_data shared_data;
+};
+
+const vec4 rays_background = vec4(0.6, 0.5, 0.5, 1);
+const float rays_reflectivity = 0.5;	// Of every surface, 0 - 1
+const vec3 rays_light_center = vec3(-4, 14, -6);
+const float rays_light_radius = 2.0;
+const float rays_ambient = 0.35;		// Share of the light that reaches surfaces in shadow
+
+const vec3 the_vertices[4] = vec3[4](vec3(-10, 0, -10), vec3(-10, 0, 10), vec3(10, 0, 10), vec3(10, 0, -10));
+const ivec3 the_triangles[2] = ivec3[2](ivec3(0, 1, 2), ivec3(2, 3, 0));	// Indices of the_vertices
+
+struct Hit {
+	int object;			// RAYS_MISS, RAYS_FLOOR or the index of a sphere
+	float distance;		// Along the ray
+	vec3 point;
+};
+
+// Camera ray through the center of a pixel, with -1 <= x <= 1 on the render screen
+//	TODO: Something's a bit fishy with the rays. See this for ray generation: https://viterbi-web.usc.edu/~jbarbic/cs420-s21/15-ray-tracing/15-ray-tracing.pdf
+vec3 rays_camera_ray(ivec2 texel_coord, int w, int h, vec3 the_camera, vec3 the_focus) {
+	float fov_h = 90.0f;
+	// tan (fov_H/2) = opp/adj => adj = 1/tan(fov_H/2)
+	float dist_to_render_screen = 1.0f / tan(radians(fov_h / 2.0f));
+	vec3 the_up = vec3(0, 1, 0);
+	vec3 render_screen_x = normalize(cross(the_focus, the_up));
+	vec3 render_screen_y = normalize(cross(render_screen_x, the_focus));
+	vec3 render_screen_pixel = the_camera + dist_to_render_screen * the_focus + (2 * render_screen_x * (float(texel_coord.x) / w - 0.5f)) + (2 * render_screen_y * (float(texel_coord.y) / h - 0.5f));
+
+	return normalize(render_screen_pixel - the_camera);
+}
+
+// See https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm
+void hit_triangles(vec3 ray_start_pos, vec3 ray, inout Hit hit) {
+	for (int idx_triangle = 0; idx_triangle < the_triangles.length(); idx_triangle++) {
+		ivec3 current_triangle = the_triangles[idx_triangle];
+		const float EPSILON = 0.00001;
+		vec3 vertex0 = the_vertices[current_triangle.x];
+		vec3 vertex1 = the_vertices[current_triangle.y];
+		vec3 vertex2 = the_vertices[current_triangle.z];
+
+		vec3 edge1 = vertex1 - vertex0;
+		vec3 edge2 = vertex2 - vertex0;
+		vec3 h = cross(ray, edge2);
+		float a = dot(edge1, h);
+
+		if (a > -EPSILON && a < EPSILON) {
+			continue; // This ray is parallel to this triangle.
+		}
+
+		float f = 1.0 / a;
+		vec3 s = ray_start_pos - vertex0;
+		float u = f * dot(s, h);
+
+		if (u < 0.0 || u > 1.0) {
+			continue;
+		}
+
+		vec3 q = cross(s, edge1);
+		float v = f * dot(ray, q);
+
+		if (v < 0.0 || u + v > 1.0) {
+			continue;
+		}
+
+		float tt = f * dot(edge2, q);
+
+		if (tt > EPSILON && tt < hit.distance) {
+			hit.object = RAYS_FLOOR;
+			hit.distance = tt;
+			hit.point = ray_start_pos + ray * tt;
+		}
+	}
+}
+
+// The nearer intersection in front of the start, or the farther one for rays that start inside a sphere
+void hit_spheres(vec3 ray_start_pos, vec3 ray, inout Hit hit) {
+	for (int i = 0; i < spheres.length(); i++) {
+		vec3 sphere_pos = vec3(spheres[i].position[0], spheres[i].position[1], spheres[i].position[2]);
+		float sphere_rad = spheres[i].r;
+
+		vec3 oc = ray_start_pos - sphere_pos;
+		float a = dot(ray, ray);
+		float b = 2.f * dot(oc, ray);
+		float c = dot(oc, oc) - sphere_rad * sphere_rad;
+		float discriminant = b * b - 4 * a * c;
+
+		if (discriminant <= 0) {
+			continue;
+		}
+
+		float t = (-b - sqrt(discriminant)) / (2.0 * a);
+		if (t <= RAYS_EPSILON) {
+			t = (-b + sqrt(discriminant)) / (2.0 * a);
+		}
+
+		if (t > RAYS_EPSILON && t < hit.distance) {
+			hit.object = i;
+			hit.distance = t;
+			hit.point = ray_start_pos + t * ray;
+		}
+	}
+}
+
+// ray must be normalized
+Hit rays_closest_hit(vec3 ray_start_pos, vec3 ray) {
+	Hit hit = Hit(RAYS_MISS, RAYS_MAX_DISTANCE, vec3(0));
+
+	hit_triangles(ray_start_pos, ray, hit);
+	hit_spheres(ray_start_pos, ray, hit);
+
+	return hit;
+}
+
+vec3 rays_normal(int object, vec3 point) {
+	if (object == RAYS_FLOOR) {
+		return vec3(0, 1, 0);
+	}
+
+	return normalize(point - vec3(spheres[object].position[0], spheres[object].position[1], spheres[object].position[2]));
+}
+
+// Mirror direction of a ray that hit object at point
+vec3 rays_reflect(int object, vec3 point, vec3 ray) {
+	return normalize(reflect(ray, rays_normal(object, point)));
+}
+
+// Color of the object at point, seen along ray. t animates the floor and the highlight of the selected sphere
+vec4 rays_hit_color(int object, vec3 point, vec3 ray, float t) {
+	if (object == RAYS_FLOOR) {
+		vec4 pixel_color_side_one = vec4(0.8, 0.2, 0.05, 1);
+		vec4 pixel_color_side_two = vec4(0.9, 0.4, 0.7, 1);
+		vec4 pixel_color_band = vec4(1, 1, 1, 1);
+		float sin_val = sin(10.0f * (point.z / 10.0f + t));
+		float band_width = 1.0f;
+		vec4 color = pixel_color_side_one;
+
+		if (sin_val < point.x) {
+			color = pixel_color_side_two;
+		}
+		else if (sin_val < point.x + band_width) {
+			float mix_factor = (sin_val - point.x) / band_width; // 0 <= mix_factor <= 1
+			color = mix_factor * pixel_color_side_one + (1.0f - mix_factor) * pixel_color_side_two;
+			float mix_factor2 = 0.15f * (sin(5 * t) + 1.0f) + 0.7f;
+			color = mix_factor2 * color + (1 - mix_factor2) * pixel_color_band;
+		}
+
+		return color;
+	}
+
+	vec4 sphere_color = vec4(spheres[object].color[0], spheres[object].color[1], spheres[object].color[2], 1);
+	if (shared_data.host_idx_selected_sphere == object) {
+		sphere_color = vec4(0.7 * sphere_color.xyz + 0.3 * sin(3 * t) * vec3(1, 1, 1), 1);
+	}
+
+	// Darker towards the edge, where the surface turns away from the ray
+	vec3 v1 = rays_normal(object, point);
+	float angle = acos(clamp(dot(v1, ray), -1.0f, 1.0f));
+	float angle_normalized = 2.0f * (angle / 3.1415f - 0.5f);
+
+	return sphere_color * angle_normalized;
+}
+
+// A point on the surface of the light, from four uniform random numbers
+vec3 rays_light_sample(vec4 r) {
+	float z = 2.0f * r.x - 1.0f;
+	float phi = 2.0f * PI * r.y;
+	float radius_xy = sqrt(max(0.0f, 1.0f - z * z));
+
+	return rays_light_center + rays_light_radius * vec3(radius_xy * cos(phi), z, radius_xy * sin(phi));
+}
+
+bool rays_is_occluded(vec3 ray_start_pos, vec3 target) {
+	float the_distance = distance(ray_start_pos, target);
+	Hit hit = rays_closest_hit(ray_start_pos, (target - ray_start_pos) / the_distance);
+
+	return hit.object != RAYS_MISS && hit.distance < the_distance;
+}
+
+vec4 rays_draw_crosshair(vec2 texel_coord, vec4 pixel_color, vec2 mouse_pos, int h)
+{
+	float dx = abs(mouse_pos.x - texel_coord.x);
+	float dy = abs(h - mouse_pos.y - texel_coord.y);
+	float crosshair_width = 2;
+	float crosshair_height = 15;
+
+	if ((dx < crosshair_width && dy < crosshair_height) || (dx < crosshair_height && dy < crosshair_width))
+	{
+		pixel_color.x = 1;
+		pixel_color.y = 1;
+		pixel_color.z = 1;
+	}
+
+	return pixel_color;
+}
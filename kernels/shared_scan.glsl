@@ -0,0 +1,91 @@
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Prefix sums over 1D work groups of SCAN_GROUP_SIZE invocations. With subgroup operations, each subgroup
+//  scans in registers and only the subgroup totals go through shared memory, otherwise it is a work-efficient
+//  Blelloch scan in shared memory. The kernel has to use local_size_x = SCAN_GROUP_SIZE, a power of two
+#define SCAN_GROUP_SIZE 1024
+
+shared uint scan_buffer[SCAN_GROUP_SIZE];
+shared uint scan_total;
+
+// Must be called from all invocations in the work group. The sum over the whole group is available
+//  from group_scan_total() afterwards, until the next call
+uint group_exclusive_scan(uint value) {
+    uint idx = gl_LocalInvocationIndex;
+
+    // A previous call might still be reading the shared memory
+    barrier();
+
+#ifdef GL_KHR_shader_subgroup_arithmetic
+    uint prefix = subgroupExclusiveAdd(value);
+
+    if (gl_SubgroupInvocationID == gl_SubgroupSize - 1u) {
+        scan_buffer[gl_SubgroupID] = prefix + value;
+    }
+
+    barrier();
+
+    // The first subgroup scans the subgroup totals, in chunks if there are more of them than invocations in a subgroup
+    if (gl_SubgroupID == 0u) {
+        uint carry = 0u;
+        for (uint base = 0u; base < gl_NumSubgroups; base += gl_SubgroupSize) {
+            uint idx_sum = base + gl_SubgroupInvocationID;
+            uint sum = idx_sum < gl_NumSubgroups ? scan_buffer[idx_sum] : 0u;
+            uint prefix_sum = subgroupExclusiveAdd(sum);
+            if (idx_sum < gl_NumSubgroups) {
+                scan_buffer[idx_sum] = carry + prefix_sum;
+            }
+            carry += subgroupAdd(sum);
+        }
+        if (gl_SubgroupInvocationID == 0u) {
+            scan_total = carry;
+        }
+    }
+
+    barrier();
+
+    return scan_buffer[gl_SubgroupID] + prefix;
+#else
+    scan_buffer[idx] = value;
+    barrier();
+
+    // Up-sweep: sums of ever larger blocks, each at the last element of its block. The active invocations are
+    //  the first num_active ones, so whole subgroups drop out instead of leaving gaps
+    for (uint offset = 1u, num_active = SCAN_GROUP_SIZE / 2u; num_active > 0u; offset *= 2u, num_active /= 2u) {
+        if (idx < num_active) {
+            scan_buffer[offset * (2u * idx + 2u) - 1u] += scan_buffer[offset * (2u * idx + 1u) - 1u];
+        }
+        barrier();
+    }
+
+    if (idx == 0u) {
+        scan_total = scan_buffer[SCAN_GROUP_SIZE - 1u];
+        scan_buffer[SCAN_GROUP_SIZE - 1u] = 0u;
+    }
+
+    barrier();
+
+    // Down-sweep: each block passes its prefix to its left half, and its prefix plus the left half to its right half
+    for (uint offset = SCAN_GROUP_SIZE / 2u, num_active = 1u; offset > 0u; offset /= 2u, num_active *= 2u) {
+        if (idx < num_active) {
+            uint idx_left = offset * (2u * idx + 1u) - 1u;
+            uint idx_right = offset * (2u * idx + 2u) - 1u;
+            uint left = scan_buffer[idx_left];
+            scan_buffer[idx_left] = scan_buffer[idx_right];
+            scan_buffer[idx_right] += left;
+        }
+        barrier();
+    }
+
+    return scan_buffer[idx];
+#endif
+}
+
+uint group_scan_total() {
+    return scan_total;
+}
+
+// Index of the work group for 1D dispatches spread over x and y, see dispatch_compute_linear() in main.cpp
+uint linear_group_index() {
+    return gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x;
+}
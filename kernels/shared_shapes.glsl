@@ -17,4 +17,5 @@ struct Mold_particle {
     vec2 pos_last;
     float angle;
     int type;
+    uint age;   // Steps since the particle was spawned
 };
\ No newline at end of file
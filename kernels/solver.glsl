@@ -1,16 +1,282 @@
-layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
-layout(std430, binding = 0) buffer layoutName
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Iterative solvers for the Poisson problem -laplace(u) = f on the unit square, with u = 0 on the border. The
+//  unknowns are an n x n grid, row by row and without the border, with the 5-point stencil
+//  (4 u[i, j] - u[i - 1, j] - u[i + 1, j] - u[i, j - 1] - u[i, j + 1]) / h^2 = f[i, j] and h = 1 / (n + 1).
+//  The host functions in main.cpp (gpu_solver_iterate(), gpu_solver_check()) run the actions in order for
+//  Jacobi, red-black Gauss-Seidel, multigrid V-cycles and conjugate gradients. Solver_cpu in main.cpp does the
+//  same on the CPU and is used to validate them.
+// Must be kept in sync with solver_group_size and solver_num_groups in main.cpp
+#define SOLVER_GROUP_SIZE 256
+#define SOLVER_NUM_GROUPS 256
+
+#define ACTION_JACOBI 0
+#define ACTION_RED_BLACK 1
+#define ACTION_RESIDUAL 2
+#define ACTION_RESTRICT 3
+#define ACTION_PROLONG 4
+#define ACTION_MATVEC 5
+#define ACTION_DOT 6
+#define ACTION_DOT_SUM 7
+#define ACTION_CG_UPDATE_X 8
+#define ACTION_CG_UPDATE_P 9
+#define ACTION_RENDER 10
+#define ACTION_ERROR 11
+
+// Slots of the scalars. Must be kept in sync with Solver_scalar in main.cpp
+#define SCALAR_RR_EVEN 0    // r.r before even and odd CG iterations
+#define SCALAR_RR_ODD 1
+#define SCALAR_PQ 2         // p.Ap
+#define SCALAR_CHECK 3      // |b - Ax|^2 or |x - x_exact|^2, for the checks
+
+layout(local_size_x = SOLVER_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(rgba32f, binding = 0) uniform image2D img_output;
+layout(location = 0) uniform int action_id;
+layout(location = 1) uniform int n;             // Of the level the action runs on
+layout(location = 2) uniform float h_square;
+layout(location = 3) uniform int color;         // Red-black: 0 updates the cells with an even i + j, 1 the others
+layout(location = 4) uniform int scalar_slot;   // Where ACTION_DOT_SUM writes
+layout(location = 5) uniform int parity;        // CG: Number of the iteration % 2
+layout(location = 6) uniform int w;             // Render: size of the image
+layout(location = 7) uniform int h;
+layout(location = 8) uniform float value_scale; // Render: Values of about this size get the full color
+
+// What the buffers hold depends on the action:
+//  Jacobi:       x, b, out (next x)
+//  red-black:    x (in place), b
+//  residual:     x, b, out (b - Ax)
+//  restrict:     aux (residual of the finer level, 2n + 1 wide), b (of this level), x (zeroed)
+//  prolong:      aux (x of the coarser level, (n - 1) / 2 wide), x (corrected)
+//  matvec:       aux (p), out (Ap)
+//  dot:          aux, out, partials
+//  CG update x:  x, b (r), aux (p), out (Ap), scalars
+//  CG update p:  b (r), aux (p), scalars
+//  render:       x
+layout(std430, binding = 0) buffer layout_solver_x
 {
-    int data_SSBO [];
+    float x[];
 };
 
-void main()
+layout(std430, binding = 44) buffer layout_solver_b
+{
+    float b[];
+};
+
+layout(std430, binding = 45) buffer layout_solver_out
+{
+    float out_data[];
+};
+
+layout(std430, binding = 46) buffer layout_solver_aux
+{
+    float aux[];
+};
+
+layout(std430, binding = 47) buffer layout_solver_partials
+{
+    float partials[];   // One per work group of ACTION_DOT
+};
+
+layout(std430, binding = 48) buffer layout_solver_scalars
 {
-    ivec2 texelCoord = ivec2(gl_GlobalInvocationID.xy);
+    float scalars[];
+};
+
+shared float reduce_buffer[SOLVER_GROUP_SIZE];
+
+// Sum over the work group, in the first invocation. Must be called from all invocations
+float group_sum(float value) {
+    barrier();
+#ifdef GL_KHR_shader_subgroup_arithmetic
+    float sum = subgroupAdd(value);
+    if (subgroupElect()) {
+        reduce_buffer[gl_SubgroupID] = sum;
+    }
+    barrier();
+    float total = 0.0f;
+    if (gl_LocalInvocationIndex == 0u) {
+        for (uint idx = 0u; idx < gl_NumSubgroups; idx++) {
+            total += reduce_buffer[idx];
+        }
+    }
+    return total;
+#else
+    uint idx = gl_LocalInvocationIndex;
+    reduce_buffer[idx] = value;
+    barrier();
+    for (uint stride = SOLVER_GROUP_SIZE / 2u; stride > 0u; stride /= 2u) {
+        if (idx < stride) {
+            reduce_buffer[idx] += reduce_buffer[idx + stride];
+        }
+        barrier();
+    }
+    return reduce_buffer[0];
+#endif
+}
+
+// The actions over the cells are dispatched with dispatch_compute_linear() and skip the invocations past the end
+int cell_index() {
+    return int((gl_WorkGroupID.x + gl_WorkGroupID.y * gl_NumWorkGroups.x) * SOLVER_GROUP_SIZE + gl_LocalInvocationIndex);
+}
+
+// Sum of the 4 neighbours, with 0 on the border. Same order as solver_cpu_neighbours() in main.cpp
+float neighbours_x(int idx, int i, int j) {
+    return (i > 0 ? x[idx - 1] : 0.0f) + (i < n - 1 ? x[idx + 1] : 0.0f) + (j > 0 ? x[idx - n] : 0.0f) + (j < n - 1 ? x[idx + n] : 0.0f);
+}
+
+float neighbours_aux(int idx, int i, int j) {
+    return (i > 0 ? aux[idx - 1] : 0.0f) + (i < n - 1 ? aux[idx + 1] : 0.0f) + (j > 0 ? aux[idx - n] : 0.0f) + (j < n - 1 ? aux[idx + n] : 0.0f);
+}
+
+// Value of the coarser level in aux, which is 0 on its border
+float coarse_value(int i, int j) {
+    int n_coarse = (n - 1) / 2;
+    if (i < 0 || i >= n_coarse || j < 0 || j >= n_coarse) {
+        return 0.0f;
+    }
+    return aux[i + j * n_coarse];
+}
+
+void cell_action(int idx) {
+    int i = idx % n;
+    int j = idx / n;
 
-    // These few lines are what we use to try out the SSBO capability of compute shaders
-    if (texelCoord.x == 0 && texelCoord.y < 1000)
+    switch (action_id) {
+    case ACTION_JACOBI:
+        out_data[idx] = (h_square * b[idx] + neighbours_x(idx, i, j)) / 4.0f;
+        break;
+    case ACTION_RED_BLACK:
+        // The neighbours all have the other color, so the cells of one color can be updated in place at once
+        if (((i + j) & 1) == color) {
+            x[idx] = (h_square * b[idx] + neighbours_x(idx, i, j)) / 4.0f;
+        }
+        break;
+    case ACTION_RESIDUAL:
+        out_data[idx] = b[idx] - (4.0f * x[idx] - neighbours_x(idx, i, j)) / h_square;
+        break;
+    case ACTION_RESTRICT:
+    {
+        // Full weighting of the 3 x 3 fine cells around the one at the same place as this coarse cell
+        int n_fine = 2 * n + 1;
+        int idx_fine = (2 * i + 1) + (2 * j + 1) * n_fine;
+        float edges = aux[idx_fine - 1] + aux[idx_fine + 1] + aux[idx_fine - n_fine] + aux[idx_fine + n_fine];
+        float corners = aux[idx_fine - n_fine - 1] + aux[idx_fine - n_fine + 1] + aux[idx_fine + n_fine - 1] + aux[idx_fine + n_fine + 1];
+        b[idx] = (4.0f * aux[idx_fine] + 2.0f * edges + corners) / 16.0f;
+        x[idx] = 0.0f;
+    }
+    break;
+    case ACTION_PROLONG:
+    {
+        // Bilinear: fine cells with odd coordinates are at a coarse cell, the others between two or four
+        int i_coarse = (i - 1) / 2;
+        int j_coarse = (j - 1) / 2;
+        float correction;
+        if ((i & 1) == 1 && (j & 1) == 1) {
+            correction = coarse_value(i_coarse, j_coarse);
+        }
+        else if ((j & 1) == 1) {
+            correction = 0.5f * (coarse_value(i / 2 - 1, j_coarse) + coarse_value(i / 2, j_coarse));
+        }
+        else if ((i & 1) == 1) {
+            correction = 0.5f * (coarse_value(i_coarse, j / 2 - 1) + coarse_value(i_coarse, j / 2));
+        }
+        else {
+            correction = 0.25f * (coarse_value(i / 2 - 1, j / 2 - 1) + coarse_value(i / 2, j / 2 - 1) + coarse_value(i / 2 - 1, j / 2) + coarse_value(i / 2, j / 2));
+        }
+        x[idx] += correction;
+    }
+    break;
+    case ACTION_MATVEC:
+        out_data[idx] = (4.0f * aux[idx] - neighbours_aux(idx, i, j)) / h_square;
+        break;
+    case ACTION_CG_UPDATE_X:
+    {
+        float pq = scalars[SCALAR_PQ];
+        float alpha = pq != 0.0f ? scalars[SCALAR_RR_EVEN + parity] / pq : 0.0f;
+        x[idx] += alpha * aux[idx];
+        b[idx] -= alpha * out_data[idx];
+    }
+    break;
+    case ACTION_CG_UPDATE_P:
     {
-        data_SSBO[texelCoord.y] *= 2;
+        float rr = scalars[SCALAR_RR_EVEN + parity];
+        float beta = rr != 0.0f ? scalars[SCALAR_RR_EVEN + 1 - parity] / rr : 0.0f;
+        aux[idx] = b[idx] + beta * aux[idx];
+    }
+    break;
+    case ACTION_ERROR:
+        // aux is the exact solution
+        out_data[idx] = x[idx] - aux[idx];
+        break;
+    }
+}
+
+// Each of the SOLVER_NUM_GROUPS work groups adds up its part of aux . out
+void dot() {
+    uint num_cells = uint(n * n);
+    float sum = 0.0f;
+
+    for (uint idx = gl_WorkGroupID.x * SOLVER_GROUP_SIZE + gl_LocalInvocationIndex; idx < num_cells; idx += SOLVER_NUM_GROUPS * SOLVER_GROUP_SIZE) {
+        sum += aux[idx] * out_data[idx];
+    }
+
+    sum = group_sum(sum);
+    if (gl_LocalInvocationIndex == 0u) {
+        partials[gl_WorkGroupID.x] = sum;
+    }
+}
+
+// One work group
+void dot_sum() {
+    float sum = 0.0f;
+
+    for (uint idx = gl_LocalInvocationIndex; idx < SOLVER_NUM_GROUPS; idx += SOLVER_GROUP_SIZE) {
+        sum += partials[idx];
+    }
+
+    sum = group_sum(sum);
+    if (gl_LocalInvocationIndex == 0u) {
+        scalars[scalar_slot] = sum;
+    }
+}
+
+// Positive values red, negative blue, with a darker line every eighth of value_scale
+void render(int idx) {
+    ivec2 texel_coord = ivec2(idx % w, idx / w);
+    int i = min(n - 1, texel_coord.x * n / w);
+    int j = min(n - 1, texel_coord.y * n / h);
+    float value = x[i + j * n] / value_scale;
+    float t = tanh(abs(value));
+    vec3 background = vec3(0.05f, 0.05f, 0.1f);
+    vec3 pixel_color = mix(background, value > 0.0f ? vec3(1.0f, 0.45f, 0.1f) : vec3(0.1f, 0.5f, 1.0f), t);
+
+    if (fract(8.0f * abs(value)) < 0.08f) {
+        pixel_color *= 0.6f;
+    }
+
+    imageStore(img_output, texel_coord, vec4(pixel_color, 1.0f));
+}
+
+void main()
+{
+    int idx = cell_index();
+
+    switch (action_id) {
+    case ACTION_DOT:
+        dot();
+        break;
+    case ACTION_DOT_SUM:
+        dot_sum();
+        break;
+    case ACTION_RENDER:
+        if (idx < w * h) {
+            render(idx);
+        }
+        break;
+    default:
+        if (idx < n * n) {
+            cell_action(idx);
+        }
+        break;
     }
-}
\ No newline at end of file
+}
@@ -0,0 +1,234 @@
+#extension GL_KHR_shader_subgroup_arithmetic : enable
+
+// Aggregates of the simulations for the stats overlay, see Gpu_statistics in main.cpp. A fixed number of work
+//  groups loops over the items, each group reduces its part in registers and shared memory and writes one row
+//  of partial sums, and a single work group adds up the rows. There are no float atomics, and the result does
+//  not depend on the timing. The actions:
+//   0: Mold particles per type and trail intensity per type
+//   1: Physics kinetic energy and momentum
+//   2: Add up the rows of the actions that ran into layout_statistics, one work group
+// Must be kept in sync with max_num_mold_types in main.cpp
+#define MAX_TYPES 16
+// Must be kept in sync with statistics_group_size and statistics_num_groups in main.cpp
+#define STATISTICS_GROUP_SIZE 256
+#define STATISTICS_NUM_GROUPS 256
+// Offsets in a row of partial sums. Counts are uints, the rest floats stored as uint bits
+#define ROW_MOLD_POPULATION 0
+#define ROW_MOLD_TRAILS (ROW_MOLD_POPULATION + MAX_TYPES)
+#define ROW_KINETIC_ENERGY (ROW_MOLD_TRAILS + MAX_TYPES)
+#define ROW_MOMENTUM_X (ROW_KINETIC_ENERGY + 1)
+#define ROW_MOMENTUM_Y (ROW_MOMENTUM_X + 1)
+#define ROW_NUM_BODIES (ROW_MOMENTUM_Y + 1)
+#define ROW_SIZE (ROW_NUM_BODIES + 1)
+
+layout(local_size_x = STATISTICS_GROUP_SIZE, local_size_y = 1, local_size_z = 1) in;
+layout(location = 0) uniform int action_id;
+layout(location = 1) uniform int num_types;
+layout(location = 2) uniform int num_layers;
+layout(location = 3) uniform uint num_trail_pixels;   // In all pages of the pool
+layout(location = 4) uniform bool has_mold;          // Which rows action 2 adds up
+layout(location = 5) uniform bool has_physics;
+
+// Must be kept in sync with Mold_counters in main.cpp
+layout(std430, binding = 19) buffer layout_mold_counters
+{
+    uvec3 mold_num_groups;
+    uint num_alive;
+    uint num_alive_next;
+    uint num_spawned;
+    int num_free_slots;
+};
+
+layout(std430, binding = 7) buffer layout_mold_particles
+{
+    Mold_particle mold_particles[];
+};
+
+layout(std430, binding = 8) buffer layout_mold_intensity
+{
+    vec4 mold_intensity[];
+};
+
+layout(std430, binding = 21) buffer layout_mold_alive
+{
+    uint mold_alive[];
+};
+
+layout(std430, binding = 11) buffer layout_physics
+{
+    Physics physics[];
+};
+
+layout(std430, binding = 41) buffer layout_statistics_partials
+{
+    uint partials[];    // STATISTICS_NUM_GROUPS rows of ROW_SIZE
+};
+
+// Must be kept in sync with Statistics in main.cpp
+layout(std430, binding = 40) buffer layout_statistics
+{
+    uint mold_population[MAX_TYPES];
+    float mold_trail_total[MAX_TYPES];
+    float physics_kinetic_energy;
+    float physics_momentum[2];
+    uint physics_num_bodies;
+    // Filled in from the ray and mold counters by the host
+    uint rays_num_rays[8];
+    uint rays_num_hits[8];
+    uint mold_num_alive;
+    int mold_num_free_pages;
+};
+
+shared float reduce_buffer[STATISTICS_GROUP_SIZE];
+shared uint group_population[MAX_TYPES];
+
+// Sum over the work group, in the first invocation. Must be called from all invocations
+float group_sum(float value) {
+    barrier();
+#ifdef GL_KHR_shader_subgroup_arithmetic
+    float sum = subgroupAdd(value);
+    if (subgroupElect()) {
+        reduce_buffer[gl_SubgroupID] = sum;
+    }
+    barrier();
+    float total = 0.0f;
+    if (gl_LocalInvocationIndex == 0u) {
+        for (uint idx = 0u; idx < gl_NumSubgroups; idx++) {
+            total += reduce_buffer[idx];
+        }
+    }
+    return total;
+#else
+    uint idx = gl_LocalInvocationIndex;
+    reduce_buffer[idx] = value;
+    barrier();
+    for (uint stride = STATISTICS_GROUP_SIZE / 2u; stride > 0u; stride /= 2u) {
+        if (idx < stride) {
+            reduce_buffer[idx] += reduce_buffer[idx + stride];
+        }
+        barrier();
+    }
+    return reduce_buffer[0];
+#endif
+}
+
+uint row_index(int offset) {
+    return gl_WorkGroupID.x * ROW_SIZE + uint(offset);
+}
+
+void mold_statistics() {
+    uint idx_first = gl_WorkGroupID.x * STATISTICS_GROUP_SIZE + gl_LocalInvocationIndex;
+    uint stride = STATISTICS_NUM_GROUPS * STATISTICS_GROUP_SIZE;
+
+    if (gl_LocalInvocationIndex < MAX_TYPES) {
+        group_population[gl_LocalInvocationIndex] = 0u;
+    }
+    barrier();
+
+    for (uint idx = idx_first; idx < num_alive; idx += stride) {
+        atomicAdd(group_population[mold_particles[mold_alive[idx]].type], 1u);
+    }
+
+    // Free pages are skipped, they may still hold the trails of the tile they had before
+    vec4 trails[MAX_TYPES / 4];
+    for (int idx_layer = 0; idx_layer < MAX_TYPES / 4; idx_layer++) {
+        trails[idx_layer] = vec4(0);
+    }
+    for (uint idx_pixel = idx_first; idx_pixel < num_trail_pixels; idx_pixel += stride) {
+        if (mold_page_tiles[idx_pixel / (MOLD_TILE_SIZE * MOLD_TILE_SIZE)] < 0) {
+            continue;
+        }
+        for (int idx_layer = 0; idx_layer < num_layers; idx_layer++) {
+            trails[idx_layer] += mold_intensity[idx_pixel * uint(num_layers) + uint(idx_layer)];
+        }
+    }
+
+    for (int idx_type = 0; idx_type < num_types; idx_type++) {
+        float total = group_sum(trails[idx_type / 4][idx_type % 4]);
+        if (gl_LocalInvocationIndex == 0u) {
+            partials[row_index(ROW_MOLD_TRAILS + idx_type)] = floatBitsToUint(total);
+        }
+    }
+
+    barrier();
+    if (gl_LocalInvocationIndex < uint(num_types)) {
+        partials[row_index(ROW_MOLD_POPULATION + int(gl_LocalInvocationIndex))] = group_population[gl_LocalInvocationIndex];
+    }
+}
+
+void physics_statistics() {
+    uint idx_first = gl_WorkGroupID.x * STATISTICS_GROUP_SIZE + gl_LocalInvocationIndex;
+    uint stride = STATISTICS_NUM_GROUPS * STATISTICS_GROUP_SIZE;
+    uint num_bodies = uint(physics.length());
+    float kinetic_energy = 0.0f;
+    vec2 momentum = vec2(0);
+
+    for (uint idx = idx_first; idx < num_bodies; idx += stride) {
+        float dir_length = length(physics[idx].dir);
+        vec2 velocity = dir_length > 0.0f ? physics[idx].speed * physics[idx].dir / dir_length : vec2(0);
+        kinetic_energy += 0.5f * physics[idx].mass * dot(velocity, velocity);
+        momentum += physics[idx].mass * velocity;
+    }
+
+    kinetic_energy = group_sum(kinetic_energy);
+    momentum.x = group_sum(momentum.x);
+    momentum.y = group_sum(momentum.y);
+
+    if (gl_LocalInvocationIndex == 0u) {
+        partials[row_index(ROW_KINETIC_ENERGY)] = floatBitsToUint(kinetic_energy);
+        partials[row_index(ROW_MOMENTUM_X)] = floatBitsToUint(momentum.x);
+        partials[row_index(ROW_MOMENTUM_Y)] = floatBitsToUint(momentum.y);
+        partials[row_index(ROW_NUM_BODIES)] = gl_WorkGroupID.x == 0u ? num_bodies : 0u;
+    }
+}
+
+// One invocation per value of the row, adding it up over all rows. Rows of actions that did not run are skipped
+void add_rows() {
+    int offset = int(gl_LocalInvocationIndex);
+
+    if (offset >= ROW_SIZE) {
+        return;
+    }
+
+    int idx_type = offset < ROW_MOLD_TRAILS ? offset - ROW_MOLD_POPULATION : offset - ROW_MOLD_TRAILS;
+    bool is_used = offset < ROW_KINETIC_ENERGY ? has_mold && idx_type < num_types : has_physics;
+    uint count = 0u;
+    float sum = 0.0f;
+
+    for (uint idx_row = 0u; is_used && idx_row < STATISTICS_NUM_GROUPS; idx_row++) {
+        uint value = partials[idx_row * ROW_SIZE + uint(offset)];
+        count += value;
+        sum += uintBitsToFloat(value);
+    }
+
+    if (offset < ROW_MOLD_TRAILS) {
+        mold_population[idx_type] = count;
+    }
+    else if (offset < ROW_KINETIC_ENERGY) {
+        mold_trail_total[idx_type] = sum;
+    }
+    else if (offset == ROW_KINETIC_ENERGY) {
+        physics_kinetic_energy = sum;
+    }
+    else if (offset < ROW_NUM_BODIES) {
+        physics_momentum[offset - ROW_MOMENTUM_X] = sum;
+    }
+    else {
+        physics_num_bodies = count;
+    }
+}
+
+void main()
+{
+    switch (action_id) {
+    case 0:
+        mold_statistics();
+        break;
+    case 1:
+        physics_statistics();
+        break;
+    case 2:
+        add_rows();
+        break;
+    }
+}
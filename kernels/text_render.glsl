@@ -0,0 +1,55 @@
+struct Glyph_instance {
+    ivec2 pos;
+    int glyph;
+    int padding;
+    vec4 color;
+    vec4 background;
+};
+
+// One invocation per glyph pixel. The glyph index is taken from the z dimension, so
+//  the whole text batch for a frame is drawn with a single dispatch.
+layout(local_size_x = 8, local_size_y = 8, local_size_z = 1) in;
+layout(rgba32f, binding = 0) uniform image2D img_output;
+layout(binding = 1) uniform sampler2D font_atlas;
+layout(location = 0) uniform int char_width;
+layout(location = 1) uniform int char_height;
+layout(location = 2) uniform int num_chars_per_row;
+layout(location = 3) uniform int num_rows;
+layout(location = 4) uniform int num_glyphs;
+
+layout(std430, binding = 12) buffer layout_text_glyphs
+{
+    Glyph_instance glyphs[];
+};
+
+void main()
+{
+    ivec2 texel_glyph = ivec2(gl_GlobalInvocationID.xy);
+    int idx_glyph = int(gl_GlobalInvocationID.z);
+
+    if (idx_glyph >= num_glyphs || texel_glyph.x >= char_width || texel_glyph.y >= char_height) {
+        return;
+    }
+
+    Glyph_instance glyph = glyphs[idx_glyph];
+    ivec2 texel_coord = glyph.pos + texel_glyph;
+    ivec2 image_size = imageSize(img_output);
+
+    if (texel_coord.x < 0 || texel_coord.y < 0 || texel_coord.x >= image_size.x || texel_coord.y >= image_size.y) {
+        return;
+    }
+
+    // The atlas is stored bottom-up like the BMP it comes from, so the first character row is at the top
+    int char_row = glyph.glyph / num_chars_per_row;
+    int char_col = glyph.glyph - char_row * num_chars_per_row;
+    ivec2 atlas_coord = ivec2(char_col * char_width, (num_rows - 1 - char_row) * char_height) + texel_glyph;
+
+    // The font bitmap has white glyphs on a dark, blue-ish background. Only the near-white texels are part of the glyph
+    float coverage = step(0.85, texelFetch(font_atlas, atlas_coord, 0).r);
+
+    vec4 pixel_color = imageLoad(img_output, texel_coord);
+    pixel_color = mix(pixel_color, vec4(glyph.background.rgb, 1), glyph.background.a);
+    pixel_color = mix(pixel_color, vec4(glyph.color.rgb, 1), coverage * glyph.color.a);
+
+    imageStore(img_output, texel_coord, pixel_color);
+}
\ No newline at end of file
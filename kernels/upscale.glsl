@@ -0,0 +1,22 @@
+// Stretches a scene that was rendered at a lower resolution over the whole canvas, see Quality_governor in main.cpp.
+//  The scene is in the lower left corner of the scene texture
+layout(local_size_x = 16, local_size_y = 16, local_size_z = 1) in;
+layout(rgba32f, binding = 0) uniform image2D img_output;
+layout(binding = 4) uniform sampler2D scene;
+layout(location = 0) uniform vec2 scene_size;   // In pixels
+
+void main()
+{
+    ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
+    ivec2 image_size = imageSize(img_output);
+
+    if (texel_coord.x >= image_size.x || texel_coord.y >= image_size.y) {
+        return;
+    }
+
+    // Bilinear filtering, but never from the unused part of the texture
+    vec2 scene_coord = clamp((vec2(texel_coord) + 0.5) * scene_size / vec2(image_size), vec2(0.5), scene_size - 0.5);
+    vec3 color = texture(scene, scene_coord / vec2(textureSize(scene, 0))).rgb;
+
+    imageStore(img_output, texel_coord, vec4(color, 1.0));
+}
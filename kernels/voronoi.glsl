@@ -1,3 +1,17 @@
+// Renders the Voronoi scene in tiles of VORONOI_TILE_SIZE x VORONOI_TILE_SIZE pixels, one work group per tile in
+//  the list from the host, see Voronoi_dirty_tiles in main.cpp. The seed that owns each pixel is kept between
+//  frames, so only the tiles a moved seed can reach search the seeds again. The other tiles in the list, eg. under
+//  the text of the last frame or the toolbar, color their pixels from the owners they already have
+// Must be kept in sync with voronoi_tile_size in main.cpp
+#define VORONOI_TILE_SIZE 32
+// Must be kept in sync with voronoi_tile_resolve in main.cpp
+#define VORONOI_TILE_RESOLVE 0x80000000u
+// Must be kept in sync with voronoi_max_distance in main.cpp. Pixels this far from the edge of every seed in
+//  the blocks around them stay black
+#define VORONOI_MAX_DISTANCE 200.0f
+// Inside the circle of a seed, or out of reach of all of them
+#define VORONOI_NO_OWNER -1
+
 struct Block_id {
     int x;
     int y;
@@ -11,7 +25,7 @@ struct Toolbar_info {
     int border_height;
 };
 
-layout(local_size_x = 32, local_size_y = 32, local_size_z = 1) in;
+layout(local_size_x = VORONOI_TILE_SIZE, local_size_y = VORONOI_TILE_SIZE, local_size_z = 1) in;
 layout(rgba32f, binding = 0) uniform image2D img_output;
 layout(location = 0) uniform int block_size;
 layout(location = 1) uniform int w;
@@ -44,14 +58,69 @@ layout(std430, binding = 6) buffer layout_toolbar_pixels
     float toolbar_colors[];
 };
 
+// The seed that owns each pixel, or VORONOI_NO_OWNER. w x h, row by row
+layout(std430, binding = 42) buffer layout_owners
+{
+    int owners[];
+};
+
+// Index of the tile, row by row, with VORONOI_TILE_RESOLVE set if the owners of its pixels have to be found again
+layout(std430, binding = 43) buffer layout_dirty_tiles
+{
+    uint dirty_tiles[];
+};
+
+// The seed with the nearest edge among the seeds in the blocks around the pixel
+int find_owner(ivec2 texel_coord) {
+    int this_block_id_x = texel_coord.x / block_size;
+    int this_block_id_y = texel_coord.y / block_size;
+    int block_x_min = this_block_id_x - 1;
+    int block_x_max = this_block_id_x + 1;
+    int block_y_min = this_block_id_y - 1;
+    int block_y_max = this_block_id_y + 1;
+
+    float min_d = 1000000.0f;
+    float max_d = VORONOI_MAX_DISTANCE * VORONOI_MAX_DISTANCE;
+    int owner = VORONOI_NO_OWNER;
+
+    for (int i = 0; i < circles.length(); i++) {
+        if (block_ids[i].x >= block_x_min && block_ids[i].x <= block_x_max && block_ids[i].y >= block_y_min && block_ids[i].y <= block_y_max) {
+            vec2 v = texel_coord.xy - physics[i].pos;
+            float d = dot(v, v);
+            float outer_d = d - circles[i].r_square;
+            if (outer_d < 0.0f) {
+                return VORONOI_NO_OWNER;
+            }
+            if (outer_d > 0.0f && outer_d < min_d && outer_d < max_d) {
+                min_d = outer_d;
+                owner = i;
+            }
+        }
+    }
+
+    return owner;
+}
+
 void main()
 {
-    ivec2 texel_coord = ivec2(gl_GlobalInvocationID.xy);
-    if (texel_coord.x > w || texel_coord.y > h) {
+    uint tile = dirty_tiles[gl_WorkGroupID.x];
+    uint idx_tile = tile & ~VORONOI_TILE_RESOLVE;
+    uint num_tiles_x = uint(w + VORONOI_TILE_SIZE - 1) / VORONOI_TILE_SIZE;
+    ivec2 texel_coord = ivec2(idx_tile % num_tiles_x, idx_tile / num_tiles_x) * VORONOI_TILE_SIZE + ivec2(gl_LocalInvocationID.xy);
+
+    if (texel_coord.x >= w || texel_coord.y >= h) {
         return;
     }
 
-    vec4 pixel_color_scene = vec4(0, 0, 0, 1);
+    int idx_pixel = texel_coord.x + texel_coord.y * w;
+
+    // Found for every pixel, also under the toolbar, so the toolbar can move or turn transparent without a search
+    if ((tile & VORONOI_TILE_RESOLVE) != 0u) {
+        owners[idx_pixel] = find_owner(texel_coord);
+    }
+
+    int owner = owners[idx_pixel];
+    vec4 pixel_color_scene = owner == VORONOI_NO_OWNER ? vec4(0, 0, 0, 1) : vec4(circles[owner].color, 1);
     vec4 pixel_color_toolbar = vec4(0, 0, 0, 1);
 
     bool within_toolbar_x = (texel_coord.x >= toolbar_info.x && texel_coord.x < (toolbar_info.x + toolbar_info.w));
@@ -70,36 +139,6 @@ void main()
         pixel_color_toolbar = vec4(rr, gg, bb, 1);
     }
 
-    if(use_toolbar_alpha || !within_toolbar) {
-        int this_block_id_x = texel_coord.x / block_size;
-        int this_block_id_y = texel_coord.y / block_size;
-        int block_x_min = this_block_id_x - 1;
-        int block_x_max = this_block_id_x + 1;
-        int block_y_min = this_block_id_y - 1;
-        int block_y_max = this_block_id_y + 1;
-
-        float min_d = 1000000.0f;
-        float max_d = 200 * 200;
-
-        for (int i = 0; i < circles.length(); i++) {
-            if (block_ids[i].x >= block_x_min && block_ids[i].x <= block_x_max && block_ids[i].y >= block_y_min && block_ids[i].y <= block_y_max) {
-                vec2 v = texel_coord.xy - physics[i].pos;
-                float d = dot(v, v);
-                float outer_d = d - circles[i].r_square;
-                if (outer_d < 0.0f) {
-                    pixel_color_scene = vec4(0, 0, 0, 1);
-                    min_d = 0;
-                    break;
-                }
-                if (outer_d > 0.0f && outer_d < min_d && outer_d < max_d) {
-                    min_d = outer_d;
-                    vec3 the_color = circles[i].color;
-                    pixel_color_scene = vec4(the_color, 1);
-                }
-            }
-        }
-    }
-
     vec4 pixel_color = pixel_color_scene;
 
     if (within_toolbar) {
@@ -4,6 +4,18 @@
 #include <filesystem>
 #include <map>
 #include <fstream>
+#include <functional>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <queue>
+#include <cstdio>
+#include <chrono>
+#include <cstring>
+#include <cstddef>
 
 #include <glad/glad.h>
 #include <GLFW/glfw3.h>
@@ -11,6 +23,19 @@
 #include <glm/gtc/matrix_transform.hpp>
 #include <glm/gtc/type_ptr.hpp>
 
+// Platform headers go after GLFW, which has its own APIENTRY handling
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <csignal>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
 void framebuffer_size_callback(GLFWwindow* window, int width, int height);
 void renderQuad();
 
@@ -21,6 +46,15 @@ float t_last_frame = 0.0f; // time of last frame
 auto background_center = glm::vec2(500, 500);
 enum class Shaders { funky, rays, voronoi, solver, mold, physics };
 enum class Toolbar_control_type { button, slider, knob };
+// Must be kept in sync with the MOLD_INIT_* defines in mold_init.glsl
+enum class Mold_init_mode {
+	Random,
+	Ellipse,
+	Circle,
+	Seed_map	// Particles start on the bright pixels of an image, stretched to the window
+};
+// Must be kept in sync with the RANDOM_STREAM_* defines in shared_random.glsl
+enum class Random_stream { mold_init = 0, voronoi_init = 1, mold_move = 2, mold_spawn = 3, benchmark = 4, physics_init = 5, rays_shadow = 6 };
 
 Shaders shader = Shaders::mold;
 
@@ -63,11 +97,36 @@ struct Physics {
 	float mass;
 };
 
+// Must be kept in sync with Physics_scratch in physics_compute.glsl
+struct Physics_scratch {
+	alignas(8) float vel[2];
+	float t_body;
+	float t_event;
+	int32_t partner;
+	uint32_t walls;
+};
+
 struct Mold_particle {
 	alignas(8) float pos[2];
 	alignas(8) float pos_last[2];
 	float angle;
 	int type;
+	uint32_t age;
+};
+
+// Must be kept in sync with layout_mold_counters in mold_lifecycle.glsl. The first three values are
+//	the indirect dispatch arguments for the passes over the alive list
+struct Mold_counters {
+	uint32_t num_groups[3];
+	uint32_t num_alive;
+	uint32_t num_alive_next;
+	uint32_t num_spawned;
+	int32_t num_free_slots;
+};
+
+struct Mold_tile {
+	int page;
+	uint32_t step_last_used;
 };
 
 struct Block_id {
@@ -100,6 +159,21 @@ struct Toolbar_control {
 	int val_cur;
 };
 
+struct Glyph_instance {
+	int pos[2];
+	int glyph;
+	int padding;
+	alignas(16) float color[4];
+	float background[4];	// Alpha 0 leaves the pixels behind the glyph untouched
+};
+
+struct Font_info {
+	int char_width;
+	int char_height;
+	int num_chars_per_row;
+	int num_rows;
+};
+
 Key_info key_info[512] = {}; // GLFW_KEY_ESCAPE is 256 for some reason
 Mouse_button_info mouse_button_info[2] = {};
 Mouse_move_info mouse_move_info = {};
@@ -108,13 +182,426 @@ void log_error(std::string msg) {
 	std::cout << msg << std::endl;
 }
 
-void mouse_button_callback(GLFWwindow*, int button, int action, int)
-{
+// Must be kept in sync with MAX_TYPES in the mold kernels
+const int max_num_mold_types = 16;
+// Must be kept in sync with MOLD_TILE_SIZE in shared_mold_world.glsl
+const int mold_tile_size = 64;
+const int mold_no_page = -1;
+// Work groups in y are limited to 65535, and the passes over the page pool use one row per page
+const size_t max_num_mold_pages = 65535;
+// Must be kept in sync with RAYS_MAX_BOUNCES in shared_rays.glsl
+const int rays_max_bounces = 8;
+
+struct Options {
+	uint32_t seed = 0;				// --seed <n>: Seed for all random initialization
+	size_t num_mold_particles = 400000;	// --mold-particles <n>: Number of particles at the start
+	size_t mold_pool_size = 0;		// --mold-pool <n>: Max number of particles alive at the same time. At least --mold-particles
+	uint32_t mold_lifetime = 0;		// --mold-lifetime <n>: Particles die after this many steps. 0: Never
+	int num_mold_types = 3;			// --mold-types <n>: 1 - max_num_mold_types
+	int mold_world_width = 0;		// --mold-world <w>x<h>: Size of the mold world. 0: The window size
+	int mold_world_height = 0;
+	size_t mold_max_tiles = 0;		// --mold-max-tiles <n>: Number of tiles with trail storage. 0: Enough for four windows
+	std::filesystem::path mold_seed_map_path = {};	// --mold-seed-map <file>: Start the particles on the bright pixels of this BMP file
+	bool cpu_init = false;			// --cpu-init: Initialize particles on the CPU instead of in a compute shader
+	bool accumulate_trails = false;	// --accumulate-trails: Overlapping mold trails add up instead of overwriting each other
+	bool trail_texture = false;		// --trail-texture: Keep a mipmapped texture copy of the mold trails and sense from it
+	bool benchmark = false;			// --benchmark [name]: Run the benchmarks (all, or the one with the given name) instead of the app
+	std::string benchmark_name = {};
+	std::filesystem::path capture_directory = {};	// --capture <dir>: Save the frames as PPM files in this directory
+	std::string capture_pipe = {};	// --capture-pipe <command>: Write the frames as raw RGBA to the input of this command, eg. a video encoder
+	int capture_every = 1;			// --capture-every <n>: Only capture every nth frame
+	std::filesystem::path record_path = {};	// --record <file>: Record the input to the file, for --replay
+	std::filesystem::path replay_path = {};	// --replay <file>: Replay recorded input instead of the live input, then exit
+	bool hidden = false;			// --hidden: Do not show the window, eg. for replays on a machine without a display
+	bool release_inactive_scenes = false;	// --release-inactive-scenes: Delete the GPU buffers of a scene when switching away from it
+	size_t physics_cpu_bodies = 0;	// --physics-cpu [n]: Run the CPU physics on n bodies (default 1M) without a window or GPU, then exit
+	int physics_steps = 100;		// --physics-steps <n>: Number of steps for --physics-cpu
+	float frame_budget_ms = 0.0f;	// --frame-budget <ms>: Lower the resolution and mold steps per frame to keep the GPU time of the scene within this
+	size_t physics_ccd_bodies = 0;	// --physics-ccd [n]: Compare fixed steps and event-driven steps on n bodies (default 2000), then exit
+	size_t seed_grid_seeds = 0;		// --seed-grid [n]: Compare picking among n Voronoi seeds (default 1M) with the grid and a linear scan, then exit
+	// --sweep <dir>: Run many small mold simulations at once, one for every combination of the values below,
+	//	save a thumbnail of each in the directory, then exit. The lists are comma separated, eg. --sweep-speed 0.5,1,2
+	std::filesystem::path sweep_directory = {};
+	std::vector<float> sweep_speed_factors = { 1.0f };		// --sweep-speed <list>
+	std::vector<float> sweep_step_ms = { 20.0f };			// --sweep-step <list>: Step lengths in ms
+	std::vector<float> sweep_sensor_distances = { 10.0f };	// --sweep-sensor <list>: From a particle to its sensors, in pixels
+	std::vector<int> sweep_num_types = { 3 };				// --sweep-types <list>
+	int sweep_num_seeds = 1;				// --sweep-seeds <n>: Runs of each combination, with the seeds --seed, --seed + 1, ...
+	int sweep_num_steps = 500;				// --sweep-steps <n>
+	size_t sweep_num_particles = 20000;		// --sweep-particles <n>: Per run
+	int sweep_world_width = 256;			// --sweep-world <w>x<h>: Size of the world of each run
+	int sweep_world_height = 256;
+	size_t sweep_batch_size = 64;			// --sweep-batch <n>: Most runs in one dispatch
+	int rays_bounces = 3;					// --rays-bounces <n>: 1 - rays_max_bounces. 1: No reflections
+	int rays_shadow_samples = 4;			// --rays-shadows <n>: Samples of the light per hit for soft shadows. 0: No shadows
+	bool rays_megakernel = false;			// --rays-megakernel: Trace all bounces of a pixel in one invocation instead of the wavefront passes. No shadows
+	float soak_minutes = 0.0f;				// --soak <minutes>: Run for this long while logging the frame time and GPU memory, then report any drift
+	std::filesystem::path soak_log_path = "soak.csv";	// --soak-log <file>
+	std::filesystem::path stats_log_path = {};	// --stats-log <file>: Write the statistics of the scene computed on the GPU every frame, see Gpu_statistics
+};
+
+// Comma separated numbers, eg. "0.5,1,2". Throws like std::stof for invalid numbers
+std::vector<float> parse_number_list(const std::string& list) {
+	std::vector<float> values;
+	size_t idx_start = 0;
+
+	while (idx_start <= list.size()) {
+		auto idx_end = std::min(list.find(',', idx_start), list.size());
+		values.push_back(std::stof(list.substr(idx_start, idx_end - idx_start)));
+		idx_start = idx_end + 1;
+	}
+
+	return values;
+}
+
+bool parse_options(int argc, char* argv[], Options& options) {
+	for (int idx_arg = 1; idx_arg < argc; idx_arg++) {
+		std::string arg = argv[idx_arg];
+		bool has_value = idx_arg + 1 < argc;
+
+		try {
+			if (arg == "--seed" && has_value) {
+				options.seed = static_cast<uint32_t>(std::stoul(argv[++idx_arg]));
+			}
+			else if (arg == "--mold-particles" && has_value) {
+				options.num_mold_particles = std::stoull(argv[++idx_arg]);
+			}
+			else if (arg == "--mold-pool" && has_value) {
+				options.mold_pool_size = std::stoull(argv[++idx_arg]);
+			}
+			else if (arg == "--mold-lifetime" && has_value) {
+				options.mold_lifetime = static_cast<uint32_t>(std::stoul(argv[++idx_arg]));
+			}
+			else if (arg == "--mold-types" && has_value) {
+				options.num_mold_types = std::stoi(argv[++idx_arg]);
+				if (options.num_mold_types < 1 || options.num_mold_types > max_num_mold_types) {
+					log_error(std::format("--mold-types must be between 1 and {}", max_num_mold_types));
+					return false;
+				}
+			}
+			else if (arg == "--mold-world" && has_value) {
+				std::string size = argv[++idx_arg];
+				auto idx_x = size.find('x');
+				options.mold_world_width = std::stoi(size.substr(0, idx_x));
+				options.mold_world_height = idx_x == std::string::npos ? options.mold_world_width : std::stoi(size.substr(idx_x + 1));
+				if (options.mold_world_width < 1 || options.mold_world_height < 1) {
+					log_error("--mold-world must be a positive size");
+					return false;
+				}
+			}
+			else if (arg == "--mold-max-tiles" && has_value) {
+				options.mold_max_tiles = std::stoull(argv[++idx_arg]);
+			}
+			else if (arg == "--mold-seed-map" && has_value) {
+				options.mold_seed_map_path = argv[++idx_arg];
+			}
+			else if (arg == "--cpu-init") {
+				options.cpu_init = true;
+			}
+			else if (arg == "--accumulate-trails") {
+				options.accumulate_trails = true;
+			}
+			else if (arg == "--trail-texture") {
+				options.trail_texture = true;
+			}
+			else if (arg == "--capture" && has_value) {
+				options.capture_directory = argv[++idx_arg];
+			}
+			else if (arg == "--capture-pipe" && has_value) {
+				options.capture_pipe = argv[++idx_arg];
+			}
+			else if (arg == "--capture-every" && has_value) {
+				options.capture_every = std::stoi(argv[++idx_arg]);
+				if (options.capture_every < 1) {
+					log_error("--capture-every must be at least 1");
+					return false;
+				}
+			}
+			else if (arg == "--record" && has_value) {
+				options.record_path = argv[++idx_arg];
+			}
+			else if (arg == "--replay" && has_value) {
+				options.replay_path = argv[++idx_arg];
+			}
+			else if (arg == "--hidden") {
+				options.hidden = true;
+			}
+			else if (arg == "--release-inactive-scenes") {
+				options.release_inactive_scenes = true;
+			}
+			else if (arg == "--physics-cpu") {
+				options.physics_cpu_bodies = 1'000'000;
+				if (has_value && std::string(argv[idx_arg + 1]).substr(0, 2) != "--") {
+					options.physics_cpu_bodies = std::stoull(argv[++idx_arg]);
+				}
+				if (options.physics_cpu_bodies < 1) {
+					log_error("--physics-cpu needs at least one body");
+					return false;
+				}
+			}
+			else if (arg == "--physics-ccd") {
+				options.physics_ccd_bodies = 2000;
+				if (has_value && std::string(argv[idx_arg + 1]).substr(0, 2) != "--") {
+					options.physics_ccd_bodies = std::stoull(argv[++idx_arg]);
+				}
+				if (options.physics_ccd_bodies < 1) {
+					log_error("--physics-ccd needs at least one body");
+					return false;
+				}
+			}
+			else if (arg == "--seed-grid") {
+				options.seed_grid_seeds = 1'000'000;
+				if (has_value && std::string(argv[idx_arg + 1]).substr(0, 2) != "--") {
+					options.seed_grid_seeds = std::stoull(argv[++idx_arg]);
+				}
+				if (options.seed_grid_seeds < 1) {
+					log_error("--seed-grid needs at least one seed");
+					return false;
+				}
+			}
+			else if (arg == "--frame-budget" && has_value) {
+				options.frame_budget_ms = std::stof(argv[++idx_arg]);
+				if (options.frame_budget_ms <= 0.0f) {
+					log_error("--frame-budget must be a positive number of milliseconds");
+					return false;
+				}
+			}
+			else if (arg == "--physics-steps" && has_value) {
+				options.physics_steps = std::stoi(argv[++idx_arg]);
+				if (options.physics_steps < 1) {
+					log_error("--physics-steps must be at least 1");
+					return false;
+				}
+			}
+			else if (arg == "--sweep" && has_value) {
+				options.sweep_directory = argv[++idx_arg];
+			}
+			else if (arg == "--sweep-speed" && has_value) {
+				options.sweep_speed_factors = parse_number_list(argv[++idx_arg]);
+			}
+			else if (arg == "--sweep-step" && has_value) {
+				options.sweep_step_ms = parse_number_list(argv[++idx_arg]);
+			}
+			else if (arg == "--sweep-sensor" && has_value) {
+				options.sweep_sensor_distances = parse_number_list(argv[++idx_arg]);
+			}
+			else if (arg == "--sweep-types" && has_value) {
+				options.sweep_num_types.clear();
+				for (auto n : parse_number_list(argv[++idx_arg])) {
+					options.sweep_num_types.push_back(static_cast<int>(n));
+					if (n != options.sweep_num_types.back() || n < 1 || n > max_num_mold_types) {
+						log_error(std::format("--sweep-types must be whole numbers between 1 and {}", max_num_mold_types));
+						return false;
+					}
+				}
+			}
+			else if (arg == "--sweep-seeds" && has_value) {
+				options.sweep_num_seeds = std::stoi(argv[++idx_arg]);
+				if (options.sweep_num_seeds < 1) {
+					log_error("--sweep-seeds must be at least 1");
+					return false;
+				}
+			}
+			else if (arg == "--sweep-steps" && has_value) {
+				options.sweep_num_steps = std::stoi(argv[++idx_arg]);
+				if (options.sweep_num_steps < 1) {
+					log_error("--sweep-steps must be at least 1");
+					return false;
+				}
+			}
+			else if (arg == "--sweep-particles" && has_value) {
+				options.sweep_num_particles = std::stoull(argv[++idx_arg]);
+				if (options.sweep_num_particles < 1) {
+					log_error("--sweep-particles must be at least 1");
+					return false;
+				}
+			}
+			else if (arg == "--sweep-world" && has_value) {
+				std::string size = argv[++idx_arg];
+				auto idx_x = size.find('x');
+				options.sweep_world_width = std::stoi(size.substr(0, idx_x));
+				options.sweep_world_height = idx_x == std::string::npos ? options.sweep_world_width : std::stoi(size.substr(idx_x + 1));
+				if (options.sweep_world_width < 1 || options.sweep_world_height < 1) {
+					log_error("--sweep-world must be a positive size");
+					return false;
+				}
+			}
+			else if (arg == "--sweep-batch" && has_value) {
+				options.sweep_batch_size = std::stoull(argv[++idx_arg]);
+				if (options.sweep_batch_size < 1 || options.sweep_batch_size > 65535) {
+					log_error("--sweep-batch must be between 1 and 65535");
+					return false;
+				}
+			}
+			else if (arg == "--rays-bounces" && has_value) {
+				options.rays_bounces = std::stoi(argv[++idx_arg]);
+				if (options.rays_bounces < 1 || options.rays_bounces > rays_max_bounces) {
+					log_error(std::format("--rays-bounces must be 1 - {}", rays_max_bounces));
+					return false;
+				}
+			}
+			else if (arg == "--rays-shadows" && has_value) {
+				options.rays_shadow_samples = std::stoi(argv[++idx_arg]);
+				if (options.rays_shadow_samples < 0) {
+					log_error("--rays-shadows can not be negative");
+					return false;
+				}
+			}
+			else if (arg == "--rays-megakernel") {
+				options.rays_megakernel = true;
+			}
+			else if (arg == "--soak" && has_value) {
+				options.soak_minutes = std::stof(argv[++idx_arg]);
+				if (options.soak_minutes <= 0.0f) {
+					log_error("--soak must be a positive number of minutes");
+					return false;
+				}
+			}
+			else if (arg == "--soak-log" && has_value) {
+				options.soak_log_path = argv[++idx_arg];
+			}
+			else if (arg == "--stats-log" && has_value) {
+				options.stats_log_path = argv[++idx_arg];
+			}
+			else if (arg == "--benchmark") {
+				options.benchmark = true;
+				if (has_value && std::string(argv[idx_arg + 1]).substr(0, 2) != "--") {
+					options.benchmark_name = argv[++idx_arg];
+				}
+			}
+			else {
+				log_error(std::format("Unknown or incomplete argument '{}'", arg));
+				return false;
+			}
+		}
+		catch (const std::exception&) {
+			log_error(std::format("Invalid value for argument '{}'", arg));
+			return false;
+		}
+	}
+
+	return true;
+}
+
+// Philox4x32-10 counter-based random numbers (Salmon et al., "Parallel random numbers: as easy as 1, 2, 3").
+//	Must be kept in sync with shared_random.glsl, so the CPU and GPU draw the same numbers
+std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> counter, std::array<uint32_t, 2> key) {
+	for (int idx_round = 0; idx_round < 10; idx_round++) {
+		if (idx_round > 0) {
+			key[0] += 0x9E3779B9u;
+			key[1] += 0xBB67AE85u;
+		}
+		uint64_t product0 = uint64_t(0xD2511F53u) * counter[0];
+		uint64_t product1 = uint64_t(0xCD9E8D57u) * counter[2];
+		uint32_t hi0 = static_cast<uint32_t>(product0 >> 32);
+		uint32_t lo0 = static_cast<uint32_t>(product0);
+		uint32_t hi1 = static_cast<uint32_t>(product1 >> 32);
+		uint32_t lo1 = static_cast<uint32_t>(product1);
+		counter = { hi1 ^ counter[1] ^ key[0], lo1, hi0 ^ counter[3] ^ key[1], lo0 };
+	}
+
+	return counter;
+}
+
+// [0, 1) from the upper 24 bits, which a float holds exactly
+float random_to_float(uint32_t x) {
+	return (x >> 8) * (1.0f / 16777216.0f);
+}
+
+std::array<float, 4> random_uniform4(uint32_t seed, Random_stream stream, uint32_t idx, uint32_t sub_idx) {
+	auto r = philox4x32({ idx, sub_idx, static_cast<uint32_t>(stream), 0 }, { seed, 0 });
+
+	return { random_to_float(r[0]), random_to_float(r[1]), random_to_float(r[2]), random_to_float(r[3]) };
+}
+
+// Number of threads used by parallel_for() and the CPU primitives. 0: All hardware threads
+size_t cpu_max_threads = 0;
+
+size_t cpu_num_threads() {
+	return cpu_max_threads > 0 ? cpu_max_threads : std::max(1u, std::thread::hardware_concurrency());
+}
+
+// Runs fn(idx_start, idx_end) on cpu_num_threads() threads, each with its own contiguous range
+void parallel_for(size_t num_items, const std::function<void(size_t, size_t)>& fn) {
+	size_t num_threads = cpu_num_threads();
+	size_t items_per_thread = (num_items + num_threads - 1) / num_threads;
+	std::vector<std::thread> threads;
+
+	for (size_t idx_start = 0; idx_start < num_items; idx_start += items_per_thread) {
+		threads.emplace_back(fn, idx_start, std::min(num_items, idx_start + items_per_thread));
+	}
+
+	for (auto& thread : threads) {
+		thread.join();
+	}
+}
+
+// Input can be recorded to a file (--record) and replayed from it (--replay) instead of coming from GLFW.
+//	Every frame starts with a frame event holding the frame time, so the replay runs on the recorded clock and
+//	takes the same steps. Then come the cursor positions read during the frame, and the key, mouse button and
+//	mouse move events that arrived at the end of it, in order
+enum class Input_event_type : uint16_t { frame, key, mouse_button, mouse_move, cursor };
+
+struct Input_event {
+	Input_event_type type;
+	uint16_t action;	// Key and mouse button events
+	int32_t x;			// Key, mouse button, x position (float bits for the cursor), or the frame index
+	int32_t y;			// y position (float bits for the cursor), or the frame time (float bits)
+	uint32_t check;		// Frame: The mold step index at the start of the frame, to detect replays that diverge
+};
+
+const std::array<char, 8> input_recording_magic = { 'C', 'S', 'I', 'N', 'P', 'U', 'T', '2' };
+
+struct Input_recording_header {
+	std::array<char, 8> magic;
+	uint32_t seed;
+	uint32_t num_events;
+};
+
+struct Input_recording {
+	enum class Mode { live, record, replay };
+	Mode mode = Mode::live;
+	std::filesystem::path path;
+	uint32_t seed = 0;
+	std::vector<Input_event> events;	// Recorded so far, or to be replayed
+	size_t idx_next = 0;				// Next event to replay
+	uint32_t idx_frame = 0;				// Of the last input_begin_frame()
+	bool has_diverged = false;			// The replay ends at the next frame
+};
+
+Input_recording input_recording = {};
+
+int32_t input_float_bits(float value) {
+	int32_t bits = 0;
+	std::memcpy(&bits, &value, sizeof(float));
+	return bits;
+}
+
+float input_bits_float(int32_t bits) {
+	float value = 0.0f;
+	std::memcpy(&value, &bits, sizeof(float));
+	return value;
+}
+
+void input_replay_diverged(const std::string& reason) {
+	if (!input_recording.has_diverged) {
+		log_error(std::format("Replay diverged from the recording at frame {}: {}", input_recording.idx_frame, reason));
+	}
+	input_recording.has_diverged = true;
+}
+
+void input_record(Input_event_type type, int action, int x, int y, uint32_t check = 0) {
+	if (input_recording.mode == Input_recording::Mode::record) {
+		input_recording.events.push_back({ type, static_cast<uint16_t>(action), x, y, check });
+	}
+}
+
+void mouse_button_apply(int button, int action) {
 	enum class Mouse_actions { up, down };
 
 	auto num_allocated_buttons = sizeof(mouse_button_info) / sizeof(Mouse_button_info);
 
-	if (button >= num_allocated_buttons) {
+	if (button < 0 || button >= num_allocated_buttons) {
 		return;
 	}
 
@@ -129,18 +616,18 @@ void mouse_button_callback(GLFWwindow*, int button, int action, int)
 	}
 }
 
-void mouse_move_callback(GLFWwindow*, double xpos, double ypos) {
-	mouse_move_info.new_x = static_cast<int>(xpos);
-	mouse_move_info.new_y = static_cast<int>(ypos);
+void mouse_move_apply(int x, int y) {
+	mouse_move_info.new_x = x;
+	mouse_move_info.new_y = y;
 	mouse_move_info.has_been_read = false;
 }
 
-void key_callback(GLFWwindow*, int key, int, int action, int) {
+void key_apply(int key, int action) {
 	enum class Key_actions { up, down, holding };
 
 	auto num_allocated_keys = sizeof(key_info) / sizeof(Key_info);
 
-	if (key >= num_allocated_keys) {
+	if (key < 0 || key >= num_allocated_keys) {
 		return;
 	}
 
@@ -155,341 +642,4448 @@ void key_callback(GLFWwindow*, int key, int, int action, int) {
 	}
 }
 
-bool read_file_binary(std::filesystem::path& path, std::vector<char>& data) {
-	std::ifstream file(path, std::ios::binary | std::ios::ate);
+// While replaying, the live input is ignored
+void mouse_button_callback(GLFWwindow*, int button, int action, int)
+{
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		input_record(Input_event_type::mouse_button, action, button, 0);
+		mouse_button_apply(button, action);
+	}
+}
 
-	if (!file.is_open()) {
-		log_error(std::format("Could not read file ''", path.string()));
-		return false;
+void mouse_move_callback(GLFWwindow*, double xpos, double ypos) {
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		input_record(Input_event_type::mouse_move, 0, static_cast<int>(xpos), static_cast<int>(ypos));
+		mouse_move_apply(static_cast<int>(xpos), static_cast<int>(ypos));
+	}
+}
+
+void key_callback(GLFWwindow*, int key, int, int action, int) {
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		input_record(Input_event_type::key, action, key, 0);
+		key_apply(key, action);
 	}
+}
+
+bool input_record_start(const std::filesystem::path& path, uint32_t seed) {
+	input_recording = {};
+	input_recording.mode = Input_recording::Mode::record;
+	input_recording.path = path;
+	input_recording.seed = seed;
 
-	std::streamsize size = file.tellg();
-	file.seekg(0, std::ios::beg);
+	return true;
+}
 
-	data = std::vector<char>(size);
+// The recording is kept in memory and written when it ends, so recording costs nothing during the frames
+bool input_record_stop() {
+	if (input_recording.mode != Input_recording::Mode::record) {
+		return true;
+	}
 
-	auto success = false;
+	Input_recording_header header = { input_recording_magic, input_recording.seed, static_cast<uint32_t>(input_recording.events.size()) };
+	std::ofstream file(input_recording.path, std::ios::binary);
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+	file.write(reinterpret_cast<const char*>(input_recording.events.data()), sizeof(Input_event) * input_recording.events.size());
+	input_recording.mode = Input_recording::Mode::live;
 
-	if (file.read(data.data(), size)) {
-		success = true;
+	if (!file) {
+		log_error(std::format("Could not write input recording '{}'", input_recording.path.string()));
+		return false;
 	}
 
-	return success;
-}
+	std::cout << std::format("Recorded {} input events to '{}'", header.num_events, input_recording.path.string()) << std::endl;
 
-struct Bmp_file {
-	// TODO: Parse complete BMP header
-	int width;
-	int height;
-	std::vector<unsigned char> data;
-};
+	return true;
+}
 
-Bmp_file read_bmp(std::filesystem::path& filename) {
-	std::vector<char> data = { };
+bool input_replay_start(const std::filesystem::path& path, uint32_t seed) {
+	input_recording = {};
+	std::ifstream file(path, std::ios::binary);
+	Input_recording_header header = {};
 
-	read_file_binary(filename, data);
+	if (!file.read(reinterpret_cast<char*>(&header), sizeof(header)) || header.magic != input_recording_magic) {
+		log_error(std::format("Could not read input recording '{}'", path.string()));
+		return false;
+	}
 
-	int width = *(int*)&data[18];
-	int height = *(int*)&data[22];
+	if (header.seed != seed) {
+		log_error(std::format("Input recording '{}' was made with --seed {}, so the replay would diverge", path.string(), header.seed));
+		return false;
+	}
 
-	auto header_size = 54;
+	// Checked before allocating, a broken header could ask for gigabytes
+	std::error_code error;
+	auto file_size = std::filesystem::file_size(path, error);
+	if (error || (file_size - sizeof(header)) / sizeof(Input_event) < header.num_events) {
+		log_error(std::format("Input recording '{}' is truncated", path.string()));
+		return false;
+	}
 
-	Bmp_file ret = {};
-	ret.width = width;
-	ret.height = height;
-	ret.data = std::vector<unsigned char>(data.begin() + header_size, data.end());
+	input_recording.events.resize(header.num_events);
 
-	return ret;
-}
+	if (!file.read(reinterpret_cast<char*>(input_recording.events.data()), sizeof(Input_event) * header.num_events)) {
+		log_error(std::format("Input recording '{}' is truncated", path.string()));
+		return false;
+	}
 
-bool setup_window(int width, int height, std::string title, GLFWwindow*& window) {
-	glfwInit();
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
-	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+	input_recording.mode = Input_recording::Mode::replay;
+	input_recording.path = path;
+	input_recording.seed = seed;
 
-#ifdef __APPLE__
-	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-#endif
+	return true;
+}
 
-	window = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
+bool input_replay_next(Input_event_type type, Input_event& event) {
+	auto& events = input_recording.events;
 
-	if (window == nullptr) {
-		std::cout << "Failed to create GLFW window" << std::endl;
-		glfwTerminate();
+	if (input_recording.idx_next >= events.size() || events[input_recording.idx_next].type != type) {
 		return false;
 	}
 
-	glfwMakeContextCurrent(window);
-	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
-	glfwSwapInterval(0);
+	event = events[input_recording.idx_next++];
 
 	return true;
 }
 
-bool load_opengl() {
-	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
-		log_error("Failed to initialize GLAD");
+// Gives the time of the frame: the real one, or the recorded one when replaying. Returns false when the replay
+//	has ended or diverged from the recording, and the main loop then exits
+bool input_begin_frame(float& t_frame, uint32_t idx_frame, uint32_t check) {
+	if (input_recording.mode == Input_recording::Mode::record) {
+		input_record(Input_event_type::frame, 0, static_cast<int>(idx_frame), input_float_bits(t_frame), check);
+	}
+
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		return true;
+	}
+
+	Input_event event = {};
+
+	if (input_recording.has_diverged || !input_replay_next(Input_event_type::frame, event)) {
+		input_recording.mode = Input_recording::Mode::live;
 		return false;
 	}
 
+	input_recording.idx_frame = idx_frame;
+	if (event.check != check || event.x != static_cast<int>(idx_frame)) {
+		input_replay_diverged("different frame or mold step");
+		input_recording.mode = Input_recording::Mode::live;
+		return false;
+	}
+
+	t_frame = input_bits_float(event.y);
+
 	return true;
 }
 
-void print_gl_info() {
-	int max_compute_work_group_count[3];
-	int max_compute_work_group_size[3];
-	int max_compute_work_group_invocations;
+// Applies the replayed events that arrived after the frame, like glfwPollEvents() does for live input
+void input_end_frame() {
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		return;
+	}
 
-	for (int idx = 0; idx < 3; idx++) {
-		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, idx, &max_compute_work_group_count[idx]);
-		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, idx, &max_compute_work_group_size[idx]);
+	auto& events = input_recording.events;
+
+	while (input_recording.idx_next < events.size() && events[input_recording.idx_next].type != Input_event_type::frame) {
+		auto& event = events[input_recording.idx_next++];
+		switch (event.type) {
+		case Input_event_type::key: key_apply(event.x, event.action); break;
+		case Input_event_type::mouse_button: mouse_button_apply(event.x, event.action); break;
+		case Input_event_type::mouse_move: mouse_move_apply(event.x, event.y); break;
+		case Input_event_type::cursor: input_replay_diverged("the frame read the cursor fewer times"); break;
+		default: break;
+		}
 	}
-	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_compute_work_group_invocations);
+}
 
-	std::cout << "OpenGL Limitations: " << std::endl;
-	std::cout << "maximum number of work groups in X dimension " << max_compute_work_group_count[0] << std::endl;
-	std::cout << "maximum number of work groups in Y dimension " << max_compute_work_group_count[1] << std::endl;
-	std::cout << "maximum number of work groups in Z dimension " << max_compute_work_group_count[2] << std::endl;
+// glfwGetCursorPos(), recorded or replayed. Rounded to float in every mode, so the recording holds exactly the
+//	position the frame used
+void input_cursor_pos(GLFWwindow* window, double* xpos, double* ypos) {
+	Input_event event = {};
 
-	std::cout << "maximum size of a work group in X dimension " << max_compute_work_group_size[0] << std::endl;
-	std::cout << "maximum size of a work group in Y dimension " << max_compute_work_group_size[1] << std::endl;
-	std::cout << "maximum size of a work group in Z dimension " << max_compute_work_group_size[2] << std::endl;
+	if (input_recording.mode == Input_recording::Mode::replay) {
+		if (input_replay_next(Input_event_type::cursor, event)) {
+			*xpos = input_bits_float(event.x);
+			*ypos = input_bits_float(event.y);
+			return;
+		}
+		// Keeps the frame going on the live cursor, the replay ends at the next one
+		input_replay_diverged("the frame read the cursor more times");
+	}
 
-	std::cout << "Number of invocations in a single local work group that may be dispatched to a compute shader " << max_compute_work_group_invocations << std::endl;
+	glfwGetCursorPos(window, xpos, ypos);
+	*xpos = static_cast<float>(*xpos);
+	*ypos = static_cast<float>(*ypos);
+	input_record(Input_event_type::cursor, 0, input_float_bits(static_cast<float>(*xpos)), input_float_bits(static_cast<float>(*ypos)));
 }
 
-bool file_read(std::filesystem::path& path, std::string& s) {
-	std::ifstream t(path);
+// glfwSetCursorPos(), except when replaying, where the recording already has the resulting mouse move event
+void input_set_cursor_pos(GLFWwindow* window, double xpos, double ypos) {
+	if (input_recording.mode != Input_recording::Mode::replay) {
+		glfwSetCursorPos(window, xpos, ypos);
+	}
+}
 
-	if (!t.is_open()) {
+// A read-only view of a whole file. The OS pages the data in on demand, so nothing is copied
+//	until the data is actually used (eg. by the driver during a texture upload)
+struct Mapped_file {
+	const unsigned char* data = nullptr;
+	size_t size = 0;
+#ifdef _WIN32
+	HANDLE file_handle = INVALID_HANDLE_VALUE;
+	HANDLE mapping_handle = nullptr;
+#endif
+};
+
+void mapped_file_close(Mapped_file& file) {
+#ifdef _WIN32
+	if (file.data != nullptr) {
+		UnmapViewOfFile(file.data);
+	}
+	if (file.mapping_handle != nullptr) {
+		CloseHandle(file.mapping_handle);
+	}
+	if (file.file_handle != INVALID_HANDLE_VALUE) {
+		CloseHandle(file.file_handle);
+	}
+#else
+	if (file.data != nullptr) {
+		munmap(const_cast<unsigned char*>(file.data), file.size);
+	}
+#endif
+	file = {};
+}
+
+bool mapped_file_open(const std::filesystem::path& path, Mapped_file& file) {
+	file = {};
+
+#ifdef _WIN32
+	file.file_handle = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+
+	if (file.file_handle == INVALID_HANDLE_VALUE) {
+		log_error(std::format("Could not open file '{}'", path.string()));
 		return false;
 	}
 
-	std::stringstream ss;
-	ss << t.rdbuf();
+	LARGE_INTEGER file_size = {};
 
-	s = ss.str();
+	if (!GetFileSizeEx(file.file_handle, &file_size) || file_size.QuadPart == 0) {
+		log_error(std::format("Could not get size of file '{}'", path.string()));
+		mapped_file_close(file);
+		return false;
+	}
 
-	return true;
-}
+	file.size = static_cast<size_t>(file_size.QuadPart);
+	file.mapping_handle = CreateFileMappingW(file.file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
 
-bool has_linker_error(GLuint id_shader, std::string& msg) {
-	const int max_size_log_message = 1024;
-	GLint success;
-	GLchar log_message[max_size_log_message];
+	if (file.mapping_handle == nullptr) {
+		log_error(std::format("Could not map file '{}'", path.string()));
+		mapped_file_close(file);
+		return false;
+	}
+
+	file.data = static_cast<const unsigned char*>(MapViewOfFile(file.mapping_handle, FILE_MAP_READ, 0, 0, 0));
+#else
+	int fd = open(path.c_str(), O_RDONLY);
+
+	if (fd < 0) {
+		log_error(std::format("Could not open file '{}'", path.string()));
+		return false;
+	}
+
+	struct stat file_stat = {};
+
+	if (fstat(fd, &file_stat) != 0 || file_stat.st_size == 0) {
+		log_error(std::format("Could not get size of file '{}'", path.string()));
+		close(fd);
+		return false;
+	}
+
+	file.size = static_cast<size_t>(file_stat.st_size);
+	void* mapped = mmap(nullptr, file.size, PROT_READ, MAP_PRIVATE, fd, 0);
+	// The mapping stays valid after the descriptor is closed
+	close(fd);
+
+	if (mapped != MAP_FAILED) {
+		file.data = static_cast<const unsigned char*>(mapped);
+	}
+#endif
+
+	if (file.data == nullptr) {
+		log_error(std::format("Could not map file '{}'", path.string()));
+		mapped_file_close(file);
+		return false;
+	}
+
+	return true;
+}
+
+// Reads a little endian value from a possibly unaligned position
+template <typename T>
+T read_le(const unsigned char* data) {
+	T ret;
+	std::memcpy(&ret, data, sizeof(T));
+	return ret;
+}
+
+struct Bmp_file {
+	int width;
+	int height;
+	int bits_per_pixel;			// 24 (BGR) or 32 (BGRA/BGRX)
+	int row_stride;				// Bytes per row, including the padding to a multiple of four bytes
+	bool is_top_down;			// Rows are normally stored bottom-up, which is what OpenGL expects
+	const unsigned char* pixels;	// Points into the mapped file
+	Mapped_file file;
+};
+
+void bmp_close(Bmp_file& bmp) {
+	mapped_file_close(bmp.file);
+	bmp = {};
+}
+
+// Maps the file and parses BITMAPFILEHEADER + BITMAPINFOHEADER (or any of the later, larger info headers).
+//	The pixel data is not copied; bmp.pixels points into the mapping until bmp_close() is called
+bool read_bmp(const std::filesystem::path& filename, Bmp_file& bmp) {
+	bmp = {};
+
+	if (!mapped_file_open(filename, bmp.file)) {
+		return false;
+	}
+
+	auto fail = [&bmp, &filename](std::string msg) {
+		log_error(std::format("Could not read BMP file '{}': {}", filename.string(), msg));
+		bmp_close(bmp);
+		return false;
+		};
+
+	const size_t file_header_size = 14;
+	const size_t info_header_min_size = 40;
+	auto data = bmp.file.data;
+	auto size = bmp.file.size;
+
+	if (size < file_header_size + info_header_min_size || data[0] != 'B' || data[1] != 'M') {
+		return fail("Not a BMP file");
+	}
+
+	auto pixel_offset = read_le<uint32_t>(data + 10);
+	auto info_header_size = read_le<uint32_t>(data + 14);
+	auto width = read_le<int32_t>(data + 18);
+	auto height = read_le<int32_t>(data + 22);
+	auto bits_per_pixel = read_le<uint16_t>(data + 28);
+	auto compression = read_le<uint32_t>(data + 30);
+
+	const uint32_t compression_rgb = 0;
+	const uint32_t compression_bitfields = 3;
+
+	if (info_header_size < info_header_min_size) {
+		return fail("Unsupported info header");
+	}
+
+	if (bits_per_pixel != 24 && bits_per_pixel != 32) {
+		return fail(std::format("Unsupported bit depth {}", bits_per_pixel));
+	}
+
+	if (compression == compression_bitfields && bits_per_pixel == 32) {
+		// The masks directly follow BITMAPINFOHEADER (or are part of the V4/V5 headers, at the same position)
+		if (size < file_header_size + info_header_min_size + 12) {
+			return fail("Missing bit masks");
+		}
+		auto mask_r = read_le<uint32_t>(data + 54);
+		auto mask_g = read_le<uint32_t>(data + 58);
+		auto mask_b = read_le<uint32_t>(data + 62);
+		if (mask_r != 0x00FF0000 || mask_g != 0x0000FF00 || mask_b != 0x000000FF) {
+			return fail("Only BGRA bit masks are supported");
+		}
+	}
+	else if (compression != compression_rgb) {
+		return fail("Compressed BMP files are not supported");
+	}
+
+	// Larger than any texture, and small enough that the sizes below cannot overflow
+	const int32_t max_dimension = 1 << 16;
+
+	if (width <= 0 || height == 0 || width > max_dimension || height > max_dimension || height < -max_dimension) {
+		return fail("Invalid dimensions");
+	}
+
+	if (pixel_offset < file_header_size + info_header_size) {
+		return fail("Pixel data overlaps the header");
+	}
+
+	auto row_stride = ((static_cast<int64_t>(width) * bits_per_pixel + 31) / 32) * 4;
+
+	if (pixel_offset + static_cast<uint64_t>(row_stride) * std::abs(height) > size) {
+		return fail("File is truncated");
+	}
+
+	bmp.width = width;
+	bmp.height = std::abs(height);
+	bmp.bits_per_pixel = bits_per_pixel;
+	bmp.row_stride = static_cast<int>(row_stride);
+	bmp.is_top_down = height < 0;
+
+	bmp.pixels = data + pixel_offset;
+
+	return true;
+}
+
+// Row 0 is the bottom row, regardless of how the rows are stored in the file
+const unsigned char* bmp_row(const Bmp_file& bmp, int y) {
+	auto row = bmp.is_top_down ? bmp.height - 1 - y : y;
+	return bmp.pixels + static_cast<size_t>(row) * bmp.row_stride;
+}
+
+// Average of the color channels, 0 - 1
+float bmp_intensity(const Bmp_file& bmp, int x, int y) {
+	auto pixel = bmp_row(bmp, y) + x * (bmp.bits_per_pixel / 8);
+	return (pixel[0] + pixel[1] + pixel[2]) / (3 * 255.0f);
+}
+
+struct Mold_init_params {
+	Mold_init_mode mode;
+	uint32_t seed;
+	int image_width;	// Size of the spawn area
+	int image_height;
+	int num_types;
+	float spawn_origin[2];	// Position of the spawn area in the world
+	uint32_t max_age;
+};
+
+// CPU version of mold_init.glsl. Particle idx_mold only depends on its index and the seed
+Mold_particle mold_init_particle(uint32_t idx_mold, size_t num_mold_particles, const Mold_init_params& params, const Bmp_file& seed_map) {
+	auto image_width = static_cast<float>(params.image_width);
+	auto image_height = static_cast<float>(params.image_height);
+	float pos_x = image_width / 2.0f;
+	float pos_y = image_height / 2.0f;
+	float angle = 0.0f;
+	auto id_normalized = idx_mold / (num_mold_particles - 1.0f);
+
+	if (params.mode == Mold_init_mode::Random) {
+		auto r = random_uniform4(params.seed, Random_stream::mold_init, idx_mold, 0);
+		pos_x = image_width * r[0];
+		pos_y = image_height * r[1];
+		angle = 2.0f * std::numbers::pi_v<float> *r[2];
+	}
+
+	if (params.mode == Mold_init_mode::Ellipse) {
+		pos_x = image_width / 2.0f + image_width / 4.0f * std::cos(2.0f * std::numbers::pi_v<float> *id_normalized);
+		pos_y = image_height / 2.0f + image_height / 4.0f * std::sin(2.0f * std::numbers::pi_v<float> *id_normalized);
+		angle = 2.0f * std::numbers::pi_v<float> *id_normalized;
+	}
+
+	if (params.mode == Mold_init_mode::Circle) {
+		pos_x = image_width / 2.0f + image_width / 4.0f * std::cos(2.0f * std::numbers::pi_v<float> *id_normalized);
+		pos_y = image_height / 2.0f + image_width / 4.0f * std::sin(2.0f * std::numbers::pi_v<float> *id_normalized);
+		angle = 2.0f * std::numbers::pi_v<float> *id_normalized;
+	}
+
+	if (params.mode == Mold_init_mode::Seed_map) {
+		// Pick random pixels until we find a bright enough one
+		int max_attempts = 100;
+		for (int idx_attempt = 0; idx_attempt < max_attempts; idx_attempt++) {
+			auto r = random_uniform4(params.seed, Random_stream::mold_init, idx_mold, idx_attempt);
+			int seed_x = std::min(static_cast<int>(r[0] * seed_map.width), seed_map.width - 1);
+			int seed_y = std::min(static_cast<int>(r[1] * seed_map.height), seed_map.height - 1);
+			pos_x = image_width * (seed_x + 0.5f) / seed_map.width;
+			pos_y = image_height * (seed_y + 0.5f) / seed_map.height;
+			angle = 2.0f * std::numbers::pi_v<float> *r[2];
+			if (bmp_intensity(seed_map, seed_x, seed_y) > 0.5f) {
+				break;
+			}
+		}
+	}
+
+	// No trail until the particle has moved
+	pos_x += params.spawn_origin[0];
+	pos_y += params.spawn_origin[1];
+
+	// Staggered, so the initial particles do not all die in the same step
+	uint32_t age = params.max_age > 0 ? idx_mold % params.max_age : 0;
+
+	return { .pos = {pos_x, pos_y}, .pos_last = {pos_x, pos_y}, .angle = angle, .type = static_cast<int>((idx_mold + 1) % params.num_types), .age = age };
+}
+
+bool setup_window(int width, int height, std::string title, bool visible, GLFWwindow*& window) {
+	glfwInit();
+	glfwWindowHint(GLFW_VISIBLE, visible ? GLFW_TRUE : GLFW_FALSE);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+	glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+	glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+
+#ifdef __APPLE__
+	glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+
+	window = glfwCreateWindow(width, height, title.c_str(), NULL, NULL);
+
+	if (window == nullptr) {
+		std::cout << "Failed to create GLFW window" << std::endl;
+		glfwTerminate();
+		return false;
+	}
+
+	glfwMakeContextCurrent(window);
+	glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+	glfwSwapInterval(0);
+
+	return true;
+}
+
+bool load_opengl() {
+	if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress)) {
+		log_error("Failed to initialize GLAD");
+		return false;
+	}
+
+	return true;
+}
+
+void print_gl_info() {
+	int max_compute_work_group_count[3];
+	int max_compute_work_group_size[3];
+	int max_compute_work_group_invocations;
+
+	for (int idx = 0; idx < 3; idx++) {
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, idx, &max_compute_work_group_count[idx]);
+		glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_SIZE, idx, &max_compute_work_group_size[idx]);
+	}
+	glGetIntegerv(GL_MAX_COMPUTE_WORK_GROUP_INVOCATIONS, &max_compute_work_group_invocations);
+
+	std::cout << "OpenGL Limitations: " << std::endl;
+	std::cout << "maximum number of work groups in X dimension " << max_compute_work_group_count[0] << std::endl;
+	std::cout << "maximum number of work groups in Y dimension " << max_compute_work_group_count[1] << std::endl;
+	std::cout << "maximum number of work groups in Z dimension " << max_compute_work_group_count[2] << std::endl;
+
+	std::cout << "maximum size of a work group in X dimension " << max_compute_work_group_size[0] << std::endl;
+	std::cout << "maximum size of a work group in Y dimension " << max_compute_work_group_size[1] << std::endl;
+	std::cout << "maximum size of a work group in Z dimension " << max_compute_work_group_size[2] << std::endl;
+
+	std::cout << "Number of invocations in a single local work group that may be dispatched to a compute shader " << max_compute_work_group_invocations << std::endl;
+}
+
+// Every GPU buffer, texture and program the app creates is registered here with its owner, eg. "scene mold" or
+//	"capture", so the stats, the soak test (--soak) and the exit can account for all of them. Sizes are as
+//	requested from the driver, which may round them up
+struct Gpu_object {
+	std::string owner;
+	size_t num_bytes = 0;
+};
+
+struct Gpu_registry {
+	std::map<GLuint, Gpu_object> buffers;
+	std::map<GLuint, Gpu_object> textures;
+	std::map<GLuint, Gpu_object> programs;
+	size_t num_bytes = 0;
+	size_t num_bytes_peak = 0;
+	uint64_t num_created = 0;
+	uint64_t num_deleted = 0;
+};
+
+Gpu_registry gpu_registry;
+
+// Registers a new object, or the new size of one whose storage was specified again, eg. with glBufferData()
+void gpu_track(std::map<GLuint, Gpu_object>& objects, GLuint id, const std::string& owner, size_t num_bytes) {
+	auto it = objects.find(id);
+
+	if (it != objects.end()) {
+		gpu_registry.num_bytes -= it->second.num_bytes;
+	}
+	else {
+		gpu_registry.num_created++;
+	}
+
+	objects[id] = { owner, num_bytes };
+	gpu_registry.num_bytes += num_bytes;
+	gpu_registry.num_bytes_peak = std::max(gpu_registry.num_bytes_peak, gpu_registry.num_bytes);
+}
+
+void gpu_untrack(std::map<GLuint, Gpu_object>& objects, GLuint id) {
+	auto it = objects.find(id);
+
+	if (it == objects.end()) {
+		return;
+	}
+
+	gpu_registry.num_bytes -= it->second.num_bytes;
+	gpu_registry.num_deleted++;
+	objects.erase(it);
+}
+
+// glGenBuffers() and glBufferData() in one. The buffer is left bound to target
+GLuint gpu_create_buffer(const std::string& owner, GLenum target, size_t num_bytes, const void* data, GLenum usage) {
+	GLuint id_buffer;
+
+	glGenBuffers(1, &id_buffer);
+	glBindBuffer(target, id_buffer);
+	glBufferData(target, num_bytes, data, usage);
+	gpu_track(gpu_registry.buffers, id_buffer, owner, num_bytes);
+
+	return id_buffer;
+}
+
+void gpu_delete_buffers(const std::vector<GLuint>& ids) {
+	for (auto id : ids) {
+		gpu_untrack(gpu_registry.buffers, id);
+	}
+
+	if (!ids.empty()) {
+		glDeleteBuffers(static_cast<GLsizei>(ids.size()), ids.data());
+	}
+}
+
+void gpu_delete_buffer(GLuint& id_buffer) {
+	if (id_buffer != 0) {
+		gpu_delete_buffers({ id_buffer });
+	}
+	id_buffer = 0;
+}
+
+void gpu_delete_textures(const std::vector<GLuint>& ids) {
+	for (auto id : ids) {
+		gpu_untrack(gpu_registry.textures, id);
+	}
+
+	if (!ids.empty()) {
+		glDeleteTextures(static_cast<GLsizei>(ids.size()), ids.data());
+	}
+}
+
+void gpu_delete_texture(GLuint& id_texture) {
+	if (id_texture != 0) {
+		gpu_delete_textures({ id_texture });
+	}
+	id_texture = 0;
+}
+
+std::map<std::string, size_t> gpu_bytes_by_owner() {
+	std::map<std::string, size_t> num_bytes;
+
+	for (auto objects : { &gpu_registry.buffers, &gpu_registry.textures }) {
+		for (auto& [_, object] : *objects) {
+			num_bytes[object.owner] += object.num_bytes;
+		}
+	}
+
+	return num_bytes;
+}
+
+// Free video memory as reported by the driver, from GL_NVX_gpu_memory_info or GL_ATI_meminfo. Unlike the
+//	registry, this also sees what the driver allocates on its own. Returns false without either extension
+bool gpu_driver_free_mb(float& free_mb) {
+	// The loader does not necessarily include these extensions
+	const GLenum gpu_memory_info_current_available_vidmem_nvx = 0x9049;
+	const GLenum texture_free_memory_ati = 0x87FC;
+	enum class Extension { unknown, none, nvx, ati };
+	static Extension extension = Extension::unknown;
+
+	if (extension == Extension::unknown) {
+		extension = Extension::none;
+		GLint num_extensions = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &num_extensions);
+		for (GLint idx = 0; idx < num_extensions; idx++) {
+			std::string name = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, idx));
+			if (name == "GL_NVX_gpu_memory_info") {
+				extension = Extension::nvx;
+			}
+			else if (name == "GL_ATI_meminfo" && extension == Extension::none) {
+				extension = Extension::ati;
+			}
+		}
+	}
+
+	// Both report KB. GL_ATI_meminfo gives four values per pool, the first is the total free memory
+	GLint values[4] = {};
+
+	switch (extension) {
+	case Extension::nvx: glGetIntegerv(gpu_memory_info_current_available_vidmem_nvx, values); break;
+	case Extension::ati: glGetIntegerv(texture_free_memory_ati, values); break;
+	default: return false;
+	}
+
+	free_mb = values[0] / 1024.0f;
+	return true;
+}
+
+// Deletes everything that is still registered, at exit, after reporting it by owner
+void gpu_registry_release_all() {
+	std::string owners;
+
+	for (auto& [owner, num_bytes] : gpu_bytes_by_owner()) {
+		owners += std::format("{}{} {:.1f} MB", owners.empty() ? "" : ", ", owner, num_bytes / (1024.0f * 1024.0f));
+	}
+
+	std::cout << std::format("GPU objects at exit: {} buffers, {} textures, {} programs ({}). {} created and {} deleted in total, peak {:.1f} MB",
+		gpu_registry.buffers.size(), gpu_registry.textures.size(), gpu_registry.programs.size(), owners,
+		gpu_registry.num_created, gpu_registry.num_deleted, gpu_registry.num_bytes_peak / (1024.0f * 1024.0f)) << std::endl;
+
+	std::vector<GLuint> ids;
+	for (auto& [id, _] : gpu_registry.buffers) {
+		ids.push_back(id);
+	}
+	gpu_delete_buffers(ids);
+
+	ids.clear();
+	for (auto& [id, _] : gpu_registry.textures) {
+		ids.push_back(id);
+	}
+	gpu_delete_textures(ids);
+
+	for (auto& [id, _] : gpu_registry.programs) {
+		glDeleteProgram(id);
+	}
+	gpu_registry.programs.clear();
+}
+
+bool file_read(std::filesystem::path& path, std::string& s) {
+	std::ifstream t(path);
+
+	if (!t.is_open()) {
+		return false;
+	}
+
+	std::stringstream ss;
+	ss << t.rdbuf();
+
+	s = ss.str();
+
+	return true;
+}
+
+bool has_linker_error(GLuint id_shader, std::string& msg) {
+	const int max_size_log_message = 1024;
+	GLint success;
+	GLchar log_message[max_size_log_message];
+
+	glGetProgramiv(id_shader, GL_LINK_STATUS, &success);
+
+	if (!success) {
+		glGetProgramInfoLog(id_shader, max_size_log_message, NULL, log_message);
+		msg = log_message;
+		return true;
+	}
+
+	return false;
+}
+
+bool has_compiler_error(GLuint id_shader, std::string& msg) {
+	const int max_size_log_message = 1024;
+	GLint success;
+	GLchar log_message[max_size_log_message];
+
+	glGetShaderiv(id_shader, GL_COMPILE_STATUS, &success);
+
+	if (!success) {
+		glGetShaderInfoLog(id_shader, max_size_log_message, nullptr, log_message);
+		msg = log_message;
+		return true;
+	}
+
+	return false;
+}
+
+enum class Shader_type {
+	vertex,
+	fragment,
+	compute
+};
+
+bool compile_shader(GLuint& id_shader, const std::string& shader_code, Shader_type shader_type) {
+	struct Shader_type_data {
+		GLuint type;
+		std::string display_name;
+	};
+
+	std::map<Shader_type, Shader_type_data> shader_type_to_type = {
+		{Shader_type::compute,	{GL_COMPUTE_SHADER, "compute"}},
+		{Shader_type::fragment, {GL_FRAGMENT_SHADER, "fragment"}},
+		{Shader_type::vertex,	{GL_VERTEX_SHADER, "vertex"}}
+	};
+
+	if (shader_type_to_type.count(shader_type) == 0) {
+		log_error(std::format("Shader type '{}' not enabled", static_cast<int>(shader_type)));
+		return false;
+	}
+
+	auto shader_type_data = shader_type_to_type[shader_type];
+
+	id_shader = glCreateShader(shader_type_data.type);
+	auto the_code = shader_code.c_str();
+
+	std::string version_string = "#version 430 core\n";
+
+	const char* src[2] = { version_string.c_str(), the_code };
+	glShaderSource(id_shader, 2, src, nullptr);
+	glCompileShader(id_shader);
+
+	std::string log_message = {};
+	auto success = !has_compiler_error(id_shader, log_message);
+
+	if (!success) {
+		std::cout << "Could not compile " << shader_type_data.display_name << " shader. Message: " << log_message << std::endl;
+	}
+
+	return success;
+}
+
+bool compile_program(std::vector<GLuint> ids_shaders, GLuint& id_program) {
+	if (ids_shaders.empty()) {
+		log_error("No shaders to compile");
+		return false;
+	}
+
+	id_program = glCreateProgram();
+	gpu_track(gpu_registry.programs, id_program, "programs", 0);
+
+	for (auto& id : ids_shaders) {
+		glAttachShader(id_program, id);
+	}
+
+	glLinkProgram(id_program);
+
+	std::string log_message = {};
+	auto success = !has_linker_error(id_program, log_message);
+
+	if (!success) {
+		std::cout << "Could not link program. Message: " << log_message << std::endl;
+	}
+
+	return success;
+}
+
+struct Shader_info {
+	std::filesystem::path path;
+	std::vector<std::filesystem::path> paths_shared;
+	Shader_type type;
+};
+
+bool shader_create(std::vector<Shader_info> shader_info, GLuint& id_program) {
+	if (shader_info.empty()) {
+		log_error("No shader info");
+		return false;
+	}
+
+	auto num_shaders = shader_info.size();
+
+	std::vector<GLuint> ids(num_shaders);
+
+	for (auto idx_shader = 0; idx_shader < num_shaders; idx_shader++) {
+		std::string code_shader = { };
+		std::string code_extensions = { };
+		auto& cur_shader_info = shader_info[idx_shader];
+
+		std::vector<std::filesystem::path> paths_all(cur_shader_info.paths_shared.begin(), cur_shader_info.paths_shared.end());
+		paths_all.push_back(cur_shader_info.path);
+
+		for (auto& cur_path : paths_all) {
+			std::string cur_code = {};
+			if (!file_read(cur_path, cur_code)) {
+				log_error(std::format("Could not read file '{}'", cur_shader_info.path.string()));
+				return false;
+			}
+			// Extensions have to come before any other code, so they are moved up from the shared files
+			std::istringstream lines(cur_code);
+			std::string code_without_extensions = { };
+			for (std::string line; std::getline(lines, line);) {
+				(line.starts_with("#extension") ? code_extensions : code_without_extensions) += line + "\n";
+			}
+			code_shader += "\n" + code_without_extensions;
+		}
+
+		auto success_compile = compile_shader(ids[idx_shader], code_extensions + code_shader, cur_shader_info.type);
+
+		if (!success_compile) {
+			log_error(std::format("Could not compile code in file '{}'", cur_shader_info.path.string()));
+			return false;
+		}
+	}
+
+	auto success_program = compile_program(ids, id_program);
+
+	for (auto& id : ids) {
+		glDeleteShader(id);
+	}
+
+	return success_program;
+}
+
+void shader_set_bool(GLuint id_program, const std::string& variable_name, bool value) {
+	glUniform1i(glGetUniformLocation(id_program, variable_name.c_str()), (int)value);
+}
+
+void shader_set_int(GLuint id_program, const std::string& variable_name, int value) {
+	glUniform1i(glGetUniformLocation(id_program, variable_name.c_str()), value);
+}
+
+void shader_set_uint(GLuint id_program, const std::string& variable_name, unsigned int value) {
+	glUniform1ui(glGetUniformLocation(id_program, variable_name.c_str()), value);
+}
+
+void shader_set_float(GLuint id_program, const std::string& variable_name, float value) {
+	glUniform1f(glGetUniformLocation(id_program, variable_name.c_str()), value);
+}
+
+void shader_set_float_array(GLuint id_program, const std::string& variable_name, const std::vector<float>& values) {
+	glUniform1fv(glGetUniformLocation(id_program, variable_name.c_str()), static_cast<GLsizei>(values.size()), values.data());
+}
+
+void shader_set_vec2(GLuint id_program, const std::string& variable_name, const glm::vec2& value) {
+	glUniform2fv(glGetUniformLocation(id_program, variable_name.c_str()), 1, &value[0]);
+}
+
+void shader_set_vec3(GLuint id_program, const std::string& variable_name, const glm::vec3& value) {
+	glUniform3fv(glGetUniformLocation(id_program, variable_name.c_str()), 1, &value[0]);
+}
+
+void shader_use_program(GLuint id_program) {
+	glUseProgram(id_program);
+}
+
+// For kernels with one invocation per item and local_size invocations per work group. There can be more than
+//	65535 groups, so they are spread over x and y, and the kernel has to skip the invocations past the end
+void dispatch_compute_linear(size_t num_items, unsigned int local_size) {
+	unsigned int max_num_groups_x = 65535;
+	auto num_groups = static_cast<unsigned int>(std::max<size_t>(1, (num_items + local_size - 1) / local_size));
+	auto num_groups_x = std::min(num_groups, max_num_groups_x);
+	auto num_groups_y = (num_groups + num_groups_x - 1) / num_groups_x;
+	glDispatchCompute(num_groups_x, num_groups_y, 1);
+}
+
+// These indices needs to be synched with the bindings used in the compute shaders
+enum class Ssbo_index {
+	solver_x = 0,
+	ray_spheres = 1,
+	ray_shared_data = 2,
+	voronoi_circles = 3,
+	voronoi_blocks = 4,
+	voronoi_toolbar = 5,
+	voronoi_toolbar_colors = 6,
+	mold = 7,
+	mold_intensities = 8,
+	physics_circles = 9,
+	voronoi_physics = 10,
+	physics_physics = 11,
+	text_glyphs = 12,
+	mold_deposits = 13,
+	mold_intensities_next = 14,
+	mold_interactions = 15,
+	mold_tiles = 16,
+	mold_page_pool = 17,
+	mold_page_tiles = 18,
+	mold_counters = 19,
+	mold_free_slots = 20,
+	mold_alive = 21,
+	mold_alive_next = 22,
+	mold_scan_offsets = 23,
+	mold_group_sums = 24,
+	primitives_data = 25,
+	primitives_aux = 26,
+	primitives_out = 27,
+	primitives_out_aux = 28,
+	primitives_counts = 29,
+	primitives_block_sums = 30,
+	capture_pixels = 31,
+	mold_sweep_runs = 32,
+	mold_sweep_particles = 33,
+	mold_sweep_trails = 34,
+	mold_sweep_trails_next = 35,
+	mold_sweep_pixels = 36,
+	ray_queue = 37,
+	ray_queue_sorted = 38,
+	ray_counters = 39,
+	statistics = 40,
+	statistics_partials = 41,
+	voronoi_owners = 42,
+	voronoi_dirty_tiles = 43,
+	solver_b = 44,
+	solver_out = 45,
+	solver_aux = 46,
+	solver_partials = 47,
+	solver_scalars = 48,
+	physics_scratch = 49
+};
+
+// usage an be eg. GL_DYNAMIC_DRAW or GL_DYNAMIC_READ, see documentation
+//	TODO: Is it actually used?
+GLuint setup_ssbo(const std::string& owner, GLuint ssbo_index, GLuint usage, GLsizeiptr data_size, void* data) {
+	auto idx_buffer = gpu_create_buffer(owner, GL_SHADER_STORAGE_BUFFER, data_size, data, usage);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ssbo_index, idx_buffer);
+
+	return idx_buffer;
+}
+
+void ssbo_update(GLuint idx_buffer, GLintptr offset, GLsizeiptr size, void* data) {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, idx_buffer);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
+}
+
+void ssbo_read(GLuint idx_buffer, GLintptr offset, GLsizeiptr size, void* data) {
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, idx_buffer);
+	glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
+}
+
+// Runs fn num_iterations times and returns the average GPU time per iteration. Waits for the result,
+//	so this is meant for benchmarks and not for the main loop
+float gpu_time_ms(const std::function<void()>& fn, int num_iterations) {
+	GLuint id_query;
+	GLuint64 t_elapsed_ns = 0;
+
+	glGenQueries(1, &id_query);
+	glBeginQuery(GL_TIME_ELAPSED, id_query);
+
+	for (int idx_iteration = 0; idx_iteration < num_iterations; idx_iteration++) {
+		fn();
+	}
+
+	glEndQuery(GL_TIME_ELAPSED);
+	glGetQueryObjectui64v(id_query, GL_QUERY_RESULT, &t_elapsed_ns);
+	glDeleteQueries(1, &id_query);
+
+	return t_elapsed_ns / 1.0e6f / num_iterations;
+}
+
+// GPU time of a part of the frame, without waiting for the GPU: each frame uses the next query of a ring,
+//	and a query is only read once its result is available, a few frames later
+struct Gpu_timer {
+	std::array<GLuint, 4> queries = {};
+	std::array<int, 4> counts = {};		// Number of items timed by each pending query, eg. mold steps. 0: Not pending
+	size_t idx_next = 0;
+};
+
+void gpu_timer_begin(Gpu_timer& timer) {
+	if (timer.queries[0] == 0) {
+		glGenQueries(static_cast<GLsizei>(timer.queries.size()), timer.queries.data());
+	}
+	glBeginQuery(GL_TIME_ELAPSED, timer.queries[timer.idx_next]);
+}
+
+void gpu_timer_end(Gpu_timer& timer, int count) {
+	glEndQuery(GL_TIME_ELAPSED);
+	timer.counts[timer.idx_next] = count;
+	timer.idx_next = (timer.idx_next + 1) % timer.queries.size();
+}
+
+// Time per item of the oldest query that has finished, if any. A query that is still pending when its slot
+//	comes round again is overwritten, so this never waits
+bool gpu_timer_poll(Gpu_timer& timer, float& ms_per_item) {
+	bool has_result = false;
+	for (size_t idx_offset = 0; idx_offset < timer.queries.size(); idx_offset++) {
+		auto idx = (timer.idx_next + idx_offset) % timer.queries.size();
+		if (timer.counts[idx] == 0) {
+			continue;
+		}
+		GLint is_available = GL_FALSE;
+		glGetQueryObjectiv(timer.queries[idx], GL_QUERY_RESULT_AVAILABLE, &is_available);
+		if (!is_available) {
+			break;
+		}
+		GLuint64 t_elapsed_ns = 0;
+		glGetQueryObjectui64v(timer.queries[idx], GL_QUERY_RESULT, &t_elapsed_ns);
+		ms_per_item = t_elapsed_ns / 1.0e6f / timer.counts[idx];
+		timer.counts[idx] = 0;
+		has_result = true;
+	}
+
+	return has_result;
+}
+
+void gpu_timer_release(Gpu_timer& timer) {
+	if (timer.queries[0] != 0) {
+		glDeleteQueries(static_cast<GLsizei>(timer.queries.size()), timer.queries.data());
+	}
+	timer = {};
+}
+
+// Resolutions the scenes can be rendered at, as a fraction of the canvas size in each direction
+const std::array<float, 6> quality_render_scales = { 1.0f, 0.85f, 0.7f, 0.6f, 0.5f, 0.35f };
+
+// Holds the GPU time of the scene passes within a budget (--frame-budget). The scene is rendered at a lower
+//	resolution and stretched over the canvas when it does not fit, and the mold takes fewer steps per frame
+//	instead of catching up all at once. The resolution only changes after a few frames at the same one, so the
+//	timings in between are from the current setting
+struct Quality_governor {
+	float budget_ms = 0.0f;			// 0: Off
+	int level = 0;					// Index in quality_render_scales
+	int num_frames_at_level = 0;
+	float render_ms = 0.0f;			// Smoothed GPU times of the render pass and of one mold step. 0: Not measured yet
+	float mold_step_ms = 0.0f;
+	float mold_steps_per_frame = 0.0f;	// Smoothed
+	float saved_ms = 0.0f;			// Smoothed estimate of the GPU time per frame saved compared to full quality
+	uint64_t num_mold_steps_dropped = 0;
+	Gpu_timer render_timer;
+	Gpu_timer mold_timer;
+};
+
+float quality_render_scale(const Quality_governor& governor) {
+	return governor.budget_ms > 0.0f ? quality_render_scales[governor.level] : 1.0f;
+}
+
+// Most mold steps to take this frame. 0: No limit
+int quality_max_mold_steps(const Quality_governor& governor) {
+	if (governor.budget_ms <= 0.0f || governor.mold_step_ms <= 0.0f) {
+		return 0;
+	}
+
+	return std::max(1, static_cast<int>((governor.budget_ms - governor.render_ms) / governor.mold_step_ms));
+}
+
+const float quality_smoothing = 0.1f;
+
+void quality_smooth(float& value, float sample) {
+	value = value > 0.0f ? value + quality_smoothing * (sample - value) : sample;
+}
+
+// Reads the timers that have finished. Without a frame budget only the soak test times the mold steps
+void quality_governor_poll(Quality_governor& governor) {
+	float ms;
+
+	if (gpu_timer_poll(governor.render_timer, ms)) {
+		quality_smooth(governor.render_ms, ms);
+	}
+	if (gpu_timer_poll(governor.mold_timer, ms)) {
+		quality_smooth(governor.mold_step_ms, ms);
+	}
+}
+
+// Called once per frame, after the scene passes. Reads the timers and picks the resolution for the next frame
+void quality_governor_update(Quality_governor& governor, int num_mold_steps, int num_mold_steps_dropped) {
+	quality_governor_poll(governor);
+
+	auto scale = quality_render_scales[governor.level];
+	governor.mold_steps_per_frame += quality_smoothing * (num_mold_steps - governor.mold_steps_per_frame);
+	governor.num_mold_steps_dropped += num_mold_steps_dropped;
+	quality_smooth(governor.saved_ms, governor.render_ms * (1.0f / (scale * scale) - 1.0f) + num_mold_steps_dropped * governor.mold_step_ms);
+
+	int num_frames_to_settle = 8;
+	if (++governor.num_frames_at_level < num_frames_to_settle || governor.render_ms <= 0.0f) {
+		return;
+	}
+
+	// The render passes cost about the same per pixel, so the time is predicted from the number of pixels
+	float frame_ms = governor.render_ms + governor.mold_steps_per_frame * governor.mold_step_ms;
+	int level = governor.level;
+	if (frame_ms > governor.budget_ms && level + 1 < static_cast<int>(quality_render_scales.size())) {
+		level++;
+	}
+	else if (level > 0) {
+		auto pixels_ratio = std::pow(quality_render_scales[level - 1] / scale, 2.0f);
+		// Some room is left, so it does not go back and forth between two levels
+		if (frame_ms + governor.render_ms * (pixels_ratio - 1.0f) < 0.85f * governor.budget_ms) {
+			level--;
+		}
+	}
+
+	if (level != governor.level) {
+		governor.render_ms *= std::pow(quality_render_scales[level] / scale, 2.0f);
+		governor.level = level;
+		governor.num_frames_at_level = 0;
+		std::cout << std::format("Frame budget {:.1f} ms: rendering at {:.0f}% resolution", governor.budget_ms, 100.0f * quality_render_scales[level]) << std::endl;
+	}
+}
+
+// A scene switch makes the timings meaningless, so the governor starts over at full quality
+void quality_governor_reset(Quality_governor& governor) {
+	governor.level = 0;
+	governor.num_frames_at_level = 0;
+	governor.render_ms = 0.0f;
+	governor.mold_step_ms = 0.0f;
+	governor.mold_steps_per_frame = 0.0f;
+	governor.saved_ms = 0.0f;
+}
+
+// Long runs to find out why the app slows down over time (--soak). Every soak_interval_s, the frame time, the GPU
+//	time of a mold step and the GPU memory are logged, and at the end the start and the end of the run are
+//	compared, to tell allocations that keep growing from kernels that get slower as the simulation evolves
+const double soak_interval_s = 10.0;
+
+struct Soak_sample {
+	double t_s = 0.0;				// Since the start of the soak test
+	uint64_t num_frames = 0;
+	float frame_ms = 0.0f;			// Wall time per frame since the previous sample
+	float mold_step_ms = 0.0f;		// GPU time of one step, smoothed over the last frames. 0: The mold scene was not shown
+	float tracked_mb = 0.0f;		// Everything in gpu_registry
+	float driver_free_mb = -1.0f;	// -1: Not reported by the driver
+	uint32_t num_particles = 0;
+	int num_resident_tiles = 0;
+};
+
+struct Soak_test {
+	bool is_active = false;
+	double duration_s = 0.0;
+	double t_start_s = 0.0;
+	double t_last_sample_s = 0.0;
+	uint64_t num_frames_last_sample = 0;
+	std::ofstream log;
+	std::vector<Soak_sample> samples;
+};
+
+bool soak_start(Soak_test& soak, const std::filesystem::path& log_path, double duration_s, double t_now_s) {
+	soak.log.open(log_path);
+
+	if (!soak.log) {
+		log_error(std::format("Could not open '{}' for the soak test log", log_path.string()));
+		return false;
+	}
+
+	soak.log << "t_s,frames,frame_ms,mold_step_ms,tracked_mb,driver_free_mb,particles,resident_tiles\n";
+	soak.is_active = true;
+	soak.duration_s = duration_s;
+	soak.t_start_s = t_now_s;
+	soak.t_last_sample_s = t_now_s;
+	std::cout << std::format("Soak test for {:.1f} minutes, logging to '{}' every {:.0f} s", duration_s / 60.0, log_path.string(), soak_interval_s) << std::endl;
+
+	return true;
+}
+
+bool soak_is_sample_due(const Soak_test& soak, double t_now_s) {
+	return soak.is_active && t_now_s - soak.t_last_sample_s >= soak_interval_s;
+}
+
+// Completes a sample whose mold fields were measured by the caller, and logs it. Returns false once the soak test is over
+bool soak_add_sample(Soak_test& soak, Soak_sample sample, double t_now_s, uint64_t num_frames) {
+	auto num_frames_since = num_frames - soak.num_frames_last_sample;
+	float driver_free_mb = 0.0f;
+
+	sample.t_s = t_now_s - soak.t_start_s;
+	sample.num_frames = num_frames;
+	sample.frame_ms = num_frames_since > 0 ? static_cast<float>(1000.0 * (t_now_s - soak.t_last_sample_s) / num_frames_since) : 0.0f;
+	sample.tracked_mb = gpu_registry.num_bytes / (1024.0f * 1024.0f);
+	if (gpu_driver_free_mb(driver_free_mb)) {
+		sample.driver_free_mb = driver_free_mb;
+	}
+
+	soak.log << std::format("{:.1f},{},{:.3f},{:.4f},{:.2f},{:.1f},{},{}\n", sample.t_s, sample.num_frames, sample.frame_ms, sample.mold_step_ms,
+		sample.tracked_mb, sample.driver_free_mb, sample.num_particles, sample.num_resident_tiles) << std::flush;
+	std::cout << std::format("Soak {:6.0f} s: {:6.2f} ms per frame, {:6.3f} ms per mold step, {:7.1f} MB tracked, {} particles, {} resident tiles",
+		sample.t_s, sample.frame_ms, sample.mold_step_ms, sample.tracked_mb, sample.num_particles, sample.num_resident_tiles) << std::endl;
+
+	soak.samples.push_back(sample);
+	soak.t_last_sample_s = t_now_s;
+	soak.num_frames_last_sample = num_frames;
+
+	return sample.t_s < soak.duration_s;
+}
+
+// Compares the first and the last quarter of the samples. The very first sample is left out, since it includes
+//	the start up. More memory points to allocations that are never released, a slower mold step with the same
+//	memory to a cost that depends on the state of the simulation
+void soak_report(const Soak_test& soak) {
+	if (soak.samples.size() < 3) {
+		std::cout << "Soak test too short to compare its start and end, it needs at least three samples" << std::endl;
+		return;
+	}
+
+	auto num_compared = std::max<size_t>(1, (soak.samples.size() - 1) / 4);
+	auto mean = [&](size_t idx_first, auto member) {
+		float sum = 0.0f;
+		for (size_t idx = idx_first; idx < idx_first + num_compared; idx++) {
+			sum += static_cast<float>(soak.samples[idx].*member);
+		}
+		return sum / num_compared;
+		};
+	auto idx_end = soak.samples.size() - num_compared;
+	auto relative = [](float start, float end) { return start > 0.0f ? end / start - 1.0f : 0.0f; };
+
+	float frame_start = mean(1, &Soak_sample::frame_ms), frame_end = mean(idx_end, &Soak_sample::frame_ms);
+	float step_start = mean(1, &Soak_sample::mold_step_ms), step_end = mean(idx_end, &Soak_sample::mold_step_ms);
+	float tracked_start = mean(1, &Soak_sample::tracked_mb), tracked_end = mean(idx_end, &Soak_sample::tracked_mb);
+	float free_start = mean(1, &Soak_sample::driver_free_mb), free_end = mean(idx_end, &Soak_sample::driver_free_mb);
+	float particles_start = mean(1, &Soak_sample::num_particles), particles_end = mean(idx_end, &Soak_sample::num_particles);
+	float tiles_start = mean(1, &Soak_sample::num_resident_tiles), tiles_end = mean(idx_end, &Soak_sample::num_resident_tiles);
+
+	std::cout << std::format("Soak test over {:.0f} s, start to end: {:.2f} -> {:.2f} ms per frame ({:+.0f}%), {:.3f} -> {:.3f} ms per mold step ({:+.0f}%)",
+		soak.samples.back().t_s, frame_start, frame_end, 100.0f * relative(frame_start, frame_end), step_start, step_end, 100.0f * relative(step_start, step_end)) << std::endl;
+	std::cout << std::format("  {:.1f} -> {:.1f} MB tracked, {} MB free on the GPU, {:.0f} -> {:.0f} particles, {:.0f} -> {:.0f} resident tiles",
+		tracked_start, tracked_end, free_start >= 0.0f ? std::format("{:.0f} -> {:.0f}", free_start, free_end) : "unknown",
+		particles_start, particles_end, tiles_start, tiles_end) << std::endl;
+
+	float drift = 0.1f;
+	bool has_allocation_growth = tracked_end - tracked_start > 1.0f || (free_start >= 0.0f && free_start - free_end > 64.0f);
+	bool has_more_data = relative(particles_start, particles_end) > drift || relative(tiles_start, tiles_end) > drift;
+
+	if (has_allocation_growth) {
+		std::cout << "  Allocation growth: GPU memory keeps growing. The GPU objects by owner are listed at exit" << std::endl;
+	}
+	else if (relative(step_start, step_end) > drift && has_more_data) {
+		std::cout << "  Data-dependent kernel cost: the mold step got slower with more particles or resident tiles, and no allocation growth" << std::endl;
+	}
+	else if (relative(step_start, step_end) > drift) {
+		std::cout << "  The mold step got slower with the same memory, particles and tiles, eg. from how the trails are spread or a GPU clocking down" << std::endl;
+	}
+	else if (relative(frame_start, frame_end) > drift) {
+		std::cout << "  Frames got slower outside the mold step, with no allocation growth" << std::endl;
+	}
+	else {
+		std::cout << "  No drift" << std::endl;
+	}
+}
+
+// Must be kept in sync with primitives.glsl
+const unsigned int primitives_group_size = 1024;
+const int primitives_radix_bits = 8;
+const int primitives_max_histogram_bins = 1024;
+
+// The primitives program and its scratch buffers, which grow on demand and are reused between calls
+struct Primitives {
+	GLuint id_program = 0;
+	std::vector<GLuint> scan_block_sums;		// One per level of the recursive scan
+	std::vector<size_t> scan_block_sums_bytes;
+	GLuint radix_keys = 0;
+	GLuint radix_payload = 0;
+	GLuint radix_counts = 0;
+	size_t radix_keys_bytes = 0;
+	size_t radix_payload_bytes = 0;
+	size_t radix_counts_bytes = 0;
+};
+
+// Makes sure the buffer has room for num_bytes. The contents are not kept when it grows
+void primitives_reserve(GLuint& id_buffer, size_t& num_bytes_allocated, size_t num_bytes, const std::string& owner = "primitives") {
+	if (id_buffer != 0 && num_bytes_allocated >= num_bytes) {
+		return;
+	}
+
+	gpu_delete_buffer(id_buffer);
+	id_buffer = gpu_create_buffer(owner, GL_SHADER_STORAGE_BUFFER, std::max<size_t>(num_bytes, sizeof(uint32_t)), nullptr, GL_DYNAMIC_COPY);
+	num_bytes_allocated = num_bytes;
+}
+
+void primitives_bind(Ssbo_index ssbo_index, GLuint id_buffer) {
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(ssbo_index), id_buffer);
+}
+
+void primitives_release(Primitives& primitives) {
+	for (auto& id_buffer : primitives.scan_block_sums) {
+		gpu_delete_buffer(id_buffer);
+	}
+
+	for (auto id_buffer : { &primitives.radix_keys, &primitives.radix_payload, &primitives.radix_counts }) {
+		gpu_delete_buffer(*id_buffer);
+	}
+
+	primitives = { primitives.id_program };
+}
+
+// Scans each block of primitives_group_size values, scans the block sums the same way one level down,
+//	and adds them back. Three levels cover 2^30 values
+void gpu_exclusive_scan_level(Primitives& primitives, GLuint id_buffer, size_t num_items, size_t level) {
+	auto num_blocks = (num_items + primitives_group_size - 1) / primitives_group_size;
+
+	if (primitives.scan_block_sums.size() <= level) {
+		primitives.scan_block_sums.resize(level + 1, 0);
+		primitives.scan_block_sums_bytes.resize(level + 1, 0);
+	}
+
+	primitives_reserve(primitives.scan_block_sums[level], primitives.scan_block_sums_bytes[level], sizeof(uint32_t) * num_blocks);
+	auto id_block_sums = primitives.scan_block_sums[level];
+
+	shader_use_program(primitives.id_program);
+	shader_set_int(primitives.id_program, "action_id", 0);
+	shader_set_uint(primitives.id_program, "num_items", static_cast<unsigned int>(num_items));
+	primitives_bind(Ssbo_index::primitives_data, id_buffer);
+	primitives_bind(Ssbo_index::primitives_block_sums, id_block_sums);
+	dispatch_compute_linear(num_items, primitives_group_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	if (num_blocks == 1) {
+		return;
+	}
+
+	gpu_exclusive_scan_level(primitives, id_block_sums, num_blocks, level + 1);
+
+	shader_use_program(primitives.id_program);
+	shader_set_int(primitives.id_program, "action_id", 1);
+	shader_set_uint(primitives.id_program, "num_items", static_cast<unsigned int>(num_items));
+	primitives_bind(Ssbo_index::primitives_data, id_buffer);
+	primitives_bind(Ssbo_index::primitives_block_sums, id_block_sums);
+	dispatch_compute_linear(num_items, primitives_group_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// In place exclusive prefix sum of num_items uint32 values
+void gpu_exclusive_scan(Primitives& primitives, GLuint id_buffer, size_t num_items) {
+	if (num_items > 0) {
+		gpu_exclusive_scan_level(primitives, id_buffer, num_items, 0);
+	}
+}
+
+// Sum of each segment of values. Segment i is [segment_starts[i], segment_starts[i + 1]), so segment_starts has num_segments + 1 entries
+void gpu_segmented_reduce(Primitives& primitives, GLuint id_values, GLuint id_segment_starts, size_t num_segments, GLuint id_sums) {
+	if (num_segments == 0) {
+		return;
+	}
+
+	shader_use_program(primitives.id_program);
+	shader_set_int(primitives.id_program, "action_id", 2);
+	shader_set_uint(primitives.id_program, "num_segments", static_cast<unsigned int>(num_segments));
+	primitives_bind(Ssbo_index::primitives_data, id_values);
+	primitives_bind(Ssbo_index::primitives_aux, id_segment_starts);
+	primitives_bind(Ssbo_index::primitives_out, id_sums);
+	dispatch_compute_linear(num_segments * primitives_group_size, primitives_group_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Counts the values per bin, where the bin is (value >> bit_shift) & (num_bins - 1). num_bins has to be a power of two
+bool gpu_histogram(Primitives& primitives, GLuint id_values, size_t num_items, GLuint id_bins, int num_bins, int bit_shift) {
+	if (num_bins <= 0 || num_bins > primitives_max_histogram_bins || (num_bins & (num_bins - 1)) != 0) {
+		log_error(std::format("The number of histogram bins has to be a power of two up to {}, not {}", primitives_max_histogram_bins, num_bins));
+		return false;
+	}
+
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, id_bins);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, 0, sizeof(uint32_t) * num_bins, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+
+	if (num_items == 0) {
+		return true;
+	}
+
+	shader_use_program(primitives.id_program);
+	shader_set_int(primitives.id_program, "action_id", 3);
+	shader_set_uint(primitives.id_program, "num_items", static_cast<unsigned int>(num_items));
+	shader_set_uint(primitives.id_program, "num_bins", static_cast<unsigned int>(num_bins));
+	shader_set_uint(primitives.id_program, "bit_shift", static_cast<unsigned int>(bit_shift));
+	primitives_bind(Ssbo_index::primitives_data, id_values);
+	primitives_bind(Ssbo_index::primitives_out, id_bins);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	dispatch_compute_linear(num_items, primitives_group_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	return true;
+}
+
+// Stable LSD radix sort of uint32 keys, with a uint32 payload per key (eg. an index). One pass per 8 bits:
+//	count the digits per block, scan the counts, scatter. The passes ping-pong with scratch buffers, and since
+//	there is an even number of them, the sorted keys and payload end up back in the given buffers
+void gpu_radix_sort(Primitives& primitives, GLuint id_keys, GLuint id_payload, size_t num_items) {
+	if (num_items < 2) {
+		return;
+	}
+
+	auto num_digits = size_t(1) << primitives_radix_bits;
+	auto num_blocks = (num_items + primitives_group_size - 1) / primitives_group_size;
+	primitives_reserve(primitives.radix_keys, primitives.radix_keys_bytes, sizeof(uint32_t) * num_items);
+	primitives_reserve(primitives.radix_payload, primitives.radix_payload_bytes, sizeof(uint32_t) * num_items);
+	primitives_reserve(primitives.radix_counts, primitives.radix_counts_bytes, sizeof(uint32_t) * num_digits * num_blocks);
+
+	GLuint keys[2] = { id_keys, primitives.radix_keys };
+	GLuint payload[2] = { id_payload, primitives.radix_payload };
+
+	for (int bit_shift = 0, idx_pass = 0; bit_shift < 32; bit_shift += primitives_radix_bits, idx_pass++) {
+		auto idx_src = idx_pass % 2;
+		auto idx_dst = 1 - idx_src;
+
+		shader_use_program(primitives.id_program);
+		shader_set_int(primitives.id_program, "action_id", 4);
+		shader_set_uint(primitives.id_program, "num_items", static_cast<unsigned int>(num_items));
+		shader_set_uint(primitives.id_program, "bit_shift", static_cast<unsigned int>(bit_shift));
+		primitives_bind(Ssbo_index::primitives_data, keys[idx_src]);
+		primitives_bind(Ssbo_index::primitives_counts, primitives.radix_counts);
+		dispatch_compute_linear(num_items, primitives_group_size);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+		gpu_exclusive_scan(primitives, primitives.radix_counts, num_digits * num_blocks);
+
+		shader_use_program(primitives.id_program);
+		shader_set_int(primitives.id_program, "action_id", 5);
+		shader_set_uint(primitives.id_program, "num_items", static_cast<unsigned int>(num_items));
+		shader_set_uint(primitives.id_program, "bit_shift", static_cast<unsigned int>(bit_shift));
+		primitives_bind(Ssbo_index::primitives_data, keys[idx_src]);
+		primitives_bind(Ssbo_index::primitives_aux, payload[idx_src]);
+		primitives_bind(Ssbo_index::primitives_out, keys[idx_dst]);
+		primitives_bind(Ssbo_index::primitives_out_aux, payload[idx_dst]);
+		primitives_bind(Ssbo_index::primitives_counts, primitives.radix_counts);
+		dispatch_compute_linear(num_items, primitives_group_size);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+// CPU versions of the primitives, with the same results as the GPU ones. Used to validate them, and as
+//	the baseline in the benchmark. They split the work in one chunk per thread
+size_t cpu_num_chunks(size_t num_items) {
+	return std::max<size_t>(1, std::min<size_t>(num_items, cpu_num_threads()));
+}
+
+size_t cpu_chunk_start(size_t num_items, size_t num_chunks, size_t idx_chunk) {
+	return num_items * idx_chunk / num_chunks;
+}
+
+void cpu_exclusive_scan(std::vector<uint32_t>& values) {
+	auto num_chunks = cpu_num_chunks(values.size());
+	std::vector<uint32_t> chunk_sums(num_chunks + 1, 0);
+
+	parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+			uint32_t sum = 0;
+			for (auto idx = cpu_chunk_start(values.size(), num_chunks, idx_chunk); idx < cpu_chunk_start(values.size(), num_chunks, idx_chunk + 1); idx++) {
+				sum += values[idx];
+			}
+			chunk_sums[idx_chunk + 1] = sum;
+		}
+		});
+
+	for (size_t idx_chunk = 0; idx_chunk < num_chunks; idx_chunk++) {
+		chunk_sums[idx_chunk + 1] += chunk_sums[idx_chunk];
+	}
+
+	parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+			uint32_t sum = chunk_sums[idx_chunk];
+			for (auto idx = cpu_chunk_start(values.size(), num_chunks, idx_chunk); idx < cpu_chunk_start(values.size(), num_chunks, idx_chunk + 1); idx++) {
+				auto value = values[idx];
+				values[idx] = sum;
+				sum += value;
+			}
+		}
+		});
+}
+
+std::vector<uint32_t> cpu_segmented_reduce(const std::vector<uint32_t>& values, const std::vector<uint32_t>& segment_starts) {
+	std::vector<uint32_t> sums(segment_starts.size() - 1, 0);
+
+	parallel_for(sums.size(), [&](size_t idx_start, size_t idx_end) {
+		for (auto idx_segment = idx_start; idx_segment < idx_end; idx_segment++) {
+			for (auto idx = segment_starts[idx_segment]; idx < segment_starts[idx_segment + 1]; idx++) {
+				sums[idx_segment] += values[idx];
+			}
+		}
+		});
+
+	return sums;
+}
+
+std::vector<uint32_t> cpu_histogram(const std::vector<uint32_t>& values, int num_bins, int bit_shift) {
+	auto num_chunks = cpu_num_chunks(values.size());
+	std::vector<std::vector<uint32_t>> chunk_bins(num_chunks, std::vector<uint32_t>(num_bins, 0));
+
+	parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+			for (auto idx = cpu_chunk_start(values.size(), num_chunks, idx_chunk); idx < cpu_chunk_start(values.size(), num_chunks, idx_chunk + 1); idx++) {
+				chunk_bins[idx_chunk][(values[idx] >> bit_shift) & (num_bins - 1)]++;
+			}
+		}
+		});
+
+	std::vector<uint32_t> bins(num_bins, 0);
+	for (auto& cur_bins : chunk_bins) {
+		for (int bin = 0; bin < num_bins; bin++) {
+			bins[bin] += cur_bins[bin];
+		}
+	}
+
+	return bins;
+}
+
+// Same passes as gpu_radix_sort(), with chunks in place of work groups. Only the lowest num_key_bits of the keys are sorted on
+void cpu_radix_sort(std::vector<uint32_t>& keys, std::vector<uint32_t>& payload, int num_key_bits = 32) {
+	auto num_items = keys.size();
+	auto num_chunks = cpu_num_chunks(num_items);
+	auto num_digits = size_t(1) << primitives_radix_bits;
+	std::vector<uint32_t> keys_next(num_items);
+	std::vector<uint32_t> payload_next(num_items);
+	std::vector<size_t> offsets(num_digits * num_chunks);
+
+	for (int bit_shift = 0; bit_shift < num_key_bits; bit_shift += primitives_radix_bits) {
+		std::fill(offsets.begin(), offsets.end(), 0);
+
+		parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+			for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+				for (auto idx = cpu_chunk_start(num_items, num_chunks, idx_chunk); idx < cpu_chunk_start(num_items, num_chunks, idx_chunk + 1); idx++) {
+					offsets[((keys[idx] >> bit_shift) & (num_digits - 1)) * num_chunks + idx_chunk]++;
+				}
+			}
+			});
+
+		size_t sum = 0;
+		for (auto& offset : offsets) {
+			auto count = offset;
+			offset = sum;
+			sum += count;
+		}
+
+		parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+			for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+				for (auto idx = cpu_chunk_start(num_items, num_chunks, idx_chunk); idx < cpu_chunk_start(num_items, num_chunks, idx_chunk + 1); idx++) {
+					auto pos = offsets[((keys[idx] >> bit_shift) & (num_digits - 1)) * num_chunks + idx_chunk]++;
+					keys_next[pos] = keys[idx];
+					payload_next[pos] = payload[idx];
+				}
+			}
+			});
+
+		std::swap(keys, keys_next);
+		std::swap(payload, payload_next);
+	}
+}
+
+// CPU version of physics_compute.glsl, so the circle physics can run and be checked on machines without a GPU.
+//	The bodies are stored as one array per value, so the integration loops can be vectorized, and with the
+//	velocity instead of dir and speed. They are kept sorted by grid cell, so id holds the index each body started with
+struct Physics_bodies {
+	std::vector<uint32_t> id;
+	std::vector<float> pos_x;
+	std::vector<float> pos_y;
+	std::vector<float> vel_x;
+	std::vector<float> vel_y;
+	std::vector<float> r;
+	std::vector<float> mass;
+};
+
+// Cell list broadphase. The cells are at least as wide as the largest body, so a body can only touch bodies
+//	in its own cell and the eight around it. The bodies are sorted by cell every step, so the neighbours of a
+//	body are read from a few contiguous ranges. Bodies move little per step, so the sort mostly reads in order
+struct Physics_grid {
+	float cell_size = 0.0f;
+	int num_cells_x = 0;
+	int num_cells_y = 0;
+	int num_key_bits = 0;
+	std::vector<uint32_t> cell_of_sorted;	// Cell of each sorted body
+	std::vector<uint32_t> body_of_sorted;	// Index in Physics_cpu::bodies of each sorted body
+	std::vector<uint32_t> cell_start;		// First sorted body in each cell, and one past the last cell
+	Physics_bodies sorted;
+	std::vector<float> vel_x_next;			// Velocities after the collisions, in sorted order
+	std::vector<float> vel_y_next;
+};
+
+// Event-driven stepping, see physics_cpu_advance()
+enum class Physics_event_type { pair, wall_x, wall_y, cell_x, cell_y };
+
+struct Physics_event {
+	double t;
+	Physics_event_type type;
+	uint32_t idx_a;
+	uint32_t idx_b;				// The other body of a pair, or the cell the body was in for a cell crossing
+	uint32_t num_collisions_a;	// Collisions of the bodies when the event was predicted. If either has collided since, the event is stale
+	uint32_t num_collisions_b;
+
+	bool operator>(const Physics_event& other) const {
+		return t > other.t;
+	}
+};
+
+struct Physics_events {
+	std::vector<double> t_body;				// Time of each body's position in Physics_cpu::bodies
+	std::vector<uint32_t> num_collisions;	// Walls included
+	std::vector<int> cell_x;				// The cells are tracked by the events instead of being computed from the
+	std::vector<int> cell_y;				//	positions, so rounding on a cell border can not lose a body
+	std::vector<int> cell_head;				// Linked list of the bodies in each cell. -1: End of list
+	std::vector<int> body_next;
+	std::vector<int> body_prev;
+	std::priority_queue<Physics_event, std::vector<Physics_event>, std::greater<>> queue;
+	uint64_t num_events = 0;				// Events handled in the last call, stale ones not included
+};
+
+struct Physics_cpu {
+	Physics_bodies bodies;
+	Physics_grid grid;
+	Physics_events events;
+	float world_min_x = 0.0f;
+	float world_max_x = 0.0f;
+	float world_min_y = 0.0f;
+	float world_max_y = 0.0f;
+	uint64_t num_contacts = 0;	// Colliding pairs in the last step, counted once per body in the pair
+};
+
+void physics_bodies_resize(Physics_bodies& bodies, size_t num_bodies) {
+	bodies.id.resize(num_bodies);
+	for (auto values : { &bodies.pos_x, &bodies.pos_y, &bodies.vel_x, &bodies.vel_y, &bodies.r, &bodies.mass }) {
+		values->resize(num_bodies);
+	}
+}
+
+void physics_cpu_setup(Physics_cpu& physics, const std::vector<Circle>& circles, const std::vector<Physics>& physics_in,
+	float world_min_x, float world_max_x, float world_min_y, float world_max_y) {
+	auto num_bodies = circles.size();
+	physics_bodies_resize(physics.bodies, num_bodies);
+	physics_bodies_resize(physics.grid.sorted, num_bodies);
+	physics.world_min_x = world_min_x;
+	physics.world_max_x = world_max_x;
+	physics.world_min_y = world_min_y;
+	physics.world_max_y = world_max_y;
+
+	float r_max = 0.0f;
+	for (size_t idx = 0; idx < num_bodies; idx++) {
+		auto dir_length = std::sqrt(physics_in[idx].dir[0] * physics_in[idx].dir[0] + physics_in[idx].dir[1] * physics_in[idx].dir[1]);
+		auto scale = dir_length > 0.0f ? physics_in[idx].speed / dir_length : 0.0f;
+		physics.bodies.id[idx] = static_cast<uint32_t>(idx);
+		physics.bodies.pos_x[idx] = physics_in[idx].pos[0];
+		physics.bodies.pos_y[idx] = physics_in[idx].pos[1];
+		physics.bodies.vel_x[idx] = scale * physics_in[idx].dir[0];
+		physics.bodies.vel_y[idx] = scale * physics_in[idx].dir[1];
+		physics.bodies.r[idx] = circles[idx].r;
+		physics.bodies.mass[idx] = physics_in[idx].mass;
+		r_max = std::max(r_max, circles[idx].r);
+	}
+
+	// Tiny bodies in a large world would give far more cells than bodies, so the cells are made
+	//	larger until there is at most one per body
+	auto& grid = physics.grid;
+	auto world_w = world_max_x - world_min_x;
+	auto world_h = world_max_y - world_min_y;
+	grid.cell_size = std::max(2.0f * r_max, std::sqrt(world_w * world_h / std::max<size_t>(1, num_bodies)));
+	grid.num_cells_x = std::max(1, static_cast<int>(world_w / grid.cell_size));
+	grid.num_cells_y = std::max(1, static_cast<int>(world_h / grid.cell_size));
+	grid.cell_size = std::max(world_w / grid.num_cells_x, world_h / grid.num_cells_y);
+	grid.cell_start.resize(size_t(grid.num_cells_x) * grid.num_cells_y + 1);
+	grid.cell_of_sorted.resize(num_bodies);
+	grid.body_of_sorted.resize(num_bodies);
+	grid.vel_x_next.resize(num_bodies);
+	grid.vel_y_next.resize(num_bodies);
+	grid.num_key_bits = 1;
+	while ((size_t(1) << grid.num_key_bits) < grid.cell_start.size() - 1) {
+		grid.num_key_bits++;
+	}
+}
+
+// Back to the layout of the physics_compute kernel
+void physics_cpu_read(const Physics_cpu& physics, std::vector<Physics>& physics_out) {
+	physics_out.resize(physics.bodies.pos_x.size());
+	for (size_t idx = 0; idx < physics_out.size(); idx++) {
+		auto& out = physics_out[physics.bodies.id[idx]];
+		auto speed = std::sqrt(physics.bodies.vel_x[idx] * physics.bodies.vel_x[idx] + physics.bodies.vel_y[idx] * physics.bodies.vel_y[idx]);
+		out.pos[0] = physics.bodies.pos_x[idx];
+		out.pos[1] = physics.bodies.pos_y[idx];
+		out.dir[0] = speed > 0.0f ? physics.bodies.vel_x[idx] / speed : 1.0f;
+		out.dir[1] = speed > 0.0f ? physics.bodies.vel_y[idx] / speed : 0.0f;
+		out.speed = speed;
+		out.mass = physics.bodies.mass[idx];
+	}
+}
+
+// Moves the bodies and reflects them off the walls. No branches, so the compiler can vectorize it
+void physics_cpu_integrate(float* pos, float* vel, const float* r, size_t num_bodies, float dt, float world_min, float world_max) {
+	for (size_t idx = 0; idx < num_bodies; idx++) {
+		float pos_next = pos[idx] + dt * vel[idx];
+		float lo = world_min + r[idx];
+		float hi = world_max - r[idx];
+		float past_lo = std::max(0.0f, lo - pos_next);
+		float past_hi = std::max(0.0f, pos_next - hi);
+		pos[idx] = std::min(hi, std::max(lo, pos_next + 2.0f * (past_lo - past_hi)));
+		vel[idx] = past_lo + past_hi > 0.0f ? -vel[idx] : vel[idx];
+	}
+}
+
+void physics_cpu_build_grid(Physics_cpu& physics) {
+	auto& bodies = physics.bodies;
+	auto& grid = physics.grid;
+	auto num_bodies = bodies.pos_x.size();
+
+	parallel_for(num_bodies, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx = idx_start; idx < idx_end; idx++) {
+			int cell_x = std::clamp(static_cast<int>((bodies.pos_x[idx] - physics.world_min_x) / grid.cell_size), 0, grid.num_cells_x - 1);
+			int cell_y = std::clamp(static_cast<int>((bodies.pos_y[idx] - physics.world_min_y) / grid.cell_size), 0, grid.num_cells_y - 1);
+			grid.cell_of_sorted[idx] = static_cast<uint32_t>(cell_y * grid.num_cells_x + cell_x);
+			grid.body_of_sorted[idx] = static_cast<uint32_t>(idx);
+		}
+		});
+
+	// The sort is stable, so the order within a cell, and with it the result of a step, does not depend on the number of threads
+	cpu_radix_sort(grid.cell_of_sorted, grid.body_of_sorted, grid.num_key_bits);
+
+	// Each body sets the start of its own cell and of the empty cells before it. Every cell is written by exactly one body,
+	//	or by the last one for the empty cells at the end
+	parallel_for(num_bodies, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx = idx_start; idx < idx_end; idx++) {
+			auto cell = grid.cell_of_sorted[idx];
+			auto cell_first = idx == 0 ? 0 : grid.cell_of_sorted[idx - 1] + 1;
+			for (auto cell_empty = cell_first; cell_empty <= cell; cell_empty++) {
+				grid.cell_start[cell_empty] = static_cast<uint32_t>(idx);
+			}
+			if (idx == num_bodies - 1) {
+				std::fill(grid.cell_start.begin() + cell + 1, grid.cell_start.end(), static_cast<uint32_t>(num_bodies));
+			}
+
+			auto idx_body = grid.body_of_sorted[idx];
+			grid.sorted.id[idx] = bodies.id[idx_body];
+			grid.sorted.pos_x[idx] = bodies.pos_x[idx_body];
+			grid.sorted.pos_y[idx] = bodies.pos_y[idx_body];
+			grid.sorted.vel_x[idx] = bodies.vel_x[idx_body];
+			grid.sorted.vel_y[idx] = bodies.vel_y[idx_body];
+			grid.sorted.r[idx] = bodies.r[idx_body];
+			grid.sorted.mass[idx] = bodies.mass[idx_body];
+		}
+		});
+}
+
+// Elastic response for all touching pairs that move towards each other. Each thread owns a range of
+//	cells and only writes the new velocities of the bodies in them: a pair is handled from both sides,
+//	and both read the velocities from before the collisions, so no locks are needed
+void physics_cpu_collide(Physics_cpu& physics) {
+	auto& grid = physics.grid;
+	auto& sorted = grid.sorted;
+	std::atomic<uint64_t> num_contacts = 0;
+
+	parallel_for(grid.cell_start.size() - 1, [&](size_t idx_start, size_t idx_end) {
+		uint64_t num_contacts_range = 0;
+		for (auto cell = idx_start; cell < idx_end; cell++) {
+			if (grid.cell_start[cell] == grid.cell_start[cell + 1]) {
+				continue;
+			}
+
+			// The cells are sorted row by row, so the three neighbouring cells in a row are one range of bodies
+			int cell_x = static_cast<int>(cell % grid.num_cells_x);
+			int cell_y = static_cast<int>(cell / grid.num_cells_x);
+			int other_x_first = std::max(0, cell_x - 1);
+			int other_x_last = std::min(grid.num_cells_x - 1, cell_x + 1);
+			int num_rows = 0;
+			std::array<std::pair<uint32_t, uint32_t>, 3> rows;
+			for (int other_y = std::max(0, cell_y - 1); other_y <= std::min(grid.num_cells_y - 1, cell_y + 1); other_y++) {
+				auto row_start = size_t(other_y) * grid.num_cells_x;
+				rows[num_rows++] = { grid.cell_start[row_start + other_x_first], grid.cell_start[row_start + other_x_last + 1] };
+			}
+
+			for (auto idx_me = grid.cell_start[cell]; idx_me < grid.cell_start[cell + 1]; idx_me++) {
+				float x1 = sorted.pos_x[idx_me];
+				float y1 = sorted.pos_y[idx_me];
+				float vx1 = sorted.vel_x[idx_me];
+				float vy1 = sorted.vel_y[idx_me];
+				float r1 = sorted.r[idx_me];
+				float m1 = sorted.mass[idx_me];
+				float dvx = 0.0f;
+				float dvy = 0.0f;
+
+				for (int idx_row = 0; idx_row < num_rows; idx_row++) {
+					for (auto idx_other = rows[idx_row].first; idx_other < rows[idx_row].second; idx_other++) {
+						float dx = x1 - sorted.pos_x[idx_other];
+						float dy = y1 - sorted.pos_y[idx_other];
+						float d_square = dx * dx + dy * dy;
+						float r_sum = r1 + sorted.r[idx_other];
+						if (idx_other == idx_me || d_square >= r_sum * r_sum || d_square == 0.0f) {
+							continue;
+						}
+						float m2 = sorted.mass[idx_other];
+						float approach = (vx1 - sorted.vel_x[idx_other]) * dx + (vy1 - sorted.vel_y[idx_other]) * dy;
+						if (approach >= 0.0f) {
+							continue;
+						}
+						// Same as collide() in physics_compute.glsl
+						float impulse = (2.0f * m2 / (m1 + m2)) * (approach / d_square);
+						dvx -= impulse * dx;
+						dvy -= impulse * dy;
+						num_contacts_range++;
+					}
+				}
+
+				grid.vel_x_next[idx_me] = vx1 + dvx;
+				grid.vel_y_next[idx_me] = vy1 + dvy;
+			}
+		}
+		num_contacts += num_contacts_range;
+		});
+
+	physics.num_contacts = num_contacts;
+}
+
+void physics_cpu_step(Physics_cpu& physics, float dt) {
+	auto& bodies = physics.bodies;
+
+	parallel_for(bodies.pos_x.size(), [&](size_t idx_start, size_t idx_end) {
+		auto num_bodies = idx_end - idx_start;
+		physics_cpu_integrate(&bodies.pos_x[idx_start], &bodies.vel_x[idx_start], &bodies.r[idx_start], num_bodies, dt, physics.world_min_x, physics.world_max_x);
+		physics_cpu_integrate(&bodies.pos_y[idx_start], &bodies.vel_y[idx_start], &bodies.r[idx_start], num_bodies, dt, physics.world_min_y, physics.world_max_y);
+		});
+
+	physics_cpu_build_grid(physics);
+	physics_cpu_collide(physics);
+
+	// The sorted copy with the new velocities is the state for the next step
+	std::swap(bodies, physics.grid.sorted);
+	std::swap(bodies.vel_x, physics.grid.vel_x_next);
+	std::swap(bodies.vel_y, physics.grid.vel_y_next);
+}
+
+double physics_cpu_kinetic_energy(const Physics_cpu& physics) {
+	double energy = 0.0;
+	for (size_t idx = 0; idx < physics.bodies.pos_x.size(); idx++) {
+		energy += 0.5 * physics.bodies.mass[idx] * (physics.bodies.vel_x[idx] * physics.bodies.vel_x[idx] + physics.bodies.vel_y[idx] * physics.bodies.vel_y[idx]);
+	}
+
+	return energy;
+}
+
+// Event-driven stepping (continuous collision detection): instead of moving all bodies a fixed step and then
+//	looking for overlaps, the times of the upcoming wall hits, collisions and cell crossings are computed, and
+//	the bodies go from one event to the next. Each body only moves when it is part of an event, up to the time
+//	of it. Collisions happen at the exact time of contact, so the duration can be as long as wanted at the same
+//	accuracy. The events must be handled in order, so this runs on one thread
+void physics_events_sync(Physics_cpu& physics, uint32_t idx, double t) {
+	auto& events = physics.events;
+	auto dt = static_cast<float>(t - events.t_body[idx]);
+	physics.bodies.pos_x[idx] += dt * physics.bodies.vel_x[idx];
+	physics.bodies.pos_y[idx] += dt * physics.bodies.vel_y[idx];
+	events.t_body[idx] = t;
+}
+
+void physics_events_insert(Physics_cpu& physics, uint32_t idx) {
+	auto& events = physics.events;
+	auto cell = events.cell_y[idx] * physics.grid.num_cells_x + events.cell_x[idx];
+	events.body_prev[idx] = -1;
+	events.body_next[idx] = events.cell_head[cell];
+	if (events.cell_head[cell] >= 0) {
+		events.body_prev[events.cell_head[cell]] = static_cast<int>(idx);
+	}
+	events.cell_head[cell] = static_cast<int>(idx);
+}
+
+void physics_events_remove(Physics_cpu& physics, uint32_t idx) {
+	auto& events = physics.events;
+	auto cell = events.cell_y[idx] * physics.grid.num_cells_x + events.cell_x[idx];
+	if (events.body_prev[idx] >= 0) {
+		events.body_next[events.body_prev[idx]] = events.body_next[idx];
+	}
+	else {
+		events.cell_head[cell] = events.body_next[idx];
+	}
+	if (events.body_next[idx] >= 0) {
+		events.body_prev[events.body_next[idx]] = events.body_prev[idx];
+	}
+}
+
+// Time from now until the bodies touch, if they are moving towards each other. Bodies that already overlap
+//	and move towards each other collide right away
+double physics_events_time_of_impact(const Physics_cpu& physics, uint32_t idx_a, uint32_t idx_b, double t_now) {
+	auto& bodies = physics.bodies;
+	auto& events = physics.events;
+	double dx = (bodies.pos_x[idx_a] + (t_now - events.t_body[idx_a]) * bodies.vel_x[idx_a]) - (bodies.pos_x[idx_b] + (t_now - events.t_body[idx_b]) * bodies.vel_x[idx_b]);
+	double dy = (bodies.pos_y[idx_a] + (t_now - events.t_body[idx_a]) * bodies.vel_y[idx_a]) - (bodies.pos_y[idx_b] + (t_now - events.t_body[idx_b]) * bodies.vel_y[idx_b]);
+	double dvx = double(bodies.vel_x[idx_a]) - bodies.vel_x[idx_b];
+	double dvy = double(bodies.vel_y[idx_a]) - bodies.vel_y[idx_b];
+	double approach = dx * dvx + dy * dvy;
+	if (approach >= 0.0) {
+		return std::numeric_limits<double>::infinity();
+	}
+
+	double r_sum = double(bodies.r[idx_a]) + bodies.r[idx_b];
+	double d_square = dx * dx + dy * dy;
+	if (d_square <= r_sum * r_sum) {
+		return 0.0;
+	}
+
+	double v_square = dvx * dvx + dvy * dvy;
+	double discriminant = approach * approach - v_square * (d_square - r_sum * r_sum);
+	if (discriminant < 0.0) {
+		return std::numeric_limits<double>::infinity();
+	}
+
+	return (-approach - std::sqrt(discriminant)) / v_square;
+}
+
+// Queues the first wall hit and cell crossing of the body, and its collisions with the bodies around it, that happen before t_end
+void physics_events_predict(Physics_cpu& physics, uint32_t idx, double t_now, double t_end) {
+	auto& bodies = physics.bodies;
+	auto& grid = physics.grid;
+	auto& events = physics.events;
+	int cell_x = events.cell_x[idx];
+	int cell_y = events.cell_y[idx];
+	auto cell = static_cast<uint32_t>(cell_y * grid.num_cells_x + cell_x);
+	auto num_collisions = events.num_collisions[idx];
+	auto push = [&](double t_from_now, Physics_event_type type, uint32_t idx_b) {
+		auto t = t_now + std::max(0.0, t_from_now);
+		if (t < t_end) {
+			auto num_collisions_b = type == Physics_event_type::pair ? events.num_collisions[idx_b] : 0;
+			events.queue.push({ t, type, idx, idx_b, num_collisions, num_collisions_b });
+		}
+		};
+	for (int other_y = std::max(0, cell_y - 1); other_y <= std::min(grid.num_cells_y - 1, cell_y + 1); other_y++) {
+		for (int other_x = std::max(0, cell_x - 1); other_x <= std::min(grid.num_cells_x - 1, cell_x + 1); other_x++) {
+			for (auto idx_other = events.cell_head[other_y * grid.num_cells_x + other_x]; idx_other >= 0; idx_other = events.body_next[idx_other]) {
+				if (static_cast<uint32_t>(idx_other) != idx) {
+					push(physics_events_time_of_impact(physics, idx, idx_other, t_now), Physics_event_type::pair, idx_other);
+				}
+			}
+		}
+	}
+
+	auto vel_x = bodies.vel_x[idx];
+	auto vel_y = bodies.vel_y[idx];
+	auto r = bodies.r[idx];
+	if (vel_x != 0.0f) {
+		push(((vel_x > 0.0f ? physics.world_max_x - r : physics.world_min_x + r) - bodies.pos_x[idx]) / vel_x, Physics_event_type::wall_x, 0);
+	}
+	if (vel_y != 0.0f) {
+		push(((vel_y > 0.0f ? physics.world_max_y - r : physics.world_min_y + r) - bodies.pos_y[idx]) / vel_y, Physics_event_type::wall_y, 0);
+	}
+
+	// The border cells reach the walls, so there is nothing to cross there
+	if ((vel_x > 0.0f && cell_x < grid.num_cells_x - 1) || (vel_x < 0.0f && cell_x > 0)) {
+		auto border = physics.world_min_x + grid.cell_size * (cell_x + (vel_x > 0.0f ? 1 : 0));
+		push((border - bodies.pos_x[idx]) / vel_x, Physics_event_type::cell_x, cell);
+	}
+	if ((vel_y > 0.0f && cell_y < grid.num_cells_y - 1) || (vel_y < 0.0f && cell_y > 0)) {
+		auto border = physics.world_min_y + grid.cell_size * (cell_y + (vel_y > 0.0f ? 1 : 0));
+		push((border - bodies.pos_y[idx]) / vel_y, Physics_event_type::cell_y, cell);
+	}
+}
+
+// Moves the bodies duration forward, handling every event on the way
+void physics_cpu_advance(Physics_cpu& physics, double duration) {
+	auto& bodies = physics.bodies;
+	auto& grid = physics.grid;
+	auto& events = physics.events;
+	auto num_bodies = static_cast<uint32_t>(bodies.pos_x.size());
+
+	events.t_body.assign(num_bodies, 0.0);
+	events.num_collisions.assign(num_bodies, 0);
+	events.cell_x.resize(num_bodies);
+	events.cell_y.resize(num_bodies);
+	events.body_next.resize(num_bodies);
+	events.body_prev.resize(num_bodies);
+	events.cell_head.assign(size_t(grid.num_cells_x) * grid.num_cells_y, -1);
+	events.queue = {};
+	events.num_events = 0;
+
+	for (uint32_t idx = 0; idx < num_bodies; idx++) {
+		events.cell_x[idx] = std::clamp(static_cast<int>((bodies.pos_x[idx] - physics.world_min_x) / grid.cell_size), 0, grid.num_cells_x - 1);
+		events.cell_y[idx] = std::clamp(static_cast<int>((bodies.pos_y[idx] - physics.world_min_y) / grid.cell_size), 0, grid.num_cells_y - 1);
+		physics_events_insert(physics, idx);
+	}
+
+	for (uint32_t idx = 0; idx < num_bodies; idx++) {
+		physics_events_predict(physics, idx, 0.0, duration);
+	}
+
+	while (!events.queue.empty()) {
+		auto event = events.queue.top();
+		events.queue.pop();
+
+		auto idx_a = event.idx_a;
+		auto idx_b = event.idx_b;
+		bool is_pair = event.type == Physics_event_type::pair;
+		bool is_cell = event.type == Physics_event_type::cell_x || event.type == Physics_event_type::cell_y;
+		// A crossing does not change the velocity, so a body can have a crossing queued twice. Only the first one is valid
+		if (event.num_collisions_a != events.num_collisions[idx_a] ||
+			(is_pair && event.num_collisions_b != events.num_collisions[idx_b]) ||
+			(is_cell && idx_b != static_cast<uint32_t>(events.cell_y[idx_a] * grid.num_cells_x + events.cell_x[idx_a]))) {
+			continue;
+		}
+
+		events.num_events++;
+		physics_events_sync(physics, idx_a, event.t);
+
+		switch (event.type) {
+		case Physics_event_type::pair:
+		{
+			physics_events_sync(physics, idx_b, event.t);
+			// Same response as physics_cpu_collide(), for both bodies
+			float dx = bodies.pos_x[idx_a] - bodies.pos_x[idx_b];
+			float dy = bodies.pos_y[idx_a] - bodies.pos_y[idx_b];
+			float d_square = std::max(dx * dx + dy * dy, 1.0e-12f);
+			float m_a = bodies.mass[idx_a];
+			float m_b = bodies.mass[idx_b];
+			float approach = (bodies.vel_x[idx_a] - bodies.vel_x[idx_b]) * dx + (bodies.vel_y[idx_a] - bodies.vel_y[idx_b]) * dy;
+			float impulse_a = (2.0f * m_b / (m_a + m_b)) * (approach / d_square);
+			float impulse_b = (2.0f * m_a / (m_a + m_b)) * (approach / d_square);
+			bodies.vel_x[idx_a] -= impulse_a * dx;
+			bodies.vel_y[idx_a] -= impulse_a * dy;
+			bodies.vel_x[idx_b] += impulse_b * dx;
+			bodies.vel_y[idx_b] += impulse_b * dy;
+			events.num_collisions[idx_a]++;
+			events.num_collisions[idx_b]++;
+			physics_events_predict(physics, idx_a, event.t, duration);
+			physics_events_predict(physics, idx_b, event.t, duration);
+		}
+		break;
+		case Physics_event_type::wall_x:
+		case Physics_event_type::wall_y:
+		{
+			auto& vel = event.type == Physics_event_type::wall_x ? bodies.vel_x[idx_a] : bodies.vel_y[idx_a];
+			vel = -vel;
+			events.num_collisions[idx_a]++;
+			physics_events_predict(physics, idx_a, event.t, duration);
+		}
+		break;
+		case Physics_event_type::cell_x:
+		case Physics_event_type::cell_y:
+		{
+			// The events already queued for the body stay valid. Predicting again adds the bodies around the
+			//	new cell, and the next crossing
+			physics_events_remove(physics, idx_a);
+			if (event.type == Physics_event_type::cell_x) {
+				events.cell_x[idx_a] += bodies.vel_x[idx_a] > 0.0f ? 1 : -1;
+			}
+			else {
+				events.cell_y[idx_a] += bodies.vel_y[idx_a] > 0.0f ? 1 : -1;
+			}
+			physics_events_insert(physics, idx_a);
+			physics_events_predict(physics, idx_a, event.t, duration);
+		}
+		break;
+		}
+	}
+
+	parallel_for(num_bodies, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx = idx_start; idx < idx_end; idx++) {
+			physics_events_sync(physics, static_cast<uint32_t>(idx), duration);
+			auto r = bodies.r[idx];
+			bodies.pos_x[idx] = std::clamp(bodies.pos_x[idx], physics.world_min_x + r, physics.world_max_x - r);
+			bodies.pos_y[idx] = std::clamp(bodies.pos_y[idx], physics.world_min_y + r, physics.world_max_y - r);
+		}
+		});
+}
+
+// Random bodies for the benchmarks, with radius 0.5 - 1 and speed 0 - 10 per second. The world is sized so
+//	that the bodies cover about a tenth of it. Each body starts somewhere in its own square, so none overlap
+void physics_cpu_random_bodies(size_t num_bodies, uint32_t seed, std::vector<Circle>& circles, std::vector<Physics>& physics_in, float& world_size) {
+	float r_min = 0.5f;
+	float r_max = 1.0f;
+	float speed_max = 10.0f;
+	float r_mean = 0.5f * (r_min + r_max);
+	auto num_squares_x = static_cast<size_t>(std::ceil(std::sqrt(static_cast<double>(num_bodies))));
+	auto square_size = std::sqrt(std::numbers::pi_v<float> * r_mean * r_mean / 0.1f);
+	world_size = num_squares_x * square_size;
+
+	circles.resize(num_bodies);
+	physics_in.resize(num_bodies);
+	parallel_for(num_bodies, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx = idx_start; idx < idx_end; idx++) {
+			auto random = random_uniform4(seed, Random_stream::physics_init, static_cast<uint32_t>(idx), 0);
+			auto r = r_min + random[2] * (r_max - r_min);
+			auto angle = 2.0f * std::numbers::pi_v<float> * random[3];
+			circles[idx].r = r;
+			circles[idx].r_square = r * r;
+			physics_in[idx].pos[0] = (idx % num_squares_x) * square_size + r + random[0] * (square_size - 2.0f * r);
+			physics_in[idx].pos[1] = (idx / num_squares_x) * square_size + r + random[1] * (square_size - 2.0f * r);
+			physics_in[idx].dir[0] = std::cos(angle);
+			physics_in[idx].dir[1] = std::sin(angle);
+			physics_in[idx].speed = speed_max * random_uniform4(seed, Random_stream::physics_init, static_cast<uint32_t>(idx), 1)[0];
+			physics_in[idx].mass = r * r;
+		}
+		});
+}
+
+// --physics-cpu: Runs the CPU physics on random bodies, without a window or GL context, with an increasing
+//	number of threads. The bodies move less than their radius per step
+void physics_cpu_benchmark(size_t num_bodies, int num_steps, uint32_t seed) {
+	float dt = 1.0f / 60.0f;
+	float world_size;
+	std::vector<Circle> circles;
+	std::vector<Physics> physics_in;
+	physics_cpu_random_bodies(num_bodies, seed, circles, physics_in, world_size);
+
+	std::vector<size_t> thread_counts;
+	size_t max_num_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (size_t num_threads = 1; num_threads < max_num_threads; num_threads *= 2) {
+		thread_counts.push_back(num_threads);
+	}
+	thread_counts.push_back(max_num_threads);
+
+	Physics_cpu physics;
+	std::vector<float> pos_x_reference;
+	double t_one_thread_s = 0.0;
+
+	std::cout << std::format("CPU physics with {} bodies in a {:.0f}x{:.0f} world, {} steps", num_bodies, world_size, world_size, num_steps) << std::endl;
+
+	for (auto num_threads : thread_counts) {
+		cpu_max_threads = num_threads;
+		physics_cpu_setup(physics, circles, physics_in, 0.0f, world_size, 0.0f, world_size);
+		auto energy_start = physics_cpu_kinetic_energy(physics);
+		uint64_t num_contacts = 0;
+
+		auto t_start = std::chrono::high_resolution_clock::now();
+		for (int idx_step = 0; idx_step < num_steps; idx_step++) {
+			physics_cpu_step(physics, dt);
+			num_contacts += physics.num_contacts;
+		}
+		auto t_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+
+		if (num_threads == 1) {
+			t_one_thread_s = t_s;
+			pos_x_reference = physics.bodies.pos_x;
+			std::cout << std::format("  {} cells of {:.2f}, {:.1f} contacts per step, kinetic energy {:.4g} -> {:.4g}",
+				physics.grid.cell_start.size() - 1, physics.grid.cell_size, num_contacts / 2.0 / num_steps, energy_start, physics_cpu_kinetic_energy(physics)) << std::endl;
+		}
+
+		auto body_steps_per_s = num_bodies * num_steps / t_s;
+		auto speedup = t_one_thread_s / t_s;
+		std::cout << std::format("  {:3} threads {:9.3f} ms per step, {:8.2f} M body-steps/s, {:5.2f}x, {:3.0f}% efficiency, {}",
+			num_threads, 1000.0 * t_s / num_steps, body_steps_per_s / 1.0e6, speedup, 100.0 * speedup / num_threads,
+			physics.bodies.pos_x == pos_x_reference ? "same result" : "MISMATCH") << std::endl;
+	}
+
+	cpu_max_threads = 0;
+}
+
+// --physics-ccd: Compares the fixed steps of physics_cpu_step() with the event-driven physics_cpu_advance(), as simulated seconds
+//	per second. The reference is a single physics_cpu_advance() over the whole time, and the error is the RMS distance to its
+//	positions. The time is kept short, since small differences grow quickly with every collision
+void physics_cpu_ccd_benchmark(size_t num_bodies, uint32_t seed) {
+	double t_simulated_s = 0.5;
+	double max_error = 0.001;	// Good enough, no need to go on with shorter fixed steps
+	float world_size;
+	std::vector<Circle> circles;
+	std::vector<Physics> physics_in;
+	physics_cpu_random_bodies(num_bodies, seed, circles, physics_in, world_size);
+
+	Physics_cpu physics;
+	auto run = [&](const std::function<void()>& fn, double& t_wall_s) {
+		physics_cpu_setup(physics, circles, physics_in, 0.0f, world_size, 0.0f, world_size);
+		auto t_start = std::chrono::high_resolution_clock::now();
+		fn();
+		t_wall_s = std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t_start).count();
+		std::vector<Physics> result;
+		physics_cpu_read(physics, result);
+		return result;
+		};
+
+	double t_reference_s;
+	auto reference = run([&]() { physics_cpu_advance(physics, t_simulated_s); }, t_reference_s);
+	auto error = [&](const std::vector<Physics>& result) {
+		double sum = 0.0;
+		for (size_t idx = 0; idx < num_bodies; idx++) {
+			double dx = result[idx].pos[0] - reference[idx].pos[0];
+			double dy = result[idx].pos[1] - reference[idx].pos[1];
+			sum += dx * dx + dy * dy;
+		}
+		return std::sqrt(sum / num_bodies);
+		};
+
+	std::cout << std::format("CCD with {} bodies in a {:.0f}x{:.0f} world, {:.1f} s simulated, {} events. Fixed steps on {} threads, events on one",
+		num_bodies, world_size, world_size, t_simulated_s, physics.events.num_events, cpu_num_threads()) << std::endl;
+
+	auto print = [&](const std::string& name, double dt, const std::vector<Physics>& result, double t_wall_s) {
+		std::cout << std::format("  {:<8} step {:9.6f} s, error {:10.6f}, {:9.2f} simulated s/s", name, dt, error(result), t_simulated_s / t_wall_s) << std::endl;
+		};
+
+	double dt_frame = 1.0 / 60.0;
+	double t_events_s;
+	auto events_result = run([&]() {
+		for (double t = 0.0; t < t_simulated_s - 0.5 * dt_frame; t += dt_frame) {
+			physics_cpu_advance(physics, dt_frame);
+		}
+		}, t_events_s);
+	print("events", dt_frame, events_result, t_events_s);
+	print("events", t_simulated_s, reference, t_reference_s);
+	std::vector<Physics> result;
+
+	// Float positions limit how short the fixed steps can get: the shortest ones add so little per step that the rounding
+	//	takes over. They are made shorter until the error no longer goes down, and the most accurate one is compared
+	double best_error = std::numeric_limits<double>::infinity();
+	double best_dt = 0.0;
+	double best_t_s = 0.0;
+	for (int num_steps_per_s = 60; num_steps_per_s <= 60 * 1024; num_steps_per_s *= 4) {
+		auto num_steps = static_cast<int>(t_simulated_s * num_steps_per_s);
+		double t_fixed_s;
+		result = run([&]() {
+			for (int idx_step = 0; idx_step < num_steps; idx_step++) {
+				physics_cpu_step(physics, static_cast<float>(t_simulated_s / num_steps));
+			}
+			}, t_fixed_s);
+		print("fixed", t_simulated_s / num_steps, result, t_fixed_s);
+		if (error(result) >= best_error) {
+			break;
+		}
+		best_error = error(result);
+		best_dt = t_simulated_s / num_steps;
+		best_t_s = t_fixed_s;
+		if (best_error <= max_error) {
+			break;
+		}
+	}
+
+	std::cout << std::format("  Most accurate fixed steps: {:.6f} s with error {:.6f}. Events with {:.0f}x longer steps: {:.1f}x the simulated s/s, {}",
+		best_dt, best_error, dt_frame / best_dt, best_t_s / t_events_s, error(events_result) <= best_error ? "at a lower error" : "but at a HIGHER error") << std::endl;
+}
+
+void physics_gpu_set_world(GLuint id_program, float world_min_x, float world_max_x, float world_min_y, float world_max_y) {
+	shader_use_program(id_program);
+	shader_set_float(id_program, "world_min_x", world_min_x);
+	shader_set_float(id_program, "world_max_x", world_max_x);
+	shader_set_float(id_program, "world_min_y", world_min_y);
+	shader_set_float(id_program, "world_max_y", world_max_y);
+}
+
+// One fixed step of physics_compute.glsl, the GPU version of physics_cpu_step(). The circles, the bodies and
+//	the scratch buffer must be bound
+void physics_gpu_step(GLuint id_program, size_t num_bodies, float dt) {
+	shader_use_program(id_program);
+	shader_set_float(id_program, "dt", dt);
+	for (int action_id : { 0, 1, 2 }) {
+		shader_set_int(id_program, "action_id", action_id);
+		dispatch_compute_linear(num_bodies, 32 * 32);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+}
+
+// Event-driven step of physics_compute.glsl, the GPU version of physics_cpu_advance(). One work group, which
+//	handles the events in rounds. Every round checks all pairs, so this is for up to a few thousand bodies
+void physics_gpu_advance(GLuint id_program, float dt, int max_event_rounds) {
+	shader_use_program(id_program);
+	shader_set_float(id_program, "dt", dt);
+	shader_set_int(id_program, "action_id", 3);
+	shader_set_int(id_program, "max_event_rounds", max_event_rounds);
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+// Uniform grid over the Voronoi seeds, so picking and other queries from the host only look at the seeds near
+//	a point instead of all of them. Each cell has a doubly linked list of its seeds, as in Physics_events, so a
+//	seed that is dragged or animated moves to its new cell in constant time. Seeds outside the grid are kept in
+//	the nearest border cell
+struct Seed_grid {
+	float cell_size = 0.0f;
+	int num_cells_x = 0;
+	int num_cells_y = 0;
+	std::vector<float> pos_x;		// Of each seed, as last set
+	std::vector<float> pos_y;
+	std::vector<int> seed_cell;
+	std::vector<int> cell_head;		// -1: End of list
+	std::vector<int> seed_next;
+	std::vector<int> seed_prev;
+};
+
+int seed_grid_cell_x(const Seed_grid& grid, float x) {
+	return std::clamp(static_cast<int>(std::floor(x / grid.cell_size)), 0, grid.num_cells_x - 1);
+}
+
+int seed_grid_cell_y(const Seed_grid& grid, float y) {
+	return std::clamp(static_cast<int>(std::floor(y / grid.cell_size)), 0, grid.num_cells_y - 1);
+}
+
+void seed_grid_insert(Seed_grid& grid, int idx) {
+	auto cell = seed_grid_cell_y(grid, grid.pos_y[idx]) * grid.num_cells_x + seed_grid_cell_x(grid, grid.pos_x[idx]);
+	grid.seed_cell[idx] = cell;
+	grid.seed_prev[idx] = -1;
+	grid.seed_next[idx] = grid.cell_head[cell];
+	if (grid.cell_head[cell] >= 0) {
+		grid.seed_prev[grid.cell_head[cell]] = idx;
+	}
+	grid.cell_head[cell] = idx;
+}
+
+void seed_grid_remove(Seed_grid& grid, int idx) {
+	if (grid.seed_prev[idx] >= 0) {
+		grid.seed_next[grid.seed_prev[idx]] = grid.seed_next[idx];
+	}
+	else {
+		grid.cell_head[grid.seed_cell[idx]] = grid.seed_next[idx];
+	}
+	if (grid.seed_next[idx] >= 0) {
+		grid.seed_prev[grid.seed_next[idx]] = grid.seed_prev[idx];
+	}
+}
+
+// The grid covers [0, width) x [0, height), with about two seeds per cell if they are spread evenly
+void seed_grid_build(Seed_grid& grid, const std::vector<Physics>& seeds, float width, float height) {
+	auto num_seeds = seeds.size();
+	grid.cell_size = std::sqrt(2.0f * width * height / std::max<size_t>(1, num_seeds));
+	grid.num_cells_x = std::max(1, static_cast<int>(std::ceil(width / grid.cell_size)));
+	grid.num_cells_y = std::max(1, static_cast<int>(std::ceil(height / grid.cell_size)));
+	grid.cell_head.assign(size_t(grid.num_cells_x) * grid.num_cells_y, -1);
+	grid.seed_cell.resize(num_seeds);
+	grid.seed_next.resize(num_seeds);
+	grid.seed_prev.resize(num_seeds);
+	grid.pos_x.resize(num_seeds);
+	grid.pos_y.resize(num_seeds);
+
+	for (size_t idx = 0; idx < num_seeds; idx++) {
+		grid.pos_x[idx] = seeds[idx].pos[0];
+		grid.pos_y[idx] = seeds[idx].pos[1];
+		seed_grid_insert(grid, static_cast<int>(idx));
+	}
+}
+
+void seed_grid_move(Seed_grid& grid, int idx, float x, float y) {
+	grid.pos_x[idx] = x;
+	grid.pos_y[idx] = y;
+	auto cell = seed_grid_cell_y(grid, y) * grid.num_cells_x + seed_grid_cell_x(grid, x);
+
+	if (cell != grid.seed_cell[idx]) {
+		seed_grid_remove(grid, idx);
+		seed_grid_insert(grid, idx);
+	}
+}
+
+// Calls fn(idx, distance_square) for every seed within radius of (x, y)
+void seed_grid_for_each_within(const Seed_grid& grid, float x, float y, float radius, const std::function<void(int, float)>& fn) {
+	auto cell_min_x = seed_grid_cell_x(grid, x - radius);
+	auto cell_max_x = seed_grid_cell_x(grid, x + radius);
+	auto cell_min_y = seed_grid_cell_y(grid, y - radius);
+	auto cell_max_y = seed_grid_cell_y(grid, y + radius);
+
+	for (int cell_y = cell_min_y; cell_y <= cell_max_y; cell_y++) {
+		for (int cell_x = cell_min_x; cell_x <= cell_max_x; cell_x++) {
+			for (auto idx = grid.cell_head[cell_y * grid.num_cells_x + cell_x]; idx >= 0; idx = grid.seed_next[idx]) {
+				auto dx = grid.pos_x[idx] - x;
+				auto dy = grid.pos_y[idx] - y;
+				auto d_square = dx * dx + dy * dy;
+				if (d_square <= radius * radius) {
+					fn(idx, d_square);
+				}
+			}
+		}
+	}
+}
+
+// Nearest seed to (x, y), the lower index on a tie. -1: No seeds. Searches ring after ring of cells around the
+//	point, and stops once no seed in the next ring can be closer. Seeds outside the grid are in a border cell,
+//	further out than the cell itself, so they can not be closer than the ring either
+int seed_grid_nearest(const Seed_grid& grid, float x, float y) {
+	auto center_x = seed_grid_cell_x(grid, x);
+	auto center_y = seed_grid_cell_y(grid, y);
+	auto max_ring = std::max({ center_x, grid.num_cells_x - 1 - center_x, center_y, grid.num_cells_y - 1 - center_y });
+	int idx_best = -1;
+	float d_square_best = std::numeric_limits<float>::max();
+
+	auto visit_cell = [&](int cell_x, int cell_y) {
+		if (cell_x < 0 || cell_y < 0 || cell_x >= grid.num_cells_x || cell_y >= grid.num_cells_y) {
+			return;
+		}
+		for (auto idx = grid.cell_head[cell_y * grid.num_cells_x + cell_x]; idx >= 0; idx = grid.seed_next[idx]) {
+			auto dx = grid.pos_x[idx] - x;
+			auto dy = grid.pos_y[idx] - y;
+			auto d_square = dx * dx + dy * dy;
+			if (d_square < d_square_best || (d_square == d_square_best && idx < idx_best)) {
+				d_square_best = d_square;
+				idx_best = idx;
+			}
+		}
+		};
+
+	for (int ring = 0; ring <= max_ring; ring++) {
+		// A seed beyond this ring is at least ring cells away, minus the part of the center cell on the far side
+		//	of the point. Since the point can be anywhere in its cell, only whole cells count
+		auto d_min = (ring - 1) * grid.cell_size;
+		if (idx_best >= 0 && d_min > 0.0f && d_min * d_min > d_square_best) {
+			break;
+		}
+		for (int cell_x = center_x - ring; cell_x <= center_x + ring; cell_x++) {
+			visit_cell(cell_x, center_y - ring);
+			if (ring > 0) {
+				visit_cell(cell_x, center_y + ring);
+			}
+		}
+		for (int cell_y = center_y - ring + 1; cell_y <= center_y + ring - 1; cell_y++) {
+			visit_cell(center_x - ring, cell_y);
+			visit_cell(center_x + ring, cell_y);
+		}
+	}
+
+	return idx_best;
+}
+
+// The seed whose circle is under (x, y), the nearest one if they overlap. -1: None
+int seed_grid_pick(const Seed_grid& grid, const std::vector<Circle>& circles, float r_max, float x, float y) {
+	int idx_best = -1;
+	float d_square_best = std::numeric_limits<float>::max();
+
+	seed_grid_for_each_within(grid, x, y, r_max, [&](int idx, float d_square) {
+		if (d_square < circles[idx].r * circles[idx].r && (d_square < d_square_best || (d_square == d_square_best && idx < idx_best))) {
+			d_square_best = d_square;
+			idx_best = idx;
+		}
+		});
+
+	return idx_best;
+}
+
+// --seed-grid: Picking and moving seeds with the grid against a linear scan over all seeds, on random points in a
+//	window sized area. Both have to pick the same seeds
+void seed_grid_benchmark(size_t num_seeds, uint32_t seed) {
+	float width = 1920.0f;
+	float height = 1080.0f;
+	size_t num_queries = 10000;
+	std::vector<Physics> seeds(num_seeds);
+	std::vector<std::array<float, 4>> queries(num_queries);
+
+	for (size_t idx = 0; idx < num_seeds; idx++) {
+		auto r = random_uniform4(seed, Random_stream::benchmark, static_cast<uint32_t>(idx), 0);
+		seeds[idx].pos[0] = r[0] * width;
+		seeds[idx].pos[1] = r[1] * height;
+	}
+	for (size_t idx = 0; idx < num_queries; idx++) {
+		auto r = random_uniform4(seed, Random_stream::benchmark, static_cast<uint32_t>(idx), 1);
+		queries[idx] = { r[0] * width, r[1] * height, r[2] * width, r[3] * height };
+	}
+
+	Seed_grid grid;
+	auto t_start = std::chrono::high_resolution_clock::now();
+	seed_grid_build(grid, seeds, width, height);
+	auto t_build_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+
+	std::cout << std::format("Nearest of {} seeds to {} random points, {}x{} cells of {:.2f}, built in {:.1f} ms",
+		num_seeds, num_queries, grid.num_cells_x, grid.num_cells_y, grid.cell_size, t_build_ms) << std::endl;
+
+	// Every query moves a seed as well, as dragging does, so the grid has to keep up with the moves
+	std::vector<int> result_grid(num_queries);
+	std::vector<int> result_linear(num_queries);
+	auto time_us = [&](const std::function<void(size_t)>& fn) {
+		auto t_start = std::chrono::high_resolution_clock::now();
+		for (size_t idx = 0; idx < num_queries; idx++) {
+			fn(idx);
+		}
+		return std::chrono::duration<double, std::micro>(std::chrono::high_resolution_clock::now() - t_start).count() / num_queries;
+		};
+
+	auto seeds_linear = seeds;
+	auto t_linear_us = time_us([&](size_t idx) {
+		int idx_best = -1;
+		float d_square_best = std::numeric_limits<float>::max();
+		for (size_t idx_seed = 0; idx_seed < num_seeds; idx_seed++) {
+			auto dx = seeds_linear[idx_seed].pos[0] - queries[idx][0];
+			auto dy = seeds_linear[idx_seed].pos[1] - queries[idx][1];
+			auto d_square = dx * dx + dy * dy;
+			if (d_square < d_square_best) {
+				d_square_best = d_square;
+				idx_best = static_cast<int>(idx_seed);
+			}
+		}
+		result_linear[idx] = idx_best;
+		seeds_linear[idx_best].pos[0] = queries[idx][2];
+		seeds_linear[idx_best].pos[1] = queries[idx][3];
+		});
+
+	auto t_grid_us = time_us([&](size_t idx) {
+		result_grid[idx] = seed_grid_nearest(grid, queries[idx][0], queries[idx][1]);
+		seed_grid_move(grid, result_grid[idx], queries[idx][2], queries[idx][3]);
+		});
+
+	std::cout << std::format("  linear scan {:10.3f} us per pick and move", t_linear_us) << std::endl;
+	std::cout << std::format("  grid        {:10.3f} us per pick and move, {:.0f}x faster, {}",
+		t_grid_us, t_linear_us / t_grid_us, result_grid == result_linear ? "same seeds" : "DIFFERENT SEEDS") << std::endl;
+}
+
+// Must be kept in sync with voronoi.glsl
+const int voronoi_tile_size = 32;
+const uint32_t voronoi_tile_resolve = 0x80000000u;
+const float voronoi_max_distance = 200.0f;
+
+enum class Voronoi_tile : uint8_t { clean, shade, resolve };
+
+// The tiles of the Voronoi image to render in the next frame. Only the pixels a moved seed could reach before or
+//	after the move can change owner, so only their tiles search the seeds again (Voronoi_tile::resolve). Tiles that
+//	keep their owners but were drawn over, eg. by the text of the last frame, are only colored again
+struct Voronoi_dirty_tiles {
+	int width = 0;
+	int height = 0;
+	int num_tiles_x = 0;
+	int num_tiles_y = 0;
+	std::vector<Voronoi_tile> tiles;
+	std::vector<uint32_t> list;		// Tile indices for voronoi.glsl, with voronoi_tile_resolve for the ones to search
+};
+
+void voronoi_dirty_all(Voronoi_dirty_tiles& dirty) {
+	std::fill(dirty.tiles.begin(), dirty.tiles.end(), Voronoi_tile::resolve);
+}
+
+void voronoi_dirty_init(Voronoi_dirty_tiles& dirty, int width, int height) {
+	dirty.width = width;
+	dirty.height = height;
+	dirty.num_tiles_x = (width + voronoi_tile_size - 1) / voronoi_tile_size;
+	dirty.num_tiles_y = (height + voronoi_tile_size - 1) / voronoi_tile_size;
+	dirty.tiles.assign(static_cast<size_t>(dirty.num_tiles_x) * dirty.num_tiles_y, Voronoi_tile::resolve);
+	dirty.list.reserve(dirty.tiles.size());
+}
+
+// The pixels [x_min, x_max) x [y_min, y_max), clipped to the image
+void voronoi_dirty_rect(Voronoi_dirty_tiles& dirty, int x_min, int y_min, int x_max, int y_max, Voronoi_tile state) {
+	x_min = std::max(0, x_min);
+	y_min = std::max(0, y_min);
+	x_max = std::min(dirty.width, x_max);
+	y_max = std::min(dirty.height, y_max);
+
+	for (int tile_y = y_min / voronoi_tile_size; tile_y * voronoi_tile_size < y_max; tile_y++) {
+		for (int tile_x = x_min / voronoi_tile_size; tile_x * voronoi_tile_size < x_max; tile_x++) {
+			auto& tile = dirty.tiles[tile_x + tile_y * dirty.num_tiles_x];
+			tile = std::max(tile, state);
+		}
+	}
+}
+
+// The pixels a seed can own or blacken: within voronoi_max_distance of its circle, and in the blocks next to its
+//	own, since voronoi.glsl only looks at the seeds there. Call before and after the seed moves
+void voronoi_dirty_seed(Voronoi_dirty_tiles& dirty, const Physics& physics, const Circle& circle, Block_id block, int block_size) {
+	// d^2 - r^2 < voronoi_max_distance^2
+	float reach = std::sqrt(voronoi_max_distance * voronoi_max_distance + circle.r_square);
+	int x_min = std::max(static_cast<int>(std::floor(physics.pos[0] - reach)), (block.x - 1) * block_size);
+	int y_min = std::max(static_cast<int>(std::floor(physics.pos[1] - reach)), (block.y - 1) * block_size);
+	int x_max = std::min(static_cast<int>(std::ceil(physics.pos[0] + reach)) + 1, (block.x + 2) * block_size);
+	int y_max = std::min(static_cast<int>(std::ceil(physics.pos[1] + reach)) + 1, (block.y + 2) * block_size);
+
+	voronoi_dirty_rect(dirty, x_min, y_min, x_max, y_max, Voronoi_tile::resolve);
+}
+
+// The list for this frame. All tiles are clean afterwards
+std::vector<uint32_t>& voronoi_dirty_take(Voronoi_dirty_tiles& dirty) {
+	dirty.list.clear();
+
+	for (size_t idx_tile = 0; idx_tile < dirty.tiles.size(); idx_tile++) {
+		if (dirty.tiles[idx_tile] != Voronoi_tile::clean) {
+			dirty.list.push_back(static_cast<uint32_t>(idx_tile) | (dirty.tiles[idx_tile] == Voronoi_tile::resolve ? voronoi_tile_resolve : 0));
+			dirty.tiles[idx_tile] = Voronoi_tile::clean;
+		}
+	}
+
+	return dirty.list;
+}
+
+// GPU resources owned by one scene. They are created the first time the scene is shown
+//	and can be released again when switching to another scene
+struct Scene_resources {
+	std::string name;	// Owner of the resources in gpu_registry
+	std::vector<GLuint> buffers;
+	std::vector<GLuint> textures;
+	size_t num_bytes = 0;
+	bool is_allocated = false;
+};
+
+GLuint scene_setup_ssbo(Scene_resources& scene, GLuint ssbo_index, GLuint usage, GLsizeiptr data_size, void* data) {
+	auto idx_buffer = setup_ssbo("scene " + scene.name, ssbo_index, usage, data_size, data);
+
+	scene.buffers.push_back(idx_buffer);
+	scene.num_bytes += data_size;
+
+	return idx_buffer;
+}
+
+// Same as scene_setup_ssbo(), but the buffer is zeroed on the GPU so no host memory is needed for the initial contents
+GLuint scene_setup_ssbo_zeroed(Scene_resources& scene, GLuint ssbo_index, GLuint usage, GLsizeiptr data_size) {
+	auto idx_buffer = scene_setup_ssbo(scene, ssbo_index, usage, data_size, nullptr);
+
+	glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
+
+	return idx_buffer;
+}
+
+// A 2D array texture with a full mip chain, bound to the given texture unit. Sampled with trilinear filtering
+GLuint scene_setup_texture_array(Scene_resources& scene, GLuint texture_unit, GLenum internal_format, size_t bytes_per_texel, int width, int height, int num_layers) {
+	GLuint id_texture;
+	int num_levels = 1 + static_cast<int>(std::floor(std::log2(std::max(width, height))));
+
+	glGenTextures(1, &id_texture);
+	glActiveTexture(GL_TEXTURE0 + texture_unit);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, id_texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, num_levels, internal_format, width, height, num_layers);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glActiveTexture(GL_TEXTURE0);
+
+	scene.textures.push_back(id_texture);
+
+	size_t num_bytes = 0;
+	for (int level = 0; level < num_levels; level++) {
+		num_bytes += bytes_per_texel * std::max(1, width >> level) * std::max(1, height >> level) * num_layers;
+	}
+	scene.num_bytes += num_bytes;
+	gpu_track(gpu_registry.textures, id_texture, "scene " + scene.name, num_bytes);
+
+	return id_texture;
+}
+
+void scene_release(Scene_resources& scene) {
+	gpu_delete_buffers(scene.buffers);
+	gpu_delete_textures(scene.textures);
+
+	scene = { .name = scene.name };
+}
+
+// A snapshot file holds the GPU buffers of a scene by binding, plus the parameters needed to check that it
+//	fits the running scene: a Snapshot_header, num_buffers Snapshot_buffer entries, then the buffer contents
+const std::array<char, 8> snapshot_magic = { 'C', 'S', 'S', 'N', 'A', 'P', '0', '1' };
+
+struct Snapshot_header {
+	std::array<char, 8> magic;
+	int32_t scene;
+	uint32_t seed;
+	uint32_t mold_step_idx;
+	int32_t num_mold_types;
+	int32_t mold_world_width;
+	int32_t mold_world_height;
+	uint64_t mold_pool_size;
+	uint32_t num_buffers;
+	uint32_t padding;
+};
+
+struct Snapshot_buffer {
+	uint32_t binding;
+	uint32_t padding;
+	uint64_t offset;	// From the start of the file
+	uint64_t size;
+};
+
+// A snapshot that is being saved. The buffers are first copied to staging buffers on the GPU, which does not
+//	stall the frame. Once the fence says the copies are done, the staging buffers are mapped and a thread writes
+//	them to the file, and when it is done they are unmapped. See snapshot_save_poll()
+struct Snapshot_save {
+	enum class State { idle, copying, writing };
+	State state = State::idle;
+	std::filesystem::path path;
+	Snapshot_header header = {};
+	std::vector<Snapshot_buffer> buffers;
+	std::vector<GLuint> staging;
+	GLsync fence = nullptr;
+	std::thread writer;
+	std::atomic<bool> is_written = false;
+	bool success = false;
+};
+
+// (binding, buffer) of the given buffers that are bound to a shader storage binding point
+std::vector<std::pair<GLuint, GLuint>> ssbo_bindings(const std::vector<GLuint>& buffers) {
+	GLint num_bindings = 0;
+	glGetIntegerv(GL_MAX_SHADER_STORAGE_BUFFER_BINDINGS, &num_bindings);
+	std::vector<std::pair<GLuint, GLuint>> ret;
+
+	for (GLint binding = 0; binding < num_bindings; binding++) {
+		GLint id_buffer = 0;
+		glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, binding, &id_buffer);
+		if (id_buffer != 0 && std::find(buffers.begin(), buffers.end(), static_cast<GLuint>(id_buffer)) != buffers.end()) {
+			ret.push_back({ static_cast<GLuint>(binding), static_cast<GLuint>(id_buffer) });
+		}
+	}
+
+	return ret;
+}
+
+GLint64 ssbo_size(GLuint id_buffer) {
+	GLint64 size = 0;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, id_buffer);
+	glGetBufferParameteri64v(GL_SHADER_STORAGE_BUFFER, GL_BUFFER_SIZE, &size);
+	return size;
+}
+
+// Starts saving the buffers of the scene. The buffers are stored by binding rather than by id, since
+//	double buffered state (eg. the mold trail map) swaps which buffer is bound where
+bool snapshot_save_begin(Snapshot_save& save, const std::filesystem::path& path, const Snapshot_header& header, const Scene_resources& scene) {
+	if (save.state != Snapshot_save::State::idle) {
+		log_error("A snapshot is still being saved");
+		return false;
+	}
+
+	auto bindings = ssbo_bindings(scene.buffers);
+	save.path = path;
+	save.header = header;
+	save.header.magic = snapshot_magic;
+	save.header.num_buffers = static_cast<uint32_t>(bindings.size());
+	save.buffers.clear();
+	save.staging.assign(bindings.size(), 0);
+
+	// Make the writes of earlier dispatches visible to the copies
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	uint64_t offset = sizeof(Snapshot_header) + sizeof(Snapshot_buffer) * bindings.size();
+
+	for (size_t idx = 0; idx < bindings.size(); idx++) {
+		auto [binding, id_buffer] = bindings[idx];
+		auto size = static_cast<uint64_t>(ssbo_size(id_buffer));
+		save.buffers.push_back({ binding, 0, offset, size });
+		offset += size;
+
+		save.staging[idx] = gpu_create_buffer("snapshot", GL_COPY_WRITE_BUFFER, size, nullptr, GL_STREAM_READ);
+		glBindBuffer(GL_COPY_READ_BUFFER, id_buffer);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, size);
+	}
+
+	save.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	// Otherwise the fence might not be submitted until the end of the frame, and polling it does not flush
+	glFlush();
+	save.state = Snapshot_save::State::copying;
+
+	return true;
+}
+
+bool snapshot_write(const Snapshot_save& save, const std::vector<const void*>& mapped) {
+	auto path_tmp = save.path;
+	path_tmp += ".tmp";
+	std::ofstream file(path_tmp, std::ios::binary);
+
+	file.write(reinterpret_cast<const char*>(&save.header), sizeof(Snapshot_header));
+	file.write(reinterpret_cast<const char*>(save.buffers.data()), sizeof(Snapshot_buffer) * save.buffers.size());
+
+	for (size_t idx = 0; idx < save.buffers.size(); idx++) {
+		file.write(static_cast<const char*>(mapped[idx]), save.buffers[idx].size);
+	}
+
+	file.close();
+
+	if (!file) {
+		log_error(std::format("Could not write snapshot '{}'", path_tmp.string()));
+		return false;
+	}
+
+	// Only replace an earlier snapshot once the new one is complete
+	std::error_code error;
+	std::filesystem::rename(path_tmp, save.path, error);
+
+	if (error) {
+		log_error(std::format("Could not rename snapshot '{}' to '{}'", path_tmp.string(), save.path.string()));
+		return false;
+	}
+
+	return true;
+}
+
+// Moves a snapshot that is being saved along, without waiting. Call once per frame. Returns true when a save has just finished
+bool snapshot_save_poll(Snapshot_save& save) {
+	if (save.state == Snapshot_save::State::copying) {
+		auto status = glClientWaitSync(save.fence, 0, 0);
+
+		if (status == GL_TIMEOUT_EXPIRED) {
+			return false;
+		}
+
+		glDeleteSync(save.fence);
+		save.fence = nullptr;
+
+		std::vector<const void*> mapped(save.staging.size(), nullptr);
+		bool success = status != GL_WAIT_FAILED;
+
+		for (size_t idx = 0; idx < save.staging.size() && success; idx++) {
+			glBindBuffer(GL_COPY_READ_BUFFER, save.staging[idx]);
+			mapped[idx] = glMapBufferRange(GL_COPY_READ_BUFFER, 0, save.buffers[idx].size, GL_MAP_READ_BIT);
+			success = mapped[idx] != nullptr;
+		}
+
+		save.is_written = false;
+		save.success = false;
+
+		if (!success) {
+			log_error("Could not read back the buffers for the snapshot");
+			save.is_written = true;
+		}
+		else {
+			// The mapped pointers stay valid until the buffers are unmapped, which waits for the thread
+			save.writer = std::thread([&save, mapped]() {
+				save.success = snapshot_write(save, mapped);
+				save.is_written = true;
+				});
+		}
+
+		save.state = Snapshot_save::State::writing;
+	}
+
+	if (save.state == Snapshot_save::State::writing && save.is_written) {
+		if (save.writer.joinable()) {
+			save.writer.join();
+		}
+
+		for (auto id_buffer : save.staging) {
+			glBindBuffer(GL_COPY_READ_BUFFER, id_buffer);
+			glUnmapBuffer(GL_COPY_READ_BUFFER);
+		}
+
+		gpu_delete_buffers(save.staging);
+		save.staging.clear();
+		save.state = Snapshot_save::State::idle;
+
+		return true;
+	}
+
+	return false;
+}
+
+// Blocks until a snapshot that is being saved is on disk, eg. before exiting
+void snapshot_save_finish(Snapshot_save& save) {
+	while (save.state != Snapshot_save::State::idle) {
+		snapshot_save_poll(save);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
+
+// Uploads the buffers of a snapshot to the buffers bound at the same bindings, straight from the mapped file,
+//	so the restore is bounded by how fast the OS can page the file in. All buffers have to be there with the
+//	same sizes, which means the scene has to be set up with the same options as when the snapshot was saved.
+//	Nothing is uploaded if the file does not fit. header is set to the header of the file
+bool snapshot_restore(const std::filesystem::path& path, const Snapshot_header& expected, const Scene_resources& scene, Snapshot_header& header) {
+	Mapped_file file = {};
+
+	if (!mapped_file_open(path, file)) {
+		return false;
+	}
+
+	auto fail = [&file, &path](std::string msg) {
+		log_error(std::format("Could not restore snapshot '{}': {}", path.string(), msg));
+		mapped_file_close(file);
+		return false;
+		};
+
+	if (file.size < sizeof(Snapshot_header)) {
+		return fail("Too small");
+	}
+
+	header = read_le<Snapshot_header>(file.data);
+
+	if (header.magic != snapshot_magic) {
+		return fail("Not a snapshot");
+	}
+
+	if (header.scene != expected.scene) {
+		return fail("Saved from another scene");
+	}
+
+	bool same_mold_options = header.num_mold_types == expected.num_mold_types && header.mold_world_width == expected.mold_world_width &&
+		header.mold_world_height == expected.mold_world_height && header.mold_pool_size == expected.mold_pool_size;
+
+	if (header.scene == static_cast<int32_t>(Shaders::mold) && !same_mold_options) {
+		return fail(std::format("Saved with {} mold types, a {}x{} world and a pool of {}", header.num_mold_types, header.mold_world_width, header.mold_world_height, header.mold_pool_size));
+	}
+
+	// The state loads fine, but the random numbers drawn from here on differ from the run that saved it
+	if (header.seed != expected.seed) {
+		log_error(std::format("Snapshot '{}' was saved with --seed {}, so it continues differently with --seed {}", path.string(), header.seed, expected.seed));
+	}
+
+	auto table_end = sizeof(Snapshot_header) + sizeof(Snapshot_buffer) * static_cast<uint64_t>(header.num_buffers);
+
+	if (file.size < table_end) {
+		return fail("Truncated");
+	}
+
+	auto bindings = ssbo_bindings(scene.buffers);
+	std::vector<std::pair<Snapshot_buffer, GLuint>> uploads;
+
+	for (uint32_t idx = 0; idx < header.num_buffers; idx++) {
+		auto buffer = read_le<Snapshot_buffer>(file.data + sizeof(Snapshot_header) + sizeof(Snapshot_buffer) * idx);
+		auto binding = std::find_if(bindings.begin(), bindings.end(), [&buffer](auto& x) { return x.first == buffer.binding; });
+
+		if (binding == bindings.end() || static_cast<uint64_t>(ssbo_size(binding->second)) != buffer.size) {
+			return fail(std::format("The buffer at binding {} is missing or has another size", buffer.binding));
+		}
+
+		if (buffer.offset < table_end || buffer.offset + buffer.size > file.size) {
+			return fail("Truncated");
+		}
+
+		uploads.push_back({ buffer, binding->second });
+	}
+
+	if (uploads.size() != bindings.size()) {
+		return fail("The scene has buffers that are not in the snapshot");
+	}
+
+	for (auto& [buffer, id_buffer] : uploads) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, id_buffer);
+		glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, buffer.size, file.data + buffer.offset);
+	}
+
+	// glBufferSubData() has copied the data when it returns, so the file can be unmapped right away
+	mapped_file_close(file);
+
+	return true;
+}
+
+// Captures frames without waiting for them. Each frame is converted to 8 bits on the GPU into one of a ring of
+//	buffers, and once its fence has signaled, the buffer is mapped and handed to a writer thread, which saves it
+//	as a PPM file or writes it raw to a pipe. When all buffers are busy, the frame is dropped instead of waited for
+struct Frame_capture {
+	enum class Slot_state { free, converting, writing };
+
+	struct Slot {
+		GLuint id_buffer = 0;
+		GLsync fence = nullptr;
+		Slot_state state = Slot_state::free;
+		const void* pixels = nullptr;	// Mapped while writing
+		uint64_t idx_frame = 0;
+	};
+
+	bool is_active = false;
+	int width = 0;
+	int height = 0;
+	std::vector<Slot> slots;
+	std::deque<size_t> converting;		// In capture order, so the frames are written in order
+	std::filesystem::path directory;
+	FILE* pipe = nullptr;				// Raw frames go here instead of files, when set
+	std::thread writer;
+	// Shared with the writer thread
+	std::mutex mutex;
+	std::condition_variable cv;
+	std::deque<size_t> to_write;
+	std::deque<size_t> written;
+	bool stop = false;
+	bool has_failed = false;
+	uint64_t num_captured = 0;
+	uint64_t num_dropped = 0;
+};
+
+bool write_ppm(const std::filesystem::path& path, const unsigned char* rgba, int width, int height) {
+	std::ofstream file(path, std::ios::binary);
+	std::vector<char> row(3 * width);
+
+	file << "P6\n" << width << " " << height << "\n255\n";
+
+	for (int y = 0; y < height && file; y++) {
+		for (int x = 0; x < width; x++) {
+			std::memcpy(&row[3 * x], &rgba[4 * (static_cast<size_t>(y) * width + x)], 3);
+		}
+		file.write(row.data(), row.size());
+	}
+
+	return static_cast<bool>(file);
+}
+
+void frame_capture_write_frames(Frame_capture& capture) {
+	auto num_bytes = 4 * static_cast<size_t>(capture.width) * capture.height;
+
+	while (true) {
+		size_t idx_slot = 0;
+		bool has_failed = false;
+		{
+			std::unique_lock lock(capture.mutex);
+			capture.cv.wait(lock, [&capture]() { return capture.stop || !capture.to_write.empty(); });
+			if (capture.to_write.empty()) {
+				return;
+			}
+			idx_slot = capture.to_write.front();
+			capture.to_write.pop_front();
+			has_failed = capture.has_failed;
+		}
+
+		auto& slot = capture.slots[idx_slot];
+		bool success = true;
+
+		// After a failure, the slots are only handed back
+		if (!has_failed && capture.pipe != nullptr) {
+			success = std::fwrite(slot.pixels, 1, num_bytes, capture.pipe) == num_bytes;
+		}
+		else if (!has_failed) {
+			auto path = capture.directory / std::format("frame_{:06}.ppm", slot.idx_frame);
+			success = write_ppm(path, static_cast<const unsigned char*>(slot.pixels), capture.width, capture.height);
+		}
+
+		std::lock_guard lock(capture.mutex);
+		capture.has_failed = capture.has_failed || !success;
+		capture.written.push_back(idx_slot);
+	}
+}
+
+// Either directory or pipe_command is used, see Options::capture_directory and Options::capture_pipe
+bool frame_capture_start(Frame_capture& capture, int width, int height, size_t num_slots, const std::filesystem::path& directory, const std::string& pipe_command) {
+	capture.width = width;
+	capture.height = height;
+	capture.directory = directory;
+
+	if (!pipe_command.empty()) {
+#ifdef _WIN32
+		capture.pipe = _popen(pipe_command.c_str(), "wb");
+#else
+		// A failed write to a closed pipe should show up as an error, and not end the process
+		std::signal(SIGPIPE, SIG_IGN);
+		capture.pipe = popen(pipe_command.c_str(), "w");
+#endif
+		if (capture.pipe == nullptr) {
+			log_error(std::format("Could not start '{}' for the captured frames", pipe_command));
+			return false;
+		}
+	}
+	else {
+		std::error_code error;
+		std::filesystem::create_directories(directory, error);
+		if (error) {
+			log_error(std::format("Could not create directory '{}' for the captured frames", directory.string()));
+			return false;
+		}
+	}
+
+	capture.slots = std::vector<Frame_capture::Slot>(num_slots);
+
+	for (auto& slot : capture.slots) {
+		slot.id_buffer = gpu_create_buffer("capture", GL_SHADER_STORAGE_BUFFER, 4 * static_cast<size_t>(width) * height, nullptr, GL_STREAM_READ);
+	}
+
+	capture.stop = false;
+	capture.has_failed = false;
+	capture.num_captured = 0;
+	capture.num_dropped = 0;
+	capture.writer = std::thread(frame_capture_write_frames, std::ref(capture));
+	capture.is_active = true;
+
+	return true;
+}
+
+// Starts converting the current contents of the canvas (bound to image unit 0) into a free buffer
+void frame_capture_frame(Frame_capture& capture, GLuint id_program_capture, uint64_t idx_frame) {
+	auto slot = std::find_if(capture.slots.begin(), capture.slots.end(), [](auto& x) { return x.state == Frame_capture::Slot_state::free; });
+
+	if (slot == capture.slots.end()) {
+		capture.num_dropped++;
+		return;
+	}
+
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+	shader_use_program(id_program_capture);
+	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(Ssbo_index::capture_pixels), slot->id_buffer);
+	glDispatchCompute((capture.width + 15) / 16, (capture.height + 15) / 16, 1);
+	// For mapping the buffer later
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	slot->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot->state = Frame_capture::Slot_state::converting;
+	slot->idx_frame = idx_frame;
+	capture.converting.push_back(slot - capture.slots.begin());
+}
+
+// Hands converted frames to the writer and frees the buffers of written ones, without waiting. Call once
+//	per frame. Returns false if writing has failed
+bool frame_capture_poll(Frame_capture& capture) {
+	while (!capture.converting.empty()) {
+		auto& slot = capture.slots[capture.converting.front()];
+
+		if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.id_buffer);
+		slot.pixels = glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, 4 * static_cast<size_t>(capture.width) * capture.height, GL_MAP_READ_BIT);
+		slot.state = Frame_capture::Slot_state::writing;
+		{
+			std::lock_guard lock(capture.mutex);
+			// A failed map is passed on as a failed write, so the slot is still handed back
+			capture.has_failed = capture.has_failed || slot.pixels == nullptr;
+			capture.to_write.push_back(capture.converting.front());
+		}
+		capture.cv.notify_one();
+		capture.converting.pop_front();
+	}
+
+	std::deque<size_t> written;
+	bool has_failed = false;
+	{
+		std::lock_guard lock(capture.mutex);
+		std::swap(written, capture.written);
+		has_failed = capture.has_failed;
+	}
+
+	for (auto idx_slot : written) {
+		auto& slot = capture.slots[idx_slot];
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.id_buffer);
+		if (slot.pixels != nullptr) {
+			glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+		}
+		slot.pixels = nullptr;
+		slot.state = Frame_capture::Slot_state::free;
+		capture.num_captured += has_failed ? 0 : 1;
+	}
+
+	return !has_failed;
+}
+
+// Writes out the frames that are still in flight, then stops the writer
+void frame_capture_stop(Frame_capture& capture) {
+	auto is_busy = [&capture]() {
+		return std::any_of(capture.slots.begin(), capture.slots.end(), [](auto& x) { return x.state != Frame_capture::Slot_state::free; });
+		};
+
+	glFlush();
+
+	while (is_busy()) {
+		frame_capture_poll(capture);
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	{
+		std::lock_guard lock(capture.mutex);
+		capture.stop = true;
+	}
+	capture.cv.notify_one();
+	capture.writer.join();
+
+	if (capture.pipe != nullptr) {
+#ifdef _WIN32
+		_pclose(capture.pipe);
+#else
+		pclose(capture.pipe);
+#endif
+		capture.pipe = nullptr;
+	}
+
+	for (auto& slot : capture.slots) {
+		gpu_delete_buffer(slot.id_buffer);
+	}
+
+	if (capture.has_failed) {
+		log_error("Could not write the captured frames, capture stopped");
+	}
+
+	std::cout << std::format("Captured {} frames, dropped {} because the writer could not keep up", capture.num_captured, capture.num_dropped) << std::endl;
+	capture.slots.clear();
+	capture.is_active = false;
+}
+
+// Must be kept in sync with Mold_sweep_run in mold_sweep.glsl
+struct Mold_sweep_run {
+	float speed_factor;
+	float t_step_ms;
+	float sensor_distance;
+	int32_t num_types;
+	uint32_t seed;
+};
+
+// Every combination of the swept values, with --sweep-seeds runs of each
+std::vector<Mold_sweep_run> mold_sweep_runs(const Options& options) {
+	std::vector<Mold_sweep_run> runs;
+
+	for (auto speed_factor : options.sweep_speed_factors) {
+		for (auto t_step_ms : options.sweep_step_ms) {
+			for (auto sensor_distance : options.sweep_sensor_distances) {
+				for (auto num_types : options.sweep_num_types) {
+					for (int idx_seed = 0; idx_seed < options.sweep_num_seeds; idx_seed++) {
+						runs.push_back({ speed_factor, t_step_ms, sensor_distance, num_types, options.seed + idx_seed });
+					}
+				}
+			}
+		}
+	}
+
+	return runs;
+}
+
+// The mold_sweep program and its buffers, which grow on demand and are reused between batches. Small
+//	simulations leave most of the GPU idle, so a batch packs many of them into the same dispatches
+struct Mold_sweep {
+	GLuint id_program = 0;
+	int world_width = 0;
+	int world_height = 0;
+	size_t num_particles_per_run = 0;
+	int num_steps = 0;
+	GLuint runs = 0;
+	GLuint particles = 0;
+	std::array<GLuint, 2> trails = {};		// Index 0 is the current one, bound to Ssbo_index::mold_sweep_trails
+	GLuint pixels = 0;
+	size_t runs_bytes = 0;
+	size_t particles_bytes = 0;
+	std::array<size_t, 2> trails_bytes = {};
+	size_t pixels_bytes = 0;
+};
+
+// Simulates runs[idx_first, idx_first + num_runs) together and returns their thumbnails, world_width x
+//	world_height pixels per run, in the format of capture.glsl. A run does not depend on the others in its batch
+std::vector<uint32_t> mold_sweep_batch(Mold_sweep& sweep, const std::vector<Mold_sweep_run>& runs, size_t idx_first, size_t num_runs) {
+	std::vector<Mold_sweep_run> batch(runs.begin() + idx_first, runs.begin() + idx_first + num_runs);
+	auto max_num_types = std::max_element(batch.begin(), batch.end(), [](auto& a, auto& b) { return a.num_types < b.num_types; })->num_types;
+	int num_layers = (max_num_types + 3) / 4;
+	size_t num_pixels = static_cast<size_t>(sweep.world_width) * sweep.world_height;
+	size_t num_particles = num_runs * sweep.num_particles_per_run;
+	size_t trails_bytes = sizeof(float) * 4 * num_layers * num_pixels * num_runs;
+
+	primitives_reserve(sweep.runs, sweep.runs_bytes, sizeof(Mold_sweep_run) * num_runs, "sweep");
+	primitives_reserve(sweep.particles, sweep.particles_bytes, sizeof(Mold_particle) * num_particles, "sweep");
+	primitives_reserve(sweep.trails[0], sweep.trails_bytes[0], trails_bytes, "sweep");
+	primitives_reserve(sweep.trails[1], sweep.trails_bytes[1], trails_bytes, "sweep");
+	primitives_reserve(sweep.pixels, sweep.pixels_bytes, sizeof(uint32_t) * num_pixels * num_runs, "sweep");
+	ssbo_update(sweep.runs, 0, sizeof(Mold_sweep_run) * num_runs, batch.data());
+	// Trails are only ever raised to a deposit or blurred, so they have to start at zero
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, sweep.trails[0]);
+	glClearBufferSubData(GL_SHADER_STORAGE_BUFFER, GL_R32F, 0, trails_bytes, GL_RED, GL_FLOAT, nullptr);
+
+	primitives_bind(Ssbo_index::mold_sweep_runs, sweep.runs);
+	primitives_bind(Ssbo_index::mold_sweep_particles, sweep.particles);
+	primitives_bind(Ssbo_index::mold_sweep_trails, sweep.trails[0]);
+	primitives_bind(Ssbo_index::mold_sweep_trails_next, sweep.trails[1]);
+	primitives_bind(Ssbo_index::mold_sweep_pixels, sweep.pixels);
+
+	// Same weights as the mold scene with its default radius of 1
+	float sigma = 1.0f;
+	float weight_side = std::exp(-1.0f / (2 * sigma * sigma));
+	std::vector<float> kernel_weights = { 1.0f / (1.0f + 2.0f * weight_side), weight_side / (1.0f + 2.0f * weight_side) };
+
+	shader_use_program(sweep.id_program);
+	shader_set_int(sweep.id_program, "world_width", sweep.world_width);
+	shader_set_int(sweep.id_program, "world_height", sweep.world_height);
+	shader_set_int(sweep.id_program, "num_layers", num_layers);
+	shader_set_int(sweep.id_program, "num_runs", static_cast<int>(num_runs));
+	shader_set_uint(sweep.id_program, "num_particles_per_run", static_cast<unsigned int>(sweep.num_particles_per_run));
+	shader_set_float_array(sweep.id_program, "kernel_weights", kernel_weights);
+
+	auto dispatch_particles = [&](int action_id) {
+		shader_set_int(sweep.id_program, "action_id", action_id);
+		dispatch_compute_linear(num_particles, 256);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+	// One layer of work groups per run
+	auto dispatch_pixels = [&](int action_id) {
+		shader_set_int(sweep.id_program, "action_id", action_id);
+		glDispatchCompute((sweep.world_width + 15) / 16, (sweep.world_height + 15) / 16, static_cast<GLuint>(num_runs));
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+
+	dispatch_particles(0);
+
+	// Same order as the mold scene: move, diffuse and decay, then leave the new trails
+	for (int idx_step = 0; idx_step < sweep.num_steps; idx_step++) {
+		shader_set_uint(sweep.id_program, "step_idx", static_cast<unsigned int>(idx_step));
+		dispatch_particles(1);
+		dispatch_pixels(3);
+		std::swap(sweep.trails[0], sweep.trails[1]);
+		std::swap(sweep.trails_bytes[0], sweep.trails_bytes[1]);
+		primitives_bind(Ssbo_index::mold_sweep_trails, sweep.trails[0]);
+		primitives_bind(Ssbo_index::mold_sweep_trails_next, sweep.trails[1]);
+		dispatch_particles(2);
+	}
+
+	dispatch_pixels(4);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	std::vector<uint32_t> pixels(num_pixels * num_runs);
+	ssbo_read(sweep.pixels, 0, sizeof(uint32_t) * pixels.size(), pixels.data());
+
+	return pixels;
+}
+
+// Simulates all runs, batch_size at a time. With a directory, saves the thumbnail of each run there as
+//	run_<index>.ppm, and a runs.csv with the values of each run and the share of the world its trails cover.
+//	Returns a hash of all thumbnails, to check that different batch sizes give the same results
+uint64_t mold_sweep_execute(Mold_sweep& sweep, const std::vector<Mold_sweep_run>& runs, size_t batch_size, const std::filesystem::path& directory) {
+	size_t num_pixels = static_cast<size_t>(sweep.world_width) * sweep.world_height;
+	uint64_t hash = 14695981039346656037ull;	// FNV-1a
+	std::ofstream csv;
+
+	if (!directory.empty()) {
+		csv.open(directory / "runs.csv");
+		csv << "run,speed_factor,t_step_ms,sensor_distance,num_types,seed,coverage\n";
+	}
+
+	for (size_t idx_first = 0; idx_first < runs.size(); idx_first += batch_size) {
+		auto num_runs = std::min(batch_size, runs.size() - idx_first);
+		auto pixels = mold_sweep_batch(sweep, runs, idx_first, num_runs);
+
+		for (auto pixel : pixels) {
+			hash = (hash ^ pixel) * 1099511628211ull;
+		}
+
+		if (directory.empty()) {
+			continue;
+		}
+
+		for (size_t idx_run = 0; idx_run < num_runs; idx_run++) {
+			auto run_pixels = reinterpret_cast<const unsigned char*>(pixels.data() + idx_run * num_pixels);
+			auto& run = runs[idx_first + idx_run];
+			auto idx = idx_first + idx_run;
+			// Pixels with a trail of at least 10% of the full intensity, in any channel
+			size_t num_covered = 0;
+			for (size_t idx_pixel = 0; idx_pixel < num_pixels; idx_pixel++) {
+				auto rgb = &run_pixels[4 * idx_pixel];
+				num_covered += std::max({ rgb[0], rgb[1], rgb[2] }) >= 26;
+			}
+
+			write_ppm(directory / std::format("run_{:04}.ppm", idx), run_pixels, sweep.world_width, sweep.world_height);
+			csv << std::format("{},{},{},{},{},{},{:.4f}\n", idx, run.speed_factor, run.t_step_ms, run.sensor_distance, run.num_types, run.seed, num_covered / static_cast<float>(num_pixels));
+		}
+	}
+
+	if (csv.is_open() && !csv) {
+		log_error(std::format("Could not write the sweep results to '{}'", directory.string()));
+	}
+
+	return hash;
+}
+
+void mold_sweep_release(Mold_sweep& sweep) {
+	for (auto id_buffer : { &sweep.runs, &sweep.particles, &sweep.trails[0], &sweep.trails[1], &sweep.pixels }) {
+		gpu_delete_buffer(*id_buffer);
+	}
+
+	sweep = { sweep.id_program, sweep.world_width, sweep.world_height, sweep.num_particles_per_run, sweep.num_steps };
+}
+
+// Must be kept in sync with rays_wavefront.glsl
+const int rays_num_sort_keys = 64;
+const unsigned int rays_group_size = 256;
+const size_t rays_ray_size = 12 * sizeof(uint32_t);
+
+// Must be kept in sync with layout_ray_counters in rays_wavefront.glsl. The first three values are the
+//	indirect dispatch arguments for the passes over the ray queue
+struct Ray_counters {
+	uint32_t num_groups[3];
+	uint32_t num_rays;
+	uint32_t num_rays_next;
+	uint32_t key_counts[rays_num_sort_keys];
+	uint32_t key_offsets[rays_num_sort_keys];
+	uint32_t bounce;
+	uint32_t num_rays_per_bounce[rays_max_bounces];
+	uint32_t num_hits_per_bounce[rays_max_bounces];
+};
+
+// The rays scene as a wavefront path tracer, see rays_wavefront.glsl. The queues hold one ray per pixel and
+//	grow with the image. They are not part of the scene resources, since they hold nothing between frames,
+//	and are released whenever the app switches away from the rays scene
+struct Rays_wavefront {
+	GLuint id_program = 0;
+	int num_bounces = 3;
+	int num_shadow_samples = 0;
+	bool sort_rays = true;
+	uint32_t seed = 0;
+	uint32_t frame_idx = 0;		// Picks new points on the light every frame
+	GLuint queue = 0;
+	GLuint queue_sorted = 0;
+	GLuint counters = 0;
+	size_t queue_bytes = 0;
+	size_t queue_sorted_bytes = 0;
+	size_t counters_bytes = 0;
+};
+
+// Renders into image unit 0. The program has to be in use with the camera uniforms set, as for rays.glsl.
+//	The host never reads how many rays are left: every bounce runs its passes with the size from Ray_counters
+void rays_wavefront_render(Rays_wavefront& rays, int width, int height) {
+	auto num_pixels = static_cast<size_t>(width) * height;
+
+	primitives_reserve(rays.queue, rays.queue_bytes, rays_ray_size * num_pixels, "rays");
+	primitives_reserve(rays.queue_sorted, rays.queue_sorted_bytes, rays_ray_size * num_pixels, "rays");
+	primitives_reserve(rays.counters, rays.counters_bytes, sizeof(Ray_counters), "rays");
+	primitives_bind(Ssbo_index::ray_queue, rays.queue);
+	primitives_bind(Ssbo_index::ray_queue_sorted, rays.queue_sorted);
+	primitives_bind(Ssbo_index::ray_counters, rays.counters);
+
+	shader_set_int(rays.id_program, "num_bounces", rays.num_bounces);
+	shader_set_int(rays.id_program, "num_shadow_samples", rays.num_shadow_samples);
+	shader_set_bool(rays.id_program, "sort_rays", rays.sort_rays);
+	shader_set_uint(rays.id_program, "seed", rays.seed);
+	shader_set_uint(rays.id_program, "frame_idx", rays.frame_idx++);
+
+	// Must sync with the actions in rays_wavefront::main()
+	auto dispatch_pixels = [&](int action_id) {
+		shader_set_int(rays.id_program, "action_id", action_id);
+		dispatch_compute_linear(num_pixels, rays_group_size);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		};
+	auto dispatch_queue = [&](int action_id) {
+		shader_set_int(rays.id_program, "action_id", action_id);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, rays.counters);
+		glDispatchComputeIndirect(0);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		};
+	auto dispatch_single = [&](int action_id) {
+		shader_set_int(rays.id_program, "action_id", action_id);
+		glDispatchCompute(1, 1, 1);
+		// The next indirect dispatches read the arguments written here
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_COMMAND_BARRIER_BIT);
+		};
+
+	dispatch_pixels(0);
+	glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+
+	for (int idx_bounce = 0; idx_bounce < rays.num_bounces; idx_bounce++) {
+		dispatch_queue(1);
+		if (rays.sort_rays) {
+			dispatch_single(2);
+		}
+		dispatch_queue(3);
+		dispatch_queue(4);
+		if (rays.num_shadow_samples > 0) {
+			dispatch_queue(5);
+		}
+		dispatch_single(6);
+	}
+
+	dispatch_pixels(7);
+}
+
+void rays_wavefront_release(Rays_wavefront& rays) {
+	for (auto id_buffer : { &rays.queue, &rays.queue_sorted, &rays.counters }) {
+		gpu_delete_buffer(*id_buffer);
+	}
+
+	rays = { rays.id_program, rays.num_bounces, rays.num_shadow_samples, rays.sort_rays, rays.seed, rays.frame_idx };
+}
+
+// Must be kept in sync with statistics.glsl
+const unsigned int statistics_group_size = 256;
+const unsigned int statistics_num_groups = 256;
+const size_t statistics_row_size = 2 * max_num_mold_types + 4;
+
+// Must be kept in sync with layout_statistics in statistics.glsl. The ray counts are copied from Ray_counters,
+//	the number of live particles from Mold_counters and the number of free pages from the page pool
+struct Statistics {
+	uint32_t mold_population[max_num_mold_types];
+	float mold_trail_total[max_num_mold_types];
+	float physics_kinetic_energy;
+	float physics_momentum[2];
+	uint32_t physics_num_bodies;
+	uint32_t rays_num_rays[rays_max_bounces];
+	uint32_t rays_num_hits[rays_max_bounces];
+	uint32_t mold_num_alive;
+	int32_t mold_num_free_pages;
+};
+
+// What the statistics of a frame are computed from. The buffers are the ones bound for the scene
+struct Statistics_sources {
+	std::string scene;
+	bool has_mold = false;
+	int num_mold_types = 0;
+	int num_mold_layers = 0;
+	size_t num_mold_trail_pixels = 0;	// In the whole page pool
+	size_t mold_pool_size = 0;
+	size_t num_mold_tiles = 0;
+	size_t num_mold_pages = 0;
+	GLuint mold_counters = 0;
+	GLuint mold_page_pool = 0;
+	bool has_physics = false;
+	GLuint ray_counters = 0;			// Of the last wavefront render. 0: No rays
+};
+
+// Aggregates of the simulations for the stats overlay and --stats-log, see statistics.glsl. They are reduced on
+//	the GPU into a small buffer, and read back without waiting: each frame uses the next buffer of a ring, and a
+//	result is only read once its fence has signaled. When all buffers are still in flight, the frame is skipped
+struct Gpu_statistics {
+	struct Slot {
+		GLuint id_buffer = 0;
+		GLsync fence = nullptr;
+		Statistics_sources sources;
+		uint64_t idx_frame = 0;
+	};
+
+	GLuint id_program = 0;
+	GLuint partials = 0;
+	size_t partials_bytes = 0;
+	std::array<Slot, 3> slots;
+	size_t idx_next = 0;
+	bool has_latest = false;
+	Statistics latest = {};
+	Statistics_sources latest_sources;
+	uint64_t latest_frame = 0;
+	std::ofstream log;		// --stats-log
+};
+
+bool gpu_statistics_start_log(Gpu_statistics& stats, const std::filesystem::path& log_path) {
+	stats.log.open(log_path);
+
+	if (!stats.log) {
+		log_error(std::format("Could not open '{}' for the statistics log", log_path.string()));
+		return false;
+	}
+
+	stats.log << "frame,scene,name,value\n";
+
+	return true;
+}
+
+// Runs the reductions into id_result, a buffer of one Statistics
+void gpu_statistics_reduce(Gpu_statistics& stats, const Statistics_sources& sources, GLuint id_result) {
+	primitives_reserve(stats.partials, stats.partials_bytes, sizeof(uint32_t) * statistics_row_size * statistics_num_groups, "statistics");
+	primitives_bind(Ssbo_index::statistics_partials, stats.partials);
+	primitives_bind(Ssbo_index::statistics, id_result);
+
+	shader_use_program(stats.id_program);
+	shader_set_int(stats.id_program, "num_types", sources.num_mold_types);
+	shader_set_int(stats.id_program, "num_layers", sources.num_mold_layers);
+	shader_set_uint(stats.id_program, "num_trail_pixels", static_cast<uint32_t>(sources.num_mold_trail_pixels));
+	shader_set_bool(stats.id_program, "has_mold", sources.has_mold);
+	shader_set_bool(stats.id_program, "has_physics", sources.has_physics);
+
+	// Must sync with the actions in statistics::main()
+	auto dispatch = [&](int action_id, GLuint num_groups) {
+		shader_set_int(stats.id_program, "action_id", action_id);
+		glDispatchCompute(num_groups, 1, 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+
+	if (sources.has_mold) {
+		dispatch(0, statistics_num_groups);
+	}
+	if (sources.has_physics) {
+		dispatch(1, statistics_num_groups);
+	}
+	dispatch(2, 1);
+
+	// For copying the counters and reading the result later
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+	if (sources.ray_counters != 0) {
+		glBindBuffer(GL_COPY_READ_BUFFER, sources.ray_counters);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id_result);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(Ray_counters, num_rays_per_bounce), offsetof(Statistics, rays_num_rays),
+			2 * sizeof(uint32_t) * rays_max_bounces);
+	}
+	if (sources.has_mold) {
+		glBindBuffer(GL_COPY_READ_BUFFER, sources.mold_counters);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, id_result);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, offsetof(Mold_counters, num_alive), offsetof(Statistics, mold_num_alive), sizeof(uint32_t));
+		// The count of free pages is the first int of the pool
+		glBindBuffer(GL_COPY_READ_BUFFER, sources.mold_page_pool);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, offsetof(Statistics, mold_num_free_pages), sizeof(int32_t));
+	}
+}
+
+// Queues the reductions for the current state of the scene. Call after the scene's passes of the frame
+void gpu_statistics_compute(Gpu_statistics& stats, const Statistics_sources& sources, uint64_t idx_frame) {
+	auto& slot = stats.slots[stats.idx_next];
+
+	if (slot.fence != nullptr) {
+		return;
+	}
+
+	if (slot.id_buffer == 0) {
+		slot.id_buffer = gpu_create_buffer("statistics", GL_SHADER_STORAGE_BUFFER, sizeof(Statistics), nullptr, GL_STREAM_READ);
+	}
+
+	gpu_statistics_reduce(stats, sources, slot.id_buffer);
+
+	slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	slot.sources = sources;
+	slot.idx_frame = idx_frame;
+	stats.idx_next = (stats.idx_next + 1) % stats.slots.size();
+}
+
+void gpu_statistics_write_log(Gpu_statistics& stats) {
+	const auto& s = stats.latest;
+	const auto& sources = stats.latest_sources;
+	auto write = [&](const std::string& name, auto value) {
+		stats.log << std::format("{},{},{},{}\n", stats.latest_frame, sources.scene, name, value);
+		};
+
+	if (sources.has_mold) {
+		write("mold_num_alive", s.mold_num_alive);
+		write("mold_num_free_pages", s.mold_num_free_pages);
+		for (int idx_type = 0; idx_type < sources.num_mold_types; idx_type++) {
+			write(std::format("mold_population_{}", idx_type), s.mold_population[idx_type]);
+			write(std::format("mold_trail_total_{}", idx_type), s.mold_trail_total[idx_type]);
+		}
+	}
+	if (sources.has_physics) {
+		write("physics_kinetic_energy", s.physics_kinetic_energy);
+		write("physics_momentum_x", s.physics_momentum[0]);
+		write("physics_momentum_y", s.physics_momentum[1]);
+		write("physics_num_bodies", s.physics_num_bodies);
+	}
+	for (int idx_bounce = 0; sources.ray_counters != 0 && idx_bounce < rays_max_bounces && s.rays_num_rays[idx_bounce] > 0; idx_bounce++) {
+		write(std::format("rays_num_rays_{}", idx_bounce), s.rays_num_rays[idx_bounce]);
+		write(std::format("rays_num_hits_{}", idx_bounce), s.rays_num_hits[idx_bounce]);
+	}
+}
+
+// Reads the results that are done, oldest first, without waiting. The newest one is kept in latest, and all
+//	of them go to the log. Call once per frame
+void gpu_statistics_poll(Gpu_statistics& stats) {
+	for (size_t idx_offset = 0; idx_offset < stats.slots.size(); idx_offset++) {
+		auto& slot = stats.slots[(stats.idx_next + idx_offset) % stats.slots.size()];
+
+		if (slot.fence == nullptr) {
+			continue;
+		}
+		if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
+
+		glDeleteSync(slot.fence);
+		slot.fence = nullptr;
+		ssbo_read(slot.id_buffer, 0, sizeof(Statistics), &stats.latest);
+		stats.latest_sources = slot.sources;
+		stats.latest_frame = slot.idx_frame;
+		stats.has_latest = true;
+		if (stats.log.is_open()) {
+			gpu_statistics_write_log(stats);
+		}
+	}
+}
+
+// Lines for the stats overlay
+std::vector<std::string> gpu_statistics_text(const Gpu_statistics& stats) {
+	const auto& s = stats.latest;
+	const auto& sources = stats.latest_sources;
+	std::vector<std::string> lines;
+
+	if (sources.has_mold) {
+		std::string population, trails;
+		for (int idx_type = 0; idx_type < sources.num_mold_types; idx_type++) {
+			population += std::format("{}{}", idx_type > 0 ? ", " : "", s.mold_population[idx_type]);
+			trails += std::format("{}{:.0f}", idx_type > 0 ? ", " : "", s.mold_trail_total[idx_type]);
+		}
+		lines.push_back(std::format("Particles: {} of {} ({} types)", s.mold_num_alive, sources.mold_pool_size, sources.num_mold_types));
+		lines.push_back("Particles per type: " + population);
+		lines.push_back(std::format("Resident tiles: {} of {} ({} in the pool)", sources.num_mold_pages - s.mold_num_free_pages, sources.num_mold_tiles, sources.num_mold_pages));
+		lines.push_back("Trail intensity per type: " + trails);
+	}
+	if (sources.has_physics) {
+		lines.push_back(std::format("Physics: {} bodies, kinetic energy {:.2f}, momentum ({:.2f}, {:.2f})",
+			s.physics_num_bodies, s.physics_kinetic_energy, s.physics_momentum[0], s.physics_momentum[1]));
+	}
+	if (sources.ray_counters != 0) {
+		std::string rays;
+		for (int idx_bounce = 0; idx_bounce < rays_max_bounces && s.rays_num_rays[idx_bounce] > 0; idx_bounce++) {
+			rays += std::format("{}{} ({} hits)", idx_bounce > 0 ? ", " : "", s.rays_num_rays[idx_bounce], s.rays_num_hits[idx_bounce]);
+		}
+		lines.push_back("Rays per bounce: " + rays);
+	}
+
+	return lines;
+}
+
+void gpu_statistics_release(Gpu_statistics& stats) {
+	for (auto& slot : stats.slots) {
+		if (slot.fence != nullptr) {
+			glDeleteSync(slot.fence);
+		}
+		gpu_delete_buffer(slot.id_buffer);
+		slot = {};
+	}
+	gpu_delete_buffer(stats.partials);
+	stats.partials_bytes = 0;
+	stats.has_latest = false;
+}
+
+// Must be kept in sync with solver.glsl
+const unsigned int solver_group_size = 256;
+const unsigned int solver_num_groups = 256;
+
+enum class Solver_method { jacobi, red_black, multigrid, cg };
+
+const std::array<std::string, 4> solver_method_names = { "Jacobi", "red-black Gauss-Seidel", "multigrid", "conjugate gradient" };
+
+// Must be kept in sync with the SCALAR_ slots in solver.glsl
+enum class Solver_scalar { rr_even = 0, rr_odd = 1, pq = 2, check = 3, count = 4 };
+
+// Red-black sweeps before and after the coarse correction of a V-cycle, and on the coarsest level
+const int solver_num_smoothing_sweeps = 2;
+const int solver_num_coarse_sweeps = 4;
+
+// The grid sizes of the multigrid levels, finest first. Each level has half the cells per side of the one above,
+//	so n has to be 2^k - 1, and the coarsest level is a single cell
+bool solver_level_sizes(int n, std::vector<int>& sizes) {
+	if (n < 1 || ((n + 1) & n) != 0) {
+		log_error(std::format("The solver grid has to be 2^k - 1 cells wide, eg. 511, not {}", n));
+		return false;
+	}
+
+	sizes.clear();
+	for (; n >= 1; n = (n - 1) / 2) {
+		sizes.push_back(n);
+	}
+
+	return true;
+}
+
+// Right-hand side for the exact solution x (1 - x) y (1 - y). Unlike a single sine, it is not an eigenvector
+//	of the grid Laplacian, so conjugate gradients do not converge in one iteration
+std::vector<float> solver_test_rhs(int n) {
+	std::vector<float> b(static_cast<size_t>(n) * n);
+	float h = 1.0f / (n + 1);
+
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			float x = (i + 1) * h;
+			float y = (j + 1) * h;
+			b[i + static_cast<size_t>(j) * n] = 2.0f * (x * (1.0f - x) + y * (1.0f - y));
+		}
+	}
+
+	return b;
+}
+
+// The discrete solution of solver_test_rhs(). The 5-point stencil is exact for it, so the difference to it is only
+//	the error of the solver
+std::vector<float> solver_test_solution(int n) {
+	std::vector<float> x(static_cast<size_t>(n) * n);
+	float h = 1.0f / (n + 1);
+
+	for (int j = 0; j < n; j++) {
+		for (int i = 0; i < n; i++) {
+			float x_i = (i + 1) * h;
+			float y_j = (j + 1) * h;
+			x[i + static_cast<size_t>(j) * n] = x_i * (1.0f - x_i) * y_j * (1.0f - y_j);
+		}
+	}
+
+	return x;
+}
+
+// What a check measured, relative to the check at the start: the residual |b - Ax| / |b - Ax0|, or with an exact
+//	solution the error |x - x_exact| / |x0 - x_exact|. Both mean the same on every grid size. In floats the residual
+//	stops going down at about float epsilon * n^2 though, 7e-3 on 1023x1023, long before the error does
+float solver_reduction(float norm, float initial_norm) {
+	return initial_norm > 0.0f ? norm / initial_norm : 0.0f;
+}
+
+// One level of the CPU twin, row by row without the border
+struct Solver_cpu_level {
+	int n = 0;
+	float h_square = 0.0f;
+	std::vector<float> x;
+	std::vector<float> b;
+	std::vector<float> r;
+};
+
+// The iterations of Gpu_solver on the CPU, with the rows split over cpu_num_threads() threads. The stencils are
+//	evaluated in the same order in float, so the solutions only differ by rounding, and for conjugate gradients
+//	by the order of the sums in the dot products
+struct Solver_cpu {
+	Solver_method method = Solver_method::multigrid;	// Call solver_cpu_set_rhs() after changing it
+	std::vector<Solver_cpu_level> levels;
+	std::vector<float> p;
+	std::vector<float> q;
+	float rr = 0.0f;
+	bool cg_needs_restart = true;
+};
+
+bool solver_cpu_setup(Solver_cpu& solver, int n) {
+	std::vector<int> sizes;
+
+	if (!solver_level_sizes(n, sizes)) {
+		return false;
+	}
+
+	solver.levels.clear();
+	for (auto size : sizes) {
+		auto num_cells = static_cast<size_t>(size) * size;
+		float h = 1.0f / (size + 1);
+		solver.levels.push_back({ size, h * h, std::vector<float>(num_cells), std::vector<float>(num_cells), std::vector<float>(num_cells) });
+	}
+	solver.p.assign(static_cast<size_t>(n) * n, 0.0f);
+	solver.q.assign(static_cast<size_t>(n) * n, 0.0f);
+	solver.cg_needs_restart = true;
+
+	return true;
+}
+
+// Starts over from x = 0
+void solver_cpu_set_rhs(Solver_cpu& solver, const std::vector<float>& b) {
+	auto& level = solver.levels[0];
+
+	level.b = b;
+	std::fill(level.x.begin(), level.x.end(), 0.0f);
+	solver.cg_needs_restart = true;
+}
+
+// Calls fn(i, j, idx) for every cell, with a range of rows per thread
+template <typename Fn>
+void solver_cpu_for_cells(int n, const Fn& fn) {
+	parallel_for(static_cast<size_t>(n), [&](size_t j_start, size_t j_end) {
+		for (auto j = static_cast<int>(j_start); j < static_cast<int>(j_end); j++) {
+			for (int i = 0; i < n; i++) {
+				fn(i, j, i + static_cast<size_t>(j) * n);
+			}
+		}
+		});
+}
+
+// Sum of the 4 neighbours, with 0 on the border. Same order as in solver.glsl
+float solver_cpu_neighbours(const std::vector<float>& values, int n, int i, int j, size_t idx) {
+	return (i > 0 ? values[idx - 1] : 0.0f) + (i < n - 1 ? values[idx + 1] : 0.0f) + (j > 0 ? values[idx - n] : 0.0f) + (j < n - 1 ? values[idx + n] : 0.0f);
+}
+
+void solver_cpu_jacobi(Solver_cpu_level& level) {
+	solver_cpu_for_cells(level.n, [&](int i, int j, size_t idx) {
+		level.r[idx] = (level.h_square * level.b[idx] + solver_cpu_neighbours(level.x, level.n, i, j, idx)) / 4.0f;
+		});
+
+	std::swap(level.x, level.r);
+}
+
+void solver_cpu_red_black(Solver_cpu_level& level, int num_sweeps) {
+	for (int idx_sweep = 0; idx_sweep < num_sweeps; idx_sweep++) {
+		for (int color = 0; color < 2; color++) {
+			solver_cpu_for_cells(level.n, [&](int i, int j, size_t idx) {
+				if (((i + j) & 1) == color) {
+					level.x[idx] = (level.h_square * level.b[idx] + solver_cpu_neighbours(level.x, level.n, i, j, idx)) / 4.0f;
+				}
+				});
+		}
+	}
+}
+
+void solver_cpu_residual(Solver_cpu_level& level) {
+	solver_cpu_for_cells(level.n, [&](int i, int j, size_t idx) {
+		level.r[idx] = level.b[idx] - (4.0f * level.x[idx] - solver_cpu_neighbours(level.x, level.n, i, j, idx)) / level.h_square;
+		});
+}
+
+// Full weighting of the residual of fine into the right-hand side of coarse, which starts from x = 0
+void solver_cpu_restrict(const Solver_cpu_level& fine, Solver_cpu_level& coarse) {
+	solver_cpu_for_cells(coarse.n, [&](int i, int j, size_t idx) {
+		auto n_fine = static_cast<size_t>(fine.n);
+		auto idx_fine = (2 * i + 1) + (2 * j + 1) * n_fine;
+		const auto& r = fine.r;
+		float edges = r[idx_fine - 1] + r[idx_fine + 1] + r[idx_fine - n_fine] + r[idx_fine + n_fine];
+		float corners = r[idx_fine - n_fine - 1] + r[idx_fine - n_fine + 1] + r[idx_fine + n_fine - 1] + r[idx_fine + n_fine + 1];
+		coarse.b[idx] = (4.0f * r[idx_fine] + 2.0f * edges + corners) / 16.0f;
+		coarse.x[idx] = 0.0f;
+		});
+}
+
+// Adds the bilinear interpolation of the solution of coarse to fine
+void solver_cpu_prolong(const Solver_cpu_level& coarse, Solver_cpu_level& fine) {
+	auto value = [&](int i, int j) {
+		return i < 0 || i >= coarse.n || j < 0 || j >= coarse.n ? 0.0f : coarse.x[i + static_cast<size_t>(j) * coarse.n];
+		};
+
+	solver_cpu_for_cells(fine.n, [&](int i, int j, size_t idx) {
+		int i_coarse = (i - 1) / 2;
+		int j_coarse = (j - 1) / 2;
+		float correction;
+		if ((i & 1) == 1 && (j & 1) == 1) {
+			correction = value(i_coarse, j_coarse);
+		}
+		else if ((j & 1) == 1) {
+			correction = 0.5f * (value(i / 2 - 1, j_coarse) + value(i / 2, j_coarse));
+		}
+		else if ((i & 1) == 1) {
+			correction = 0.5f * (value(i_coarse, j / 2 - 1) + value(i_coarse, j / 2));
+		}
+		else {
+			correction = 0.25f * (value(i / 2 - 1, j / 2 - 1) + value(i / 2, j / 2 - 1) + value(i / 2 - 1, j / 2) + value(i / 2, j / 2));
+		}
+		fine.x[idx] += correction;
+		});
+}
+
+void solver_cpu_v_cycle(Solver_cpu& solver, size_t idx_level) {
+	auto& level = solver.levels[idx_level];
+
+	if (idx_level + 1 == solver.levels.size()) {
+		solver_cpu_red_black(level, solver_num_coarse_sweeps);
+		return;
+	}
+
+	auto& coarse = solver.levels[idx_level + 1];
+	solver_cpu_red_black(level, solver_num_smoothing_sweeps);
+	solver_cpu_residual(level);
+	solver_cpu_restrict(level, coarse);
+	solver_cpu_v_cycle(solver, idx_level + 1);
+	solver_cpu_prolong(coarse, level);
+	solver_cpu_red_black(level, solver_num_smoothing_sweeps);
+}
+
+float solver_cpu_dot(const std::vector<float>& a, const std::vector<float>& b) {
+	auto num_chunks = cpu_num_chunks(a.size());
+	std::vector<double> chunk_sums(num_chunks, 0.0);
+
+	parallel_for(num_chunks, [&](size_t idx_start, size_t idx_end) {
+		for (auto idx_chunk = idx_start; idx_chunk < idx_end; idx_chunk++) {
+			for (auto idx = cpu_chunk_start(a.size(), num_chunks, idx_chunk); idx < cpu_chunk_start(a.size(), num_chunks, idx_chunk + 1); idx++) {
+				chunk_sums[idx_chunk] += static_cast<double>(a[idx]) * b[idx];
+			}
+		}
+		});
+
+	double sum = 0.0;
+	for (auto chunk_sum : chunk_sums) {
+		sum += chunk_sum;
+	}
+
+	return static_cast<float>(sum);
+}
+
+void solver_cpu_cg_iteration(Solver_cpu& solver) {
+	auto& level = solver.levels[0];
+
+	if (solver.cg_needs_restart) {
+		solver_cpu_residual(level);
+		solver.p = level.r;
+		solver.rr = solver_cpu_dot(level.r, level.r);
+		solver.cg_needs_restart = false;
+	}
+
+	solver_cpu_for_cells(level.n, [&](int i, int j, size_t idx) {
+		solver.q[idx] = (4.0f * solver.p[idx] - solver_cpu_neighbours(solver.p, level.n, i, j, idx)) / level.h_square;
+		});
+	float pq = solver_cpu_dot(solver.p, solver.q);
+	float alpha = pq != 0.0f ? solver.rr / pq : 0.0f;
+	solver_cpu_for_cells(level.n, [&](int, int, size_t idx) {
+		level.x[idx] += alpha * solver.p[idx];
+		level.r[idx] -= alpha * solver.q[idx];
+		});
+	float rr_next = solver_cpu_dot(level.r, level.r);
+	float beta = solver.rr != 0.0f ? rr_next / solver.rr : 0.0f;
+	solver_cpu_for_cells(level.n, [&](int, int, size_t idx) {
+		solver.p[idx] = level.r[idx] + beta * solver.p[idx];
+		});
+	solver.rr = rr_next;
+}
+
+// One iteration is a sweep for Jacobi and Gauss-Seidel, and a V-cycle for multigrid
+void solver_cpu_iterate(Solver_cpu& solver, int num_iterations) {
+	for (int idx_iteration = 0; idx_iteration < num_iterations; idx_iteration++) {
+		switch (solver.method) {
+		case Solver_method::jacobi:
+			solver_cpu_jacobi(solver.levels[0]);
+			break;
+		case Solver_method::red_black:
+			solver_cpu_red_black(solver.levels[0], 1);
+			break;
+		case Solver_method::multigrid:
+			solver_cpu_v_cycle(solver, 0);
+			break;
+		case Solver_method::cg:
+			solver_cpu_cg_iteration(solver);
+			break;
+		}
+	}
+}
+
+// One grid of the multigrid hierarchy on the GPU. Level 0 is the problem itself
+struct Solver_level {
+	int n = 0;
+	float h_square = 0.0f;
+	GLuint x = 0;
+	GLuint b = 0;
+	GLuint r = 0;		// Residual, the next x of Jacobi, or r of conjugate gradients
+};
+
+// A residual norm on its way back from the GPU
+struct Solver_check {
+	GLuint id_buffer = 0;
+	GLsync fence = nullptr;
+	uint64_t idx_iteration = 0;
+	uint32_t rhs_version = 0;
+};
+
+// Iterative solver for the Poisson problem of solver.glsl. The state stays on the GPU between calls, so the solver
+//	scene continues from the last solution. The residual or error norm is reduced on the GPU and read back like the
+//	statistics: gpu_solver_check() queues it into the next buffer of a ring, and gpu_solver_poll() reads the
+//	ones that are done without waiting
+struct Gpu_solver {
+	GLuint id_program = 0;
+	Solver_method method = Solver_method::multigrid;	// Call gpu_solver_set_rhs() after changing it
+	std::vector<Solver_level> levels;
+	GLuint p = 0;				// Conjugate gradients
+	GLuint q = 0;
+	GLuint partials = 0;
+	GLuint scalars = 0;
+	bool cg_needs_restart = true;
+	int cg_parity = 0;
+	GLuint x_exact = 0;				// Optional, the checks measure the error instead of the residual
+	uint64_t num_iterations = 0;	// Since the last gpu_solver_set_rhs()
+	uint32_t rhs_version = 0;		// Checks from before the last gpu_solver_set_rhs() are dropped
+	std::array<Solver_check, 4> checks;
+	size_t idx_next_check = 0;
+	float initial_norm = 0.0f;		// Of the check gpu_solver_set_rhs() queues
+	bool has_reduction = false;
+	float reduction = 0.0f;			// Of the newest check, see solver_reduction()
+	uint64_t reduction_iteration = 0;
+};
+
+void gpu_solver_release(Gpu_solver& solver) {
+	for (auto& level : solver.levels) {
+		for (auto id_buffer : { &level.x, &level.b, &level.r }) {
+			gpu_delete_buffer(*id_buffer);
+		}
+	}
+	for (auto id_buffer : { &solver.p, &solver.q, &solver.partials, &solver.scalars, &solver.x_exact }) {
+		gpu_delete_buffer(*id_buffer);
+	}
+	for (auto& check : solver.checks) {
+		if (check.fence != nullptr) {
+			glDeleteSync(check.fence);
+		}
+		gpu_delete_buffer(check.id_buffer);
+	}
+
+	solver = { solver.id_program, solver.method };
+}
+
+// Allocates the levels for an n x n grid, n = 2^k - 1. Call gpu_solver_set_rhs() before iterating
+bool gpu_solver_setup(Gpu_solver& solver, int n) {
+	std::vector<int> sizes;
+
+	if (!solver_level_sizes(n, sizes)) {
+		return false;
+	}
+
+	gpu_solver_release(solver);
+	for (auto size : sizes) {
+		auto num_bytes = sizeof(float) * size * size;
+		float h = 1.0f / (size + 1);
+		Solver_level level = { size, h * h };
+		for (auto id_buffer : { &level.x, &level.b, &level.r }) {
+			*id_buffer = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, num_bytes, nullptr, GL_DYNAMIC_COPY);
+		}
+		solver.levels.push_back(level);
+	}
+	solver.p = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float) * n * n, nullptr, GL_DYNAMIC_COPY);
+	solver.q = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float) * n * n, nullptr, GL_DYNAMIC_COPY);
+	solver.partials = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float) * solver_num_groups, nullptr, GL_DYNAMIC_COPY);
+	solver.scalars = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float) * static_cast<size_t>(Solver_scalar::count), nullptr, GL_DYNAMIC_COPY);
+
+	return true;
+}
+
+// Makes the checks measure the error against x_exact, eg. solver_test_solution(). Call it after gpu_solver_setup()
+//	and before gpu_solver_set_rhs()
+void gpu_solver_set_exact_solution(Gpu_solver& solver, const std::vector<float>& x_exact) {
+	gpu_delete_buffer(solver.x_exact);
+	solver.x_exact = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float) * x_exact.size(), x_exact.data(), GL_STATIC_DRAW);
+}
+
+// Must sync with the actions in solver::main(). The program has to be in use
+void gpu_solver_dispatch(Gpu_solver& solver, int action_id, const Solver_level& level) {
+	shader_set_int(solver.id_program, "action_id", action_id);
+	shader_set_int(solver.id_program, "n", level.n);
+	shader_set_float(solver.id_program, "h_square", level.h_square);
+	dispatch_compute_linear(static_cast<size_t>(level.n) * level.n, solver_group_size);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-	glGetProgramiv(id_shader, GL_LINK_STATUS, &success);
+// a . b of n x n grids into a slot of the scalars, in two passes: a fixed number of work groups each add up their
+//	part, then a single one adds up the groups
+void gpu_solver_dot(Gpu_solver& solver, GLuint id_a, GLuint id_b, int n, Solver_scalar slot) {
+	primitives_bind(Ssbo_index::solver_aux, id_a);
+	primitives_bind(Ssbo_index::solver_out, id_b);
+	primitives_bind(Ssbo_index::solver_partials, solver.partials);
+	primitives_bind(Ssbo_index::solver_scalars, solver.scalars);
+	shader_set_int(solver.id_program, "n", n);
+
+	shader_set_int(solver.id_program, "action_id", 6);
+	glDispatchCompute(solver_num_groups, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	shader_set_int(solver.id_program, "action_id", 7);
+	shader_set_int(solver.id_program, "scalar_slot", static_cast<int>(slot));
+	glDispatchCompute(1, 1, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
 
-	if (!success) {
-		glGetProgramInfoLog(id_shader, max_size_log_message, NULL, log_message);
-		msg = log_message;
-		return true;
-	}
+void gpu_solver_red_black(Gpu_solver& solver, const Solver_level& level, int num_sweeps) {
+	primitives_bind(Ssbo_index::solver_x, level.x);
+	primitives_bind(Ssbo_index::solver_b, level.b);
 
-	return false;
+	for (int idx_sweep = 0; idx_sweep < num_sweeps; idx_sweep++) {
+		for (int color = 0; color < 2; color++) {
+			shader_set_int(solver.id_program, "color", color);
+			gpu_solver_dispatch(solver, 1, level);
+		}
+	}
 }
 
-bool has_compiler_error(GLuint id_shader, std::string& msg) {
-	const int max_size_log_message = 1024;
-	GLint success;
-	GLchar log_message[max_size_log_message];
+// Into level.r
+void gpu_solver_residual(Gpu_solver& solver, const Solver_level& level) {
+	primitives_bind(Ssbo_index::solver_x, level.x);
+	primitives_bind(Ssbo_index::solver_b, level.b);
+	primitives_bind(Ssbo_index::solver_out, level.r);
+	gpu_solver_dispatch(solver, 2, level);
+}
 
-	glGetShaderiv(id_shader, GL_COMPILE_STATUS, &success);
+void gpu_solver_v_cycle(Gpu_solver& solver, size_t idx_level) {
+	const auto& level = solver.levels[idx_level];
 
-	if (!success) {
-		glGetShaderInfoLog(id_shader, max_size_log_message, nullptr, log_message);
-		msg = log_message;
-		return true;
+	if (idx_level + 1 == solver.levels.size()) {
+		gpu_solver_red_black(solver, level, solver_num_coarse_sweeps);
+		return;
 	}
 
-	return false;
-}
+	const auto& coarse = solver.levels[idx_level + 1];
+	gpu_solver_red_black(solver, level, solver_num_smoothing_sweeps);
+	gpu_solver_residual(solver, level);
 
-enum class Shader_type {
-	vertex,
-	fragment,
-	compute
-};
+	primitives_bind(Ssbo_index::solver_aux, level.r);
+	primitives_bind(Ssbo_index::solver_b, coarse.b);
+	primitives_bind(Ssbo_index::solver_x, coarse.x);
+	gpu_solver_dispatch(solver, 3, coarse);
 
-bool compile_shader(GLuint& id_shader, const std::string& shader_code, Shader_type shader_type) {
-	struct Shader_type_data {
-		GLuint type;
-		std::string display_name;
-	};
+	gpu_solver_v_cycle(solver, idx_level + 1);
 
-	std::map<Shader_type, Shader_type_data> shader_type_to_type = {
-		{Shader_type::compute,	{GL_COMPUTE_SHADER, "compute"}},
-		{Shader_type::fragment, {GL_FRAGMENT_SHADER, "fragment"}},
-		{Shader_type::vertex,	{GL_VERTEX_SHADER, "vertex"}}
-	};
+	primitives_bind(Ssbo_index::solver_aux, coarse.x);
+	primitives_bind(Ssbo_index::solver_x, level.x);
+	gpu_solver_dispatch(solver, 4, level);
 
-	if (shader_type_to_type.count(shader_type) == 0) {
-		log_error(std::format("Shader type '{}' not enabled", static_cast<int>(shader_type)));
-		return false;
+	gpu_solver_red_black(solver, level, solver_num_smoothing_sweeps);
+}
+
+// r.r alternates between two slots, so the update of p can see the old and the new value. The host never reads them
+void gpu_solver_cg_iteration(Gpu_solver& solver) {
+	const auto& level = solver.levels[0];
+	auto cells_bytes = sizeof(float) * level.n * level.n;
+
+	if (solver.cg_needs_restart) {
+		gpu_solver_residual(solver, level);
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		glBindBuffer(GL_COPY_READ_BUFFER, level.r);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, solver.p);
+		glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, 0, 0, cells_bytes);
+		gpu_solver_dot(solver, level.r, level.r, level.n, Solver_scalar::rr_even);
+		solver.cg_parity = 0;
+		solver.cg_needs_restart = false;
 	}
 
-	auto shader_type_data = shader_type_to_type[shader_type];
+	auto parity = solver.cg_parity;
 
-	id_shader = glCreateShader(shader_type_data.type);
-	auto the_code = shader_code.c_str();
+	primitives_bind(Ssbo_index::solver_aux, solver.p);
+	primitives_bind(Ssbo_index::solver_out, solver.q);
+	gpu_solver_dispatch(solver, 5, level);
+	gpu_solver_dot(solver, solver.p, solver.q, level.n, Solver_scalar::pq);
 
-	std::string version_string = "#version 430 core\n";
+	primitives_bind(Ssbo_index::solver_x, level.x);
+	primitives_bind(Ssbo_index::solver_b, level.r);
+	primitives_bind(Ssbo_index::solver_aux, solver.p);
+	primitives_bind(Ssbo_index::solver_out, solver.q);
+	shader_set_int(solver.id_program, "parity", parity);
+	gpu_solver_dispatch(solver, 8, level);
+	gpu_solver_dot(solver, level.r, level.r, level.n, parity == 0 ? Solver_scalar::rr_odd : Solver_scalar::rr_even);
 
-	const char* src[2] = { version_string.c_str(), the_code };
-	glShaderSource(id_shader, 2, src, nullptr);
-	glCompileShader(id_shader);
+	primitives_bind(Ssbo_index::solver_b, level.r);
+	primitives_bind(Ssbo_index::solver_aux, solver.p);
+	shader_set_int(solver.id_program, "parity", parity);
+	gpu_solver_dispatch(solver, 9, level);
 
-	std::string log_message = {};
-	auto success = !has_compiler_error(id_shader, log_message);
+	solver.cg_parity = 1 - parity;
+}
 
-	if (!success) {
-		std::cout << "Could not compile " << shader_type_data.display_name << " shader. Message: " << log_message << std::endl;
+// One iteration is a sweep for Jacobi and Gauss-Seidel, and a V-cycle for multigrid. Only queues the passes
+void gpu_solver_iterate(Gpu_solver& solver, int num_iterations) {
+	shader_use_program(solver.id_program);
+
+	for (int idx_iteration = 0; idx_iteration < num_iterations; idx_iteration++) {
+		auto& level = solver.levels[0];
+		switch (solver.method) {
+		case Solver_method::jacobi:
+			primitives_bind(Ssbo_index::solver_x, level.x);
+			primitives_bind(Ssbo_index::solver_b, level.b);
+			primitives_bind(Ssbo_index::solver_out, level.r);
+			gpu_solver_dispatch(solver, 0, level);
+			std::swap(level.x, level.r);
+			break;
+		case Solver_method::red_black:
+			gpu_solver_red_black(solver, level, 1);
+			break;
+		case Solver_method::multigrid:
+			gpu_solver_v_cycle(solver, 0);
+			break;
+		case Solver_method::cg:
+			gpu_solver_cg_iteration(solver);
+			break;
+		}
+		solver.num_iterations++;
 	}
-
-	return success;
 }
 
-bool compile_program(std::vector<GLuint> ids_shaders, GLuint& id_program) {
-	if (ids_shaders.empty()) {
-		log_error("No shaders to compile");
-		return false;
-	}
+// Reads the checks that are done, oldest first, without waiting
+void gpu_solver_poll(Gpu_solver& solver) {
+	for (size_t idx_offset = 0; idx_offset < solver.checks.size(); idx_offset++) {
+		auto& check = solver.checks[(solver.idx_next_check + idx_offset) % solver.checks.size()];
 
-	id_program = glCreateProgram();
+		if (check.fence == nullptr) {
+			continue;
+		}
+		if (glClientWaitSync(check.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+			break;
+		}
 
-	for (auto& id : ids_shaders) {
-		glAttachShader(id_program, id);
+		glDeleteSync(check.fence);
+		check.fence = nullptr;
+		if (check.rhs_version != solver.rhs_version) {
+			continue;
+		}
+
+		// The check at iteration 0 is the first one of the right-hand side to come back
+		float square = 0.0f;
+		ssbo_read(check.id_buffer, 0, sizeof(square), &square);
+		float norm = std::sqrt(std::max(0.0f, square));
+		if (check.idx_iteration == 0) {
+			solver.initial_norm = norm;
+		}
+		solver.reduction = solver_reduction(norm, solver.initial_norm);
+		solver.reduction_iteration = check.idx_iteration;
+		solver.has_reduction = true;
 	}
+}
 
-	glLinkProgram(id_program);
+void gpu_solver_wait(GLsync fence) {
+	while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+	}
+}
 
-	std::string log_message = {};
-	auto success = !has_linker_error(id_program, log_message);
+// Queues the residual or error norm of the current solution for gpu_solver_poll(), see solver_reduction(). When all
+//	buffers of the ring are still in flight, waits for the oldest one, which keeps the host from running more than a
+//	few checks ahead of the GPU
+void gpu_solver_check(Gpu_solver& solver) {
+	auto& check = solver.checks[solver.idx_next_check];
 
-	if (!success) {
-		std::cout << "Could not link program. Message: " << log_message << std::endl;
+	if (check.fence != nullptr) {
+		gpu_solver_wait(check.fence);
+		gpu_solver_poll(solver);
+	}
+	if (check.id_buffer == 0) {
+		check.id_buffer = gpu_create_buffer("solver", GL_SHADER_STORAGE_BUFFER, sizeof(float), nullptr, GL_STREAM_READ);
 	}
 
-	return success;
+	// Conjugate gradients keep r in levels[0].r, so their residual or error goes to the scratch buffer q
+	const auto& level = solver.levels[0];
+	Solver_level level_check = { level.n, level.h_square, level.x, level.b, solver.method == Solver_method::cg ? solver.q : level.r };
+	shader_use_program(solver.id_program);
+	if (solver.x_exact != 0) {
+		primitives_bind(Ssbo_index::solver_x, level.x);
+		primitives_bind(Ssbo_index::solver_aux, solver.x_exact);
+		primitives_bind(Ssbo_index::solver_out, level_check.r);
+		gpu_solver_dispatch(solver, 11, level);
+	}
+	else {
+		gpu_solver_residual(solver, level_check);
+	}
+	gpu_solver_dot(solver, level_check.r, level_check.r, level.n, Solver_scalar::check);
+
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	glBindBuffer(GL_COPY_READ_BUFFER, solver.scalars);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, check.id_buffer);
+	glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sizeof(float) * static_cast<size_t>(Solver_scalar::check), 0, sizeof(float));
+
+	check.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	check.idx_iteration = solver.num_iterations;
+	check.rhs_version = solver.rhs_version;
+	solver.idx_next_check = (solver.idx_next_check + 1) % solver.checks.size();
 }
 
-struct Shader_info {
-	std::filesystem::path path;
-	std::vector<std::filesystem::path> paths_shared;
-	Shader_type type;
-};
+// keep_solution: Continue from the current x, eg. when the right-hand side only changed a bit. Otherwise start from 0.
+//	Queues the check at iteration 0, which the later ones are relative to
+void gpu_solver_set_rhs(Gpu_solver& solver, const std::vector<float>& b, bool keep_solution) {
+	auto& level = solver.levels[0];
 
-bool shader_create(std::vector<Shader_info> shader_info, GLuint& id_program) {
-	if (shader_info.empty()) {
-		log_error("No shader info");
-		return false;
+	glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.b);
+	glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(float) * b.size(), b.data());
+	if (!keep_solution) {
+		glBindBuffer(GL_SHADER_STORAGE_BUFFER, level.x);
+		glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32F, GL_RED, GL_FLOAT, nullptr);
 	}
 
-	auto num_shaders = shader_info.size();
+	solver.cg_needs_restart = true;
+	solver.num_iterations = 0;
+	solver.rhs_version++;
+	solver.has_reduction = false;
+	gpu_solver_check(solver);
+}
 
-	std::vector<GLuint> ids(num_shaders);
+void gpu_solver_wait_checks(Gpu_solver& solver) {
+	for (auto& check : solver.checks) {
+		if (check.fence != nullptr) {
+			gpu_solver_wait(check.fence);
+		}
+	}
 
-	for (auto idx_shader = 0; idx_shader < num_shaders; idx_shader++) {
-		std::string code_shader = { };
-		auto& cur_shader_info = shader_info[idx_shader];
+	gpu_solver_poll(solver);
+}
 
-		std::vector<std::filesystem::path> paths_all(cur_shader_info.paths_shared.begin(), cur_shader_info.paths_shared.end());
-		paths_all.push_back(cur_shader_info.path);
+struct Solver_result {
+	bool converged = false;
+	uint64_t num_iterations = 0;		// At the first check below the tolerance that was read, or all of them
+	uint64_t num_iterations_run = 0;	// Including the ones queued while that check was on its way back
+	float reduction = 0.0f;				// See solver_reduction()
+	float t_ms = 0.0f;					// Until the host knew
+};
 
-		for (auto& cur_path : paths_all) {
-			std::string cur_code = {};
-			if (!file_read(cur_path, cur_code)) {
-				log_error(std::format("Could not read file '{}'", cur_shader_info.path.string()));
-				return false;
-			}
-			code_shader += "\n" + cur_code;
-		}
+// Iterates from the current state until a check comes back with solver_reduction() below the tolerance, with a check every
+//	iterations_per_check iterations
+Solver_result gpu_solver_solve(Gpu_solver& solver, float tolerance, uint64_t max_iterations, int iterations_per_check) {
+	Solver_result result = {};
+	auto is_done = [&]() { return solver.has_reduction && solver.reduction <= tolerance; };
 
-		auto success_compile = compile_shader(ids[idx_shader], code_shader, cur_shader_info.type);
+	glFinish();
+	auto t_start = std::chrono::steady_clock::now();
 
-		if (!success_compile) {
-			log_error(std::format("Could not compile code in file '{}'", cur_shader_info.path.string()));
-			return false;
-		}
+	while (!is_done() && solver.num_iterations < max_iterations) {
+		gpu_solver_iterate(solver, iterations_per_check);
+		gpu_solver_check(solver);
+		gpu_solver_poll(solver);
 	}
 
-	auto success_program = compile_program(ids, id_program);
-
-	for (auto& id : ids) {
-		glDeleteShader(id);
+	// Out of iterations, the last checks are still on their way
+	if (!is_done()) {
+		gpu_solver_wait_checks(solver);
 	}
 
-	return success_program;
-}
+	result.t_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+	result.converged = is_done();
+	result.num_iterations = solver.reduction_iteration;
+	result.num_iterations_run = solver.num_iterations;
+	result.reduction = solver.reduction;
+	gpu_solver_wait_checks(solver);
 
-void shader_set_bool(GLuint id_program, const std::string& variable_name, bool value) {
-	glUniform1i(glGetUniformLocation(id_program, variable_name.c_str()), (int)value);
+	return result;
 }
 
-void shader_set_int(GLuint id_program, const std::string& variable_name, int value) {
-	glUniform1i(glGetUniformLocation(id_program, variable_name.c_str()), value);
+void gpu_solver_read_solution(const Gpu_solver& solver, std::vector<float>& x) {
+	const auto& level = solver.levels[0];
+
+	x.resize(static_cast<size_t>(level.n) * level.n);
+	glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+	ssbo_read(level.x, 0, sizeof(float) * x.size(), x.data());
 }
 
-void shader_set_float(GLuint id_program, const std::string& variable_name, float value) {
-	glUniform1f(glGetUniformLocation(id_program, variable_name.c_str()), value);
+// Draws the solution stretched over the image in image unit 0
+void gpu_solver_render(Gpu_solver& solver, int width, int height, float value_scale) {
+	shader_use_program(solver.id_program);
+	primitives_bind(Ssbo_index::solver_x, solver.levels[0].x);
+	shader_set_int(solver.id_program, "action_id", 10);
+	shader_set_int(solver.id_program, "n", solver.levels[0].n);
+	shader_set_int(solver.id_program, "w", width);
+	shader_set_int(solver.id_program, "h", height);
+	shader_set_float(solver.id_program, "value_scale", value_scale);
+	dispatch_compute_linear(static_cast<size_t>(width) * height, solver_group_size);
+	glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
 }
 
-void shader_set_vec2(GLuint id_program, const std::string& variable_name, const glm::vec2& value) {
-	glUniform2fv(glGetUniformLocation(id_program, variable_name.c_str()), 1, &value[0]);
+// Creates a texture straight from the mapped pixel data. BMP rows are padded to four bytes,
+//	which is the default unpack alignment, and bottom-up like OpenGL textures, so the common case
+//	is a single upload. Top-down files are uploaded row by row instead of being flipped in memory
+GLuint bmp_upload_texture(const std::string& owner, const Bmp_file& bmp, GLint internal_format, GLint filter) {
+	GLuint id_texture;
+	GLenum format = bmp.bits_per_pixel == 32 ? GL_BGRA : GL_BGR;
+
+	glGenTextures(1, &id_texture);
+	glBindTexture(GL_TEXTURE_2D, id_texture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, filter);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, filter);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+	if (!bmp.is_top_down) {
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, bmp.width, bmp.height, 0, format, GL_UNSIGNED_BYTE, bmp.pixels);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, 0, internal_format, bmp.width, bmp.height, 0, format, GL_UNSIGNED_BYTE, nullptr);
+		for (int y = 0; y < bmp.height; y++) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, y, bmp.width, 1, format, GL_UNSIGNED_BYTE, bmp_row(bmp, y));
+		}
+	}
+
+	// Drivers store three channels as four
+	size_t bytes_per_texel = internal_format == GL_R8 ? 1 : 4;
+	gpu_track(gpu_registry.textures, id_texture, owner, bytes_per_texel * bmp.width * bmp.height);
+
+	return id_texture;
 }
 
-void shader_set_vec3(GLuint id_program, const std::string& variable_name, const glm::vec3& value) {
-	glUniform3fv(glGetUniformLocation(id_program, variable_name.c_str()), 1, &value[0]);
+// Uploads the font bitmap once as a single-channel texture. The red channel is enough to tell
+//	the white glyphs from the background, so there is no need to convert the colors first
+GLuint setup_font_atlas(const Bmp_file& font_bitmap) {
+	return bmp_upload_texture("font", font_bitmap, GL_R8, GL_NEAREST);
 }
 
-void shader_use_program(GLuint id_program) {
-	glUseProgram(id_program);
+// Adds one glyph per character to the text batch. Position is the lower left corner of the
+//	first character, in image coordinates (origin in the lower left corner)
+void text_add(std::vector<Glyph_instance>& text_batch, const Font_info& font_info, const std::string& s, int x, int y, glm::vec3 color = glm::vec3(1, 1, 1), float background_alpha = 0.0f) {
+	for (auto c : s) {
+		Glyph_instance glyph = {};
+		glyph.pos[0] = x;
+		glyph.pos[1] = y;
+		glyph.glyph = static_cast<unsigned char>(c) % (font_info.num_chars_per_row * font_info.num_rows);
+		glyph.color[0] = color.x;
+		glyph.color[1] = color.y;
+		glyph.color[2] = color.z;
+		glyph.color[3] = 1.0f;
+		glyph.background[3] = background_alpha;
+		text_batch.push_back(glyph);
+		x += font_info.char_width;
+	}
 }
 
-// These indices needs to be synched with the bindings used in the compute shaders
-enum class Ssbo_index {
-	solver = 0,
-	ray_spheres = 1,
-	ray_shared_data = 2,
-	voronoi_circles = 3,
-	voronoi_blocks = 4,
-	voronoi_toolbar = 5,
-	voronoi_toolbar_colors = 6,
-	mold = 7,
-	mold_intensities = 8,
-	physics_circles = 9,
-	voronoi_physics = 10,
-	physics_physics = 11
-};
+int main(int argc, char* argv[]) {
+	Options options = {};
 
-// usage an be eg. GL_DYNAMIC_DRAW or GL_DYNAMIC_READ, see documentation
-//	TODO: Is it actually used?
-GLuint setup_ssbo(GLuint ssbo_index, GLuint usage, GLsizeiptr data_size, void* data) {
-	GLuint idx_buffer;
+	if (!parse_options(argc, argv, options)) {
+		log_error("Usage: compute_shaders [--seed <n>] [--mold-particles <n>] [--cpu-init] [--accumulate-trails] [--trail-texture] [--benchmark [name]] [--physics-cpu [n]] [--physics-ccd [n]] [--seed-grid [n]] [--frame-budget <ms>] [--sweep <dir>] [--soak <minutes>] [--stats-log <file>] [--rays-bounces <n>] [--rays-shadows <n>] [--rays-megakernel]");
+		return -1;
+	}
 
-	glGenBuffers(1, &idx_buffer);
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, idx_buffer);
-	glBufferData(GL_SHADER_STORAGE_BUFFER, data_size, data, usage);
-	glBindBufferBase(GL_SHADER_STORAGE_BUFFER, ssbo_index, idx_buffer);
+	// Runs before the window is created, so it also works on machines without a GPU or display
+	if (options.physics_cpu_bodies > 0) {
+		physics_cpu_benchmark(options.physics_cpu_bodies, options.physics_steps, options.seed);
+		return 0;
+	}
 
-	return idx_buffer;
-}
+	if (options.physics_ccd_bodies > 0) {
+		physics_cpu_ccd_benchmark(options.physics_ccd_bodies, options.seed);
+		return 0;
+	}
 
-void ssbo_update(GLuint idx_buffer, GLintptr offset, GLsizeiptr size, void* data) {
-	glBindBuffer(GL_SHADER_STORAGE_BUFFER, idx_buffer);
-	glBufferSubData(GL_SHADER_STORAGE_BUFFER, offset, size, data);
-}
+	if (options.seed_grid_seeds > 0) {
+		seed_grid_benchmark(options.seed_grid_seeds, options.seed);
+		return 0;
+	}
 
-int main(int, char* []) {
 	const unsigned int window_width = 1920;
 	const unsigned int window_height = 1080;
 	const unsigned int texture_width = window_width;
 	const unsigned int texture_height = window_height;
 
 	GLFWwindow* window = nullptr;
+	bool run_sweep = !options.sweep_directory.empty();
 
-	if (!setup_window(window_width, window_height, "Compute shaders", window)) {
+	// The benchmarks and sweeps still need a GL context, but not a visible window
+	if (!setup_window(window_width, window_height, "Compute shaders", !options.benchmark && !run_sweep && !options.hidden, window)) {
 		log_error("Could not create GLFW window");
 		return -1;
 	}
@@ -506,12 +5100,28 @@ int main(int, char* []) {
 	std::filesystem::path initial_shader_path("computeShader.glsl");
 	std::filesystem::path solver_path("solver.glsl");
 	std::filesystem::path rays_path("rays.glsl");
+	std::filesystem::path path_rays_wavefront("rays_wavefront.glsl");
+	std::filesystem::path path_shared_rays("shared_rays.glsl");
 	std::filesystem::path path_voronoi("voronoi.glsl");
 	std::filesystem::path path_mold_compute("mold_compute.glsl");
 	std::filesystem::path path_mold_render("mold_render.glsl");
 	std::filesystem::path path_physics_compute("physics_compute.glsl");
 	std::filesystem::path path_physics_render("physics_render.glsl");
 	std::filesystem::path path_shared_shapes("shared_shapes.glsl");
+	std::filesystem::path path_text_render("text_render.glsl");
+	std::filesystem::path path_shared_random("shared_random.glsl");
+	std::filesystem::path path_shared_mold_world("shared_mold_world.glsl");
+	std::filesystem::path path_shared_mold_types("shared_mold_types.glsl");
+	std::filesystem::path path_shared_mold_step("shared_mold_step.glsl");
+	std::filesystem::path path_mold_init("mold_init.glsl");
+	std::filesystem::path path_mold_diffuse("mold_diffuse.glsl");
+	std::filesystem::path path_mold_lifecycle("mold_lifecycle.glsl");
+	std::filesystem::path path_shared_scan("shared_scan.glsl");
+	std::filesystem::path path_primitives("primitives.glsl");
+	std::filesystem::path path_capture("capture.glsl");
+	std::filesystem::path path_upscale("upscale.glsl");
+	std::filesystem::path path_mold_sweep("mold_sweep.glsl");
+	std::filesystem::path path_statistics("statistics.glsl");
 	GLuint id_program_canvas;
 
 	std::vector<Shader_info> shader_info_base = {
@@ -526,12 +5136,22 @@ int main(int, char* []) {
 
 	GLuint id_program_physics_compute;
 	GLuint id_program_physics_render;
+	GLuint id_program_mold_init;
 	GLuint id_program_mold_compute;
+	GLuint id_program_mold_diffuse;
+	GLuint id_program_mold_lifecycle;
 	GLuint id_program_mold_render;
 	GLuint id_program_rays;
+	GLuint id_program_rays_wavefront;
 	GLuint id_program_voronoi;
 	GLuint id_program_solver;
 	GLuint id_program_funky;
+	GLuint id_program_text;
+	GLuint id_program_primitives;
+	GLuint id_program_capture;
+	GLuint id_program_upscale;
+	GLuint id_program_mold_sweep;
+	GLuint id_program_statistics;
 
 	struct Compute_shader_info {
 		std::string display_name;
@@ -543,12 +5163,22 @@ int main(int, char* []) {
 	std::vector<Compute_shader_info> compute_shader_info = {
 		{"physics_compute",	id_program_physics_compute,	path_physics_compute,	{path_shared_shapes}},
 		{"physics_render",	id_program_physics_render,	path_physics_render,	{path_shared_shapes}},
-		{"mold_compute",	id_program_mold_compute,	path_mold_compute,		{path_shared_shapes}},
-		{"mold_render",		id_program_mold_render,		path_mold_render,		{path_shared_shapes}},
-		{"rays",			id_program_rays,			rays_path},
+		{"mold_init",		id_program_mold_init,		path_mold_init,			{path_shared_shapes, path_shared_random}},
+		{"mold_compute",	id_program_mold_compute,	path_mold_compute,		{path_shared_shapes, path_shared_random, path_shared_mold_world, path_shared_mold_types, path_shared_mold_step}},
+		{"mold_diffuse",	id_program_mold_diffuse,	path_mold_diffuse,		{path_shared_mold_world}},
+		{"mold_lifecycle",	id_program_mold_lifecycle,	path_mold_lifecycle,	{path_shared_shapes, path_shared_random, path_shared_mold_world, path_shared_scan}},
+		{"mold_render",		id_program_mold_render,		path_mold_render,		{path_shared_shapes, path_shared_mold_world, path_shared_mold_types}},
+		{"rays",			id_program_rays,			rays_path,				{path_shared_rays}},
+		{"rays_wavefront",	id_program_rays_wavefront,	path_rays_wavefront,	{path_shared_random, path_shared_rays}},
 		{"voronoi",			id_program_voronoi,			path_voronoi,			{path_shared_shapes}},
 		{"solver",			id_program_solver,			solver_path},
 		{"funky",			id_program_funky,			initial_shader_path},
+		{"text",			id_program_text,			path_text_render},
+		{"primitives",		id_program_primitives,		path_primitives,		{path_shared_scan}},
+		{"capture",			id_program_capture,			path_capture},
+		{"upscale",			id_program_upscale,			path_upscale},
+		{"mold_sweep",		id_program_mold_sweep,		path_mold_sweep,		{path_shared_shapes, path_shared_random, path_shared_mold_types, path_shared_mold_step}},
+		{"statistics",		id_program_statistics,		path_statistics,		{path_shared_shapes, path_shared_mold_world}},
 	};
 
 	for (auto& x : compute_shader_info) {
@@ -575,19 +5205,89 @@ int main(int, char* []) {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, texture_width, texture_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+	gpu_track(gpu_registry.textures, id_texture, "canvas", 4 * sizeof(float) * texture_width * texture_height);
 
 	glBindImageTexture(0, id_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
 
 	glActiveTexture(GL_TEXTURE0);
 	glBindTexture(GL_TEXTURE_2D, id_texture);
 
-	std::vector<int> data(1000);
-
-	for (int i = 0; i < data.size(); i++) {
-		data[i] = i;
+	// With --frame-budget, a scene that does not fit the budget is rendered at a lower resolution into the lower left
+	//	of this texture, and stretched over the canvas by the upscale kernel. See Quality_governor
+	GLuint scene_texture_unit = 4;	// Must be kept in sync with the scene binding in upscale.glsl
+	GLuint id_texture_scene = 0;
+	Quality_governor quality_governor = {};
+	quality_governor.budget_ms = options.frame_budget_ms;
+
+	if (quality_governor.budget_ms > 0.0f) {
+		glGenTextures(1, &id_texture_scene);
+		glActiveTexture(GL_TEXTURE0 + scene_texture_unit);
+		glBindTexture(GL_TEXTURE_2D, id_texture_scene);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, texture_width, texture_height, 0, GL_RGBA, GL_FLOAT, nullptr);
+		gpu_track(gpu_registry.textures, id_texture_scene, "frame budget", 4 * sizeof(float) * texture_width * texture_height);
+		glActiveTexture(GL_TEXTURE0);
 	}
 
-	auto ssbo_solver = setup_ssbo(static_cast<GLuint>(Ssbo_index::solver), GL_DYNAMIC_READ, sizeof(int) * data.size(), data.data());
+	std::map<Shaders, std::string> scene_names = {
+		{Shaders::funky, "funky"},
+		{Shaders::rays, "rays"},
+		{Shaders::voronoi, "voronoi"},
+		{Shaders::solver, "solver"},
+		{Shaders::mold, "mold"},
+		{Shaders::physics, "physics"}
+	};
+	// Each scene allocates its GPU buffers the first time it is shown, see scene_setup below.
+	//	With release_inactive_scenes, the buffers of a scene are deleted when switching away from it,
+	//	and its GPU state is set up from scratch the next time it is shown.
+	std::map<Shaders, Scene_resources> scene_resources;
+	std::map<Shaders, std::function<void(Scene_resources&)>> scene_setup;
+	bool release_inactive_scenes = options.release_inactive_scenes;
+
+	// The solver scene shows the potential of two fixed charges, and of one more at the mouse while the left button
+	//	is held. Every frame continues from the last solution for a few iterations, so how fast a change spreads shows
+	//	how fast the method converges. M switches to the next method and starts over from 0. The grids belong to
+	//	solver_scene and not to the scene resources, and are allocated again when the scene is set up again
+	Gpu_solver solver_scene = { .id_program = id_program_solver };
+	int solver_scene_size = 511;
+	std::array<int, 4> solver_scene_iterations = { 40, 20, 1, 5 };	// Per frame, by Solver_method, for about the same GPU time
+	bool solver_scene_has_mouse_charge = false;
+	glm::vec2 solver_scene_mouse_charge = glm::vec2(0);	// In the unit square
+	std::vector<float> solver_scene_rhs;
+
+	// Gaussian charges of 1 and -1, in a box of 5 sigma around each
+	auto solver_scene_update_rhs = [&](bool keep_solution) {
+		int n = solver_scene_size;
+		float h = 1.0f / (n + 1);
+		float sigma = 0.02f;
+		std::vector<std::pair<glm::vec2, float>> charges = { { glm::vec2(0.3f, 0.5f), 1.0f }, { glm::vec2(0.7f, 0.5f), -1.0f } };
+		if (solver_scene_has_mouse_charge) {
+			charges.push_back({ solver_scene_mouse_charge, 1.0f });
+		}
+
+		solver_scene_rhs.assign(static_cast<size_t>(n) * n, 0.0f);
+		for (auto& [center, charge] : charges) {
+			auto cell_min = glm::max(glm::ivec2(0), glm::ivec2((center - 5.0f * sigma) / h) - 1);
+			auto cell_max = glm::min(glm::ivec2(n - 1), glm::ivec2((center + 5.0f * sigma) / h));
+			for (int j = cell_min.y; j <= cell_max.y; j++) {
+				for (int i = cell_min.x; i <= cell_max.x; i++) {
+					auto d = glm::vec2(i + 1, j + 1) * h - center;
+					solver_scene_rhs[i + static_cast<size_t>(j) * n] += charge * std::exp(-glm::dot(d, d) / (2.0f * sigma * sigma)) / (2.0f * std::numbers::pi_v<float> * sigma * sigma);
+				}
+			}
+		}
+
+		gpu_solver_set_rhs(solver_scene, solver_scene_rhs, keep_solution);
+		};
+
+	scene_setup[Shaders::solver] = [&](Scene_resources&) {
+		if (gpu_solver_setup(solver_scene, solver_scene_size)) {
+			solver_scene_update_rhs(false);
+		}
+		};
 
 	std::vector<Sphere> spheres = {	// x y z rad r g b
 		{10, 2,   1, 1, 1, 0, 0},
@@ -596,20 +5296,38 @@ int main(int, char* []) {
 		{0,  2,   0, 4, 1, 1, 1},
 	};
 
-	setup_ssbo(static_cast<GLuint>(Ssbo_index::ray_spheres), GL_DYNAMIC_DRAW, sizeof(Sphere) * spheres.size(), spheres.data());
+	GLuint ssbo_shared_data = 0;
 
-	Shared_data shared_data = { -1, -1 };
+	scene_setup[Shaders::rays] = [&spheres, &ssbo_shared_data](Scene_resources& scene) {
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::ray_spheres), GL_DYNAMIC_DRAW, sizeof(Sphere) * spheres.size(), spheres.data());
 
-	auto ssbo_shared_data = setup_ssbo(static_cast<GLuint>(Ssbo_index::ray_shared_data), GL_DYNAMIC_DRAW, sizeof(Shared_data), &shared_data);
+		Shared_data shared_data = { -1, -1 };
+
+		ssbo_shared_data = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::ray_shared_data), GL_DYNAMIC_DRAW, sizeof(Shared_data), &shared_data);
+		};
 
 	shader_use_program(id_program_rays);
 	shader_set_int(id_program_rays, "w", window_width);
 	shader_set_int(id_program_rays, "h", window_height);
 
+	Rays_wavefront rays_wavefront = {
+		.id_program = id_program_rays_wavefront,
+		.num_bounces = options.rays_bounces,
+		.num_shadow_samples = options.rays_shadow_samples,
+		.seed = options.seed
+	};
+	bool rays_use_megakernel = options.rays_megakernel;
+
 	auto num_voronoi_circles = 200;
 	std::vector<Circle> voronoi_circles(num_voronoi_circles);
 	std::vector<Physics> voronoi_physics(num_voronoi_circles);
 	std::vector<Block_id> block_ids(num_voronoi_circles);
+	// Kept in sync with the seed positions in voronoi_physics, for picking
+	Seed_grid voronoi_grid;
+	float voronoi_r_max = 0.0f;
+	// The image is only rendered again where it changed
+	Voronoi_dirty_tiles voronoi_dirty;
+	voronoi_dirty_init(voronoi_dirty, window_width, window_height);
 	Toolbar_info toolbar_info;
 	toolbar_info = { .x = 100, .y = 300, .w = 300, .h = 500, .border_height = 50 };
 	// This is to flip the coordinate system so it works with GLSL
@@ -627,6 +5345,7 @@ int main(int, char* []) {
 	GLuint ssbo_block_ids;
 	GLuint ssbo_toolbar_info;
 	GLuint ssbo_toolbar_colors;
+	GLuint ssbo_voronoi_dirty_tiles;
 	int idx_active_circle = -1;
 	int idx_active_control = -1;
 	bool moving_toolbar = false;
@@ -639,65 +5358,36 @@ int main(int, char* []) {
 	int knob_down_start_val = 0;
 	std::filesystem::path font_file("font_bitmap_16.bmp");
 
-	auto font_texture = read_bmp(font_file);
-
-	auto hack_to_correct_font_bitmap_colors = [&font_texture]() {
-		auto& img_data = font_texture.data;
-		// The bitmap has blue-ish colors. We want pure black/white, so fix accordingly
-		for (int idx_font_color = 0; idx_font_color < img_data.size(); idx_font_color += 3) {
-			unsigned char& c1 = img_data[idx_font_color + 0];
-			unsigned char& c2 = img_data[idx_font_color + 1];
-			unsigned char& c3 = img_data[idx_font_color + 2];
-			int tot_diff = std::abs(c1 - 255) + std::abs(c2 - 255) + std::abs(c3 - 255);
-			if (tot_diff < 100) {
-				c1 = 255;
-				c2 = 255;
-				c3 = 255;
-			}
-			else {
-				c1 = 0;
-				c2 = 0;
-				c3 = 0;
-			}
-		}
-		};
+	Bmp_file font_bitmap = {};
 
-	hack_to_correct_font_bitmap_colors();
-
-	auto draw_chars = [&toolbar_pixels, &toolbar_info, &font_texture](std::string s, int offset_x, int offset_y) {
-		int char_width = 16;
-		int char_height = 24;
-		int num_chars_per_row = 16;
-		int num_rows = 8;
-		int tot_width = char_width * num_chars_per_row;
-		auto& img_data = font_texture.data;
-		for (auto idx_char : s) {
-			int char_row = idx_char / num_chars_per_row;
-			int char_col = idx_char - char_row * num_chars_per_row;
-			for (int i = 0; i < char_width; i++) {
-				auto toolbar_x = i + offset_x;
-				if (toolbar_x < 0 || toolbar_x >= toolbar_info.w) {
-					continue;
-				}
-				for (int j = 0; j < char_height; j++) {
-					auto toolbar_y = j + offset_y;
-					if (toolbar_y < 0 || toolbar_y >= toolbar_info.h) {
-						continue;
-					}
-					auto col_offset = char_col * char_width;
-					auto row_offset = (num_rows - 1 - char_row) * char_height;
-					auto font_texture_x = col_offset + i;
-					auto font_texture_y = j + row_offset;
-					for (int c = 0; c < 3; c++) {
-						toolbar_pixels[3 * (toolbar_x + toolbar_y * toolbar_info.w) + c] = img_data[3 * (font_texture_x + font_texture_y * tot_width) + c] / 255.0f;
-					}
-				}
-			}
-			offset_x += char_width;
-		}
-		};
+	if (!read_bmp(font_file, font_bitmap)) {
+		log_error("Could not load font");
+		return -1;
+	}
 
-	auto draw_toolbar = [&toolbar_pixels, &toolbar_info, &draw_chars](int x_start, int x_end, int y_start, int y_end) {
+	// The font bitmap has 16 x 8 characters
+	Font_info font_info = { .char_width = font_bitmap.width / 16, .char_height = font_bitmap.height / 8, .num_chars_per_row = 16, .num_rows = 8 };
+
+	glActiveTexture(GL_TEXTURE1);
+	setup_font_atlas(font_bitmap);
+	glActiveTexture(GL_TEXTURE0);
+	bmp_close(font_bitmap);
+
+	// All text for a frame is collected here and drawn on the GPU with one dispatch
+	std::vector<Glyph_instance> text_batch;
+	size_t max_num_glyphs = 4096;
+	text_batch.reserve(max_num_glyphs);
+	auto ssbo_text_glyphs = setup_ssbo("text", static_cast<GLuint>(Ssbo_index::text_glyphs), GL_DYNAMIC_DRAW, sizeof(Glyph_instance) * max_num_glyphs, nullptr);
+	bool show_stats = true;
+	std::string stats_text = {};
+
+	shader_use_program(id_program_text);
+	shader_set_int(id_program_text, "char_width", font_info.char_width);
+	shader_set_int(id_program_text, "char_height", font_info.char_height);
+	shader_set_int(id_program_text, "num_chars_per_row", font_info.num_chars_per_row);
+	shader_set_int(id_program_text, "num_rows", font_info.num_rows);
+
+	auto draw_toolbar = [&toolbar_pixels, &toolbar_info](int x_start, int x_end, int y_start, int y_end) {
 		for (int col = x_start; col < x_end; col++) {
 			for (int row = y_start; row < y_end; row++) {
 				int row_fixed = toolbar_info.h - row - 1;
@@ -718,10 +5408,20 @@ int main(int, char* []) {
 				}
 			}
 		}
-		draw_chars("Main toolbar", 20, toolbar_info.h - 40);
 		};
 
-	auto draw_control = [&toolbar_pixels, &toolbar_info, &ssbo_toolbar_colors, &draw_chars, &draw_toolbar](Toolbar_control& toolbar_control, bool do_push_to_device) {
+	// The toolbar labels are drawn with the text batch on top of the Voronoi image, so they follow the toolbar when it moves
+	auto draw_toolbar_text = [&text_batch, &font_info, &toolbar_info, &toolbar_controls]() {
+		text_add(text_batch, font_info, "Main toolbar", toolbar_info.x + 20, toolbar_info.y + toolbar_info.h - 40);
+		text_add(text_batch, font_info, "one two three 1 2 3", toolbar_info.x + 55, toolbar_info.y + 50);
+		for (auto& c : toolbar_controls) {
+			if (c.type == Toolbar_control_type::knob) {
+				text_add(text_batch, font_info, std::to_string(c.val_cur), toolbar_info.x + c.x + c.w + 10, toolbar_info.y + toolbar_info.h - c.y - 1 - c.h / 2 - 12);
+			}
+		}
+		};
+
+	auto draw_control = [&toolbar_pixels, &toolbar_info, &ssbo_toolbar_colors, &draw_toolbar](Toolbar_control& toolbar_control, bool do_push_to_device) {
 		auto& c = toolbar_control;
 
 		switch (c.type) {
@@ -777,7 +5477,6 @@ int main(int, char* []) {
 					toolbar_pixels[3 * (col + row_fixed * toolbar_info.w) + 2] = 0.9f;
 				}
 			}
-			draw_chars(std::to_string(c.val_cur), c.x + c.w + 10, toolbar_info.h - c.y - 1 - c.h / 2 - 12);
 		}
 		break;
 		case Toolbar_control_type::slider:
@@ -816,13 +5515,15 @@ int main(int, char* []) {
 			float radius;
 			float radius_square;
 			float color[3];
-			pos[0] = 100.0f + std::rand() % (window_width - 200);
-			pos[1] = 100.0f + std::rand() % (window_height - 200);
+			auto r_pos = random_uniform4(options.seed, Random_stream::voronoi_init, i, 0);
+			auto r_color = random_uniform4(options.seed, Random_stream::voronoi_init, i, 1);
+			pos[0] = 100.0f + static_cast<int>(r_pos[0] * (window_width - 200));
+			pos[1] = 100.0f + static_cast<int>(r_pos[1] * (window_height - 200));
 			radius = 5.0f;
 			radius_square = radius * radius;
-			color[0] = std::rand() % 100 / 100.0f;
-			color[1] = std::rand() % 100 / 100.0f;
-			color[2] = std::rand() % 100 / 100.0f;
+			color[0] = r_color[0];
+			color[1] = r_color[1];
+			color[2] = r_color[2];
 			Circle c = {};
 			c.r = radius;
 			c.r_square = radius_square;
@@ -836,25 +5537,19 @@ int main(int, char* []) {
 			voronoi_physics[i] = physics;
 		}
 
-		ssbo_voronoi_circles = setup_ssbo(static_cast<GLuint>(Ssbo_index::voronoi_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * voronoi_circles.size(), voronoi_circles.data());
-		ssbo_voronoi_physics = setup_ssbo(static_cast<GLuint>(Ssbo_index::voronoi_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * voronoi_physics.size(), voronoi_physics.data());
-
 		for (int i = 0; i < block_ids.size(); i++) {
 			block_ids[i] = { (int)voronoi_physics[i].pos[0] / block_size, (int)voronoi_physics[i].pos[1] / block_size };
+			voronoi_r_max = std::max(voronoi_r_max, voronoi_circles[i].r);
 		}
 
-		ssbo_block_ids = setup_ssbo(static_cast<GLuint>(Ssbo_index::voronoi_blocks), GL_DYNAMIC_DRAW, sizeof(Block_id) * block_ids.size(), block_ids.data());
-		ssbo_toolbar_info = setup_ssbo(static_cast<GLuint>(Ssbo_index::voronoi_toolbar), GL_DYNAMIC_DRAW, sizeof(Toolbar_info), &toolbar_info);
+		seed_grid_build(voronoi_grid, voronoi_physics, static_cast<float>(window_width), static_cast<float>(window_height));
 
 		draw_toolbar(0, toolbar_info.w, 0, toolbar_info.h);
-		draw_chars("one two three 1 2 3", 55, 50);
 
 		for (auto& c : toolbar_controls) {
 			draw_control(c, false);
 		}
 
-		ssbo_toolbar_colors = setup_ssbo(static_cast<GLuint>(Ssbo_index::voronoi_toolbar_colors), GL_DYNAMIC_DRAW, sizeof(float) * toolbar_pixels.size(), toolbar_pixels.data());
-
 		shader_use_program(id_program_voronoi);
 		shader_set_int(id_program_voronoi, "block_size", block_size);
 		shader_set_int(id_program_voronoi, "w", window_width);
@@ -862,67 +5557,323 @@ int main(int, char* []) {
 		shader_set_float(id_program_voronoi, "toolbar_opacity", toolbar_opacity);
 	}
 
-	size_t num_mold_particles = 400000;
+	// The host keeps the Voronoi state, so the scene continues where it was even if its buffers were released
+	scene_setup[Shaders::voronoi] = [&](Scene_resources& scene) {
+		ssbo_voronoi_circles = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * voronoi_circles.size(), voronoi_circles.data());
+		ssbo_voronoi_physics = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * voronoi_physics.size(), voronoi_physics.data());
+		ssbo_block_ids = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_blocks), GL_DYNAMIC_DRAW, sizeof(Block_id) * block_ids.size(), block_ids.data());
+		ssbo_toolbar_info = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_toolbar), GL_DYNAMIC_DRAW, sizeof(Toolbar_info), &toolbar_info);
+		ssbo_toolbar_colors = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_toolbar_colors), GL_DYNAMIC_DRAW, sizeof(float) * toolbar_pixels.size(), toolbar_pixels.data());
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_owners), GL_DYNAMIC_DRAW, sizeof(int) * window_width * window_height, nullptr);
+		ssbo_voronoi_dirty_tiles = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::voronoi_dirty_tiles), GL_DYNAMIC_DRAW, sizeof(uint32_t) * voronoi_dirty.tiles.size(), nullptr);
+		// The owners are not known yet
+		voronoi_dirty_all(voronoi_dirty);
+		};
+
+	// Also updates the picking grid and the GPU copy
+	auto voronoi_move_seed = [&](int idx, float x, float y) {
+		voronoi_dirty_seed(voronoi_dirty, voronoi_physics[idx], voronoi_circles[idx], block_ids[idx], block_size);
+		voronoi_physics[idx].pos[0] = x;
+		voronoi_physics[idx].pos[1] = y;
+		seed_grid_move(voronoi_grid, idx, x, y);
+		block_ids[idx] = { static_cast<int>(x) / block_size, static_cast<int>(y) / block_size };
+		voronoi_dirty_seed(voronoi_dirty, voronoi_physics[idx], voronoi_circles[idx], block_ids[idx], block_size);
+		ssbo_update(ssbo_voronoi_physics, sizeof(Physics) * idx, sizeof(Physics), &voronoi_physics[idx]);
+		ssbo_update(ssbo_block_ids, sizeof(Block_id) * idx, sizeof(Block_id), &block_ids[idx]);
+		};
+
+	// Call before and after the toolbar changes
+	auto voronoi_dirty_toolbar = [&]() {
+		voronoi_dirty_rect(voronoi_dirty, toolbar_info.x, toolbar_info.y, toolbar_info.x + toolbar_info.w, toolbar_info.y + toolbar_info.h, Voronoi_tile::shade);
+		};
+
+	// Renders the tiles that changed into the canvas, one work group per tile
+	auto voronoi_render = [&]() {
+		auto& list = voronoi_dirty_take(voronoi_dirty);
+		if (list.empty()) {
+			return;
+		}
+		ssbo_update(ssbo_voronoi_dirty_tiles, 0, sizeof(uint32_t) * list.size(), list.data());
+		shader_use_program(id_program_voronoi);
+		glDispatchCompute(static_cast<GLuint>(list.size()), 1, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		};
+
+	size_t num_mold_particles = options.num_mold_particles;
+	// Particles die and spawn on the GPU, so only the capacity of the pool is known on the host
+	size_t mold_pool_size = std::max(num_mold_particles, options.mold_pool_size);
+	float mold_spawn_probability = 0.01f;	// Per step, for particles on a trail of their own type that is at least mold_spawn_threshold
+	float mold_spawn_threshold = 0.5f;
+	int num_types = options.num_mold_types;
+	int num_mold_layers = (num_types + 3) / 4;	// The trail map stores four types per vec4
+	// The world can be much larger than the window. Only the tiles close to particles get trail storage,
+	//	from a pool of pages that is allocated once. The camera decides which part of the world is shown
+	int mold_world_width = options.mold_world_width > 0 ? options.mold_world_width : static_cast<int>(window_width);
+	int mold_world_height = options.mold_world_height > 0 ? options.mold_world_height : static_cast<int>(window_height);
+	int num_mold_tiles_x = (mold_world_width + mold_tile_size - 1) / mold_tile_size;
+	int num_mold_tiles_y = (mold_world_height + mold_tile_size - 1) / mold_tile_size;
+	size_t num_mold_tiles = static_cast<size_t>(num_mold_tiles_x) * num_mold_tiles_y;
+	size_t num_window_tiles = static_cast<size_t>((window_width + mold_tile_size - 1) / mold_tile_size) * ((window_height + mold_tile_size - 1) / mold_tile_size);
+	size_t num_mold_pages = std::min({ options.mold_max_tiles > 0 ? options.mold_max_tiles : 4 * num_window_tiles, num_mold_tiles, max_num_mold_pages });
+	glm::vec2 mold_camera_center = glm::vec2(mold_world_width, mold_world_height) / 2.0f;
+	float mold_camera_zoom = 1.0f;
+
+	if (options.trail_texture && (mold_world_width != window_width || mold_world_height != window_height)) {
+		log_error("--trail-texture needs a mold world of the same size as the window, ignoring it");
+		options.trail_texture = false;
+	}
 
-	std::vector<Mold_particle> mold_particles(num_mold_particles);
-	int type_id = 0;
-	int num_types = 3;
 	float t_step_ms = 20.0f;	// This is how long one physic step should be
 	float mold_speed_factor = 1.f;	// All mold movement is multiplied by this factor
+	float mold_steer_randomness = 0.0f;	// Max random turn per step, in radians
+	// Trails are blurred with a Gaussian of this radius (0 - 4) every step. Per type, the diffusion rate decides how much
+	//	of the blurred value is used, and the decay rate scales how fast the trail fades
+	int mold_diffuse_radius = 1;
+	std::vector<float> mold_diffusion_rates(max_num_mold_types, 0.5f);
+	std::vector<float> mold_decay_rates(max_num_mold_types, 1.0f);
+	// Row-major, max_num_mold_types x max_num_mold_types. Entry (a, b) is how strongly type a is drawn to the trail of type b,
+	//	negative values repel. By default each type follows its own trail and avoids all others
+	std::vector<float> mold_interactions(max_num_mold_types * max_num_mold_types);
+	for (int a = 0; a < max_num_mold_types; a++) {
+		for (int b = 0; b < max_num_mold_types; b++) {
+			mold_interactions[a * max_num_mold_types + b] = a == b ? 1.0f : -1.0f;
+		}
+	}
+	// Double buffered trail map. Index 0 is always the current one, bound to Ssbo_index::mold_intensities
+	GLuint ssbo_mold_intensities[2] = {};
+	GLuint ssbo_mold_page_pool = 0;
+	GLuint ssbo_mold_counters = 0;
+	// Double buffered alive list. Index 0 is the current one, bound to Ssbo_index::mold_alive
+	GLuint ssbo_mold_alive[2] = {};
+	// With --trail-texture, a copy of the trail map with four types per layer and mipmaps, for sensing with one sample per layer
+	GLuint id_texture_mold_trails = 0;
+	GLuint trail_texture_unit = 3;	// Must be kept in sync with the trail_map binding in the mold kernels
+	GLuint trail_image_unit = 1;	// Must be kept in sync with the trail_image binding in mold_compute
+
+	auto mold_publish_trails = [&]() {
+		shader_use_program(id_program_mold_compute);
+		shader_set_int(id_program_mold_compute, "action_id", 3);
+		glDispatchCompute((mold_world_width + 31) / 32, (mold_world_height + 31) / 32, 1);
+		glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_UPDATE_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+		glActiveTexture(GL_TEXTURE0 + trail_texture_unit);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, id_texture_mold_trails);
+		glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+		glActiveTexture(GL_TEXTURE0);
+		};
+	unsigned int mold_step_idx = 0;	// Together with the seed, this decides the random numbers drawn in a step
 
-	enum class Mold_init_mode {
-		Random,
-		Ellipse,
-		Circle
-	};
+	auto mold_init_mode = options.mold_seed_map_path.empty() ? Mold_init_mode::Random : Mold_init_mode::Seed_map;
+	auto mold_seed_map_file = options.mold_seed_map_path;
+
+	scene_setup[Shaders::mold] = [&](Scene_resources& scene) {
+		auto t_init_start = std::chrono::steady_clock::now();
+		mold_step_idx = 0;
+		Bmp_file mold_seed_map = {};
+
+		if (mold_init_mode == Mold_init_mode::Seed_map && !read_bmp(mold_seed_map_file, mold_seed_map)) {
+			log_error("Could not load mold seed map, using random positions instead");
+			mold_init_mode = Mold_init_mode::Random;
+		}
+
+		// The particles start in a window sized area in the middle of the world, and spread from there
+		int spawn_width = std::min(mold_world_width, static_cast<int>(window_width));
+		int spawn_height = std::min(mold_world_height, static_cast<int>(window_height));
+		Mold_init_params init_params = {
+			.mode = mold_init_mode,
+			.seed = options.seed,
+			.image_width = spawn_width,
+			.image_height = spawn_height,
+			.num_types = num_types,
+			.spawn_origin = { (mold_world_width - spawn_width) / 2.0f, (mold_world_height - spawn_height) / 2.0f },
+			.max_age = options.mold_lifetime
+		};
+
+		// In Random mode both paths give the same particles for the same seed, since every particle only depends on its
+		//	index and the conversions are exact. The other modes use sin/cos or the seed map texture, which can round
+		//	differently on the GPU
+		if (options.cpu_init) {
+			// The particles are only needed on the host until they have been uploaded
+			std::vector<Mold_particle> mold_particles(num_mold_particles);
+
+			parallel_for(num_mold_particles, [&](size_t idx_start, size_t idx_end) {
+				for (size_t idx_mold = idx_start; idx_mold < idx_end; idx_mold++) {
+					mold_particles[idx_mold] = mold_init_particle(static_cast<uint32_t>(idx_mold), num_mold_particles, init_params, mold_seed_map);
+				}
+				});
+
+			auto ssbo_mold = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold), GL_DYNAMIC_DRAW, sizeof(Mold_particle) * mold_pool_size, nullptr);
+			ssbo_update(ssbo_mold, 0, sizeof(Mold_particle) * mold_particles.size(), mold_particles.data());
+		}
+		else {
+			scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold), GL_DYNAMIC_DRAW, sizeof(Mold_particle) * mold_pool_size, nullptr);
 
-	auto mold_init_mode = Mold_init_mode::Random;
+			GLuint id_texture_seed_map = 0;
 
-	for (int idx_mold = 0; idx_mold < num_mold_particles; idx_mold++) {
-		float pos_x = window_width / 2.0f;
-		float pos_y = window_width / 2.0f;
-		float angle = 0.0f;
-		auto id_normalized = idx_mold / (num_mold_particles - 1.0f);
+			if (init_params.mode == Mold_init_mode::Seed_map) {
+				glActiveTexture(GL_TEXTURE2);
+				id_texture_seed_map = bmp_upload_texture("scene mold", mold_seed_map, GL_RGB8, GL_NEAREST);
+				glActiveTexture(GL_TEXTURE0);
+			}
+
+			shader_use_program(id_program_mold_init);
+			shader_set_int(id_program_mold_init, "image_width", init_params.image_width);
+			shader_set_int(id_program_mold_init, "image_height", init_params.image_height);
+			shader_set_int(id_program_mold_init, "init_mode", static_cast<int>(init_params.mode));
+			shader_set_uint(id_program_mold_init, "seed", init_params.seed);
+			shader_set_int(id_program_mold_init, "num_types", init_params.num_types);
+			shader_set_int(id_program_mold_init, "seed_map", 2);
+			shader_set_vec2(id_program_mold_init, "spawn_origin", glm::vec2(init_params.spawn_origin[0], init_params.spawn_origin[1]));
+			shader_set_uint(id_program_mold_init, "num_mold_particles", static_cast<unsigned int>(num_mold_particles));
+			shader_set_uint(id_program_mold_init, "max_age", init_params.max_age);
+			dispatch_compute_linear(num_mold_particles, 256);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+			// Deleting is deferred by the driver until the dispatch is done
+			gpu_delete_texture(id_texture_seed_map);
+		}
+
+		bmp_close(mold_seed_map);
 
-		if (mold_init_mode == Mold_init_mode::Random) {
-			pos_x = window_width * (std::rand() % 10000) / 10000.0f;
-			pos_y = window_height * (std::rand() % 10000) / 10000.0f;
-			angle = 2.0f * std::numbers::pi_v<float> *(std::rand() % 10000) / 10000.0f;
+		// The first num_mold_particles slots are alive, the rest of the pool is on the free stack, popped from the end
+		std::vector<uint32_t> mold_alive(mold_pool_size);
+		std::vector<uint32_t> mold_free_slots(mold_pool_size);
+		for (size_t idx = 0; idx < mold_pool_size; idx++) {
+			mold_alive[idx] = static_cast<uint32_t>(idx);
+			mold_free_slots[idx] = static_cast<uint32_t>(mold_pool_size - 1 - idx);
+		}
+		auto num_alive_groups = std::max<size_t>(1, (num_mold_particles + 1023) / 1024);
+		Mold_counters mold_counters = {
+			.num_groups = { static_cast<uint32_t>(std::min<size_t>(num_alive_groups, 65535)), static_cast<uint32_t>((num_alive_groups + 65534) / 65535), 1 },
+			.num_alive = static_cast<uint32_t>(num_mold_particles),
+			.num_alive_next = 0,
+			.num_spawned = 0,
+			.num_free_slots = static_cast<int32_t>(mold_pool_size - num_mold_particles)
+		};
+		ssbo_mold_counters = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_counters), GL_DYNAMIC_DRAW, sizeof(Mold_counters), &mold_counters);
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_free_slots), GL_DYNAMIC_DRAW, sizeof(uint32_t) * mold_free_slots.size(), mold_free_slots.data());
+		ssbo_mold_alive[0] = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_alive), GL_DYNAMIC_DRAW, sizeof(uint32_t) * mold_alive.size(), mold_alive.data());
+		ssbo_mold_alive[1] = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_alive_next), GL_DYNAMIC_DRAW, sizeof(uint32_t) * mold_pool_size, nullptr);
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_scan_offsets), GL_DYNAMIC_DRAW, sizeof(uint32_t) * mold_pool_size, nullptr);
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_group_sums), GL_DYNAMIC_DRAW, sizeof(uint32_t) * ((mold_pool_size + 1023) / 1024), nullptr);
+
+		// All tiles start without a page. The free page stack is popped from the end, so page 0 is used first
+		std::vector<Mold_tile> mold_tiles(num_mold_tiles, { .page = mold_no_page, .step_last_used = 0 });
+		std::vector<int> mold_page_pool(1 + num_mold_pages);
+		mold_page_pool[0] = static_cast<int>(num_mold_pages);
+		for (size_t idx_page = 0; idx_page < num_mold_pages; idx_page++) {
+			mold_page_pool[1 + idx_page] = static_cast<int>(num_mold_pages - 1 - idx_page);
 		}
-
-		if (mold_init_mode == Mold_init_mode::Ellipse) {
-			pos_x = window_width / 2.0f + window_width / 4.0f * std::cos(2.0f * std::numbers::pi_v<float> *id_normalized);
-			pos_y = window_height / 2.0f + window_height / 4.0f * std::sin(2.0f * std::numbers::pi_v<float> *id_normalized);
-			angle = 2.0f * std::numbers::pi_v<float> *id_normalized;
+		std::vector<int> mold_page_tiles(num_mold_pages, -1);
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_tiles), GL_DYNAMIC_DRAW, sizeof(Mold_tile) * mold_tiles.size(), mold_tiles.data());
+		ssbo_mold_page_pool = scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_page_pool), GL_DYNAMIC_DRAW, sizeof(int) * mold_page_pool.size(), mold_page_pool.data());
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_page_tiles), GL_DYNAMIC_DRAW, sizeof(int) * mold_page_tiles.size(), mold_page_tiles.data());
+
+		size_t trail_map_size = 4 * num_mold_layers * num_mold_pages * mold_tile_size * mold_tile_size;
+		ssbo_mold_intensities[0] = scene_setup_ssbo_zeroed(scene, static_cast<GLuint>(Ssbo_index::mold_intensities), GL_DYNAMIC_DRAW, sizeof(float) * trail_map_size);
+		ssbo_mold_intensities[1] = scene_setup_ssbo_zeroed(scene, static_cast<GLuint>(Ssbo_index::mold_intensities_next), GL_DYNAMIC_DRAW, sizeof(float) * trail_map_size);
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::mold_interactions), GL_DYNAMIC_DRAW, sizeof(float) * mold_interactions.size(), mold_interactions.data());
+
+		if (options.trail_texture) {
+			id_texture_mold_trails = scene_setup_texture_array(scene, trail_texture_unit, GL_RGBA16F, 8, window_width, window_height, num_mold_layers);
+			glBindImageTexture(trail_image_unit, id_texture_mold_trails, 0, GL_TRUE, 0, GL_WRITE_ONLY, GL_RGBA16F);
+			// The texture has undefined contents until the first copy, and the first step senses before that
+			mold_publish_trails();
 		}
 
-		if (mold_init_mode == Mold_init_mode::Circle) {
-			pos_x = window_width / 2.0f + window_width / 4.0f * std::cos(2.0f * std::numbers::pi_v<float> *id_normalized);
-			pos_y = window_height / 2.0f + window_width / 4.0f * std::sin(2.0f * std::numbers::pi_v<float> *id_normalized);
-			angle = 2.0f * std::numbers::pi_v<float> *id_normalized;
+		if (options.accumulate_trails) {
+			scene_setup_ssbo_zeroed(scene, static_cast<GLuint>(Ssbo_index::mold_deposits), GL_DYNAMIC_DRAW, sizeof(unsigned int) * trail_map_size);
 		}
 
-		auto& cur_mold = mold_particles[idx_mold];
-		type_id = (type_id + 1) % num_types;
-		cur_mold = { .pos = {pos_x, pos_y}, .angle = angle, .type = type_id };
-	}
-
-	setup_ssbo(static_cast<GLuint>(Ssbo_index::mold), GL_DYNAMIC_DRAW, sizeof(Mold_particle) * mold_particles.size(), mold_particles.data());
-
-	std::vector<float> mold_intensities(window_width * window_height * num_types);
-
-	setup_ssbo(static_cast<GLuint>(Ssbo_index::mold_intensities), GL_DYNAMIC_DRAW, sizeof(float) * mold_intensities.size(), mold_intensities.data());
+		// Only done once per activation, so waiting for the GPU here to get a correct timing is fine
+		glFinish();
+		std::chrono::duration<float, std::milli> t_init = std::chrono::steady_clock::now() - t_init_start;
+		std::cout << std::format("Initialized {} mold particles on the {} in {:.1f} ms (seed {})", num_mold_particles, options.cpu_init ? "CPU" : "GPU", t_init.count(), options.seed) << std::endl;
+		std::cout << std::format("Mold world of {}x{} in {} tiles, trail storage for {} of them", mold_world_width, mold_world_height, num_mold_tiles, num_mold_pages) << std::endl;
+		};
 
 	shader_use_program(id_program_mold_render);
-	shader_set_int(id_program_mold_render, "num_types", num_types);
 	shader_set_int(id_program_mold_render, "image_width", window_width);
 	shader_set_int(id_program_mold_render, "image_height", window_height);
+	shader_set_bool(id_program_mold_render, "use_trail_texture", options.trail_texture);
+	shader_set_int(id_program_mold_render, "trail_map", trail_texture_unit);
+	shader_set_int(id_program_mold_render, "world_width", mold_world_width);
+	shader_set_int(id_program_mold_render, "world_height", mold_world_height);
+	shader_set_int(id_program_mold_render, "num_tiles_x", num_mold_tiles_x);
 	shader_use_program(id_program_mold_compute);
-	shader_set_int(id_program_mold_compute, "num_types", num_types);
-	shader_set_int(id_program_mold_compute, "image_width", window_width);
-	shader_set_int(id_program_mold_compute, "image_height", window_height);
+	shader_set_int(id_program_mold_compute, "world_width", mold_world_width);
+	shader_set_int(id_program_mold_compute, "world_height", mold_world_height);
+	shader_set_int(id_program_mold_compute, "num_tiles_x", num_mold_tiles_x);
+	shader_set_int(id_program_mold_compute, "num_tiles_y", num_mold_tiles_y);
 	shader_set_float(id_program_mold_compute, "t_step_ms", t_step_ms);
 	shader_set_float(id_program_mold_compute, "speed_factor", mold_speed_factor);
+	shader_set_uint(id_program_mold_compute, "seed", options.seed);
+	shader_set_float(id_program_mold_compute, "steer_randomness", mold_steer_randomness);
+	shader_set_bool(id_program_mold_compute, "accumulate_trails", options.accumulate_trails);
+	shader_set_bool(id_program_mold_compute, "use_trail_texture", options.trail_texture);
+	shader_set_int(id_program_mold_compute, "trail_map", trail_texture_unit);
+
+	// 1D Gaussian weights, center first. The kernel is separable, so the same weights are used in both directions
+	std::vector<float> mold_kernel_weights(5);
+	float mold_kernel_sigma = (mold_diffuse_radius + 1) / 2.0f;
+	float mold_kernel_sum = 0.0f;
+	for (int k = -mold_diffuse_radius; k <= mold_diffuse_radius; k++) {
+		mold_kernel_sum += std::exp(-k * k / (2 * mold_kernel_sigma * mold_kernel_sigma));
+	}
+	for (int k = 0; k <= mold_diffuse_radius; k++) {
+		mold_kernel_weights[k] = std::exp(-k * k / (2 * mold_kernel_sigma * mold_kernel_sigma)) / mold_kernel_sum;
+	}
+
+	shader_use_program(id_program_mold_diffuse);
+	shader_set_int(id_program_mold_diffuse, "world_width", mold_world_width);
+	shader_set_int(id_program_mold_diffuse, "world_height", mold_world_height);
+	shader_set_int(id_program_mold_diffuse, "num_tiles_x", num_mold_tiles_x);
+	shader_set_int(id_program_mold_diffuse, "diffuse_radius", mold_diffuse_radius);
+	shader_set_float(id_program_mold_diffuse, "decay_amount", mold_speed_factor * t_step_ms / 1000.0f);
+	shader_set_bool(id_program_mold_diffuse, "use_shared_memory", true);
+	shader_set_float_array(id_program_mold_diffuse, "kernel_weights", mold_kernel_weights);
+	shader_set_float_array(id_program_mold_diffuse, "diffusion_rates", mold_diffusion_rates);
+	shader_set_float_array(id_program_mold_diffuse, "decay_rates", mold_decay_rates);
+
+	// One row of 16x16 work groups per page. Free pages return right away
+	auto mold_diffuse_pass = [&]() {
+		shader_use_program(id_program_mold_diffuse);
+		glDispatchCompute((mold_tile_size / 16) * (mold_tile_size / 16), static_cast<GLuint>(num_mold_pages), 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+
+	auto mold_diffuse = [&]() {
+		mold_diffuse_pass();
+		std::swap(ssbo_mold_intensities[0], ssbo_mold_intensities[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(Ssbo_index::mold_intensities), ssbo_mold_intensities[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(Ssbo_index::mold_intensities_next), ssbo_mold_intensities[1]);
+		};
+
+	// The trail map size depends on the number of types, so the mold scene has to be set up again after changing it
+	auto mold_set_num_types = [&](int n) {
+		num_types = n;
+		num_mold_layers = (n + 3) / 4;
+		shader_use_program(id_program_mold_render);
+		shader_set_int(id_program_mold_render, "num_types", num_types);
+		shader_set_int(id_program_mold_render, "num_layers", num_mold_layers);
+		shader_use_program(id_program_mold_compute);
+		shader_set_int(id_program_mold_compute, "num_types", num_types);
+		shader_set_int(id_program_mold_compute, "num_layers", num_mold_layers);
+		shader_use_program(id_program_mold_diffuse);
+		shader_set_int(id_program_mold_diffuse, "num_layers", num_mold_layers);
+		shader_use_program(id_program_mold_lifecycle);
+		shader_set_int(id_program_mold_lifecycle, "num_layers", num_mold_layers);
+		};
+
+	mold_set_num_types(num_types);
+
+	shader_use_program(id_program_mold_lifecycle);
+	shader_set_uint(id_program_mold_lifecycle, "max_age", options.mold_lifetime);
+	shader_set_float(id_program_mold_lifecycle, "spawn_probability", mold_spawn_probability);
+	shader_set_float(id_program_mold_lifecycle, "spawn_threshold", mold_spawn_threshold);
+	shader_set_uint(id_program_mold_lifecycle, "seed", options.seed);
+	shader_set_int(id_program_mold_lifecycle, "num_tiles_x", num_mold_tiles_x);
+	shader_set_int(id_program_mold_lifecycle, "world_width", mold_world_width);
+	shader_set_int(id_program_mold_lifecycle, "world_height", mold_world_height);
 
 	shader_use_program(id_program_funky);
 	shader_set_int(id_program_funky, "w", window_width);
@@ -939,7 +5890,7 @@ int main(int, char* []) {
 	physics_physics[0].dir[0] = 1;
 	physics_physics[0].dir[1] = 1;
 	circles_physics[0].r = 5;
-	physics_physics[0].speed = 1;
+	physics_physics[0].speed = 20;	// World units per second
 	physics_physics[0].mass = circles_physics[0].r * circles_physics[0].r;
 	circles_physics[0].r_square = circles_physics[0].r * circles_physics[0].r;
 	circles_physics[1] = circles_physics[0];
@@ -949,28 +5900,29 @@ int main(int, char* []) {
 	physics_physics[1].dir[0] = 0.7f;
 	circles_physics[1].r = 5;
 	physics_physics[1].mass = circles_physics[1].r * circles_physics[1].r;
-	physics_physics[1].speed = 1;
+	physics_physics[1].speed = 20;
 
 	float world_min_x = 0.0f;
 	float world_max_x = 100.0f;
 	float world_min_y = 0.0f;
 	float world_max_y = 100.0f * window_height / window_width;
-	float step_ms = 0.01f;
-
-	setup_ssbo(static_cast<GLuint>(Ssbo_index::physics_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * circles_physics.size(), circles_physics.data());
-	setup_ssbo(static_cast<GLuint>(Ssbo_index::physics_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * physics_physics.size(), physics_physics.data());
+	// The event-driven step collides the bodies at the time of contact, however long the frame was. Only a stalled
+	//	frame is cut short, so the bodies do not jump
+	float physics_max_dt_s = 0.1f;
+	int physics_max_event_rounds = 256;
+
+	scene_setup[Shaders::physics] = [&circles_physics, &physics_physics](Scene_resources& scene) {
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::physics_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * circles_physics.size(), circles_physics.data());
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::physics_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * physics_physics.size(), physics_physics.data());
+		scene_setup_ssbo(scene, static_cast<GLuint>(Ssbo_index::physics_scratch), GL_DYNAMIC_COPY, sizeof(Physics_scratch) * physics_physics.size(), nullptr);
+		};
 
-	shader_use_program(id_program_physics_compute);
-	shader_set_float(id_program_physics_compute, "world_min_x", world_min_x);
-	shader_set_float(id_program_physics_compute, "world_max_x", world_max_x);
-	shader_set_float(id_program_physics_compute, "world_min_u", world_min_y);
-	shader_set_float(id_program_physics_compute, "world_max_y", world_max_y);
-	shader_set_float(id_program_physics_compute, "step_ms", step_ms);
+	physics_gpu_set_world(id_program_physics_compute, world_min_x, world_max_x, world_min_y, world_max_y);
 
 	shader_use_program(id_program_physics_render);
 	shader_set_float(id_program_physics_render, "world_min_x", world_min_x);
 	shader_set_float(id_program_physics_render, "world_max_x", world_max_x);
-	shader_set_float(id_program_physics_render, "world_min_u", world_min_y);
+	shader_set_float(id_program_physics_render, "world_min_y", world_min_y);
 	shader_set_float(id_program_physics_render, "world_max_y", world_max_y);
 	shader_set_float(id_program_physics_render, "window_width", window_width);
 	shader_set_float(id_program_physics_render, "window_height", window_height);
@@ -989,6 +5941,37 @@ int main(int, char* []) {
 	unsigned int workgroup_size_x = (unsigned int)ceil(texture_width / 32.0);
 	unsigned int workgroup_size_y = (unsigned int)ceil(texture_height / 32.0);
 
+	// Runs the render pass of a scene at the resolution picked by the quality governor. render(width, height, scale)
+	//	must only draw the lower left width x height pixels of the image
+	auto render_scene = [&](const std::function<void(int, int, float)>& render) {
+		auto scale = quality_render_scale(quality_governor);
+		int width = static_cast<int>(texture_width * scale);
+		int height = static_cast<int>(texture_height * scale);
+		bool is_scaled = scale < 1.0f;
+
+		if (quality_governor.budget_ms > 0.0f) {
+			gpu_timer_begin(quality_governor.render_timer);
+		}
+		if (is_scaled) {
+			glBindImageTexture(0, id_texture_scene, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+		}
+
+		render(width, height, scale);
+
+		if (is_scaled) {
+			glBindImageTexture(0, id_texture, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT);
+			shader_use_program(id_program_upscale);
+			shader_set_vec2(id_program_upscale, "scene_size", glm::vec2(width, height));
+			glDispatchCompute((texture_width + 15) / 16, (texture_height + 15) / 16, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+		}
+		if (quality_governor.budget_ms > 0.0f) {
+			gpu_timer_end(quality_governor.render_timer, 1);
+		}
+		};
+	Shaders governor_scene = shader;
+
 	float last_fps_time = static_cast<float>(glfwGetTime());
 	int frame_counter = 0;
 
@@ -1016,7 +5999,58 @@ int main(int, char* []) {
 	auto angle_alpha = std::numbers::pi_v<float>;
 	auto angle_beta = -std::numbers::pi_v<float> / 8;
 
-	glfwSetCursorPos(window, window_width / 2, window_height / 2);
+	// Renders the rays scene into image unit 0. The sphere under mouse_pixel is picked, see Shared_data
+	auto rays_render = [&](int width, int height, glm::vec2 mouse_pixel, float t) {
+		auto id_program = rays_use_megakernel ? id_program_rays : rays_wavefront.id_program;
+		shader_use_program(id_program);
+		shader_set_int(id_program, "w", width);
+		shader_set_int(id_program, "h", height);
+		shader_set_float(id_program, "t", t);
+		shader_set_vec2(id_program, "mouse_pos", mouse_pixel);
+		shader_set_vec3(id_program, "the_focus", the_focus);
+		shader_set_vec3(id_program, "the_camera", the_camera);
+		if (rays_use_megakernel) {
+			shader_set_int(id_program, "num_bounces", rays_wavefront.num_bounces);
+			glDispatchCompute((width + 31) / 32, (height + 31) / 32, 1);
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		else {
+			rays_wavefront_render(rays_wavefront, width, height);
+		}
+		};
+
+	// Aggregates of the scene that is shown, for the stats overlay and --stats-log
+	Gpu_statistics gpu_statistics = { .id_program = id_program_statistics };
+	auto statistics_sources = [&](Shaders scene) {
+		Statistics_sources sources = { .scene = scene_names[scene] };
+		if (scene == Shaders::mold) {
+			sources.has_mold = true;
+			sources.num_mold_types = num_types;
+			sources.num_mold_layers = num_mold_layers;
+			sources.num_mold_trail_pixels = num_mold_pages * mold_tile_size * mold_tile_size;
+			sources.mold_pool_size = mold_pool_size;
+			sources.num_mold_tiles = num_mold_tiles;
+			sources.num_mold_pages = num_mold_pages;
+			sources.mold_counters = ssbo_mold_counters;
+			sources.mold_page_pool = ssbo_mold_page_pool;
+		}
+		sources.has_physics = scene == Shaders::physics;
+		// The megakernel does not count its rays
+		if (scene == Shaders::rays && !rays_use_megakernel) {
+			sources.ray_counters = rays_wavefront.counters;
+		}
+		return sources;
+		};
+
+	if (!options.record_path.empty() && !input_record_start(options.record_path, options.seed)) {
+		return -1;
+	}
+
+	if (!options.replay_path.empty() && !input_replay_start(options.replay_path, options.seed)) {
+		return -1;
+	}
+
+	input_set_cursor_pos(window, window_width / 2, window_height / 2);
 	mouse_move_info.has_been_read = true;
 	mouse_move_info.new_x = window_width / 2;
 	mouse_move_info.new_y = window_height / 2;
@@ -1030,10 +6064,865 @@ int main(int, char* []) {
 	float move_origin[2] = { 0,0 };
 	float move_vector[2] = { 0,0 };
 	float t_acc_mold_move_ms = 0.0f;
+	Shaders active_scene = shader;
+
+	auto scene_buffer_mb = [&scene_resources]() {
+		size_t num_bytes = 0;
+		for (auto& [_, resources] : scene_resources) {
+			num_bytes += resources.num_bytes;
+		}
+		return num_bytes / (1024.0f * 1024.0f);
+		};
+
+	auto scene_activate = [&](Shaders scene) {
+		// The ray queues are a few hundred MB at full resolution, and the next frame of the rays scene reserves them again
+		if (scene != active_scene && active_scene == Shaders::rays) {
+			rays_wavefront_release(rays_wavefront);
+		}
+		if (scene != active_scene && release_inactive_scenes) {
+			scene_release(scene_resources[active_scene]);
+			// The solver grids are not part of the scene resources, see solver_scene
+			if (active_scene == Shaders::solver) {
+				gpu_solver_release(solver_scene);
+			}
+			std::cout << std::format("Released GPU buffers of scene '{}'", scene_names[active_scene]) << std::endl;
+		}
+		active_scene = scene;
+		if (!scene_resources[scene].is_allocated) {
+			auto& resources = scene_resources[scene];
+			resources.name = scene_names[scene];
+			if (scene_setup.count(scene) > 0) {
+				scene_setup[scene](resources);
+			}
+			resources.is_allocated = true;
+			std::cout << std::format("Scene '{}' allocated {:.1f} MB of GPU buffers ({:.1f} MB for all scenes)", scene_names[scene], resources.num_bytes / (1024.0f * 1024.0f), scene_buffer_mb()) << std::endl;
+		}
+		};
+
+	// Must sync with the actions in mold::main()
+	auto mold_dispatch = [&](int action_id, size_t num_items) {
+		shader_set_int(id_program_mold_compute, "action_id", action_id);
+		dispatch_compute_linear(num_items, 32 * 32);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+
+	// The number of live particles is only known on the GPU, so the passes over them get their size from Mold_counters
+	auto mold_dispatch_alive = [&](int action_id) {
+		shader_set_int(id_program_mold_compute, "action_id", action_id);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, ssbo_mold_counters);
+		glDispatchComputeIndirect(0);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		};
+
+	// Must sync with the actions in mold_lifecycle::main(). Actions 1 and 4 run in a single work group
+	auto mold_lifecycle = [&]() {
+		shader_use_program(id_program_mold_lifecycle);
+		shader_set_uint(id_program_mold_lifecycle, "step_idx", mold_step_idx);
+		glBindBuffer(GL_DISPATCH_INDIRECT_BUFFER, ssbo_mold_counters);
+		for (int action_id = 0; action_id < 5; action_id++) {
+			shader_set_int(id_program_mold_lifecycle, "action_id", action_id);
+			if (action_id == 1 || action_id == 4) {
+				glDispatchCompute(1, 1, 1);
+			}
+			else {
+				glDispatchComputeIndirect(0);
+			}
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		// The next indirect dispatches read the arguments written by the last action
+		glMemoryBarrier(GL_COMMAND_BARRIER_BIT);
+		std::swap(ssbo_mold_alive[0], ssbo_mold_alive[1]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(Ssbo_index::mold_alive), ssbo_mold_alive[0]);
+		glBindBufferBase(GL_SHADER_STORAGE_BUFFER, static_cast<GLuint>(Ssbo_index::mold_alive_next), ssbo_mold_alive[1]);
+		};
+
+	// Without deaths and without free slots, the alive list never changes
+	bool mold_has_lifecycle = options.mold_lifetime > 0 || mold_pool_size > num_mold_particles;
+
+	auto mold_step = [&]() {
+		shader_use_program(id_program_mold_compute);
+		shader_set_uint(id_program_mold_compute, "step_idx", mold_step_idx);
+		// Mark the tiles near particles, then return the pages of unused tiles and clear them, one work group per
+		//	page, before handing out pages to new ones
+		mold_dispatch_alive(4);
+		mold_dispatch(5, num_mold_tiles);
+		shader_set_int(id_program_mold_compute, "action_id", 7);
+		glDispatchCompute(1, static_cast<GLuint>(num_mold_pages), 1);
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		mold_dispatch(6, num_mold_tiles);
+		mold_dispatch_alive(0);
+
+		mold_diffuse();
+
+		shader_use_program(id_program_mold_compute);
+		mold_dispatch_alive(1);
+		// Only needed when accumulating trails. One row of 32x32 work groups per page
+		if (options.accumulate_trails) {
+			shader_set_int(id_program_mold_compute, "action_id", 2);
+			glDispatchCompute((mold_tile_size / 32) * (mold_tile_size / 32), static_cast<GLuint>(num_mold_pages), 1);
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+		}
+		if (options.trail_texture) {
+			mold_publish_trails();
+		}
+		if (mold_has_lifecycle) {
+			mold_lifecycle();
+		}
+		mold_step_idx++;
+		};
+
+	// F5 saves the GPU state of the current scene to snapshot_<scene>.bin, F9 restores it. Saving runs in
+	//	the background over a few frames, see Snapshot_save
+	Snapshot_save snapshot_save;
+
+	auto snapshot_path = [&](Shaders scene) {
+		return std::filesystem::path(std::format("snapshot_{}.bin", scene_names[scene]));
+		};
+
+	auto snapshot_header = [&](Shaders scene) {
+		Snapshot_header header = {};
+		header.scene = static_cast<int32_t>(scene);
+		header.seed = options.seed;
+		header.mold_step_idx = mold_step_idx;
+		header.num_mold_types = num_types;
+		header.mold_world_width = mold_world_width;
+		header.mold_world_height = mold_world_height;
+		header.mold_pool_size = mold_pool_size;
+		return header;
+		};
+
+	auto snapshot_load = [&](Shaders scene) {
+		Snapshot_header header = {};
+		auto t_start = std::chrono::steady_clock::now();
+
+		if (!snapshot_restore(snapshot_path(scene), snapshot_header(scene), scene_resources[scene], header)) {
+			return;
+		}
+
+		// Host state that goes with the buffers
+		if (scene == Shaders::mold) {
+			mold_step_idx = header.mold_step_idx;
+			if (options.trail_texture) {
+				mold_publish_trails();
+			}
+		}
+
+		if (scene == Shaders::voronoi) {
+			ssbo_read(ssbo_voronoi_circles, 0, sizeof(Circle) * voronoi_circles.size(), voronoi_circles.data());
+			ssbo_read(ssbo_voronoi_physics, 0, sizeof(Physics) * voronoi_physics.size(), voronoi_physics.data());
+			seed_grid_build(voronoi_grid, voronoi_physics, static_cast<float>(window_width), static_cast<float>(window_height));
+			ssbo_read(ssbo_block_ids, 0, sizeof(Block_id) * block_ids.size(), block_ids.data());
+			ssbo_read(ssbo_toolbar_info, 0, sizeof(Toolbar_info), &toolbar_info);
+			voronoi_dirty_all(voronoi_dirty);
+		}
+
+		auto t_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_start).count();
+		std::cout << std::format("Restored snapshot '{}' in {:.1f} ms", snapshot_path(scene).string(), t_ms) << std::endl;
+		};
+
+	// Benchmarks run instead of the main loop, when started with --benchmark. Each one prints its own results
+	std::vector<std::pair<std::string, std::function<void()>>> benchmarks;
+
+	benchmarks.push_back({ "diffusion", [&]() {
+		scene_activate(Shaders::mold);
+		// Let the trails build up a bit, so the benchmark does not only run on zeros
+		for (int idx_step = 0; idx_step < 100; idx_step++) {
+			mold_step();
+		}
+
+		int num_iterations = 200;
+		auto num_pixels = num_mold_pages * mold_tile_size * mold_tile_size;
+		auto image_size = 4 * num_mold_layers * num_pixels;
+		std::vector<float> result_tiled(image_size);
+		std::vector<float> result_naive(image_size);
+
+		std::cout << std::format("Diffusion of a trail map with {} pages of {}x{}, {} types, radius {}", num_mold_pages, mold_tile_size, mold_tile_size, num_types, mold_diffuse_radius) << std::endl;
+
+		// Run both versions once from the same input, to check that they agree
+		for (auto use_shared_memory : { false, true }) {
+			shader_use_program(id_program_mold_diffuse);
+			shader_set_bool(id_program_mold_diffuse, "use_shared_memory", use_shared_memory);
+			mold_diffuse_pass();
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			ssbo_read(ssbo_mold_intensities[1], 0, sizeof(float) * image_size, use_shared_memory ? result_tiled.data() : result_naive.data());
+		}
+
+		for (auto use_shared_memory : { false, true }) {
+			shader_use_program(id_program_mold_diffuse);
+			shader_set_bool(id_program_mold_diffuse, "use_shared_memory", use_shared_memory);
+			auto t_ms = gpu_time_ms(mold_diffuse, num_iterations);
+			auto pixels_per_s = num_pixels / (t_ms / 1000.0f);
+			std::cout << std::format("  {:<14} {:8.3f} ms per pass, {:8.1f} Mpixels/s", use_shared_memory ? "shared memory" : "naive", t_ms, pixels_per_s / 1.0e6f) << std::endl;
+		}
+
+		float max_diff = 0.0f;
+		for (size_t idx = 0; idx < image_size; idx++) {
+			max_diff = std::max(max_diff, std::abs(result_tiled[idx] - result_naive[idx]));
+		}
+		std::cout << std::format("  Max difference between the versions: {}", max_diff) << std::endl;
+		} });
+
+	// Sensing and diffusion work on four types at a time, so the step cost should grow much slower than the number of types
+	benchmarks.push_back({ "mold_types", [&]() {
+		int num_types_original = num_types;
+		int num_iterations = 100;
+		float t_ms_one_type = 0.0f;
+
+		std::cout << std::format("Mold step with {} particles in a {}x{} world", num_mold_particles, mold_world_width, mold_world_height) << std::endl;
+
+		for (int n : { 1, 3, 8, 16 }) {
+			mold_set_num_types(n);
+			scene_release(scene_resources[Shaders::mold]);
+			scene_activate(Shaders::mold);
+			// Let the trails build up a bit first
+			for (int idx_step = 0; idx_step < 100; idx_step++) {
+				mold_step();
+			}
+
+			auto t_ms = gpu_time_ms(mold_step, num_iterations);
+			if (n == 1) {
+				t_ms_one_type = t_ms;
+			}
+			std::cout << std::format("  {:2} types {:8.3f} ms per step, {:5.2f}x the time for one type", n, t_ms, t_ms / t_ms_one_type) << std::endl;
+		}
+
+		mold_set_num_types(num_types_original);
+		scene_release(scene_resources[Shaders::mold]);
+		} });
+
+	// Many small simulations fill the GPU much better in one dispatch than one after the other
+	benchmarks.push_back({ "sweep", [&]() {
+		Options sweep_options = options;
+		sweep_options.sweep_speed_factors = { 0.5f, 1.0f, 2.0f, 4.0f };
+		sweep_options.sweep_sensor_distances = { 5.0f, 10.0f, 20.0f, 40.0f };
+		sweep_options.sweep_num_types = { 1, 3, 4, 8 };
+		auto runs = mold_sweep_runs(sweep_options);
+		Mold_sweep sweep = { .id_program = id_program_mold_sweep, .world_width = 128, .world_height = 128, .num_particles_per_run = 2000, .num_steps = 200 };
+		double t_one_at_a_time_s = 0.0;
+		uint64_t hash_one_at_a_time = 0;
+
+		std::cout << std::format("{} runs with {} particles in a {}x{} world for {} steps", runs.size(), sweep.num_particles_per_run, sweep.world_width, sweep.world_height, sweep.num_steps) << std::endl;
+
+		for (size_t batch_size : { 1, 4, 16, 64 }) {
+			auto t_start = std::chrono::steady_clock::now();
+			auto hash = mold_sweep_execute(sweep, runs, batch_size, {});
+			auto t_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+			if (batch_size == 1) {
+				t_one_at_a_time_s = t_s;
+				hash_one_at_a_time = hash;
+			}
+			std::cout << std::format("  {:2} runs per batch {:8.1f} ms, {:5.2f}x faster than one at a time, {}",
+				batch_size, t_s * 1000.0, t_one_at_a_time_s / t_s, hash == hash_one_at_a_time ? "same result" : "DIFFERENT RESULT") << std::endl;
+		}
+
+		mold_sweep_release(sweep);
+		} });
+
+	// The wavefront passes against the single kernel on the same frame. Without shadows, they should render the same pixels
+	benchmarks.push_back({ "rays", [&]() {
+		struct Rays_variant {
+			std::string name;
+			bool use_megakernel;
+			bool sort_rays;
+			int num_shadow_samples;
+		};
+		int num_shadow_samples = std::max(1, options.rays_shadow_samples);
+		std::vector<Rays_variant> variants = {
+			{ "megakernel", true, false, 0 },
+			{ "wavefront", false, false, 0 },
+			{ "wavefront, sorted", false, true, 0 },
+			{ std::format("sorted, {} shadow rays", num_shadow_samples), false, true, num_shadow_samples },
+		};
+		int num_iterations = 50;
+		auto num_values = 3 * static_cast<size_t>(texture_width) * texture_height;
+		std::vector<float> image_megakernel(num_values);
+		std::vector<float> image(num_values);
+		float t_ms_megakernel = 0.0f;
+
+		scene_activate(Shaders::rays);
+		std::cout << std::format("Rays at {}x{} with {} bounces", texture_width, texture_height, rays_wavefront.num_bounces) << std::endl;
+
+		for (auto& variant : variants) {
+			rays_use_megakernel = variant.use_megakernel;
+			rays_wavefront.sort_rays = variant.sort_rays;
+			rays_wavefront.num_shadow_samples = variant.num_shadow_samples;
+			// Away from the window, so there is no crosshair
+			auto render = [&]() { rays_render(texture_width, texture_height, glm::vec2(-100, -100), 0.0f); };
+
+			render();
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, id_texture);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, variant.use_megakernel ? image_megakernel.data() : image.data());
+
+			auto t_ms = gpu_time_ms(render, num_iterations);
+			if (variant.use_megakernel) {
+				t_ms_megakernel = t_ms;
+			}
+
+			std::string comparison = {};
+			if (!variant.use_megakernel && variant.num_shadow_samples == 0) {
+				float max_diff = 0.0f;
+				for (size_t idx = 0; idx < num_values; idx++) {
+					max_diff = std::max(max_diff, std::abs(image[idx] - image_megakernel[idx]));
+				}
+				comparison = std::format(", max difference to the megakernel {}", max_diff);
+			}
+			std::cout << std::format("  {:<24} {:8.3f} ms per frame, {:5.2f}x the time of the megakernel{}", variant.name, t_ms, t_ms / t_ms_megakernel, comparison) << std::endl;
+		}
+
+		rays_use_megakernel = options.rays_megakernel;
+		rays_wavefront.sort_rays = true;
+		rays_wavefront.num_shadow_samples = options.rays_shadow_samples;
+		rays_wavefront_release(rays_wavefront);
+		} });
+
+	// Redrawing the tiles around one moving seed against the whole canvas. The incremental frames must end up with the
+	//	same pixels as a full render
+	benchmarks.push_back({ "voronoi", [&]() {
+		int num_iterations = 100;
+		int idx_seed = 0;
+		float x = voronoi_physics[idx_seed].pos[0];
+		float y = voronoi_physics[idx_seed].pos[1];
+		auto num_values = 3 * static_cast<size_t>(window_width) * window_height;
+		std::vector<float> image_incremental(num_values);
+		std::vector<float> image_full(num_values);
+		auto read_canvas = [&](std::vector<float>& image) {
+			glMemoryBarrier(GL_TEXTURE_UPDATE_BARRIER_BIT);
+			glActiveTexture(GL_TEXTURE0);
+			glBindTexture(GL_TEXTURE_2D, id_texture);
+			glGetTexImage(GL_TEXTURE_2D, 0, GL_RGB, GL_FLOAT, image.data());
+			};
+
+		scene_activate(Shaders::voronoi);
+		voronoi_render();
+
+		auto t_ms_full = gpu_time_ms([&]() {
+			voronoi_dirty_all(voronoi_dirty);
+			voronoi_render();
+			}, num_iterations);
+
+		// Back and forth by a few pixels, so the seed ends where it started
+		int idx_frame = 0;
+		size_t num_tiles_drawn = 0;
+		auto t_ms_incremental = gpu_time_ms([&]() {
+			float dx = idx_frame++ % 2 == 0 ? 3.0f : -3.0f;
+			voronoi_move_seed(idx_seed, voronoi_physics[idx_seed].pos[0] + dx, y);
+			voronoi_render();
+			num_tiles_drawn += voronoi_dirty.list.size();
+			}, num_iterations);
+
+		for (int idx_move = 0; idx_move < 10; idx_move++) {
+			voronoi_move_seed(idx_seed, x + 5.0f * idx_move, y - 3.0f * idx_move);
+			voronoi_render();
+		}
+		read_canvas(image_incremental);
+		voronoi_dirty_all(voronoi_dirty);
+		voronoi_render();
+		read_canvas(image_full);
+		float max_diff = 0.0f;
+		for (size_t idx = 0; idx < num_values; idx++) {
+			max_diff = std::max(max_diff, std::abs(image_incremental[idx] - image_full[idx]));
+		}
+		voronoi_move_seed(idx_seed, x, y);
+
+		std::cout << std::format("Voronoi at {}x{} with {} seeds, {} tiles", window_width, window_height, voronoi_physics.size(), voronoi_dirty.tiles.size()) << std::endl;
+		std::cout << std::format("  {:<24} {:8.3f} ms per frame", "whole canvas", t_ms_full) << std::endl;
+		std::cout << std::format("  {:<24} {:8.3f} ms per frame, {:5.2f}x faster, {:.1f} tiles per frame",
+			"one seed moving", t_ms_incremental, t_ms_full / t_ms_incremental, static_cast<float>(num_tiles_drawn) / std::max(1, idx_frame)) << std::endl;
+		std::cout << std::format("  Max difference to the whole canvas after moving: {}", max_diff) << std::endl;
+		} });
+
+	// physics_compute.glsl and physics_cpu_step() from the same random bodies, to check that they are the same model:
+	//	the distance between their positions after a few steps, then the time per step of both. They round differently
+	//	and every collision makes a difference larger, so the distances are small but not zero
+	benchmarks.push_back({ "physics", [&]() {
+		size_t num_bodies = 20'000;
+		int num_steps = 30;
+		float dt = 1.0f / 60.0f;
+		float world_size;
+		std::vector<Circle> circles;
+		std::vector<Physics> physics_in;
+		physics_cpu_random_bodies(num_bodies, options.seed, circles, physics_in, world_size);
+
+		std::cout << std::format("Physics with {} bodies in a {:.0f}x{:.0f} world, {} steps of {:.4f} s", num_bodies, world_size, world_size, num_steps, dt) << std::endl;
+
+		Physics_cpu physics_cpu;
+		physics_cpu_setup(physics_cpu, circles, physics_in, 0.0f, world_size, 0.0f, world_size);
+		auto t_start = std::chrono::high_resolution_clock::now();
+		for (int idx_step = 0; idx_step < num_steps; idx_step++) {
+			physics_cpu_step(physics_cpu, dt);
+		}
+		auto t_cpu_ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count() / num_steps;
+		std::vector<Physics> result_cpu;
+		physics_cpu_read(physics_cpu, result_cpu);
+
+		std::vector<GLuint> buffers = {
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * num_bodies, circles.data()),
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * num_bodies, physics_in.data()),
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_scratch), GL_DYNAMIC_COPY, sizeof(Physics_scratch) * num_bodies, nullptr)
+		};
+		physics_gpu_set_world(id_program_physics_compute, 0.0f, world_size, 0.0f, world_size);
+		for (int idx_step = 0; idx_step < num_steps; idx_step++) {
+			physics_gpu_step(id_program_physics_compute, num_bodies, dt);
+		}
+		glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+		std::vector<Physics> result_gpu(num_bodies);
+		ssbo_read(buffers[1], 0, sizeof(Physics) * num_bodies, result_gpu.data());
+
+		double sum_square = 0.0;
+		double max_distance = 0.0;
+		double max_speed_difference = 0.0;
+		for (size_t idx = 0; idx < num_bodies; idx++) {
+			double dx = result_gpu[idx].pos[0] - result_cpu[idx].pos[0];
+			double dy = result_gpu[idx].pos[1] - result_cpu[idx].pos[1];
+			sum_square += dx * dx + dy * dy;
+			max_distance = std::max(max_distance, std::sqrt(dx * dx + dy * dy));
+			max_speed_difference = std::max(max_speed_difference, static_cast<double>(std::abs(result_gpu[idx].speed - result_cpu[idx].speed)));
+		}
+		std::cout << std::format("  GPU vs CPU: RMS distance {:.2e}, largest distance {:.2e}, largest speed difference {:.2e}",
+			std::sqrt(sum_square / num_bodies), max_distance, max_speed_difference) << std::endl;
+
+		auto t_gpu_ms = gpu_time_ms([&]() { physics_gpu_step(id_program_physics_compute, num_bodies, dt); }, num_steps);
+		std::cout << std::format("  GPU {:8.3f} ms per step (all pairs), CPU {:8.3f} ms per step on {} threads (cell list)", t_gpu_ms, t_cpu_ms, cpu_num_threads()) << std::endl;
+
+		gpu_delete_buffers(buffers);
+		} });
+
+	// The event-driven ACTION_EVENTS of physics_compute.glsl against its fixed steps, as in --physics-ccd. The reference is
+	//	physics_cpu_advance() in doubles over the whole time, and the error is the RMS distance to its positions. The
+	//	fixed steps are made shorter until they are as accurate as the events, and the simulated seconds per second
+	//	of both are compared at that error
+	benchmarks.push_back({ "physics_ccd", [&]() {
+		size_t num_bodies = 2000;
+		double t_simulated_s = 0.5;
+		float dt_frame = 1.0f / 60.0f;
+		auto num_frames = static_cast<int>(std::lround(t_simulated_s / dt_frame));
+		int max_event_rounds = 1 << 20;
+		float world_size;
+		std::vector<Circle> circles;
+		std::vector<Physics> physics_in;
+		physics_cpu_random_bodies(num_bodies, options.seed, circles, physics_in, world_size);
+
+		Physics_cpu physics_cpu;
+		physics_cpu_setup(physics_cpu, circles, physics_in, 0.0f, world_size, 0.0f, world_size);
+		physics_cpu_advance(physics_cpu, t_simulated_s);
+		std::vector<Physics> reference;
+		physics_cpu_read(physics_cpu, reference);
+
+		std::vector<GLuint> buffers = {
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_circles), GL_DYNAMIC_DRAW, sizeof(Circle) * num_bodies, circles.data()),
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_physics), GL_DYNAMIC_DRAW, sizeof(Physics) * num_bodies, physics_in.data()),
+			setup_ssbo("benchmark physics", static_cast<GLuint>(Ssbo_index::physics_scratch), GL_DYNAMIC_COPY, sizeof(Physics_scratch) * num_bodies, nullptr)
+		};
+		physics_gpu_set_world(id_program_physics_compute, 0.0f, world_size, 0.0f, world_size);
+
+		// Every run starts from the same bodies, and only the steps are timed
+		std::vector<Physics> result(num_bodies);
+		auto run = [&](const std::function<void()>& fn) {
+			ssbo_update(buffers[1], 0, sizeof(Physics) * num_bodies, physics_in.data());
+			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+			auto t_ms = gpu_time_ms(fn, 1);
+			glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+			ssbo_read(buffers[1], 0, sizeof(Physics) * num_bodies, result.data());
+
+			double sum_square = 0.0;
+			for (size_t idx = 0; idx < num_bodies; idx++) {
+				double dx = result[idx].pos[0] - reference[idx].pos[0];
+				double dy = result[idx].pos[1] - reference[idx].pos[1];
+				sum_square += dx * dx + dy * dy;
+			}
+			return std::pair(std::sqrt(sum_square / num_bodies), t_simulated_s / (t_ms / 1000.0));
+			};
+
+		std::cout << std::format("GPU CCD with {} bodies in a {:.0f}x{:.0f} world, {:.1f} s simulated, {} events on the CPU reference",
+			num_bodies, world_size, world_size, t_simulated_s, physics_cpu.events.num_events) << std::endl;
+
+		auto [error_events, speed_events] = run([&]() {
+			for (int idx_frame = 0; idx_frame < num_frames; idx_frame++) {
+				physics_gpu_advance(id_program_physics_compute, dt_frame, max_event_rounds);
+			}
+			});
+		std::cout << std::format("  {:<8} step {:9.6f} s, error {:10.6f}, {:9.2f} simulated s/s", "events", dt_frame, error_events, speed_events) << std::endl;
+
+		// The float positions limit how short the fixed steps can get, so they may never be as accurate as the events
+		double speed_fixed = 0.0;
+		double dt_fixed = 0.0;
+		for (int num_steps_per_s = 60; num_steps_per_s <= 60 * 1024; num_steps_per_s *= 4) {
+			auto num_steps = static_cast<int>(t_simulated_s * num_steps_per_s);
+			auto dt = static_cast<float>(t_simulated_s / num_steps);
+			auto [error, speed] = run([&]() {
+				for (int idx_step = 0; idx_step < num_steps; idx_step++) {
+					physics_gpu_step(id_program_physics_compute, num_bodies, dt);
+				}
+				});
+			std::cout << std::format("  {:<8} step {:9.6f} s, error {:10.6f}, {:9.2f} simulated s/s", "fixed", dt, error, speed) << std::endl;
+			if (error <= error_events) {
+				speed_fixed = speed;
+				dt_fixed = dt;
+				break;
+			}
+		}
 
-	while (!glfwWindowShouldClose(window))
+		if (speed_fixed > 0.0) {
+			std::cout << std::format("  At equal error the fixed steps need {:.6f} s steps, and the events run at {:.2f}x their simulated s/s",
+				dt_fixed, speed_events / speed_fixed) << std::endl;
+		}
+		else {
+			std::cout << "  None of the fixed steps reaches the error of the events" << std::endl;
+		}
+
+		gpu_delete_buffers(buffers);
+		} });
+
+	// Every solver method on growing grids: iterations per second on the GPU and on the CPU twin, the difference
+	//	between their solutions after the same iterations, and the time until the error against the exact solution is
+	//	down to the tolerance of the initial error
+	benchmarks.push_back({ "solver", [&]() {
+		struct Solver_variant {
+			Solver_method method;
+			int num_iterations_compared;
+			int iterations_per_check;
+		};
+		std::vector<Solver_variant> variants = {
+			{ Solver_method::jacobi, 200, 100 },
+			{ Solver_method::red_black, 100, 50 },
+			{ Solver_method::multigrid, 4, 1 },
+			{ Solver_method::cg, 50, 5 },
+		};
+		// Multigrid gets the error down to about 1e-5 in floats on every grid, red-black Gauss-Seidel to 7e-5 on 127x127
+		float tolerance = 1e-4f;
+		uint64_t max_iterations = 20000;
+		Gpu_solver solver = { .id_program = id_program_solver };
+		Solver_cpu solver_cpu;
+		std::vector<float> x_gpu;
+
+		std::cout << std::format("Poisson solvers until the error against the exact solution is {:.0e} of the initial error, at most {} iterations. CPU on {} threads",
+			tolerance, max_iterations, cpu_num_threads()) << std::endl;
+
+		for (int n : { 127, 255, 511, 1023 }) {
+			auto b = solver_test_rhs(n);
+			gpu_solver_setup(solver, n);
+			gpu_solver_set_exact_solution(solver, solver_test_solution(n));
+			solver_cpu_setup(solver_cpu, n);
+			std::cout << std::format("  {}x{}, {} multigrid levels", n, n, solver.levels.size()) << std::endl;
+
+			for (auto& variant : variants) {
+				// The same iterations from 0 on both
+				solver.method = variant.method;
+				solver_cpu.method = variant.method;
+				gpu_solver_set_rhs(solver, b, false);
+				solver_cpu_set_rhs(solver_cpu, b);
+				gpu_solver_iterate(solver, variant.num_iterations_compared);
+				gpu_solver_read_solution(solver, x_gpu);
+				auto t_start = std::chrono::steady_clock::now();
+				solver_cpu_iterate(solver_cpu, variant.num_iterations_compared);
+				auto t_cpu_ms = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_start).count() / variant.num_iterations_compared;
+
+				float max_diff = 0.0f;
+				float max_value = 0.0f;
+				const auto& x_cpu = solver_cpu.levels[0].x;
+				for (size_t idx = 0; idx < x_cpu.size(); idx++) {
+					max_diff = std::max(max_diff, std::abs(x_gpu[idx] - x_cpu[idx]));
+					max_value = std::max(max_value, std::abs(x_cpu[idx]));
+				}
+
+				auto t_gpu_ms = gpu_time_ms([&]() { gpu_solver_iterate(solver, 1); }, variant.num_iterations_compared);
+
+				gpu_solver_set_rhs(solver, b, false);
+				auto result = gpu_solver_solve(solver, tolerance, max_iterations, variant.iterations_per_check);
+				auto solved = result.converged ?
+					std::format("{:6} iterations in {:8.2f} ms ({} more queued)", result.num_iterations, result.t_ms, result.num_iterations_run - result.num_iterations) :
+					std::format("not reached, error {:.1e} after {} iterations in {:.0f} ms", result.reduction, result.num_iterations, result.t_ms);
+
+				std::cout << std::format("    {:<24} GPU {:9.0f} it/s, CPU {:8.0f} it/s, max relative difference {:.1e}. To tolerance: {}",
+					solver_method_names[static_cast<size_t>(variant.method)], 1000.0f / t_gpu_ms, 1000.0f / t_cpu_ms, max_diff / std::max(max_value, 1e-30f), solved) << std::endl;
+			}
+		}
+
+		gpu_solver_release(solver);
+		} });
+
+	// Reducing on the GPU against reading the buffers back and counting on the CPU, which is what the overlay would
+	//	need otherwise. Also checks that both count the same
+	benchmarks.push_back({ "statistics", [&]() {
+		scene_activate(Shaders::mold);
+		// Let the trails build up a bit first
+		for (int idx_step = 0; idx_step < 100; idx_step++) {
+			mold_step();
+		}
+
+		int num_iterations = 100;
+		auto sources = statistics_sources(Shaders::mold);
+		auto num_pixels_per_page = static_cast<size_t>(mold_tile_size) * mold_tile_size;
+		// The particles and the page tiles are only bound, their buffers are not kept by the scene setup
+		auto bound_buffer = [](Ssbo_index ssbo_index) {
+			GLint id_buffer = 0;
+			glGetIntegeri_v(GL_SHADER_STORAGE_BUFFER_BINDING, static_cast<GLuint>(ssbo_index), &id_buffer);
+			return static_cast<GLuint>(id_buffer);
+			};
+		std::vector<Mold_particle> particles(mold_pool_size);
+		std::vector<uint32_t> alive(mold_pool_size);
+		std::vector<int> page_tiles(num_mold_pages);
+		std::vector<float> trails(4 * num_mold_layers * sources.num_mold_trail_pixels);
+		std::array<uint32_t, max_num_mold_types> population = {};
+		std::array<double, max_num_mold_types> trail_total = {};
+		size_t num_bytes_read = 0;
+
+		auto read_back_and_count = [&]() {
+			Mold_counters counters = {};
+			ssbo_read(ssbo_mold_counters, 0, sizeof(Mold_counters), &counters);
+			ssbo_read(bound_buffer(Ssbo_index::mold_alive), 0, sizeof(uint32_t) * counters.num_alive, alive.data());
+			ssbo_read(bound_buffer(Ssbo_index::mold), 0, sizeof(Mold_particle) * particles.size(), particles.data());
+			ssbo_read(bound_buffer(Ssbo_index::mold_page_tiles), 0, sizeof(int) * page_tiles.size(), page_tiles.data());
+			ssbo_read(ssbo_mold_intensities[0], 0, sizeof(float) * trails.size(), trails.data());
+			num_bytes_read = sizeof(uint32_t) * counters.num_alive + sizeof(Mold_particle) * particles.size() + sizeof(int) * page_tiles.size() + sizeof(float) * trails.size();
+
+			population = {};
+			trail_total = {};
+			for (uint32_t idx = 0; idx < counters.num_alive; idx++) {
+				population[particles[alive[idx]].type]++;
+			}
+			for (size_t idx_pixel = 0; idx_pixel < sources.num_mold_trail_pixels; idx_pixel++) {
+				if (page_tiles[idx_pixel / num_pixels_per_page] < 0) {
+					continue;
+				}
+				// Type t is at component t % 4 of layer t / 4, so the types of a pixel are consecutive
+				for (int idx_type = 0; idx_type < num_types; idx_type++) {
+					trail_total[idx_type] += trails[4 * num_mold_layers * idx_pixel + idx_type];
+				}
+			}
+			};
+
+		GLuint id_result = gpu_create_buffer("statistics", GL_SHADER_STORAGE_BUFFER, sizeof(Statistics), nullptr, GL_STREAM_READ);
+		Statistics statistics = {};
+		gpu_statistics_reduce(gpu_statistics, sources, id_result);
+		ssbo_read(id_result, 0, sizeof(Statistics), &statistics);
+		read_back_and_count();
+
+		auto t_ms_step = gpu_time_ms(mold_step, num_iterations);
+		auto t_ms_gpu = gpu_time_ms([&]() { gpu_statistics_reduce(gpu_statistics, sources, id_result); }, num_iterations);
+		glFinish();
+		auto t_start = std::chrono::steady_clock::now();
+		for (int idx_iteration = 0; idx_iteration < 10; idx_iteration++) {
+			read_back_and_count();
+		}
+		auto t_ms_cpu = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - t_start).count() / 10;
+
+		std::cout << std::format("Statistics of the mold with {} types, pool of {} particles and {} trail pages", num_types, mold_pool_size, num_mold_pages) << std::endl;
+		std::cout << std::format("  {:<24} {:8.3f} ms", "mold step", t_ms_step) << std::endl;
+		std::cout << std::format("  {:<24} {:8.3f} ms, {:5.1f}% of a step", "GPU reduction", t_ms_gpu, 100.0f * t_ms_gpu / t_ms_step) << std::endl;
+		std::cout << std::format("  {:<24} {:8.3f} ms, {:5.1f}% of a step, {:.1f} MB read", "read back, CPU count", t_ms_cpu, 100.0f * t_ms_cpu / t_ms_step, num_bytes_read / (1024.0f * 1024.0f)) << std::endl;
+
+		// The trails are summed in a different order, so only close
+		int num_population_mismatches = 0;
+		double max_trail_diff = 0.0;
+		for (int idx_type = 0; idx_type < num_types; idx_type++) {
+			num_population_mismatches += statistics.mold_population[idx_type] != population[idx_type] ? 1 : 0;
+			max_trail_diff = std::max(max_trail_diff, std::abs(statistics.mold_trail_total[idx_type] - trail_total[idx_type]) / std::max(1.0, trail_total[idx_type]));
+		}
+		std::cout << std::format("  Types with a different population: {}, max relative difference of the trail totals: {:.2e}", num_population_mismatches, max_trail_diff) << std::endl;
+
+		gpu_delete_buffer(id_result);
+		gpu_statistics_release(gpu_statistics);
+		} });
+
+	// Throughput of the GPU primitives from 1K to 100M keys, checked against the CPU versions up to 10M keys
+	benchmarks.push_back({ "primitives", [&]() {
+		Primitives primitives = {};
+		primitives.id_program = id_program_primitives;
+		size_t max_num_validated = 10'000'000;
+		size_t keys_per_segment = 1000;
+		int num_bins = 256;
+		int num_iterations = 10;
+
+		std::cout << std::format("Subgroup operations: {}", glfwExtensionSupported("GL_KHR_shader_subgroup") ? "yes" : "no, shared memory scan") << std::endl;
+
+		for (size_t num_items : { 1'000, 10'000, 100'000, 1'000'000, 10'000'000, 100'000'000 }) {
+			std::vector<uint32_t> keys(num_items);
+			std::vector<uint32_t> payload(num_items);
+			parallel_for(num_items, [&](size_t idx_start, size_t idx_end) {
+				for (auto idx = idx_start; idx < idx_end; idx++) {
+					keys[idx] = philox4x32({ static_cast<uint32_t>(idx), 0, static_cast<uint32_t>(Random_stream::benchmark), 0 }, { options.seed, 0 })[0];
+					payload[idx] = static_cast<uint32_t>(idx);
+				}
+				});
+
+			auto num_segments = std::max<size_t>(1, num_items / keys_per_segment);
+			std::vector<uint32_t> segment_starts(num_segments + 1);
+			for (size_t idx_segment = 0; idx_segment <= num_segments; idx_segment++) {
+				segment_starts[idx_segment] = static_cast<uint32_t>(num_items * idx_segment / num_segments);
+			}
+
+			while (glGetError() != GL_NO_ERROR) {}
+
+			GLuint id_keys, id_payload, id_values, id_segment_starts, id_sums, id_bins;
+			auto create_buffer = [](GLuint& id_buffer, size_t num_bytes, const void* data) {
+				id_buffer = gpu_create_buffer("benchmark", GL_SHADER_STORAGE_BUFFER, num_bytes, data, GL_DYNAMIC_COPY);
+				};
+			create_buffer(id_keys, sizeof(uint32_t) * num_items, keys.data());
+			create_buffer(id_payload, sizeof(uint32_t) * num_items, payload.data());
+			create_buffer(id_values, sizeof(uint32_t) * num_items, keys.data());
+			create_buffer(id_segment_starts, sizeof(uint32_t) * segment_starts.size(), segment_starts.data());
+			create_buffer(id_sums, sizeof(uint32_t) * num_segments, nullptr);
+			create_buffer(id_bins, sizeof(uint32_t) * num_bins, nullptr);
+			// Also allocates the scratch buffers. Only touches buffers that are uploaded again before they are used
+			gpu_radix_sort(primitives, id_values, id_payload, num_items);
+			glFinish();
+
+			auto release_buffers = [&]() {
+				gpu_delete_buffers({ id_keys, id_payload, id_values, id_segment_starts, id_sums, id_bins });
+				primitives_release(primitives);
+				};
+
+			if (glGetError() == GL_OUT_OF_MEMORY) {
+				std::cout << std::format("  {:>9} keys: Not enough GPU memory, skipped", num_items) << std::endl;
+				release_buffers();
+				continue;
+			}
+
+			bool validate = num_items <= max_num_validated;
+			std::cout << std::format("  {:>9} keys{}", num_items, validate ? "" : ", not validated") << std::endl;
+
+			// Each primitive runs once from the original data to be validated, then num_iterations times for the timing
+			auto run = [&](const std::string& name, const std::function<void()>& reset, const std::function<void()>& fn_gpu,
+				const std::function<void()>& fn_cpu, const std::function<bool()>& is_equal) {
+				reset();
+				fn_gpu();
+				float t_cpu_ms = 0.0f;
+				bool is_valid = true;
+				if (validate) {
+					auto t_start = std::chrono::high_resolution_clock::now();
+					fn_cpu();
+					t_cpu_ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() - t_start).count();
+					is_valid = is_equal();
+				}
+				auto t_gpu_ms = gpu_time_ms(fn_gpu, num_iterations);
+				auto result = std::format("    {:<18} {:9.3f} ms, {:9.1f} Mkeys/s", name, t_gpu_ms, num_items / (t_gpu_ms * 1.0e3f));
+				if (validate) {
+					result += std::format(", CPU {:9.1f} Mkeys/s, {}", num_items / (t_cpu_ms * 1.0e3f), is_valid ? "ok" : "MISMATCH");
+				}
+				std::cout << result << std::endl;
+				};
+
+			auto read_back = [](GLuint id_buffer, size_t num_values) {
+				std::vector<uint32_t> values(num_values);
+				glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+				ssbo_read(id_buffer, 0, sizeof(uint32_t) * num_values, values.data());
+				return values;
+				};
+
+			std::vector<uint32_t> expected;
+
+			run("exclusive scan",
+				[&]() { ssbo_update(id_values, 0, sizeof(uint32_t) * num_items, keys.data()); },
+				[&]() { gpu_exclusive_scan(primitives, id_values, num_items); },
+				[&]() { expected = keys; cpu_exclusive_scan(expected); },
+				[&]() { return read_back(id_values, num_items) == expected; });
+
+			run("segmented reduce",
+				[&]() {},
+				[&]() { gpu_segmented_reduce(primitives, id_keys, id_segment_starts, num_segments, id_sums); },
+				[&]() { expected = cpu_segmented_reduce(keys, segment_starts); },
+				[&]() { return read_back(id_sums, num_segments) == expected; });
+
+			run("histogram",
+				[&]() {},
+				[&]() { gpu_histogram(primitives, id_keys, num_items, id_bins, num_bins, 24); },
+				[&]() { expected = cpu_histogram(keys, num_bins, 24); },
+				[&]() { return read_back(id_bins, num_bins) == expected; });
+
+			// The timed runs sort already sorted keys, which costs the same as random ones for a radix sort
+			std::vector<uint32_t> expected_payload;
+			run("radix sort (pairs)",
+				[&]() {
+					ssbo_update(id_keys, 0, sizeof(uint32_t) * num_items, keys.data());
+					ssbo_update(id_payload, 0, sizeof(uint32_t) * num_items, payload.data());
+				},
+				[&]() { gpu_radix_sort(primitives, id_keys, id_payload, num_items); },
+				[&]() { expected = keys; expected_payload = payload; cpu_radix_sort(expected, expected_payload); },
+				[&]() { return read_back(id_keys, num_items) == expected && read_back(id_payload, num_items) == expected_payload; });
+
+			release_buffers();
+		}
+		} });
+
+	if (options.benchmark) {
+		bool found_benchmark = false;
+		for (auto& [name, run_benchmark] : benchmarks) {
+			if (options.benchmark_name.empty() || options.benchmark_name == name) {
+				std::cout << std::format("Benchmark '{}'", name) << std::endl;
+				run_benchmark();
+				found_benchmark = true;
+			}
+		}
+		if (!found_benchmark) {
+			log_error(std::format("No benchmark named '{}'", options.benchmark_name));
+		}
+	}
+
+	if (run_sweep) {
+		auto runs = mold_sweep_runs(options);
+		Mold_sweep sweep = {
+			.id_program = id_program_mold_sweep,
+			.world_width = options.sweep_world_width,
+			.world_height = options.sweep_world_height,
+			.num_particles_per_run = options.sweep_num_particles,
+			.num_steps = options.sweep_num_steps
+		};
+		std::error_code error;
+		std::filesystem::create_directories(options.sweep_directory, error);
+
+		if (error) {
+			log_error(std::format("Could not create directory '{}' for the sweep", options.sweep_directory.string()));
+		}
+		else {
+			std::cout << std::format("Sweep of {} runs with {} particles in a {}x{} world for {} steps, up to {} runs at once",
+				runs.size(), sweep.num_particles_per_run, sweep.world_width, sweep.world_height, sweep.num_steps, options.sweep_batch_size) << std::endl;
+			auto t_start = std::chrono::steady_clock::now();
+			mold_sweep_execute(sweep, runs, options.sweep_batch_size, options.sweep_directory);
+			auto t_s = std::chrono::duration<double>(std::chrono::steady_clock::now() - t_start).count();
+			auto num_particle_steps = static_cast<double>(runs.size()) * sweep.num_particles_per_run * sweep.num_steps;
+			std::cout << std::format("Done in {:.2f} s, {:.1f}M particle steps/s. Thumbnails and runs.csv are in '{}'",
+				t_s, num_particle_steps / t_s / 1.0e6, options.sweep_directory.string()) << std::endl;
+		}
+
+		mold_sweep_release(sweep);
+	}
+
+	// With --capture or --capture-pipe, the frames are written out as they are shown, see Frame_capture
+	Frame_capture frame_capture;
+	uint64_t num_frames_rendered = 0;
+	bool capture_requested = !options.capture_directory.empty() || !options.capture_pipe.empty();
+
+	if (!options.benchmark && !run_sweep && capture_requested && !frame_capture_start(frame_capture, texture_width, texture_height, 4, options.capture_directory, options.capture_pipe)) {
+		return -1;
+	}
+
+	// With --soak, runs for the given time while logging samples, see Soak_test
+	Soak_test soak;
+
+	if (!options.benchmark && !run_sweep && options.soak_minutes > 0.0f && !soak_start(soak, options.soak_log_path, options.soak_minutes * 60.0, glfwGetTime())) {
+		return -1;
+	}
+
+	if (!options.benchmark && !run_sweep && !options.stats_log_path.empty() && !gpu_statistics_start_log(gpu_statistics, options.stats_log_path)) {
+		return -1;
+	}
+
+	// A replay runs as fast as it can on the recorded clock, so the real time it takes can be compared across builds
+	auto t_replay_start = glfwGetTime();
+
+	while (!options.benchmark && !run_sweep && !glfwWindowShouldClose(window))
 	{
 		float t_current_frame = static_cast<float>(glfwGetTime());
+
+		if (!input_begin_frame(t_current_frame, static_cast<uint32_t>(num_frames_rendered), mold_step_idx)) {
+			auto t_replay_s = glfwGetTime() - t_replay_start;
+			std::cout << std::format("Replayed {} frames in {:.3f} s, {:.3f} ms per frame", num_frames_rendered, t_replay_s, 1000.0 * t_replay_s / std::max<uint64_t>(1, num_frames_rendered)) << std::endl;
+			break;
+		}
+
 		t_delta_s = t_current_frame - t_last_frame;
 		t_last_frame = t_current_frame;
 
@@ -1041,6 +6930,7 @@ int main(int, char* []) {
 
 		if (fps_print_diff_time > 1.0f) {
 			std::cout << "FPS: " << frame_counter / fps_print_diff_time << " (" << 1000 * fps_print_diff_time / frame_counter << " ms per frame)" << std::endl;
+			stats_text = std::format("FPS: {:.1f} ({:.2f} ms per frame)", frame_counter / fps_print_diff_time, 1000 * fps_print_diff_time / frame_counter);
 			frame_counter = 0;
 			last_fps_time = t_current_frame;
 		}
@@ -1064,6 +6954,22 @@ int main(int, char* []) {
 		if (key_was_just_pressed(GLFW_KEY_5)) {
 			shader = Shaders::physics;
 		}
+		if (key_was_just_pressed(GLFW_KEY_6)) {
+			shader = Shaders::solver;
+		}
+		if (key_was_just_pressed(GLFW_KEY_F1)) {
+			show_stats = !show_stats;
+		}
+		scene_activate(shader);
+		if (key_was_just_pressed(GLFW_KEY_F5) && snapshot_save_begin(snapshot_save, snapshot_path(shader), snapshot_header(shader), scene_resources[shader])) {
+			std::cout << std::format("Saving snapshot '{}'", snapshot_save.path.string()) << std::endl;
+		}
+		if (key_was_just_pressed(GLFW_KEY_F9)) {
+			snapshot_load(shader);
+		}
+		if (snapshot_save_poll(snapshot_save) && snapshot_save.success) {
+			std::cout << std::format("Saved snapshot '{}'", snapshot_save.path.string()) << std::endl;
+		}
 		if (key_is_pressed(GLFW_KEY_W)) {
 			the_camera += the_focus * t_delta_s * 5.0f;
 		}
@@ -1099,12 +7005,39 @@ int main(int, char* []) {
 				angle_beta = std::numbers::pi_v<float> / 2 - 0.00001f;
 			}
 			mouse_move_info.has_been_read = true;
-			glfwSetCursorPos(window, window_width / 2, window_height / 2);
+			input_set_cursor_pos(window, window_width / 2, window_height / 2);
+		}
+		if (shader == Shaders::mold) {
+			// Arrow keys pan, Page Up/Down zoom, Home shows the middle of the world at 1:1
+			float pan_px_per_s = 600.0f;
+			float zoom_per_s = 2.0f;
+			if (key_is_pressed(GLFW_KEY_LEFT)) {
+				mold_camera_center.x -= pan_px_per_s * t_delta_s / mold_camera_zoom;
+			}
+			if (key_is_pressed(GLFW_KEY_RIGHT)) {
+				mold_camera_center.x += pan_px_per_s * t_delta_s / mold_camera_zoom;
+			}
+			if (key_is_pressed(GLFW_KEY_UP)) {
+				mold_camera_center.y += pan_px_per_s * t_delta_s / mold_camera_zoom;
+			}
+			if (key_is_pressed(GLFW_KEY_DOWN)) {
+				mold_camera_center.y -= pan_px_per_s * t_delta_s / mold_camera_zoom;
+			}
+			if (key_is_pressed(GLFW_KEY_PAGE_UP)) {
+				mold_camera_zoom = std::min(16.0f, mold_camera_zoom * std::pow(zoom_per_s, t_delta_s));
+			}
+			if (key_is_pressed(GLFW_KEY_PAGE_DOWN)) {
+				mold_camera_zoom = std::max(1.0f / 64.0f, mold_camera_zoom / std::pow(zoom_per_s, t_delta_s));
+			}
+			if (key_was_just_pressed(GLFW_KEY_HOME)) {
+				mold_camera_center = glm::vec2(mold_world_width, mold_world_height) / 2.0f;
+				mold_camera_zoom = 1.0f;
+			}
 		}
 		if (shader == Shaders::funky) {
 			if (!mouse_button_info[0].has_been_read && mouse_button_info[0].is_pressed) {
 				double xpos, ypos;
-				glfwGetCursorPos(window, &xpos, &ypos);
+				input_cursor_pos(window, &xpos, &ypos);
 				background_center.x = static_cast<float>(xpos);
 				background_center.y = window_height - static_cast<float>(ypos);
 				mouse_button_info[0].has_been_read = true;
@@ -1112,7 +7045,7 @@ int main(int, char* []) {
 		}
 		if (shader == Shaders::voronoi && !mouse_button_info[0].has_been_read && mouse_button_info[0].is_pressed) {
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
+			input_cursor_pos(window, &xpos, &ypos);
 			auto y_fixed = window_height - ypos;
 			bool within_toolbar_x = (xpos >= toolbar_info.x && xpos < toolbar_info.x + toolbar_info.w);
 			bool within_toolbar_y = (y_fixed >= toolbar_info.y && y_fixed < toolbar_info.y + toolbar_info.h);
@@ -1135,6 +7068,7 @@ int main(int, char* []) {
 							use_toolbar_alpha = !use_toolbar_alpha;
 							shader_use_program(id_program_voronoi);
 							shader_set_bool(id_program_voronoi, "use_toolbar_alpha", use_toolbar_alpha);
+							voronoi_dirty_toolbar();
 							break;
 						case Toolbar_control_type::slider:
 						{
@@ -1165,39 +7099,43 @@ int main(int, char* []) {
 				}
 			}
 			else {
-				for (int i = 0; i < voronoi_circles.size(); i++) {
-					auto d_square = (xpos - voronoi_physics[i].pos[0]) * (xpos - voronoi_physics[i].pos[0]) + (y_fixed - voronoi_physics[i].pos[1]) * (y_fixed - voronoi_physics[i].pos[1]);
-					auto r_square = voronoi_circles[i].r * voronoi_circles[i].r;
-					if (d_square < r_square) {
-						idx_active_circle = i;
-					}
-				}
+				idx_active_circle = seed_grid_pick(voronoi_grid, voronoi_circles, voronoi_r_max, static_cast<float>(xpos), static_cast<float>(y_fixed));
 			}
 			mouse_button_info[0].has_been_read = true;
 		}
+		if (shader == Shaders::solver && (mouse_button_info[0].is_pressed || solver_scene_has_mouse_charge)) {
+			double xpos, ypos;
+			input_cursor_pos(window, &xpos, &ypos);
+			auto charge = glm::vec2(xpos / window_width, 1.0 - ypos / window_height);
+			if (mouse_button_info[0].is_pressed != solver_scene_has_mouse_charge || charge != solver_scene_mouse_charge) {
+				solver_scene_has_mouse_charge = mouse_button_info[0].is_pressed;
+				solver_scene_mouse_charge = charge;
+				solver_scene_update_rhs(true);
+			}
+		}
+		if (shader == Shaders::solver && key_was_just_pressed(GLFW_KEY_M)) {
+			solver_scene.method = static_cast<Solver_method>((static_cast<size_t>(solver_scene.method) + 1) % solver_method_names.size());
+			solver_scene_update_rhs(false);
+		}
 		if (shader == Shaders::voronoi && mouse_button_info[0].is_pressed && idx_active_circle > -1) {
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
+			input_cursor_pos(window, &xpos, &ypos);
 			auto y_fixed = window_height - ypos;
-			voronoi_physics[idx_active_circle].pos[0] = static_cast<float>(xpos);
-			voronoi_physics[idx_active_circle].pos[1] = static_cast<float>(y_fixed);
-			block_ids[idx_active_circle] = { (int)xpos / block_size,(int)y_fixed / block_size };
-
-			//ssbo_update(ssbo_voronoi_circles, sizeof(Circle)* idx_active_circle, sizeof(Circle), &voronoi_circles[idx_active_circle]);
-			ssbo_update(ssbo_voronoi_physics, sizeof(Physics) * idx_active_circle, sizeof(Physics), &voronoi_physics[idx_active_circle]);
-			ssbo_update(ssbo_block_ids, sizeof(Block_id) * idx_active_circle, sizeof(Block_id), &block_ids[idx_active_circle]);
+			voronoi_move_seed(idx_active_circle, static_cast<float>(xpos), static_cast<float>(y_fixed));
 		}
 		if (shader == Shaders::voronoi && mouse_button_info[0].is_pressed && moving_toolbar) {
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
+			input_cursor_pos(window, &xpos, &ypos);
 			auto y_fixed = window_height - ypos;
+			voronoi_dirty_toolbar();
 			toolbar_info.x = static_cast<int>(xpos) - toolbar_click_pos[0];
 			toolbar_info.y = static_cast<int>(y_fixed) - toolbar_click_pos[1];
+			voronoi_dirty_toolbar();
 			ssbo_update(ssbo_toolbar_info, 0, sizeof(Toolbar_info), &toolbar_info);
 		}
 		if (shader == Shaders::voronoi && mouse_button_info[0].is_pressed && idx_active_control > -1) {
 			double xpos, ypos;
-			glfwGetCursorPos(window, &xpos, &ypos);
+			input_cursor_pos(window, &xpos, &ypos);
 			auto& c = toolbar_controls[idx_active_control];
 			switch (c.type) {
 			case Toolbar_control_type::slider:
@@ -1221,6 +7159,7 @@ int main(int, char* []) {
 				break;
 			}
 			draw_control(c, true);
+			voronoi_dirty_toolbar();
 		}
 		if (shader == Shaders::voronoi && !mouse_button_info[0].is_pressed) {
 			idx_active_circle = -1;
@@ -1237,11 +7176,7 @@ int main(int, char* []) {
 				if (t_current_frame > t_move_end) {
 					if (idx_dest != -1) {
 						// Don't move source circle when initializing the app
-						voronoi_physics[idx_src].pos[0] = voronoi_physics[idx_dest].pos[0];
-						voronoi_physics[idx_src].pos[1] = voronoi_physics[idx_dest].pos[1];
-						//ssbo_update(ssbo_circles, sizeof(Circle)* idx_src, sizeof(Circle), &voronoi_circles[idx_src]);
-						ssbo_update(ssbo_voronoi_physics, sizeof(Physics) * idx_src, sizeof(Physics), &voronoi_physics[idx_src]);
-						ssbo_update(ssbo_block_ids, sizeof(Block_id) * idx_src, sizeof(Block_id), &block_ids[idx_dest]);
+						voronoi_move_seed(idx_src, voronoi_physics[idx_dest].pos[0], voronoi_physics[idx_dest].pos[1]);
 						idx_src = idx_dest;
 					}
 					while ((idx_dest = std::rand() % voronoi_circles.size()) == idx_src);
@@ -1260,24 +7195,24 @@ int main(int, char* []) {
 					move_vector[1] = diff_y;
 				}
 				auto t = (t_current_frame - t_move_start) / (t_move_end - t_move_start);
-				voronoi_physics[idx_src].pos[0] = move_origin[0] + t * move_vector[0];
-				voronoi_physics[idx_src].pos[1] = move_origin[1] + t * move_vector[1];
-				block_ids[idx_src] = { (int)voronoi_physics[idx_src].pos[0] / block_size, (int)voronoi_physics[idx_src].pos[1] / block_size };
-				//ssbo_update(ssbo_circles, sizeof(Circle)* idx_src, sizeof(Circle), &voronoi_circles[idx_src]);
-				ssbo_update(ssbo_voronoi_physics, sizeof(Physics) * idx_src, sizeof(Physics), &voronoi_physics[idx_src]);
-				ssbo_update(ssbo_block_ids, sizeof(Block_id) * idx_src, sizeof(Block_id), &block_ids[idx_src]);
+				voronoi_move_seed(idx_src, move_origin[0] + t * move_vector[0], move_origin[1] + t * move_vector[1]);
 			}
 		}
 
 		double xpos, ypos;
-		glfwGetCursorPos(window, &xpos, &ypos);
+		input_cursor_pos(window, &xpos, &ypos);
+
+		int num_mold_steps = 0;
+		int num_mold_steps_dropped = 0;
+		if (shader != governor_scene) {
+			quality_governor_reset(quality_governor);
+			governor_scene = shader;
+		}
 
 		switch (shader) {
 		case Shaders::physics:
 		{
-			shader_use_program(id_program_physics_compute);
-			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			physics_gpu_advance(id_program_physics_compute, std::min(t_delta_s, physics_max_dt_s), physics_max_event_rounds);
 
 			shader_use_program(id_program_physics_render);
 			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
@@ -1287,21 +7222,35 @@ int main(int, char* []) {
 		case Shaders::mold:
 		{
 			t_acc_mold_move_ms += t_delta_s * 1000.0f;
+			// Over the frame budget, the steps that do not fit are dropped instead of being caught up in later frames.
+			//	Not while recording or replaying, since a replay must take the same steps
+			int max_mold_steps = input_recording.mode == Input_recording::Mode::live ? quality_max_mold_steps(quality_governor) : 0;
+			bool time_mold_steps = (quality_governor.budget_ms > 0.0f || soak.is_active) && t_acc_mold_move_ms > t_step_ms;
+			if (time_mold_steps) {
+				gpu_timer_begin(quality_governor.mold_timer);
+			}
 			while (t_acc_mold_move_ms > t_step_ms) {
-				shader_use_program(id_program_mold_compute);
-				shader_set_float(id_program_mold_compute, "pseudo_random_float", t_current_frame);
-				int tot_num_actions = 3; // Must sync with the number of actions in mold::main()
-				for (int action_id = 0; action_id < tot_num_actions; action_id++) {
-					shader_set_int(id_program_mold_compute, "action_id", action_id);
-					glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-					//glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-					glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+				if (max_mold_steps > 0 && num_mold_steps == max_mold_steps) {
+					num_mold_steps_dropped = static_cast<int>(t_acc_mold_move_ms / t_step_ms);
+					t_acc_mold_move_ms = std::fmod(t_acc_mold_move_ms, t_step_ms);
+					break;
 				}
+				mold_step();
 				t_acc_mold_move_ms -= t_step_ms;
+				num_mold_steps++;
 			}
-			shader_use_program(id_program_mold_render);
-			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			if (time_mold_steps) {
+				gpu_timer_end(quality_governor.mold_timer, num_mold_steps);
+			}
+			render_scene([&](int width, int height, float scale) {
+				shader_use_program(id_program_mold_render);
+				shader_set_int(id_program_mold_render, "image_width", width);
+				shader_set_int(id_program_mold_render, "image_height", height);
+				shader_set_vec2(id_program_mold_render, "camera_origin", mold_camera_center - glm::vec2(window_width, window_height) / (2.0f * mold_camera_zoom));
+				shader_set_float(id_program_mold_render, "camera_zoom", mold_camera_zoom * scale);
+				glDispatchCompute((width + 31) / 32, (height + 31) / 32, 1);
+				glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+				});
 		}
 		break;
 		case Shaders::funky:
@@ -1314,17 +7263,14 @@ int main(int, char* []) {
 			break;
 		case Shaders::rays:
 		{
-			shader_use_program(id_program_rays);
-			shader_set_float(id_program_rays, "t", t_current_frame);
-			shader_set_vec2(id_program_rays, "mouse_pos", glm::vec2(xpos, ypos));
 			the_focus.x = std::sin(angle_alpha) * std::cos(angle_beta);
 			the_focus.y = std::sin(angle_beta);
 			the_focus.z = std::cos(angle_alpha) * std::cos(angle_beta);
 			the_focus /= glm::length(the_focus);
-			shader_set_vec3(id_program_rays, "the_focus", the_focus);
-			shader_set_vec3(id_program_rays, "the_camera", the_camera);
-			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+			render_scene([&](int width, int height, float scale) {
+				// Whole pixels, since the sphere under the mouse is picked by comparing with the pixel position
+				rays_render(width, height, glm::floor(glm::vec2(xpos, ypos) * scale), t_current_frame);
+				});
 			Shared_data ss{};
 			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_shared_data);
 			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(Shared_data), &ss);
@@ -1334,21 +7280,95 @@ int main(int, char* []) {
 		}
 		break;
 		case Shaders::voronoi:
-			shader_use_program(id_program_voronoi);
-			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			voronoi_render();
 			break;
 		case Shaders::solver:
-			shader_use_program(id_program_solver);
-			glDispatchCompute(workgroup_size_x, workgroup_size_y, 1);
-			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
-			int result_int;
-			glBindBuffer(GL_SHADER_STORAGE_BUFFER, ssbo_solver);
-			// Here, we take the 10th int to verify results
-			glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, sizeof(int) * 10, sizeof(int), &result_int);
+			gpu_solver_poll(solver_scene);
+			gpu_solver_iterate(solver_scene, solver_scene_iterations[static_cast<int>(solver_scene.method)]);
+			gpu_solver_check(solver_scene);
+			gpu_solver_render(solver_scene, texture_width, texture_height, 0.1f);
 			break;
 		}
 
+		if (quality_governor.budget_ms > 0.0f) {
+			quality_governor_update(quality_governor, num_mold_steps, num_mold_steps_dropped);
+		}
+		else if (soak.is_active) {
+			quality_governor_poll(quality_governor);
+		}
+
+		// The other scenes draw over the whole canvas
+		if (shader != Shaders::voronoi) {
+			voronoi_dirty_all(voronoi_dirty);
+		}
+
+		// Only while the results are shown or logged, or sampled by the soak test
+		if (show_stats || gpu_statistics.log.is_open() || soak.is_active) {
+			gpu_statistics_poll(gpu_statistics);
+			auto sources = statistics_sources(shader);
+			if (sources.has_mold || sources.has_physics || sources.ray_counters != 0) {
+				gpu_statistics_compute(gpu_statistics, sources, num_frames_rendered);
+			}
+		}
+
+		text_batch.clear();
+
+		if (shader == Shaders::voronoi) {
+			draw_toolbar_text();
+		}
+
+		if (show_stats) {
+			int stats_y = window_height - font_info.char_height - 10;
+			text_add(text_batch, font_info, stats_text, 10, stats_y, glm::vec3(1, 1, 1), 0.6f);
+			stats_y -= font_info.char_height;
+			float driver_free_mb = 0.0f;
+			text_add(text_batch, font_info, std::format("GPU memory: {:.1f} MB scene, {:.1f} MB in {} objects (peak {:.1f} MB){}", scene_resources[shader].num_bytes / (1024.0f * 1024.0f),
+				gpu_registry.num_bytes / (1024.0f * 1024.0f), gpu_registry.buffers.size() + gpu_registry.textures.size(), gpu_registry.num_bytes_peak / (1024.0f * 1024.0f),
+				gpu_driver_free_mb(driver_free_mb) ? std::format(", {:.0f} MB free on the GPU", driver_free_mb) : ""), 10, stats_y, glm::vec3(1, 1, 1), 0.6f);
+			if (quality_governor.budget_ms > 0.0f) {
+				stats_y -= font_info.char_height;
+				text_add(text_batch, font_info, std::format("Frame budget {:.1f} ms: scene {:.2f} ms on the GPU at {:.0f}% resolution, saving ~{:.1f} ms. Mold steps dropped: {}",
+					quality_governor.budget_ms, quality_governor.render_ms + quality_governor.mold_steps_per_frame * quality_governor.mold_step_ms,
+					100.0f * quality_render_scale(quality_governor), quality_governor.saved_ms, quality_governor.num_mold_steps_dropped), 10, stats_y, glm::vec3(1, 1, 1), 0.6f);
+			}
+			if (shader == Shaders::solver) {
+				stats_y -= font_info.char_height;
+				text_add(text_batch, font_info, std::format("Poisson {}x{}, {}: {}. M: next method, drag: move a charge", solver_scene_size, solver_scene_size,
+					solver_method_names[static_cast<size_t>(solver_scene.method)], solver_scene.has_reduction ?
+					std::format("residual {:.2e} of the one at the start after {} iterations", solver_scene.reduction, solver_scene.reduction_iteration) : "no residual yet"), 10, stats_y, glm::vec3(1, 1, 1), 0.6f);
+			}
+			// A few frames old. Left out for a frame or two after switching scenes
+			if (gpu_statistics.has_latest && gpu_statistics.latest_sources.scene == scene_names[shader]) {
+				for (auto& line : gpu_statistics_text(gpu_statistics)) {
+					stats_y -= font_info.char_height;
+					text_add(text_batch, font_info, line, 10, stats_y, glm::vec3(1, 1, 1), 0.6f);
+				}
+			}
+		}
+
+		if (!text_batch.empty()) {
+			auto num_glyphs = std::min(text_batch.size(), max_num_glyphs);
+			ssbo_update(ssbo_text_glyphs, 0, sizeof(Glyph_instance) * num_glyphs, text_batch.data());
+			shader_use_program(id_program_text);
+			shader_set_int(id_program_text, "num_glyphs", static_cast<int>(num_glyphs));
+			glDispatchCompute((font_info.char_width + 7) / 8, (font_info.char_height + 7) / 8, static_cast<GLuint>(num_glyphs));
+			glMemoryBarrier(GL_SHADER_IMAGE_ACCESS_BARRIER_BIT | GL_TEXTURE_FETCH_BARRIER_BIT);
+			// The text is drawn into the canvas, so the Voronoi scene has to color the pixels under it again
+			if (shader == Shaders::voronoi) {
+				for (size_t idx_glyph = 0; idx_glyph < num_glyphs; idx_glyph++) {
+					auto& pos = text_batch[idx_glyph].pos;
+					voronoi_dirty_rect(voronoi_dirty, pos[0], pos[1], pos[0] + font_info.char_width, pos[1] + font_info.char_height, Voronoi_tile::shade);
+				}
+			}
+		}
+
+		if (frame_capture.is_active && num_frames_rendered % options.capture_every == 0) {
+			frame_capture_frame(frame_capture, id_program_capture, num_frames_rendered / options.capture_every);
+		}
+		if (frame_capture.is_active && !frame_capture_poll(frame_capture)) {
+			frame_capture_stop(frame_capture);
+		}
+
 		// render image to quad
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
@@ -1356,16 +7376,51 @@ int main(int, char* []) {
 
 		renderQuad();
 		glfwSwapBuffers(window);
+		input_end_frame();
 		glfwPollEvents();
 
 		frame_counter++;
+		num_frames_rendered++;
+
+		if (soak_is_sample_due(soak, glfwGetTime())) {
+			Soak_sample sample = {};
+			// From the mold steps of the last frames and the statistics of a few frames ago, so taking a sample
+			//	does not wait for the GPU
+			if (shader == Shaders::mold) {
+				sample.mold_step_ms = quality_governor.mold_step_ms;
+				if (gpu_statistics.has_latest && gpu_statistics.latest_sources.scene == scene_names[shader]) {
+					sample.num_particles = gpu_statistics.latest.mold_num_alive;
+					sample.num_resident_tiles = static_cast<int>(gpu_statistics.latest_sources.num_mold_pages) - gpu_statistics.latest.mold_num_free_pages;
+				}
+			}
+			if (!soak_add_sample(soak, sample, glfwGetTime(), num_frames_rendered)) {
+				glfwSetWindowShouldClose(window, true);
+			}
+		}
+	}
+
+	if (soak.is_active) {
+		soak_report(soak);
+	}
+
+	input_record_stop();
+	snapshot_save_finish(snapshot_save);
+
+	if (frame_capture.is_active) {
+		frame_capture_stop(frame_capture);
 	}
 
 	glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0); // unbind
-	glDeleteTextures(1, &id_texture);
-	glDeleteProgram(id_program_canvas);
-	glDeleteProgram(id_program_funky);
-	glDeleteProgram(id_program_rays);
+	for (auto& [_, resources] : scene_resources) {
+		scene_release(resources);
+	}
+	rays_wavefront_release(rays_wavefront);
+	gpu_solver_release(solver_scene);
+	gpu_statistics_release(gpu_statistics);
+	gpu_timer_release(quality_governor.render_timer);
+	gpu_timer_release(quality_governor.mold_timer);
+	// The canvas, font, text glyphs and all programs. Everything else has been released by its owner by now
+	gpu_registry_release_all();
 
 	glfwTerminate();
 
@@ -1387,10 +7442,8 @@ void renderQuad()
 		};
 		// setup plane VAO
 		glGenVertexArrays(1, &quadVAO);
-		glGenBuffers(1, &quadVBO);
 		glBindVertexArray(quadVAO);
-		glBindBuffer(GL_ARRAY_BUFFER, quadVBO);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
+		quadVBO = gpu_create_buffer("canvas", GL_ARRAY_BUFFER, sizeof(quadVertices), &quadVertices, GL_STATIC_DRAW);
 		glEnableVertexAttribArray(0);
 		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 5 * sizeof(float), (void*)0);
 		glEnableVertexAttribArray(1);